@@ -150,6 +150,28 @@ esp_err_t sgp4x_execute_compensated_conditioning(sgp4x_handle_t handle, const fl
  */
 esp_err_t sgp4x_execute_conditioning(sgp4x_handle_t handle, uint16_t *sraw_voc);
 
+/**
+ * @brief Sends the compensated VOC and NOX measurement command without waiting for the result.  Read the result
+ * with sgp4x_fetch_signals once ready_ms have passed; the i2c bus is free in between.
+ * 
+ * @param[in] handle SGP4X device handle.
+ * @param[in] temperature Temperature compensation in degree Celsius.
+ * @param[in] humidity Humidity compensation in percentage.
+ * @param[out] ready_ms Milliseconds until the result can be read.
+ * @return esp_err_t ESP_OK on success.
+ */
+esp_err_t sgp4x_start_compensated_signals(sgp4x_handle_t handle, const float temperature, const float humidity, uint32_t *ready_ms);
+
+/**
+ * @brief Reads the result of a measurement started with sgp4x_start_compensated_signals, once, without retrying.
+ * 
+ * @param[in] handle SGP4X device handle.
+ * @param[out] sraw_voc Raw signal of VOC in ticks which is proportional to the logarithm of the resistance of the sensing element.
+ * @param[out] sraw_nox Raw signal of NOX in ticks which is proportional to the logarithm of the resistance of the sensing element.
+ * @return esp_err_t ESP_OK on success, an error while the sensor is still busy.
+ */
+esp_err_t sgp4x_fetch_signals(sgp4x_handle_t handle, uint16_t *sraw_voc, uint16_t *sraw_nox);
+
 /**
  * @brief Starts and/or continues the VOC and NOX measurement mode with temperature and humidity compensation.
  * 
@@ -404,17 +404,13 @@ esp_err_t sgp4x_execute_conditioning(sgp4x_handle_t handle, uint16_t *sraw_voc)
     return ESP_OK;
 }
 
-esp_err_t sgp4x_measure_compensated_signals(sgp4x_handle_t handle, const float temperature, const float humidity, uint16_t *sraw_voc, uint16_t *sraw_nox) {
-    const uint8_t               rx_retry_max   = 5;
+esp_err_t sgp4x_start_compensated_signals(sgp4x_handle_t handle, const float temperature, const float humidity, uint32_t *ready_ms) {
     const bytes_to_uint16_t     command        = { .value = SGP4X_CMD_MEAS_RAW_SIGNALS };
-    esp_err_t                   ret            = ESP_OK;
-    uint8_t                     rx_retry_count = 0;
     bytes_to_uint16_t           crc8_buffer    = { .value = 0 };
     bit64_uint8_buffer_t               tx_buffer      = { 0 };
-    bit48_uint8_buffer_t               rx_buffer      = { 0 };
 
     /* validate arguments */
-    ESP_ARG_CHECK( handle );
+    ESP_ARG_CHECK( handle && ready_ms );
 
     // validate range of temperature compensation parameter
     if(temperature > SGP4X_TEMPERATURE_MAX || temperature < SGP4X_TEMPERATURE_MIN) {
@@ -451,20 +447,21 @@ esp_err_t sgp4x_measure_compensated_signals(sgp4x_handle_t handle, const float t
     /* attempt i2c write transaction */
     ESP_RETURN_ON_ERROR( sgp4x_i2c_write(handle, tx_buffer, BIT64_UINT8_BUFFER_SIZE), TAG, "unable to write to i2c device handle, measure compensated raw signals failed" );
 
-    /* delay before next i2c transaction */
-    vTaskDelay(pdMS_TO_TICKS(sgp4x_get_command_duration_ms(SGP4X_CMD_MEAS_RAW_SIGNALS)));
+    /* time before the result can be read */
+    *ready_ms = sgp4x_get_command_duration_ms(SGP4X_CMD_MEAS_RAW_SIGNALS);
 
-    /* retry needed - unexpected nack indicates that the sensor is still busy */
-    do {
-        /* attempt i2c read transaction */
-        ret = sgp4x_i2c_read(handle, rx_buffer, BIT48_UINT8_BUFFER_SIZE);
+    return ESP_OK;
+}
 
-        /* delay before next retry attempt */
-        vTaskDelay(pdMS_TO_TICKS(SGP4X_RETRY_DELAY_MS));
-    } while (ret != ESP_OK && ++rx_retry_count <= rx_retry_max);
+esp_err_t sgp4x_fetch_signals(sgp4x_handle_t handle, uint16_t *sraw_voc, uint16_t *sraw_nox) {
+    bytes_to_uint16_t           crc8_buffer    = { .value = 0 };
+    bit48_uint8_buffer_t               rx_buffer      = { 0 };
 
-    /* attempt i2c read transaction */
-    ESP_RETURN_ON_ERROR( ret, TAG, "unable to read to i2c device handle, measure compensated raw signals failed" );
+    /* validate arguments */
+    ESP_ARG_CHECK( handle && sraw_voc && sraw_nox );
+
+    /* attempt i2c read transaction - nack indicates that the sensor is still busy */
+    ESP_RETURN_ON_ERROR( sgp4x_i2c_read(handle, rx_buffer, BIT48_UINT8_BUFFER_SIZE), TAG, "unable to read to i2c device handle, measure compensated raw signals failed" );
 
     /* validate crc from rx result - little-endian order */
     crc8_buffer.bytes[0] = rx_buffer[0];
@@ -481,6 +478,30 @@ esp_err_t sgp4x_measure_compensated_signals(sgp4x_handle_t handle, const float t
     return ESP_OK;
 }
 
+esp_err_t sgp4x_measure_compensated_signals(sgp4x_handle_t handle, const float temperature, const float humidity, uint16_t *sraw_voc, uint16_t *sraw_nox) {
+    const uint8_t               rx_retry_max   = 5;
+    esp_err_t                   ret            = ESP_OK;
+    uint8_t                     rx_retry_count = 0;
+    uint32_t                    ready_ms       = 0;
+
+    /* attempt to start the measurement */
+    ESP_RETURN_ON_ERROR( sgp4x_start_compensated_signals(handle, temperature, humidity, &ready_ms), TAG, "unable to start measurement, measure compensated raw signals failed" );
+
+    /* delay before next i2c transaction */
+    vTaskDelay(pdMS_TO_TICKS(ready_ms));
+
+    /* retry needed - unexpected nack indicates that the sensor is still busy */
+    do {
+        /* attempt i2c read transaction */
+        ret = sgp4x_fetch_signals(handle, sraw_voc, sraw_nox);
+
+        /* delay before next retry attempt */
+        vTaskDelay(pdMS_TO_TICKS(SGP4X_RETRY_DELAY_MS));
+    } while (ret != ESP_OK && ++rx_retry_count <= rx_retry_max);
+
+    return ret;
+}
+
 esp_err_t sgp4x_measure_signals(sgp4x_handle_t handle, uint16_t *sraw_voc, uint16_t *sraw_nox) {
     /* validate arguments */
     ESP_ARG_CHECK( handle );
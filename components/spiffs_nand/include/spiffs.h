@@ -113,7 +113,8 @@ typedef enum {
   SPIFFS_CHECK_FIX_LOOKUP,
   SPIFFS_CHECK_DELETE_ORPHANED_INDEX,
   SPIFFS_CHECK_DELETE_PAGE,
-  SPIFFS_CHECK_DELETE_BAD_FILE
+  SPIFFS_CHECK_DELETE_BAD_FILE,
+  SPIFFS_CHECK_TRUNCATE_BAD_FILE
 } spiffs_check_report;
 
 /* file system check callback function */
@@ -265,6 +266,11 @@ typedef struct spiffs_t {
   u8_t cleaning;
   // max erase count amongst all blocks
   spiffs_obj_id max_erase_count;
+#if SPIFFS_GC_INCREMENTAL
+  // block being emptied by SPIFFS_gc_step, valid while gc_pending is set
+  spiffs_block_ix gc_bix;
+  u8_t gc_pending;
+#endif
 
 #if SPIFFS_GC_STATS
   u32_t stats_gc_runs;
@@ -278,7 +284,28 @@ typedef struct spiffs_t {
 #if SPIFFS_CACHE_STATS
   u32_t cache_hits;
   u32_t cache_misses;
+  // read cache pages dropped to make room
+  u32_t cache_evictions;
+  // misses on a recently evicted page, which then enters the main queue
+  // (SPIFFS_CACHE_2Q)
+  u32_t cache_promotions;
+#endif
 #endif
+
+#if SPIFFS_OBJ_MAP
+  // object index page map given with SPIFFS_obj_map, or 0
+  void *obj_map;
+  // number of entries in obj_map
+  u32_t obj_map_entries;
+  // entries in use
+  u32_t obj_map_used;
+  // set when an object index header did not fit, so lookups that miss the
+  // map must still scan
+  u8_t obj_map_lost;
+  // lookups answered from the map
+  u32_t obj_map_hits;
+  // lookups that scanned the lookup pages
+  u32_t obj_map_scans;
 #endif
 
   // check callback function
@@ -337,6 +364,22 @@ typedef struct {
 
 #endif
 
+#if SPIFFS_OBJ_MAP
+
+// entry of the object index page map, see SPIFFS_obj_map
+typedef struct {
+  // object id without SPIFFS_OBJ_ID_IX_FLAG, SPIFFS_OBJ_ID_FREE if unused
+  spiffs_obj_id obj_id;
+  // span index of the object index page
+  spiffs_span_ix spix;
+  // where the object index page is
+  spiffs_page_ix pix;
+  // hash of the name for object index headers, 0 if not known
+  u16_t name_hash;
+} spiffs_obj_map_entry;
+
+#endif
+
 // functions
 
 #if SPIFFS_USE_MAGIC && SPIFFS_USE_MAGIC_LENGTH && SPIFFS_SINGLETON==0
@@ -604,6 +647,50 @@ struct spiffs_dirent *SPIFFS_readdir(spiffs_DIR *d, struct spiffs_dirent *e);
  */
 s32_t SPIFFS_check(spiffs *fs);
 
+#if SPIFFS_CHECK_FAST
+/**
+ * Runs a consistency check on given filesystem in a single pass, reading
+ * each lookup page and the header of each page it lists as in use once and
+ * each index page in full. It finds what SPIFFS_check finds and mends it
+ * with the same fixups, then scans again; anything it cannot settle is left
+ * to the full checks. The HAL must program lookup pages before the pages
+ * they list and erase them after, or free-listed pages can hide data.
+ * Pages that do not fit the work buffer are scanned in further passes.
+ * @param fs            the file system struct
+ * @param work          work buffer, or 0 for the file system's work memory
+ * @param work_size     size of work buffer in bytes
+ */
+s32_t SPIFFS_check_fast(spiffs *fs, u8_t *work, u32_t work_size);
+
+/**
+ * Returns the work buffer size SPIFFS_check_fast needs to scan all pages
+ * in one pass.
+ * @param fs            the file system struct
+ */
+u32_t SPIFFS_check_fast_work_size(spiffs *fs);
+#endif
+
+#if SPIFFS_OBJ_MAP
+/**
+ * Gives the file system a hash table of object index pages, built here by
+ * scanning the lookup pages and afterwards kept up to date as files are
+ * written, moved by the garbage collector and removed. Opening and stat'ing
+ * by name, opening by id and seeking then look the object index pages up in
+ * the table instead of scanning the lookup pages for them.
+ * Object index headers come before other object index pages when the table
+ * fills up. If a header does not fit, lookups that miss the table scan as if
+ * there were none. SPIFFS_check and SPIFFS_check_fast put the table aside
+ * while they run and build it again afterwards.
+ * Must be invoked after mount, and again after every mount.
+ *
+ * @param fs            the file system struct
+ * @param buf           the table, an array of spiffs_obj_map_entry, or 0 to
+ *                      stop using it
+ * @param size          size of buf in bytes
+ */
+s32_t SPIFFS_obj_map(spiffs *fs, void *buf, u32_t size);
+#endif
+
 /**
  * Returns number of total bytes available and number of used bytes.
  * This is an estimation, and depends on if there a many files with little
@@ -683,6 +770,27 @@ s32_t SPIFFS_gc_quick(spiffs *fs, u16_t max_free_pages);
  */
 s32_t SPIFFS_gc(spiffs *fs, u32_t size);
 
+#if SPIFFS_GC_INCREMENTAL
+/**
+ * Does a bounded slice of garbage collection, for an idle hook. While fewer
+ * than SPIFFS_GC_IDLE_FREE_BLOCKS blocks are free, a block with deleted
+ * pages is picked and its live pages are moved out, at most max_moves per
+ * call; the call that finds it empty erases it. Between calls the file
+ * system is consistent and may be used as usual. A writer that runs out of
+ * free blocks meanwhile finishes the block itself.
+ *
+ * Each call rescans the block's lookup page and rewrites the object index
+ * of the pages it moved, so a small max_moves costs more flash access per
+ * page than a full collection.
+ *
+ * Returns 1 if there is more to do, 0 if not, or an error.
+ *
+ * @param fs            the file system struct
+ * @param max_moves     most pages to move in this call, at least 1
+ */
+s32_t SPIFFS_gc_step(spiffs *fs, u32_t max_moves);
+#endif
+
 /**
  * Check if EOF reached.
  * @param fs            the file system struct
@@ -114,6 +114,20 @@ extern void spiffs_api_unlock(struct spiffs_t *fs);
 #else
 #define SPIFFS_CACHE_STATS          (0)
 #endif
+
+// Read cache replacement. 2Q keeps newly read pages in a FIFO (up to half
+// the cache) and only gives a page a place in the main, LRU-ordered queue
+// when it is read again shortly after being evicted, so a sequential scan
+// cannot flush pages that are read over and over. 0 evicts the least
+// recently used page, as upstream spiffs does.
+#ifndef SPIFFS_CACHE_2Q
+#define SPIFFS_CACHE_2Q             (1)
+#endif
+// Number of recently evicted pages remembered (by page index only) for
+// promotion when read again
+#ifndef SPIFFS_CACHE_2Q_GHOSTS
+#define SPIFFS_CACHE_2Q_GHOSTS      (16)
+#endif
 #endif
 
 // Always check header of each accessed page to ensure consistent state.
@@ -134,6 +148,49 @@ extern void spiffs_api_unlock(struct spiffs_t *fs);
 #define SPIFFS_GC_STATS             (0)
 #endif
 
+// Enable SPIFFS_gc_step(), which cleans a block a few page moves at a time so
+// the work can be spread over idle periods instead of landing on a write.
+// Writers still collect synchronously when the free blocks run down to the
+// reserve, as upstream spiffs does.
+#ifndef SPIFFS_GC_INCREMENTAL
+#define SPIFFS_GC_INCREMENTAL       (1)
+#endif
+// SPIFFS_gc_step() has work while fewer than this many blocks are free.
+// Writers collect below 4, so anything above that is headroom.
+#ifndef SPIFFS_GC_IDLE_FREE_BLOCKS
+#define SPIFFS_GC_IDLE_FREE_BLOCKS  (6)
+#endif
+
+// Enable SPIFFS_check_fast(), which finds what SPIFFS_check() finds in one
+// pass over the pages, keeping 2 bits per page and a table of object ids in
+// a caller supplied buffer, and runs the fixups only for what it found.
+#ifndef SPIFFS_CHECK_FAST
+#define SPIFFS_CHECK_FAST           (1)
+#endif
+// Objects SPIFFS_check_fast() keeps track of. A volume with more falls back
+// to the full checks.
+#ifndef SPIFFS_CHECK_FAST_OBJS
+#define SPIFFS_CHECK_FAST_OBJS      (64)
+#endif
+// Pages SPIFFS_check_fast() mends one by one after a pass. More findings
+// than this run the full check they belong to instead.
+#ifndef SPIFFS_CHECK_FAST_FIXES
+#define SPIFFS_CHECK_FAST_FIXES     (32)
+#endif
+// Passes SPIFFS_check_fast() makes, each after mending what the previous
+// one found, before leaving the rest to the full checks.
+#ifndef SPIFFS_CHECK_FAST_ROUNDS
+#define SPIFFS_CHECK_FAST_ROUNDS    (4)
+#endif
+
+// Enable SPIFFS_obj_map(), which keeps the object index pages of all files
+// in a caller supplied hash table, so that opening, stat'ing and seeking find
+// them there instead of scanning the lookup pages. Object index headers that
+// do not fit make the lookups scan again, as without the map.
+#ifndef SPIFFS_OBJ_MAP
+#define SPIFFS_OBJ_MAP              (1)
+#endif
+
 // Garbage collecting examines all pages in a block which and sums up
 // to a block score. Deleted pages normally gives positive score and
 // used pages normally gives a negative score (as these must be moved).
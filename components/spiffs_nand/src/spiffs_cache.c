@@ -10,6 +10,35 @@
 
 #if SPIFFS_CACHE
 
+// marks a cached page as accessed now
+static void spiffs_cache_page_touch(spiffs_cache *cache, spiffs_cache_page *cp) {
+#if SPIFFS_CACHE_2Q
+  // the once-read queue is a FIFO, kept in order of allocation
+  if ((cp->flags & (SPIFFS_CACHE_FLAG_TYPE_WR | SPIFFS_CACHE_FLAG_HOT)) == 0) return;
+#endif
+  cp->last_access = cache->last_access;
+}
+
+#if SPIFFS_CACHE_2Q
+// remembers an evicted page
+static void spiffs_cache_ghost_add(spiffs_cache *cache, spiffs_page_ix pix) {
+  cache->ghosts[cache->ghost_next] = pix;
+  cache->ghost_next = (cache->ghost_next + 1) % SPIFFS_CACHE_2Q_GHOSTS;
+}
+
+// forgets and returns true if page was evicted lately
+static u8_t spiffs_cache_ghost_take(spiffs_cache *cache, spiffs_page_ix pix) {
+  int i;
+  for (i = 0; i < SPIFFS_CACHE_2Q_GHOSTS; i++) {
+    if (cache->ghosts[i] == pix) {
+      cache->ghosts[i] = (spiffs_page_ix)-1;
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif
+
 // returns cached page for give page index, or null if no such cached page
 static spiffs_cache_page *spiffs_cache_page_get(spiffs *fs, spiffs_page_ix pix) {
   spiffs_cache *cache = spiffs_get_cache(fs);
@@ -21,7 +50,7 @@ static spiffs_cache_page *spiffs_cache_page_get(spiffs *fs, spiffs_page_ix pix)
         (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) == 0 &&
         cp->pix == pix ) {
       //SPIFFS_CACHE_DBG("CACHE_GET: have cache page "_SPIPRIi" for "_SPIPRIpg"\n", i, pix);
-      cp->last_access = cache->last_access;
+      spiffs_cache_page_touch(cache, cp);
       return cp;
     }
   }
@@ -68,9 +97,45 @@ static s32_t spiffs_cache_page_remove_oldest(spiffs *fs, u8_t flag_mask, u8_t fl
     return SPIFFS_OK;
   }
 
-  // all busy, scan thru all to find the cpage which has oldest access
   int i;
   int cand_ix = -1;
+#if SPIFFS_CACHE_2Q
+  // all busy: take the first-allocated once-read cpage while that queue
+  // holds at least half the cache, else the least recently used cpage of
+  // the main queue. Either is remembered, so reading it again soon puts it
+  // in the main queue.
+  int once_ix = -1;
+  int once_count = 0;
+  u32_t once_age = 0;
+  int hot_ix = -1;
+  u32_t hot_age = 0;
+  for (i = 0; i < cache->cpage_count; i++) {
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
+    if ((cp->flags & flag_mask) != flags) continue;
+    u32_t age = cache->last_access - cp->last_access;
+    if (cp->flags & SPIFFS_CACHE_FLAG_HOT) {
+      if (hot_ix < 0 || age > hot_age) {
+        hot_age = age;
+        hot_ix = i;
+      }
+    } else {
+      once_count++;
+      if (once_ix < 0 || age > once_age) {
+        once_age = age;
+        once_ix = i;
+      }
+    }
+  }
+  int once_share = cache->cpage_count / 2 > 0 ? cache->cpage_count / 2 : 1;
+  cand_ix = (once_ix >= 0 && (once_count >= once_share || hot_ix < 0)) ? once_ix : hot_ix;
+  if (cand_ix >= 0) {
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, cand_ix);
+    if ((cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) == 0) {
+      spiffs_cache_ghost_add(cache, cp->pix);
+    }
+  }
+#else
+  // all busy, scan thru all to find the cpage which has oldest access
   u32_t oldest_val = 0;
   for (i = 0; i < cache->cpage_count; i++) {
     spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
@@ -80,8 +145,12 @@ static s32_t spiffs_cache_page_remove_oldest(spiffs *fs, u8_t flag_mask, u8_t fl
       cand_ix = i;
     }
   }
+#endif
 
   if (cand_ix >= 0) {
+#if SPIFFS_CACHE_STATS
+    fs->cache_evictions++;
+#endif
     res = spiffs_cache_page_free(fs, cand_ix, 1);
   }
 
@@ -137,7 +206,7 @@ s32_t spiffs_phys_rd(
 #if SPIFFS_CACHE_STATS
     fs->cache_hits++;
 #endif
-    cp->last_access = cache->last_access;
+    spiffs_cache_page_touch(cache, cp);
     u8_t *mem =  spiffs_get_cache_page(fs, cache, cp->ix);
     _SPIFFS_MEMCPY(dst, &mem[SPIFFS_PADDR_TO_PAGE_OFFSET(fs, addr)], len);
   } else {
@@ -156,6 +225,15 @@ s32_t spiffs_phys_rd(
     if (cp) {
       cp->flags = SPIFFS_CACHE_FLAG_WRTHRU;
       cp->pix = SPIFFS_PADDR_TO_PAGE(fs, addr);
+#if SPIFFS_CACHE_2Q
+      if (spiffs_cache_ghost_take(cache, cp->pix)) {
+        // read again soon after eviction
+        cp->flags |= SPIFFS_CACHE_FLAG_HOT;
+#if SPIFFS_CACHE_STATS
+        fs->cache_promotions++;
+#endif
+      }
+#endif
       SPIFFS_CACHE_DBG("CACHE_ALLO: allocated cache page "_SPIPRIi" for pix "_SPIPRIpg "\n", cp->ix, cp->pix);
 
       s32_t res2 = SPIFFS_HAL_READ(fs,
@@ -208,7 +286,7 @@ s32_t spiffs_phys_wr(
     _SPIFFS_MEMCPY(&mem[SPIFFS_PADDR_TO_PAGE_OFFSET(fs, addr)], src, len);
 
     cache->last_access++;
-    cp->last_access = cache->last_access;
+    spiffs_cache_page_touch(cache, cp);
 
     if (cp->flags & SPIFFS_CACHE_FLAG_WRTHRU) {
       // page is being updated, no write-cache, just pass thru
@@ -304,6 +382,11 @@ void spiffs_cache_init(spiffs *fs) {
 
   cache.cpage_use_map = 0xffffffff;
   cache.cpage_use_mask = cache_mask;
+#if SPIFFS_CACHE_2Q
+  for (i = 0; i < SPIFFS_CACHE_2Q_GHOSTS; i++) {
+    cache.ghosts[i] = (spiffs_page_ix)-1;
+  }
+#endif
   _SPIFFS_MEMCPY(fs->cache, &cache, sizeof(spiffs_cache));
 
   spiffs_cache *c = spiffs_get_cache(fs);
@@ -139,14 +139,15 @@ static s32_t spiffs_rewrite_index(spiffs *fs, spiffs_obj_id obj_id, spiffs_span_
     ((spiffs_page_ix*)((u8_t *)fs->lu_work + sizeof(spiffs_page_object_ix)))[SPIFFS_OBJ_IX_ENTRY(fs, data_spix)] = new_data_pix;
   }
 
-  res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_DA | SPIFFS_OP_C_UPDT,
-      0, SPIFFS_PAGE_TO_PADDR(fs, free_pix), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
-  SPIFFS_CHECK_RES(res);
+  // look up entry first, as spiffs_page_allocate_data does
   res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_UPDT,
       0, SPIFFS_BLOCK_TO_PADDR(fs, SPIFFS_BLOCK_FOR_PAGE(fs, free_pix)) + SPIFFS_OBJ_LOOKUP_ENTRY_FOR_PAGE(fs, free_pix) * sizeof(spiffs_page_ix),
       sizeof(spiffs_obj_id),
       (u8_t *)&obj_id);
   SPIFFS_CHECK_RES(res);
+  res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_DA | SPIFFS_OP_C_UPDT,
+      0, SPIFFS_PAGE_TO_PADDR(fs, free_pix), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+  SPIFFS_CHECK_RES(res);
   res = spiffs_page_delete(fs, objix_pix);
 
   return res;
@@ -175,6 +176,47 @@ static s32_t spiffs_delete_obj_lazy(spiffs *fs, spiffs_obj_id obj_id) {
   return res;
 }
 
+// cuts off an object whose index cannot be mended at data span data_spix,
+// keeping the data before it; deletes the object only when it cannot be
+// opened or truncated
+static s32_t spiffs_truncate_bad_obj(spiffs *fs, spiffs_check_type type, spiffs_obj_id obj_id,
+    spiffs_span_ix data_spix) {
+  spiffs_page_ix objix_hdr_pix;
+  spiffs_fd *fd;
+  obj_id |= SPIFFS_OBJ_ID_IX_FLAG;
+  s32_t res = spiffs_obj_lu_find_id_and_span(fs, obj_id, 0, 0, &objix_hdr_pix);
+  if (res == SPIFFS_ERR_NOT_FOUND) {
+    // no header, the object index check removes the rest
+    return SPIFFS_OK;
+  }
+  SPIFFS_CHECK_RES(res);
+  u32_t new_size = (u32_t)data_spix * SPIFFS_DATA_PAGE_SIZE(fs);
+  res = spiffs_fd_find_new(fs, &fd, 0);
+  if (res == SPIFFS_OK) {
+    res = spiffs_object_open_by_page(fs, objix_hdr_pix, fd, 0, 0);
+    if (res == SPIFFS_OK && fd->size != SPIFFS_UNDEFINED_LEN && fd->size > new_size) {
+      // stops short at a page it cannot validate, keeping the pages before
+      res = spiffs_object_truncate(fd, new_size, 0);
+    } else if (res == SPIFFS_OK) {
+      // past the end, where nothing reads it: only drop the reference
+      spiffs_page_ix objix_pix;
+      res = spiffs_obj_lu_find_id_and_span(fs, obj_id, SPIFFS_OBJ_IX_ENTRY_SPAN_IX(fs, data_spix), 0, &objix_pix);
+      if (res == SPIFFS_OK) {
+        res = spiffs_rewrite_index(fs, obj_id, data_spix, (spiffs_page_ix)-1, objix_pix);
+      }
+    }
+    spiffs_fd_return(fs, fd->file_nbr);
+  }
+  if (res != SPIFFS_OK) {
+    SPIFFS_CHECK_DBG("CH: FIXUP: truncating obj id "_SPIPRIid" failed "_SPIPRIi", deleting it\n", obj_id, res);
+    CHECK_CB(fs, type, SPIFFS_CHECK_DELETE_BAD_FILE, obj_id, 0);
+    return spiffs_delete_obj_lazy(fs, obj_id);
+  }
+  SPIFFS_CHECK_DBG("CH: FIXUP: truncated obj id "_SPIPRIid" to "_SPIPRIi" bytes at most\n", obj_id, new_size);
+  CHECK_CB(fs, type, SPIFFS_CHECK_TRUNCATE_BAD_FILE, obj_id, new_size);
+  return SPIFFS_OK;
+}
+
 // validates the given look up entry
 static s32_t spiffs_lookup_check_validate(spiffs *fs, spiffs_obj_id lu_obj_id, spiffs_page_header *p_hdr,
     spiffs_page_ix cur_pix, spiffs_block_ix cur_block, int cur_entry, int *reload_lu) {
@@ -215,8 +257,7 @@ static s32_t spiffs_lookup_check_validate(spiffs *fs, spiffs_obj_id lu_obj_id, s
             SPIFFS_CHECK_DBG("LU: FIXUP: index bad "_SPIPRIi", cannot mend!\n", res);
             res = spiffs_page_delete(fs, new_pix);
             SPIFFS_CHECK_RES(res);
-            res = spiffs_delete_obj_lazy(fs, p_hdr->obj_id);
-            CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr->obj_id, 0);
+            res = spiffs_truncate_bad_obj(fs, SPIFFS_CHECK_LOOKUP, p_hdr->obj_id, p_hdr->span_ix);
           } else {
             CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_FIX_INDEX, p_hdr->obj_id, p_hdr->span_ix);
           }
@@ -274,9 +315,8 @@ static s32_t spiffs_lookup_check_validate(spiffs *fs, spiffs_obj_id lu_obj_id, s
                 SPIFFS_CHECK_DBG("LU: FIXUP: index bad "_SPIPRIi", cannot mend!\n", res);
                 res = spiffs_page_delete(fs, new_pix);
                 SPIFFS_CHECK_RES(res);
-                res = spiffs_delete_obj_lazy(fs, p_hdr->obj_id);
+                res = spiffs_truncate_bad_obj(fs, SPIFFS_CHECK_LOOKUP, p_hdr->obj_id, p_hdr->span_ix);
                 *reload_lu = 1;
-                CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr->obj_id, 0);
               }
               SPIFFS_CHECK_RES(res);
             }
@@ -509,6 +549,107 @@ s32_t spiffs_lookup_consistency_check(spiffs *fs, u8_t check_all_objects) {
 //---------------------------------------
 // Page consistency
 
+// mends a used data page that no object index references: points the index
+// at it if the index entry is bad, else deletes it
+static s32_t spiffs_page_check_unreferenced(spiffs *fs, spiffs_page_ix cur_pix, u8_t *restart) {
+  s32_t res;
+  u8_t rewrite_ix_to_this = 0;
+  u8_t delete_page = 0;
+  // check corresponding object index entry
+  spiffs_page_header p_hdr;
+  spiffs_page_ix objix_pix;
+  spiffs_page_ix rpix;
+  res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+      0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), sizeof(spiffs_page_header), (u8_t*)&p_hdr);
+  SPIFFS_CHECK_RES(res);
+
+  res = spiffs_object_get_data_page_index_reference(fs, p_hdr.obj_id, p_hdr.span_ix,
+      &rpix, &objix_pix);
+  if (res == SPIFFS_OK) {
+    spiffs_page_object_ix_header objix_hdr;
+    spiffs_page_ix objix_hdr_pix;
+    if (rpix == (spiffs_page_ix)-1) {
+      res = spiffs_obj_lu_find_id_and_span(fs, p_hdr.obj_id | SPIFFS_OBJ_ID_IX_FLAG, 0, 0, &objix_hdr_pix);
+      if (res == SPIFFS_OK) {
+        res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+            0, SPIFFS_PAGE_TO_PADDR(fs, objix_hdr_pix), sizeof(spiffs_page_object_ix_header), (u8_t*)&objix_hdr);
+        SPIFFS_CHECK_RES(res);
+      } else if (res == SPIFFS_ERR_NOT_FOUND) {
+        objix_hdr.size = SPIFFS_UNDEFINED_LEN;
+        res = SPIFFS_OK;
+      }
+      SPIFFS_CHECK_RES(res);
+    }
+    if (rpix == (spiffs_page_ix)-1 && objix_hdr.size != SPIFFS_UNDEFINED_LEN &&
+        (u32_t)p_hdr.span_ix * SPIFFS_DATA_PAGE_SIZE(fs) >= objix_hdr.size) {
+      // an append cut before the index took the page: nothing in it was
+      // flushed, and pointing the index at it would leave it behind once
+      // the next append writes this span again
+      SPIFFS_CHECK_DBG("PA: pix "_SPIPRIpg" is past the object size "_SPIPRIi", delete it\n", cur_pix, objix_hdr.size);
+      delete_page = 1;
+    } else if (((rpix == (spiffs_page_ix)-1 || rpix > SPIFFS_MAX_PAGES(fs)) || (SPIFFS_IS_LOOKUP_PAGE(fs, rpix)))) {
+      // pointing to a bad page altogether, rewrite index to this
+      rewrite_ix_to_this = 1;
+      SPIFFS_CHECK_DBG("PA: corresponding ref is bad: "_SPIPRIpg", rewrite to this "_SPIPRIpg"\n", rpix, cur_pix);
+    } else {
+      // pointing to something else, check what
+      spiffs_page_header rp_hdr;
+      res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+          0, SPIFFS_PAGE_TO_PADDR(fs, rpix), sizeof(spiffs_page_header), (u8_t*)&rp_hdr);
+      SPIFFS_CHECK_RES(res);
+      if (((p_hdr.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG) == rp_hdr.obj_id) &&
+          ((rp_hdr.flags & (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_USED | SPIFFS_PH_FLAG_FINAL)) ==
+              (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_DELET))) {
+        // pointing to something else valid, just delete this page then
+        SPIFFS_CHECK_DBG("PA: corresponding ref is good but different: "_SPIPRIpg", delete this "_SPIPRIpg"\n", rpix, cur_pix);
+        delete_page = 1;
+      } else {
+        // pointing to something weird, update index to point to this page instead
+        if (rpix != cur_pix) {
+          SPIFFS_CHECK_DBG("PA: corresponding ref is weird: "_SPIPRIpg" %s%s%s%s, rewrite this "_SPIPRIpg"\n", rpix,
+              (rp_hdr.flags & SPIFFS_PH_FLAG_INDEX) ? "" : "INDEX ",
+                  (rp_hdr.flags & SPIFFS_PH_FLAG_DELET) ? "" : "DELETED ",
+                      (rp_hdr.flags & SPIFFS_PH_FLAG_USED) ? "NOTUSED " : "",
+                          (rp_hdr.flags & SPIFFS_PH_FLAG_FINAL) ? "NOTFINAL " : "",
+              cur_pix);
+          rewrite_ix_to_this = 1;
+        } else {
+          // should not happen, destined for fubar
+        }
+      }
+    }
+  } else if (res == SPIFFS_ERR_NOT_FOUND) {
+    SPIFFS_CHECK_DBG("PA: corresponding ref not found, delete "_SPIPRIpg"\n", cur_pix);
+    delete_page = 1;
+    res = SPIFFS_OK;
+  }
+
+  if (rewrite_ix_to_this) {
+    // if pointing to invalid page, redirect index to this page
+    SPIFFS_CHECK_DBG("PA: FIXUP: rewrite index id "_SPIPRIid" data spix "_SPIPRIsp" to point to this pix: "_SPIPRIpg"\n",
+        p_hdr.obj_id, p_hdr.span_ix, cur_pix);
+    res = spiffs_rewrite_index(fs, p_hdr.obj_id, p_hdr.span_ix, cur_pix, objix_pix);
+    if (res <= _SPIFFS_ERR_CHECK_FIRST && res > _SPIFFS_ERR_CHECK_LAST) {
+      // index bad also, cannot mend this file
+      SPIFFS_CHECK_DBG("PA: FIXUP: index bad "_SPIPRIi", cannot mend!\n", res);
+      res = spiffs_page_delete(fs, cur_pix);
+      SPIFFS_CHECK_RES(res);
+      res = spiffs_truncate_bad_obj(fs, SPIFFS_CHECK_PAGE, p_hdr.obj_id, p_hdr.span_ix);
+    } else {
+      CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_FIX_INDEX, p_hdr.obj_id, p_hdr.span_ix);
+    }
+    SPIFFS_CHECK_RES(res);
+    *restart = 1;
+    return res;
+  } else if (delete_page) {
+    SPIFFS_CHECK_DBG("PA: FIXUP: deleting page "_SPIPRIpg"\n", cur_pix);
+    CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_PAGE, cur_pix, 0);
+    res = spiffs_page_delete(fs, cur_pix);
+  }
+  SPIFFS_CHECK_RES(res);
+  return res;
+}
+
 // Scans all pages (except lu pages), reserves 4 bits in working memory for each page
 // bit 0: 0 == FREE|DELETED, 1 == USED
 // bit 1: 0 == UNREFERENCED, 1 == REFERENCED
@@ -667,10 +808,10 @@ static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
                SPIFFS_CHECK_RES(res);
                if (data_pix == 0) {
                  // not found, this index is badly borked
-                 SPIFFS_CHECK_DBG("PA: FIXUP: index bad, delete object id "_SPIPRIid"\n", p_hdr.obj_id);
-                 CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr.obj_id, 0);
-                 res = spiffs_delete_obj_lazy(fs, p_hdr.obj_id);
+                 SPIFFS_CHECK_DBG("PA: FIXUP: index bad, truncate object id "_SPIPRIid"\n", p_hdr.obj_id);
+                 res = spiffs_truncate_bad_obj(fs, SPIFFS_CHECK_PAGE, p_hdr.obj_id, data_spix_offset + i);
                  SPIFFS_CHECK_RES(res);
+                 restart = 1;
                  break;
                } else {
                  // found it, so rewrite index
@@ -680,8 +821,7 @@ static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
                  if (res <= _SPIFFS_ERR_CHECK_FIRST && res > _SPIFFS_ERR_CHECK_LAST) {
                    // index bad also, cannot mend this file
                    SPIFFS_CHECK_DBG("PA: FIXUP: index bad "_SPIPRIi", cannot mend!\n", res);
-                   CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr.obj_id, 0);
-                   res = spiffs_delete_obj_lazy(fs, p_hdr.obj_id);
+                   res = spiffs_truncate_bad_obj(fs, SPIFFS_CHECK_PAGE, p_hdr.obj_id, data_spix_offset + i);
                  } else {
                    CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_FIX_INDEX, p_hdr.obj_id, p_hdr.span_ix);
                  }
@@ -697,15 +837,12 @@ static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
                   SPIFFS_CHECK_DBG("PA: pix "_SPIPRIpg" multiple referenced from page "_SPIPRIpg"\n",
                       rpix, cur_pix);
                   // Here, we should have fixed all broken references - getting this means there
-                  // must be multiple files with same object id. Only solution is to delete
-                  // the object which is referring to this page
-                  SPIFFS_CHECK_DBG("PA: FIXUP: removing object "_SPIPRIid" and page "_SPIPRIpg"\n",
+                  // must be multiple files with same object id, or an object referencing a
+                  // page twice. Cut the object referring to this page off before it; a
+                  // page it still references twice below is found again on the restart
+                  SPIFFS_CHECK_DBG("PA: FIXUP: truncating object "_SPIPRIid" at page "_SPIPRIpg"\n",
                       p_hdr.obj_id, cur_pix);
-                  CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr.obj_id, 0);
-                  res = spiffs_delete_obj_lazy(fs, p_hdr.obj_id);
-                  SPIFFS_CHECK_RES(res);
-                  // extra precaution, delete this page also
-                  res = spiffs_page_delete(fs, cur_pix);
+                  res = spiffs_truncate_bad_obj(fs, SPIFFS_CHECK_PAGE, p_hdr.obj_id, data_spix_offset + i);
                   SPIFFS_CHECK_RES(res);
                   restart = 1;
                 }
@@ -723,9 +860,6 @@ static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
     }
     // check consistency bitmap
     if (!restart) {
-      spiffs_page_ix objix_pix;
-      spiffs_page_ix rpix;
-
       u32_t byte_ix;
       u8_t bit_ix;
       for (byte_ix = 0; !restart && byte_ix < SPIFFS_CFG_LOG_PAGE_SZ(fs); byte_ix++) {
@@ -740,78 +874,11 @@ static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
             // 001
             SPIFFS_CHECK_DBG("PA: pix "_SPIPRIpg" USED, UNREFERENCED, not index\n", cur_pix);
 
-            u8_t rewrite_ix_to_this = 0;
-            u8_t delete_page = 0;
-            // check corresponding object index entry
-            spiffs_page_header p_hdr;
-            res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
-                0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), sizeof(spiffs_page_header), (u8_t*)&p_hdr);
+            res = spiffs_page_check_unreferenced(fs, cur_pix, &restart);
             SPIFFS_CHECK_RES(res);
-
-            res = spiffs_object_get_data_page_index_reference(fs, p_hdr.obj_id, p_hdr.span_ix,
-                &rpix, &objix_pix);
-            if (res == SPIFFS_OK) {
-              if (((rpix == (spiffs_page_ix)-1 || rpix > SPIFFS_MAX_PAGES(fs)) || (SPIFFS_IS_LOOKUP_PAGE(fs, rpix)))) {
-                // pointing to a bad page altogether, rewrite index to this
-                rewrite_ix_to_this = 1;
-                SPIFFS_CHECK_DBG("PA: corresponding ref is bad: "_SPIPRIpg", rewrite to this "_SPIPRIpg"\n", rpix, cur_pix);
-              } else {
-                // pointing to something else, check what
-                spiffs_page_header rp_hdr;
-                res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
-                    0, SPIFFS_PAGE_TO_PADDR(fs, rpix), sizeof(spiffs_page_header), (u8_t*)&rp_hdr);
-                SPIFFS_CHECK_RES(res);
-                if (((p_hdr.obj_id & ~SPIFFS_OBJ_ID_IX_FLAG) == rp_hdr.obj_id) &&
-                    ((rp_hdr.flags & (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_USED | SPIFFS_PH_FLAG_FINAL)) ==
-                        (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_DELET))) {
-                  // pointing to something else valid, just delete this page then
-                  SPIFFS_CHECK_DBG("PA: corresponding ref is good but different: "_SPIPRIpg", delete this "_SPIPRIpg"\n", rpix, cur_pix);
-                  delete_page = 1;
-                } else {
-                  // pointing to something weird, update index to point to this page instead
-                  if (rpix != cur_pix) {
-                    SPIFFS_CHECK_DBG("PA: corresponding ref is weird: "_SPIPRIpg" %s%s%s%s, rewrite this "_SPIPRIpg"\n", rpix,
-                        (rp_hdr.flags & SPIFFS_PH_FLAG_INDEX) ? "" : "INDEX ",
-                            (rp_hdr.flags & SPIFFS_PH_FLAG_DELET) ? "" : "DELETED ",
-                                (rp_hdr.flags & SPIFFS_PH_FLAG_USED) ? "NOTUSED " : "",
-                                    (rp_hdr.flags & SPIFFS_PH_FLAG_FINAL) ? "NOTFINAL " : "",
-                        cur_pix);
-                    rewrite_ix_to_this = 1;
-                  } else {
-                    // should not happen, destined for fubar
-                  }
-                }
-              }
-            } else if (res == SPIFFS_ERR_NOT_FOUND) {
-              SPIFFS_CHECK_DBG("PA: corresponding ref not found, delete "_SPIPRIpg"\n", cur_pix);
-              delete_page = 1;
-              res = SPIFFS_OK;
-            }
-
-            if (rewrite_ix_to_this) {
-              // if pointing to invalid page, redirect index to this page
-              SPIFFS_CHECK_DBG("PA: FIXUP: rewrite index id "_SPIPRIid" data spix "_SPIPRIsp" to point to this pix: "_SPIPRIpg"\n",
-                  p_hdr.obj_id, p_hdr.span_ix, cur_pix);
-              res = spiffs_rewrite_index(fs, p_hdr.obj_id, p_hdr.span_ix, cur_pix, objix_pix);
-              if (res <= _SPIFFS_ERR_CHECK_FIRST && res > _SPIFFS_ERR_CHECK_LAST) {
-                // index bad also, cannot mend this file
-                SPIFFS_CHECK_DBG("PA: FIXUP: index bad "_SPIPRIi", cannot mend!\n", res);
-                CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_BAD_FILE, p_hdr.obj_id, 0);
-                res = spiffs_page_delete(fs, cur_pix);
-                SPIFFS_CHECK_RES(res);
-                res = spiffs_delete_obj_lazy(fs, p_hdr.obj_id);
-              } else {
-                CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_FIX_INDEX, p_hdr.obj_id, p_hdr.span_ix);
-              }
-              SPIFFS_CHECK_RES(res);
-              restart = 1;
+            if (restart) {
               continue;
-            } else if (delete_page) {
-              SPIFFS_CHECK_DBG("PA: FIXUP: deleting page "_SPIPRIpg"\n", cur_pix);
-              CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_DELETE_PAGE, cur_pix, 0);
-              res = spiffs_page_delete(fs, cur_pix);
             }
-            SPIFFS_CHECK_RES(res);
           }
           if (bitmask == 0x2) {
 
@@ -860,10 +927,172 @@ static s32_t spiffs_page_consistency_check_i(spiffs *fs) {
   return res;
 }
 
+// counts the references of index page pix that lead to a live data page of
+// its object and span, and the rest; loads the index page into fs->lu_work
+static s32_t spiffs_stale_index_count(spiffs *fs, spiffs_page_ix pix, u32_t *live, u32_t *dead) {
+  s32_t res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+      0, SPIFFS_PAGE_TO_PADDR(fs, pix), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+  SPIFFS_CHECK_RES(res);
+  spiffs_page_header *objix_p_hdr = (spiffs_page_header *)fs->lu_work;
+  spiffs_page_ix *object_page_index;
+  int entries;
+  int i;
+  spiffs_span_ix data_spix_offset;
+  if (objix_p_hdr->span_ix == 0) {
+    entries = SPIFFS_OBJ_HDR_IX_LEN(fs);
+    data_spix_offset = 0;
+    object_page_index = (spiffs_page_ix *)((u8_t *)fs->lu_work + sizeof(spiffs_page_object_ix_header));
+  } else {
+    entries = SPIFFS_OBJ_IX_LEN(fs);
+    data_spix_offset = SPIFFS_OBJ_HDR_IX_LEN(fs) + SPIFFS_OBJ_IX_LEN(fs) * (objix_p_hdr->span_ix - 1);
+    object_page_index = (spiffs_page_ix *)((u8_t *)fs->lu_work + sizeof(spiffs_page_object_ix));
+  }
+  spiffs_obj_id obj_id = objix_p_hdr->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG;
+  *live = 0;
+  *dead = 0;
+  for (i = 0; i < entries; i++) {
+    spiffs_page_ix rpix = object_page_index[i];
+    if (rpix == (spiffs_page_ix)-1) {
+      continue;
+    }
+    if (rpix >= SPIFFS_MAX_PAGES(fs) || SPIFFS_IS_LOOKUP_PAGE(fs, rpix)) {
+      (*dead)++;
+      continue;
+    }
+    spiffs_page_header rp_hdr;
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+        0, SPIFFS_PAGE_TO_PADDR(fs, rpix), sizeof(spiffs_page_header), (u8_t*)&rp_hdr);
+    SPIFFS_CHECK_RES(res);
+    if (rp_hdr.obj_id == obj_id && rp_hdr.span_ix == data_spix_offset + i &&
+        (rp_hdr.flags & (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_USED |
+            SPIFFS_PH_FLAG_FINAL)) == (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_INDEX)) {
+      (*live)++;
+    } else {
+      (*dead)++;
+    }
+  }
+  return SPIFFS_OK;
+}
+
+typedef struct {
+  spiffs_obj_id obj_id;
+  spiffs_span_ix span_ix;
+  spiffs_page_ix pix;
+} spiffs_stale_index_entry;
+
+typedef struct {
+  u32_t count;
+  u8_t overflow;
+} spiffs_stale_index_table;
+
+// lists the live index pages in fs->work, as spiffs_obj_lu_find_id_and_span
+// would find them
+static s32_t spiffs_stale_index_collect_v(spiffs *fs, spiffs_obj_id obj_id, spiffs_block_ix cur_block,
+    int cur_entry, const void *user_const_p, void *user_var_p) {
+  (void)user_const_p;
+  spiffs_stale_index_table *table = (spiffs_stale_index_table *)user_var_p;
+  spiffs_stale_index_entry *entries = (spiffs_stale_index_entry *)fs->work;
+  if (obj_id == SPIFFS_OBJ_ID_FREE || obj_id == SPIFFS_OBJ_ID_DELETED || (obj_id & SPIFFS_OBJ_ID_IX_FLAG) == 0) {
+    return SPIFFS_VIS_COUNTINUE;
+  }
+  spiffs_page_ix cur_pix = SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, cur_block, cur_entry);
+  spiffs_page_header p_hdr;
+  s32_t res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+      0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), sizeof(spiffs_page_header), (u8_t*)&p_hdr);
+  SPIFFS_CHECK_RES(res);
+  if (p_hdr.obj_id != obj_id ||
+      (p_hdr.flags & (SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_USED)) != SPIFFS_PH_FLAG_DELET ||
+      (p_hdr.flags & SPIFFS_PH_FLAG_IXDELE) == 0) {
+    return SPIFFS_VIS_COUNTINUE;
+  }
+  if (table->count >= SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_stale_index_entry)) {
+    table->overflow = 1;
+    return SPIFFS_OK;
+  }
+  entries[table->count].obj_id = obj_id;
+  entries[table->count].span_ix = p_hdr.span_ix;
+  entries[table->count].pix = cur_pix;
+  table->count++;
+  return SPIFFS_VIS_COUNTINUE;
+}
+
+// of two live index pages a_pix and b_pix for the same object and span, keeps
+// the one with more intact references (the newer: appends add references,
+// rewrites delete the pages the old one references first) and deletes the
+// other, returned in stale_pix
+static s32_t spiffs_stale_index_delete(spiffs *fs, spiffs_obj_id obj_id, spiffs_span_ix span_ix,
+    spiffs_page_ix a_pix, spiffs_page_ix b_pix, spiffs_page_ix *stale_pix) {
+  u32_t a_live, a_dead, b_live, b_dead;
+  s32_t res = spiffs_stale_index_count(fs, a_pix, &a_live, &a_dead);
+  SPIFFS_CHECK_RES(res);
+  u32_t a_size = ((spiffs_page_object_ix_header *)fs->lu_work)->size;
+  res = spiffs_stale_index_count(fs, b_pix, &b_live, &b_dead);
+  SPIFFS_CHECK_RES(res);
+  u32_t b_size = ((spiffs_page_object_ix_header *)fs->lu_work)->size;
+  u8_t keep_a;
+  if (a_live != b_live) {
+    keep_a = a_live > b_live;
+  } else if (a_dead != b_dead) {
+    keep_a = a_dead < b_dead;
+  } else if (span_ix == 0 && a_size != b_size) {
+    // an append cut before it wrote data pages
+    keep_a = a_size != SPIFFS_UNDEFINED_LEN && (b_size == SPIFFS_UNDEFINED_LEN || a_size > b_size);
+  } else {
+    keep_a = 1;
+  }
+  *stale_pix = keep_a ? b_pix : a_pix;
+  SPIFFS_CHECK_DBG("IX: obj id "_SPIPRIid" spix "_SPIPRIsp" in "_SPIPRIpg" and "_SPIPRIpg", deleting stale "_SPIPRIpg"\n",
+      obj_id, span_ix, a_pix, b_pix, *stale_pix);
+  CHECK_CB(fs, SPIFFS_CHECK_INDEX, SPIFFS_CHECK_DELETE_PAGE, *stale_pix, obj_id);
+  return spiffs_page_delete(fs, *stale_pix);
+}
+
+// A cut between writing an index page and deleting the one it replaces
+// leaves two live index pages for the same object and span. The page check
+// would mend the stale one back to life, find both referencing the same data
+// pages and delete the object, so the stale one is deleted first.
+static s32_t spiffs_stale_index_check(spiffs *fs) {
+  spiffs_stale_index_table table = {0, 0};
+  spiffs_stale_index_entry *entries = (spiffs_stale_index_entry *)fs->work;
+  s32_t res = spiffs_obj_lu_find_entry_visitor(fs, 0, 0, 0, 0, spiffs_stale_index_collect_v, 0, &table, 0, 0);
+  if (res == SPIFFS_VIS_END) {
+    res = SPIFFS_OK;
+  }
+  SPIFFS_CHECK_RES(res);
+  if (table.overflow) {
+    // more index pages than fit the work memory: the page check mends them
+    SPIFFS_CHECK_DBG("IX: over "_SPIPRIi" index pages, not looking for stale copies\n", table.count);
+    return SPIFFS_OK;
+  }
+  u32_t i, j;
+  for (i = 0; i < table.count; i++) {
+    for (j = i + 1; j < table.count; j++) {
+      spiffs_stale_index_entry *a = &entries[i];
+      spiffs_stale_index_entry *b = &entries[j];
+      if (a->obj_id != b->obj_id || a->span_ix != b->span_ix ||
+          a->pix == (spiffs_page_ix)-1 || b->pix == (spiffs_page_ix)-1) {
+        continue;
+      }
+      spiffs_page_ix stale_pix;
+      res = spiffs_stale_index_delete(fs, a->obj_id, a->span_ix, a->pix, b->pix, &stale_pix);
+      SPIFFS_CHECK_RES(res);
+      if (stale_pix == a->pix) {
+        a->pix = (spiffs_page_ix)-1;
+      } else {
+        b->pix = (spiffs_page_ix)-1;
+      }
+    }
+  }
+  return SPIFFS_OK;
+}
+
 // Checks consistency amongst all pages and fixes irregularities
 s32_t spiffs_page_consistency_check(spiffs *fs) {
   CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_PROGRESS, 0, 0);
-  s32_t res = spiffs_page_consistency_check_i(fs);
+  s32_t res = spiffs_stale_index_check(fs);
+  if (res == SPIFFS_OK) {
+    res = spiffs_page_consistency_check_i(fs);
+  }
   if (res != SPIFFS_OK) {
     CHECK_CB(fs, SPIFFS_CHECK_PAGE, SPIFFS_CHECK_ERROR, res, 0);
   }
@@ -1005,4 +1234,544 @@ s32_t spiffs_object_index_consistency_check(spiffs *fs) {
   return res;
 }
 
+//---------------------------------------
+// Fast consistency check
+
+#if SPIFFS_CHECK_FAST
+
+// Finds what the three checks above find, reading each lookup page and the
+// header of each page it lists as in use once and each index page in full,
+// for as many pages as the work memory has room for (all of them, given
+// spiffs_check_fast_work_size()). A used page behind a free or deleted look
+// up entry is only found once an index references it: spiffs_page_delete
+// marks the page before its entry, and the HAL has to program look up pages
+// before the pages they list and erase them after.
+//  * look up: the conditions spiffs_lookup_check_validate acts on, per page
+//  * object index: partly deleted index headers, and index pages that are
+//    not final or have IXDELE cleared while their object has no header
+//  * page: 2 bits per page, used and referenced as in the page check, plus
+//    a table of object ids holding the xor of a hash of each (page, span
+//    index) the object's indices reference and of each data page of the
+//    object. With every used page referenced exactly once, the two sets
+//    only differ where a referenced page header is inconsistent, which is
+//    what the page check reads each referenced page header to find.
+// The first of the three with findings is then mended, page by page with
+// the fixups of the full check or by running the full check when the
+// findings need its searches or do not fit, and the pages are scanned again.
+
+#define SPIFFS_CHECK_FAST_BITS        2
+#define SPIFFS_CHECK_FAST_USED        (1<<0)
+#define SPIFFS_CHECK_FAST_REFERENCED  (1<<1)
+
+// findings, in the order they are mended
+#define SPIFFS_CHECK_FAST_LU          (1<<0)
+#define SPIFFS_CHECK_FAST_IX          (1<<1)
+#define SPIFFS_CHECK_FAST_PA          (1<<2)
+
+#define SPIFFS_CHECK_FAST_OBJ_SLOT    (1<<0)  // table entry in use
+#define SPIFFS_CHECK_FAST_OBJ_HDR     (1<<1)  // object index header found
+#define SPIFFS_CHECK_FAST_OBJ_LOOSE   (1<<2)  // index page needing a header found
+
+typedef struct {
+  u32_t refs;
+  spiffs_obj_id obj_id;
+  u8_t flags;
+} spiffs_check_fast_obj;
+
+typedef struct {
+  spiffs_check_fast_obj *objs;
+  spiffs_page_ix *fix;
+  u8_t *map;
+  u32_t pages_per_range;
+  spiffs_page_ix pix_offset;
+  u32_t fix_count;
+  // SPIFFS_CHECK_FAST_LU etc. with findings, and those needing the full check
+  u8_t findings;
+  u8_t full;
+  // more objects than the table holds
+  u8_t overflow;
+} spiffs_check_fast_state;
+
+#define SPIFFS_CHECK_FAST_TABLES \
+  (SPIFFS_CHECK_FAST_OBJS * sizeof(spiffs_check_fast_obj) + \
+   SPIFFS_CHECK_FAST_FIXES * sizeof(spiffs_page_ix))
+
+// used as the page check counts it: not deleted, not free, not a live index
+static u8_t spiffs_check_fast_page_used(u8_t flags) {
+  u8_t live_index = (flags & SPIFFS_PH_FLAG_DELET) && (flags & SPIFFS_PH_FLAG_IXDELE) &&
+      (flags & (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_USED)) == 0;
+  return (flags & SPIFFS_PH_FLAG_DELET) && (flags & SPIFFS_PH_FLAG_USED) == 0 && !live_index;
+}
+
+// whether spiffs_lookup_check_validate would act on this page
+static u8_t spiffs_check_fast_lookup_bad(spiffs_obj_id lu_obj_id, const spiffs_page_header *p_hdr) {
+  if (lu_obj_id == SPIFFS_OBJ_ID_DELETED) {
+    return (p_hdr->flags & SPIFFS_PH_FLAG_DELET) != 0;
+  }
+  if (lu_obj_id == SPIFFS_OBJ_ID_FREE) {
+    return (p_hdr->flags & SPIFFS_PH_FLAG_USED) == 0;
+  }
+  return (p_hdr->obj_id | SPIFFS_OBJ_ID_IX_FLAG) != (lu_obj_id | SPIFFS_OBJ_ID_IX_FLAG) ||
+      ((lu_obj_id & SPIFFS_OBJ_ID_IX_FLAG) != 0) == ((p_hdr->flags & SPIFFS_PH_FLAG_INDEX) != 0) ||
+      (p_hdr->flags & SPIFFS_PH_FLAG_DELET) == 0 ||
+      (p_hdr->flags & SPIFFS_PH_FLAG_FINAL) != 0;
+}
+
+static u32_t spiffs_check_fast_hash(spiffs_page_ix pix, spiffs_span_ix spix) {
+  u32_t h = (u32_t)pix * 0x9e3779b1 ^ ((u32_t)spix + 1) * 0x85ebca77;
+  h ^= h >> 15;
+  h *= 0xc2b2ae3d;
+  h ^= h >> 13;
+  return h;
+}
+
+// finds or adds the table entry for an object, 0 if the table is full
+static spiffs_check_fast_obj *spiffs_check_fast_obj_get(spiffs_check_fast_state *st, spiffs_obj_id obj_id) {
+  obj_id &= ~SPIFFS_OBJ_ID_IX_FLAG;
+  u32_t ix = ((u32_t)obj_id * 31) % SPIFFS_CHECK_FAST_OBJS;
+  u32_t i;
+  for (i = 0; i < SPIFFS_CHECK_FAST_OBJS; i++) {
+    spiffs_check_fast_obj *obj = &st->objs[ix];
+    if ((obj->flags & SPIFFS_CHECK_FAST_OBJ_SLOT) == 0) {
+      obj->obj_id = obj_id;
+      obj->flags = SPIFFS_CHECK_FAST_OBJ_SLOT;
+      obj->refs = 0;
+      return obj;
+    }
+    if (obj->obj_id == obj_id) {
+      return obj;
+    }
+    ix = (ix + 1) % SPIFFS_CHECK_FAST_OBJS;
+  }
+  st->overflow = 1;
+  return 0;
+}
+
+// records a finding; pages to mend one by one are listed for the first
+// check with findings only
+static void spiffs_check_fast_found(spiffs_check_fast_state *st, u8_t check, spiffs_page_ix pix, u8_t listed) {
+  if (check == SPIFFS_CHECK_FAST_LU && (st->findings & SPIFFS_CHECK_FAST_LU) == 0) {
+    st->fix_count = 0;
+  }
+  st->findings |= check;
+  if (!listed) {
+    st->full |= check;
+  } else if (check == SPIFFS_CHECK_FAST_LU || (st->findings & SPIFFS_CHECK_FAST_LU) == 0) {
+    if (st->fix_count > 0 && st->fix[st->fix_count - 1] == pix) {
+      // an index page with several findings
+    } else if (st->fix_count < SPIFFS_CHECK_FAST_FIXES) {
+      st->fix[st->fix_count++] = pix;
+    } else {
+      st->full |= check;
+    }
+  }
+}
+
+// marks the pages an index page references
+static void spiffs_check_fast_refs(spiffs *fs, spiffs_check_fast_state *st, spiffs_page_ix cur_pix,
+    const spiffs_page_header *p_hdr) {
+  spiffs_page_ix *object_page_index;
+  int entries;
+  int i;
+  spiffs_span_ix data_spix_offset;
+  if (p_hdr->span_ix == 0) {
+    entries = SPIFFS_OBJ_HDR_IX_LEN(fs);
+    data_spix_offset = 0;
+    object_page_index = (spiffs_page_ix *)((u8_t *)fs->lu_work + sizeof(spiffs_page_object_ix_header));
+  } else {
+    entries = SPIFFS_OBJ_IX_LEN(fs);
+    data_spix_offset = SPIFFS_OBJ_HDR_IX_LEN(fs) + SPIFFS_OBJ_IX_LEN(fs) * (p_hdr->span_ix - 1);
+    object_page_index = (spiffs_page_ix *)((u8_t *)fs->lu_work + sizeof(spiffs_page_object_ix));
+  }
+
+  spiffs_check_fast_obj *obj = 0;
+  for (i = 0; i < entries; i++) {
+    spiffs_page_ix rpix = object_page_index[i];
+    if (rpix == (spiffs_page_ix)-1) {
+      continue;
+    }
+    u8_t rpix_within_range = rpix >= st->pix_offset && (u32_t)(rpix - st->pix_offset) < st->pages_per_range &&
+        rpix < SPIFFS_MAX_PAGES(fs);
+    if (rpix > SPIFFS_MAX_PAGES(fs) || (rpix_within_range && SPIFFS_IS_LOOKUP_PAGE(fs, rpix))) {
+      SPIFFS_CHECK_DBG("FA: pix "_SPIPRIpg" bad pix / LU referenced from page "_SPIPRIpg"\n", rpix, cur_pix);
+      spiffs_check_fast_found(st, SPIFFS_CHECK_FAST_PA, cur_pix, 0);
+      continue;
+    }
+    if (!rpix_within_range) {
+      continue;
+    }
+    u32_t bit_ix = (rpix - st->pix_offset) * SPIFFS_CHECK_FAST_BITS;
+    if (st->map[bit_ix / 8] & (SPIFFS_CHECK_FAST_REFERENCED << (bit_ix % 8))) {
+      SPIFFS_CHECK_DBG("FA: pix "_SPIPRIpg" multiple referenced from page "_SPIPRIpg"\n", rpix, cur_pix);
+      // usually a second copy of the index page, left by a cut in
+      // spiffs_page_move
+      spiffs_check_fast_found(st, SPIFFS_CHECK_FAST_PA, cur_pix, 1);
+    }
+    st->map[bit_ix / 8] |= SPIFFS_CHECK_FAST_REFERENCED << (bit_ix % 8);
+    if (obj == 0) {
+      obj = spiffs_check_fast_obj_get(st, p_hdr->obj_id);
+      if (obj == 0) {
+        return;
+      }
+    }
+    obj->refs ^= spiffs_check_fast_hash(rpix, data_spix_offset + i);
+  }
+}
+
+// checks one page against its look up entry; index pages are loaded into
+// fs->lu_work
+static s32_t spiffs_check_fast_page(spiffs *fs, spiffs_check_fast_state *st, spiffs_obj_id lu_obj_id,
+    spiffs_page_ix cur_pix, u8_t within_range) {
+  s32_t res;
+  spiffs_page_header p_hdr;
+  u8_t lu_index = lu_obj_id != SPIFFS_OBJ_ID_FREE && lu_obj_id != SPIFFS_OBJ_ID_DELETED &&
+      (lu_obj_id & SPIFFS_OBJ_ID_IX_FLAG);
+
+  if (lu_index) {
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+        0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+    SPIFFS_CHECK_RES(res);
+    memcpy(&p_hdr, fs->lu_work, sizeof(spiffs_page_header));
+  } else {
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+        0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), sizeof(spiffs_page_header), (u8_t*)&p_hdr);
+    SPIFFS_CHECK_RES(res);
+  }
+
+  if (within_range) {
+    // look up consistency
+    if (spiffs_check_fast_lookup_bad(lu_obj_id, &p_hdr)) {
+      SPIFFS_CHECK_DBG("FA: pix "_SPIPRIpg" lu "_SPIPRIid" differs from page "_SPIPRIid" flags "_SPIPRIfl"\n",
+          cur_pix, lu_obj_id, p_hdr.obj_id, p_hdr.flags);
+      spiffs_check_fast_found(st, SPIFFS_CHECK_FAST_LU, cur_pix, 1);
+    }
+
+    // object index consistency
+    if (lu_index) {
+      u8_t ix_flags = p_hdr.flags &
+          (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_IXDELE);
+      spiffs_check_fast_obj *obj = spiffs_check_fast_obj_get(st, lu_obj_id);
+      if (obj == 0) {
+        return SPIFFS_OK;
+      }
+      if (p_hdr.span_ix == 0 && ix_flags == SPIFFS_PH_FLAG_DELET) {
+        SPIFFS_CHECK_DBG("FA: pix "_SPIPRIpg" index header not fully deleted\n", cur_pix);
+        spiffs_check_fast_found(st, SPIFFS_CHECK_FAST_IX, cur_pix, 0);
+      } else if (p_hdr.span_ix != 0 && ix_flags != (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_IXDELE)) {
+        obj->flags |= SPIFFS_CHECK_FAST_OBJ_LOOSE;
+      }
+      // a header as spiffs_obj_lu_find_id_and_span finds it
+      if (p_hdr.obj_id == lu_obj_id && p_hdr.span_ix == 0 &&
+          (p_hdr.flags & (SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_USED)) == SPIFFS_PH_FLAG_DELET &&
+          (p_hdr.flags & SPIFFS_PH_FLAG_IXDELE)) {
+        obj->flags |= SPIFFS_CHECK_FAST_OBJ_HDR;
+      }
+    }
+
+    // page consistency
+    if (spiffs_check_fast_page_used(p_hdr.flags)) {
+      u32_t bit_ix = (cur_pix - st->pix_offset) * SPIFFS_CHECK_FAST_BITS;
+      st->map[bit_ix / 8] |= SPIFFS_CHECK_FAST_USED << (bit_ix % 8);
+      if ((p_hdr.flags & SPIFFS_PH_FLAG_INDEX) && (p_hdr.obj_id & SPIFFS_OBJ_ID_IX_FLAG)) {
+        // data page that no reference can match
+        spiffs_check_fast_found(st, SPIFFS_CHECK_FAST_PA, cur_pix, 0);
+      } else if (p_hdr.flags & SPIFFS_PH_FLAG_INDEX) {
+        // data page, balances the reference to it
+        spiffs_check_fast_obj *obj = spiffs_check_fast_obj_get(st, p_hdr.obj_id);
+        if (obj == 0) {
+          return SPIFFS_OK;
+        }
+        obj->refs ^= spiffs_check_fast_hash(cur_pix, p_hdr.span_ix);
+      }
+    }
+  }
+
+  // index pages are found through look up; one that the look up does not
+  // mark is a look up finding, mended before references are looked at
+  if (lu_index && (p_hdr.flags & SPIFFS_PH_FLAG_DELET) && (p_hdr.flags & SPIFFS_PH_FLAG_IXDELE) &&
+      (p_hdr.flags & (SPIFFS_PH_FLAG_INDEX | SPIFFS_PH_FLAG_USED)) == 0) {
+    spiffs_check_fast_refs(fs, st, cur_pix, &p_hdr);
+  }
+  return SPIFFS_OK;
+}
+
+// scans all pages, range by range, and records the findings in st
+static s32_t spiffs_check_fast_scan(spiffs *fs, spiffs_check_fast_state *st) {
+  s32_t res = SPIFFS_OK;
+  const u32_t max_pages = SPIFFS_MAX_PAGES(fs);
+  const int entries_per_page = SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id);
+  const u32_t ranges = (max_pages + st->pages_per_range - 1) / st->pages_per_range;
+  spiffs_obj_id *obj_lu_buf = (spiffs_obj_id *)fs->lu_work;
+  u32_t range;
+
+  st->findings = 0;
+  st->full = 0;
+  st->overflow = 0;
+  st->fix_count = 0;
+  memset(st->objs, 0, SPIFFS_CHECK_FAST_OBJS * sizeof(spiffs_check_fast_obj));
+
+  for (range = 0; range < ranges; range++) {
+    st->pix_offset = range * st->pages_per_range;
+    u32_t range_pages = MIN(st->pages_per_range, max_pages - st->pix_offset);
+    memset(st->map, 0, (range_pages * SPIFFS_CHECK_FAST_BITS + 7) / 8);
+
+    spiffs_block_ix cur_block;
+    for (cur_block = 0; cur_block < fs->block_count; cur_block++) {
+      CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_PROGRESS,
+          ((range * fs->block_count + cur_block) * 256) / (ranges * fs->block_count), 0);
+      int obj_lookup_page;
+      for (obj_lookup_page = 0; obj_lookup_page < (int)SPIFFS_OBJ_LOOKUP_PAGES(fs); obj_lookup_page++) {
+        u32_t lu_addr = SPIFFS_PAGE_TO_PADDR(fs, cur_block * SPIFFS_PAGES_PER_BLOCK(fs) + obj_lookup_page);
+        int entry_offset = obj_lookup_page * entries_per_page;
+        int cur_entry;
+        res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+            0, lu_addr, SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+        SPIFFS_CHECK_RES(res);
+        for (cur_entry = entry_offset;
+            cur_entry - entry_offset < entries_per_page && cur_entry < (int)SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs);
+            cur_entry++) {
+          spiffs_obj_id lu_obj_id = obj_lu_buf[cur_entry - entry_offset];
+          spiffs_page_ix cur_pix = SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, cur_block, cur_entry);
+          u8_t within_range = cur_pix >= st->pix_offset && (u32_t)(cur_pix - st->pix_offset) < range_pages;
+          u8_t lu_index = lu_obj_id != SPIFFS_OBJ_ID_FREE && lu_obj_id != SPIFFS_OBJ_ID_DELETED &&
+              (lu_obj_id & SPIFFS_OBJ_ID_IX_FLAG);
+          if (!within_range && !lu_index) {
+            continue;
+          }
+          if (lu_obj_id == SPIFFS_OBJ_ID_FREE || lu_obj_id == SPIFFS_OBJ_ID_DELETED) {
+            // look up entries are written before their page, deleted after
+            // it and erased after it, so the page behind a free or deleted
+            // entry is free or deleted too
+            continue;
+          }
+          res = spiffs_check_fast_page(fs, st, lu_obj_id, cur_pix, within_range);
+          SPIFFS_CHECK_RES(res);
+          if (st->overflow) {
+            return SPIFFS_OK;
+          }
+          if (lu_index) {
+            // index page was loaded over the look up page
+            res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+                0, lu_addr, SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+            SPIFFS_CHECK_RES(res);
+          }
+        }
+      }
+    }
+
+    // used but unreferenced, or referenced but not used
+    u32_t i;
+    for (i = 0; i < range_pages; i++) {
+      u32_t bit_ix = i * SPIFFS_CHECK_FAST_BITS;
+      u8_t bits = (st->map[bit_ix / 8] >> (bit_ix % 8)) &
+          (SPIFFS_CHECK_FAST_USED | SPIFFS_CHECK_FAST_REFERENCED);
+      if (bits == SPIFFS_CHECK_FAST_USED) {
+        SPIFFS_CHECK_DBG("FA: pix "_SPIPRIpg" USED, UNREFERENCED\n", st->pix_offset + i);
+        spiffs_check_fast_found(st, SPIFFS_CHECK_FAST_PA, st->pix_offset + i, 1);
+      } else if (bits == SPIFFS_CHECK_FAST_REFERENCED) {
+        // usually a page that was moved and deleted before its index was
+        // written, which mending the unreferenced copy redirects
+        SPIFFS_CHECK_DBG("FA: pix "_SPIPRIpg" FREE, REFERENCED\n", st->pix_offset + i);
+        spiffs_check_fast_found(st, SPIFFS_CHECK_FAST_PA, st->pix_offset + i, 1);
+      }
+    }
+  }
+
+  u32_t i;
+  u8_t page_findings = st->findings & SPIFFS_CHECK_FAST_PA;
+  for (i = 0; i < SPIFFS_CHECK_FAST_OBJS; i++) {
+    spiffs_check_fast_obj *obj = &st->objs[i];
+    if ((obj->flags & SPIFFS_CHECK_FAST_OBJ_LOOSE) && (obj->flags & SPIFFS_CHECK_FAST_OBJ_HDR) == 0) {
+      SPIFFS_CHECK_DBG("FA: obj id "_SPIPRIid" has index pages but no header\n", obj->obj_id);
+      spiffs_check_fast_found(st, SPIFFS_CHECK_FAST_IX, 0, 0);
+    }
+    // unreferenced pages unbalance their object too, so this only tells
+    // once they are gone
+    if (!page_findings && obj->refs != 0) {
+      SPIFFS_CHECK_DBG("FA: obj id "_SPIPRIid" references pages with other headers\n", obj->obj_id);
+      spiffs_check_fast_found(st, SPIFFS_CHECK_FAST_PA, 0, 0);
+    }
+  }
+  return res;
+}
+
+// runs spiffs_lookup_check_validate on the listed pages still in need,
+// counting them in mended
+static s32_t spiffs_check_fast_mend_lookup(spiffs *fs, spiffs_check_fast_state *st, u32_t *mended) {
+  s32_t res = SPIFFS_OK;
+  u32_t i;
+  *mended = 0;
+  for (i = 0; i < st->fix_count; i++) {
+    spiffs_page_ix cur_pix = st->fix[i];
+    spiffs_block_ix cur_block = SPIFFS_BLOCK_FOR_PAGE(fs, cur_pix);
+    int cur_entry = SPIFFS_OBJ_LOOKUP_ENTRY_FOR_PAGE(fs, cur_pix);
+    spiffs_obj_id lu_obj_id;
+    spiffs_page_header p_hdr;
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+        0, SPIFFS_BLOCK_TO_PADDR(fs, cur_block) + cur_entry * sizeof(spiffs_obj_id),
+        sizeof(spiffs_obj_id), (u8_t *)&lu_obj_id);
+    SPIFFS_CHECK_RES(res);
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+        0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), sizeof(spiffs_page_header), (u8_t*)&p_hdr);
+    SPIFFS_CHECK_RES(res);
+    if (!spiffs_check_fast_lookup_bad(lu_obj_id, &p_hdr)) {
+      // mended along with an earlier page
+      continue;
+    }
+    int reload_lu = 0;
+    res = spiffs_lookup_check_validate(fs, lu_obj_id, &p_hdr, cur_pix, cur_block, cur_entry, &reload_lu);
+    SPIFFS_CHECK_RES(res);
+    (*mended)++;
+  }
+  return res;
+}
+
+// mends the listed pages in three steps, scanning again after any that
+// mends something: the look up fixup for pages behind a free or deleted
+// entry that an index references, deleting the stale one of index pages
+// that have a second live copy as the page check does first, and the page
+// check's fixup for unreferenced pages. Referenced pages that are not used
+// are left to those; the full page check runs when none applies, or when a
+// listed index page has no copy to blame.
+static s32_t spiffs_check_fast_mend_pages(spiffs *fs, spiffs_check_fast_state *st) {
+  u32_t mended;
+  u32_t i;
+  s32_t res = spiffs_check_fast_mend_lookup(fs, st, &mended);
+  SPIFFS_CHECK_RES(res);
+  if (mended > 0) {
+    return SPIFFS_OK;
+  }
+  for (i = 0; i < st->fix_count; i++) {
+    spiffs_page_ix cur_pix = st->fix[i];
+    spiffs_page_header p_hdr;
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+        0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), sizeof(spiffs_page_header), (u8_t*)&p_hdr);
+    SPIFFS_CHECK_RES(res);
+    if ((p_hdr.flags & (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_IXDELE | SPIFFS_PH_FLAG_INDEX |
+        SPIFFS_PH_FLAG_USED | SPIFFS_PH_FLAG_FINAL)) != (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_IXDELE)) {
+      // not a live index page
+      continue;
+    }
+    spiffs_page_ix other_pix;
+    res = spiffs_obj_lu_find_id_and_span(fs, p_hdr.obj_id | SPIFFS_OBJ_ID_IX_FLAG, p_hdr.span_ix, cur_pix, &other_pix);
+    if (res == SPIFFS_ERR_NOT_FOUND) {
+      // references another page of the object, or of another object
+      return spiffs_page_consistency_check(fs);
+    }
+    SPIFFS_CHECK_RES(res);
+    spiffs_page_ix stale_pix;
+    res = spiffs_stale_index_delete(fs, p_hdr.obj_id, p_hdr.span_ix, other_pix, cur_pix, &stale_pix);
+    SPIFFS_CHECK_RES(res);
+    mended++;
+  }
+  if (mended > 0) {
+    return SPIFFS_OK;
+  }
+  for (i = 0; i < st->fix_count; i++) {
+    spiffs_page_ix cur_pix = st->fix[i];
+    spiffs_page_header p_hdr;
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+        0, SPIFFS_PAGE_TO_PADDR(fs, cur_pix), sizeof(spiffs_page_header), (u8_t*)&p_hdr);
+    SPIFFS_CHECK_RES(res);
+    if (!spiffs_check_fast_page_used(p_hdr.flags)) {
+      continue;
+    }
+    u8_t restart = 0;
+    res = spiffs_page_check_unreferenced(fs, cur_pix, &restart);
+    SPIFFS_CHECK_RES(res);
+    mended++;
+  }
+  if (mended == 0) {
+    res = spiffs_page_consistency_check(fs);
+  }
+  return res;
+}
+
+// all three full checks, in SPIFFS_check's order
+static s32_t spiffs_check_fast_fallback(spiffs *fs) {
+  s32_t res;
+  res = spiffs_lookup_consistency_check(fs, 0);
+  res = spiffs_object_index_consistency_check(fs);
+  res = spiffs_page_consistency_check(fs);
+  return res;
+}
+
+u32_t spiffs_check_fast_work_size(spiffs *fs) {
+  // tables, the map, and slack for aligning the tables
+  return SPIFFS_CHECK_FAST_TABLES +
+      (SPIFFS_MAX_PAGES(fs) * SPIFFS_CHECK_FAST_BITS + 7) / 8 + sizeof(u32_t) - 1;
+}
+
+// Checks and mends the file system like the three checks above, scanning the
+// pages once per round. work is laid out as the object table, the list of
+// pages to mend and the page map, the last taking what is left.
+s32_t spiffs_check_fast(spiffs *fs, u8_t *work, u32_t work_size) {
+  s32_t res = SPIFFS_OK;
+  spiffs_check_fast_state st;
+  u8_t mended = 0;
+  int round;
+
+  if (work == 0) {
+    work = fs->work;
+    work_size = SPIFFS_CFG_LOG_PAGE_SZ(fs);
+  }
+  u32_t align = (sizeof(u32_t) - ((size_t)work & (sizeof(u32_t) - 1))) & (sizeof(u32_t) - 1);
+  if (work_size < align + SPIFFS_CHECK_FAST_TABLES + 1) {
+    SPIFFS_CHECK_DBG("FA: "_SPIPRIi" bytes of work memory is too small\n", work_size);
+    res = spiffs_check_fast_fallback(fs);
+    return res == SPIFFS_OK ? spiffs_obj_lu_scan(fs) : res;
+  }
+  st.objs = (spiffs_check_fast_obj *)(work + align);
+  st.fix = (spiffs_page_ix *)(st.objs + SPIFFS_CHECK_FAST_OBJS);
+  st.map = (u8_t *)(st.fix + SPIFFS_CHECK_FAST_FIXES);
+  st.pages_per_range = (work_size - align - SPIFFS_CHECK_FAST_TABLES) * 8 / SPIFFS_CHECK_FAST_BITS;
+
+  CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_PROGRESS, 0, 0);
+  for (round = 0; ; round++) {
+    res = spiffs_check_fast_scan(fs, &st);
+    if (res != SPIFFS_OK) {
+      CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_ERROR, res, 0);
+      return res;
+    }
+    if (st.findings == 0 && !st.overflow) {
+      break;
+    }
+    mended = 1;
+    if (st.overflow || round + 1 >= SPIFFS_CHECK_FAST_ROUNDS) {
+      SPIFFS_CHECK_DBG("FA: %s, running full checks\n", st.overflow ? "too many objects" : "not settled");
+      res = spiffs_check_fast_fallback(fs);
+      break;
+    }
+    SPIFFS_CHECK_DBG("FA: round %d findings "_SPIPRIfl" full "_SPIPRIfl" pages "_SPIPRIi"\n",
+        round, st.findings, st.full, st.fix_count);
+    if (st.findings & SPIFFS_CHECK_FAST_LU) {
+      if (st.full & SPIFFS_CHECK_FAST_LU) {
+        res = spiffs_lookup_consistency_check(fs, 0);
+      } else {
+        u32_t mended_pages;
+        res = spiffs_check_fast_mend_lookup(fs, &st, &mended_pages);
+      }
+    } else if (st.findings & SPIFFS_CHECK_FAST_IX) {
+      res = spiffs_object_index_consistency_check(fs);
+    } else if (st.full & SPIFFS_CHECK_FAST_PA) {
+      res = spiffs_page_consistency_check(fs);
+    } else {
+      res = spiffs_check_fast_mend_pages(fs, &st);
+    }
+    if (res != SPIFFS_OK) {
+      CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_ERROR, res, 0);
+      return res;
+    }
+  }
+  CHECK_CB(fs, SPIFFS_CHECK_LOOKUP, SPIFFS_CHECK_PROGRESS, 256, 0);
+
+  if (mended) {
+    // free block count and the like, as SPIFFS_check ends with
+    res = spiffs_obj_lu_scan(fs);
+  }
+  return res;
+}
+
+#endif // SPIFFS_CHECK_FAST
+
 #endif // !SPIFFS_READ_ONLY
@@ -14,6 +14,12 @@ static s32_t spiffs_gc_erase_block(
   SPIFFS_GC_DBG("gc: erase block "_SPIPRIbl"\n", bix);
   res = spiffs_erase_block(fs, bix);
   SPIFFS_CHECK_RES(res);
+#if SPIFFS_GC_INCREMENTAL
+  if (fs->gc_pending && fs->gc_bix == bix) {
+    // whoever erased it, SPIFFS_gc_step is done with it
+    fs->gc_pending = 0;
+  }
+#endif
 
 #if SPIFFS_CACHE
   {
@@ -151,6 +157,12 @@ s32_t spiffs_gc_check(
     fs->stats_gc_runs++;
 #endif
     cand = cands[0];
+#if SPIFFS_GC_INCREMENTAL
+    if (fs->gc_pending) {
+      // finish the block SPIFFS_gc_step has partly emptied
+      cand = fs->gc_bix;
+    }
+#endif
     fs->cleaning = 1;
     //SPIFFS_GC_DBG("gcing: cleaning block "_SPIPRIi"\n", cand);
     res = spiffs_gc_clean(fs, cand);
@@ -195,10 +207,13 @@ s32_t spiffs_gc_check(
   return res;
 }
 
-// Updates page statistics for a block that is about to be erased
-s32_t spiffs_gc_erase_page_stats(
+// Counts the used, deleted and free pages of a block, using lu_work only
+static s32_t spiffs_gc_count_pages(
     spiffs *fs,
-    spiffs_block_ix bix) {
+    spiffs_block_ix bix,
+    u32_t *allo_out,
+    u32_t *dele_out,
+    u32_t *free_out) {
   s32_t res = SPIFFS_OK;
   int obj_lookup_page = 0;
   int entries_per_page = (SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id));
@@ -206,6 +221,7 @@ s32_t spiffs_gc_erase_page_stats(
   int cur_entry = 0;
   u32_t dele = 0;
   u32_t allo = 0;
+  u32_t free = 0;
 
   // check each object lookup page
   while (res == SPIFFS_OK && obj_lookup_page < (int)SPIFFS_OBJ_LOOKUP_PAGES(fs)) {
@@ -217,6 +233,7 @@ s32_t spiffs_gc_erase_page_stats(
         cur_entry - entry_offset < entries_per_page && cur_entry < (int)(SPIFFS_PAGES_PER_BLOCK(fs)-SPIFFS_OBJ_LOOKUP_PAGES(fs))) {
       spiffs_obj_id obj_id = obj_lu_buf[cur_entry-entry_offset];
       if (obj_id == SPIFFS_OBJ_ID_FREE) {
+        free++;
       } else if (obj_id == SPIFFS_OBJ_ID_DELETED) {
         dele++;
       } else {
@@ -226,6 +243,21 @@ s32_t spiffs_gc_erase_page_stats(
     } // per entry
     obj_lookup_page++;
   } // per object lookup page
+  *allo_out = allo;
+  *dele_out = dele;
+  *free_out = free;
+  return res;
+}
+
+// Updates page statistics for a block that is about to be erased
+s32_t spiffs_gc_erase_page_stats(
+    spiffs *fs,
+    spiffs_block_ix bix) {
+  u32_t dele;
+  u32_t allo;
+  u32_t free;
+  s32_t res = spiffs_gc_count_pages(fs, bix, &allo, &dele, &free);
+  SPIFFS_CHECK_RES(res);
   SPIFFS_GC_DBG("gc_check: wipe pallo:"_SPIPRIi" pdele:"_SPIPRIi"\n", allo, dele);
   fs->stats_p_allocated -= allo;
   fs->stats_p_deleted -= dele;
@@ -374,8 +406,13 @@ typedef struct {
 //   repeat loop until end of object lookup
 //   scan object lookup again for remaining object index pages, move to new page in other block
 //
-s32_t spiffs_gc_clean(spiffs *fs, spiffs_block_ix bix) {
+// Stops after max_moves moved or wiped pages, storing the object index in
+// memory first, and returns 1. The block is then consistent and a later
+// call starts over from the first lookup entry: what was moved has left the
+// block, so the scan picks up where this one stopped.
+static s32_t spiffs_gc_clean_some(spiffs *fs, spiffs_block_ix bix, u32_t max_moves) {
   s32_t res = SPIFFS_OK;
+  u32_t moves = 0;
   const int entries_per_page = (SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id));
   // this is the global localizer being pushed and popped
   int cur_entry = 0;
@@ -398,6 +435,10 @@ s32_t spiffs_gc_clean(spiffs *fs, spiffs_block_ix bix) {
   }
 
   while (res == SPIFFS_OK && gc.state != FINISHED) {
+    if (gc.state == FIND_OBJ_DATA && moves >= max_moves) {
+      SPIFFS_GC_DBG("gc_clean: "_SPIPRIi" moves done, block "_SPIPRIbl" not empty yet\n", moves, bix);
+      return 1;
+    }
     SPIFFS_GC_DBG("gc_clean: state = "_SPIPRIi" entry:"_SPIPRIi"\n", gc.state, cur_entry);
     gc.obj_id_found = 0; // reset (to no found data page)
 
@@ -462,6 +503,10 @@ s32_t spiffs_gc_clean(spiffs *fs, spiffs_block_ix bix) {
                 SPIFFS_CHECK_RES(res);
                 new_data_pix = SPIFFS_OBJ_ID_FREE;
               }
+              if (++moves >= max_moves) {
+                // out of moves: store the object index below, then stop
+                scan = 0;
+              }
               // update memory representation of object index page with new data page
               if (gc.cur_objix_spix == 0) {
                 // update object index header page
@@ -510,6 +555,9 @@ s32_t spiffs_gc_clean(spiffs *fs, spiffs_block_ix bix) {
               }
             }
             SPIFFS_CHECK_RES(res);
+            if (++moves >= max_moves) {
+              scan = 0;
+            }
           }
           break;
         default:
@@ -521,6 +569,10 @@ s32_t spiffs_gc_clean(spiffs *fs, spiffs_block_ix bix) {
       obj_lookup_page++; // no need to check scan variable here, obj_lookup_page is set in start of loop
     } // per object lookup page
     if (res != SPIFFS_OK) break;
+    if (gc.state == MOVE_OBJ_IX && !scan) {
+      SPIFFS_GC_DBG("gc_clean: "_SPIPRIi" moves done, block "_SPIPRIbl" not empty yet\n", moves, bix);
+      return 1;
+    }
 
     // state finalization and switch
     switch (gc.state) {
@@ -603,4 +655,69 @@ s32_t spiffs_gc_clean(spiffs *fs, spiffs_block_ix bix) {
   return res;
 }
 
+s32_t spiffs_gc_clean(spiffs *fs, spiffs_block_ix bix) {
+  return spiffs_gc_clean_some(fs, bix, (u32_t)-1);
+}
+
+#if SPIFFS_GC_INCREMENTAL
+// Moves at most max_moves pages out of the block being collected, picking
+// one first if fewer than SPIFFS_GC_IDLE_FREE_BLOCKS blocks are free, and
+// erases it once empty. Returns 1 while there is more to do.
+s32_t spiffs_gc_step(
+    spiffs *fs, u32_t max_moves) {
+  s32_t res;
+  spiffs_block_ix bix;
+
+  if (max_moves == 0) {
+    max_moves = 1;
+  }
+  if (!fs->gc_pending) {
+    spiffs_block_ix *cands;
+    int count;
+    int i;
+    if (fs->free_blocks >= SPIFFS_GC_IDLE_FREE_BLOCKS || fs->stats_p_deleted == 0) {
+      return 0;
+    }
+    res = spiffs_gc_find_candidate(fs, &cands, &count, 0);
+    SPIFFS_CHECK_RES(res);
+    // take the best scored block that gains something: one with deleted
+    // pages and no free ones, so writers cannot allocate in it meanwhile
+    for (i = 0; i < count && cands[i] != (spiffs_block_ix)-1; i++) {
+      u32_t allo;
+      u32_t dele;
+      u32_t free;
+      res = spiffs_gc_count_pages(fs, cands[i], &allo, &dele, &free);
+      SPIFFS_CHECK_RES(res);
+      if (dele > 0 && free == 0) {
+        SPIFFS_GC_DBG("gc_step: collecting block "_SPIPRIbl", pallo:"_SPIPRIi" pdele:"_SPIPRIi"\n", cands[i], allo, dele);
+        fs->gc_bix = cands[i];
+        fs->gc_pending = 1;
+        break;
+      }
+    }
+    if (!fs->gc_pending) {
+      return 0;
+    }
+  }
+
+  bix = fs->gc_bix;
+  fs->cleaning = 1;
+  res = spiffs_gc_clean_some(fs, bix, max_moves);
+  fs->cleaning = 0;
+  SPIFFS_CHECK_RES(res);
+  if (res == 1) {
+    return 1;
+  }
+
+  res = spiffs_gc_erase_page_stats(fs, bix);
+  SPIFFS_CHECK_RES(res);
+  res = spiffs_gc_erase_block(fs, bix);
+  SPIFFS_CHECK_RES(res);
+#if SPIFFS_GC_STATS
+  fs->stats_gc_runs++;
+#endif
+  return fs->free_blocks < SPIFFS_GC_IDLE_FREE_BLOCKS ? 1 : 0;
+}
+#endif // SPIFFS_GC_INCREMENTAL
+
 #endif // !SPIFFS_READ_ONLY
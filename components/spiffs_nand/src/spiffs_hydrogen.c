@@ -1148,6 +1148,12 @@ s32_t SPIFFS_check(spiffs *fs) {
   SPIFFS_API_CHECK_MOUNT(fs);
   SPIFFS_LOCK(fs);
 
+#if SPIFFS_OBJ_MAP
+  // the checks look for what the lookup pages say, not the map
+  void *obj_map = fs->obj_map;
+  fs->obj_map = 0;
+#endif
+
   res = spiffs_lookup_consistency_check(fs, 0);
 
   res = spiffs_object_index_consistency_check(fs);
@@ -1156,11 +1162,85 @@ s32_t SPIFFS_check(spiffs *fs) {
 
   res = spiffs_obj_lu_scan(fs);
 
+#if SPIFFS_OBJ_MAP
+  spiffs_obj_map_resume(fs, obj_map);
+#endif
+
   SPIFFS_UNLOCK(fs);
   return res;
 #endif // SPIFFS_READ_ONLY
 }
 
+#if SPIFFS_CHECK_FAST
+s32_t SPIFFS_check_fast(spiffs *fs, u8_t *work, u32_t work_size) {
+  SPIFFS_API_DBG("%s "_SPIPRIi "\n", __func__, work_size);
+#if SPIFFS_READ_ONLY
+  (void)fs; (void)work; (void)work_size;
+  return SPIFFS_ERR_RO_NOT_IMPL;
+#else
+  s32_t res;
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+#if SPIFFS_OBJ_MAP
+  void *obj_map = fs->obj_map;
+  fs->obj_map = 0;
+#endif
+
+  res = spiffs_check_fast(fs, work, work_size);
+
+#if SPIFFS_OBJ_MAP
+  spiffs_obj_map_resume(fs, obj_map);
+#endif
+
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+  SPIFFS_UNLOCK(fs);
+  return res;
+#endif // SPIFFS_READ_ONLY
+}
+
+u32_t SPIFFS_check_fast_work_size(spiffs *fs) {
+#if SPIFFS_READ_ONLY
+  (void)fs;
+  return 0;
+#else
+  return spiffs_check_fast_work_size(fs);
+#endif // SPIFFS_READ_ONLY
+}
+#endif // SPIFFS_CHECK_FAST
+
+#if SPIFFS_OBJ_MAP
+s32_t SPIFFS_obj_map(spiffs *fs, void *buf, u32_t size) {
+  SPIFFS_API_DBG("%s "_SPIPRIi "\n", __func__, size);
+  s32_t res = SPIFFS_OK;
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+  // align map to entry boundary
+  u8_t addr_lsb = ((u8_t)(intptr_t)buf) & (sizeof(spiffs_page_ix)-1);
+  if (buf && addr_lsb) {
+    buf = (u8_t *)buf + (sizeof(spiffs_page_ix)-addr_lsb);
+    size = size > sizeof(spiffs_page_ix) ? size - (sizeof(spiffs_page_ix)-addr_lsb) : 0;
+  }
+  fs->obj_map_entries = buf ? size / sizeof(spiffs_obj_map_entry) : 0;
+  fs->obj_map = fs->obj_map_entries ? buf : 0;
+  fs->obj_map_hits = 0;
+  fs->obj_map_scans = 0;
+  if (fs->obj_map) {
+    res = spiffs_obj_map_rebuild(fs);
+    if (res != SPIFFS_OK) {
+      fs->obj_map = 0;
+    }
+  }
+
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+  SPIFFS_UNLOCK(fs);
+  return res;
+}
+#endif // SPIFFS_OBJ_MAP
+
 s32_t SPIFFS_info(spiffs *fs, u32_t *total, u32_t *used) {
   SPIFFS_API_DBG("%s\n", __func__);
   s32_t res = SPIFFS_OK;
@@ -1225,6 +1305,27 @@ s32_t SPIFFS_gc(spiffs *fs, u32_t size) {
 #endif // SPIFFS_READ_ONLY
 }
 
+#if SPIFFS_GC_INCREMENTAL
+s32_t SPIFFS_gc_step(spiffs *fs, u32_t max_moves) {
+  SPIFFS_API_DBG("%s "_SPIPRIi "\n", __func__, max_moves);
+#if SPIFFS_READ_ONLY
+  (void)fs; (void)max_moves;
+  return SPIFFS_ERR_RO_NOT_IMPL;
+#else
+  s32_t res;
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+  res = spiffs_gc_step(fs, max_moves);
+
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+  SPIFFS_UNLOCK(fs);
+  return res;
+#endif // SPIFFS_READ_ONLY
+}
+#endif // SPIFFS_GC_INCREMENTAL
+
 s32_t SPIFFS_eof(spiffs *fs, spiffs_file fh) {
   SPIFFS_API_DBG("%s "_SPIPRIfd "\n", __func__, fh);
   s32_t res;
@@ -522,6 +522,243 @@ static s32_t spiffs_obj_lu_find_id_and_span_v(
   }
 }
 
+#if SPIFFS_TEMPORAL_FD_CACHE || SPIFFS_OBJ_MAP
+// djb2 hash
+static u32_t spiffs_hash(spiffs *fs, const u8_t *name) {
+  (void)fs;
+  u32_t hash = 5381;
+  u8_t c;
+  int i = 0;
+  while ((c = name[i++]) && i < SPIFFS_OBJ_NAME_LEN) {
+    hash = (hash * 33) ^ c;
+  }
+  return hash;
+}
+#endif
+
+#if SPIFFS_OBJ_MAP
+
+// The object index page map is an open addressed hash table keyed on object
+// id and span index, probed linearly and kept at most this full.
+#define SPIFFS_OBJ_MAP_LOAD(fs)   ((fs)->obj_map_entries * 3 / 4)
+
+static u32_t spiffs_obj_map_slot(spiffs *fs, spiffs_obj_id obj_id, spiffs_span_ix spix) {
+  return ((((u32_t)obj_id << 16) | spix) * 2654435761u) % fs->obj_map_entries;
+}
+
+static u16_t spiffs_obj_map_name_hash(spiffs *fs, const u8_t *name) {
+  u32_t hash = spiffs_hash(fs, name);
+  hash ^= hash >> 16;
+  // 0 stands for a name not known
+  return (u16_t)hash ? (u16_t)hash : 1;
+}
+
+static spiffs_obj_map_entry *spiffs_obj_map_find(spiffs *fs, spiffs_obj_id obj_id, spiffs_span_ix spix) {
+  spiffs_obj_map_entry *map = (spiffs_obj_map_entry *)fs->obj_map;
+  u32_t i = spiffs_obj_map_slot(fs, obj_id, spix);
+  u32_t n;
+  for (n = 0; n < fs->obj_map_entries; n++) {
+    if (map[i].obj_id == SPIFFS_OBJ_ID_FREE) break;
+    if (map[i].obj_id == obj_id && map[i].spix == spix) return &map[i];
+    i = (i + 1) % fs->obj_map_entries;
+  }
+  return 0;
+}
+
+// removes an entry, moving back entries after it that would otherwise no
+// longer be found from their slot
+static void spiffs_obj_map_remove(spiffs *fs, spiffs_obj_map_entry *e) {
+  spiffs_obj_map_entry *map = (spiffs_obj_map_entry *)fs->obj_map;
+  u32_t i = e - map;
+  u32_t j = i;
+  while (1) {
+    j = (j + 1) % fs->obj_map_entries;
+    if (map[j].obj_id == SPIFFS_OBJ_ID_FREE) break;
+    u32_t k = spiffs_obj_map_slot(fs, map[j].obj_id, map[j].spix);
+    // move entry j to the hole at i unless its slot lies cyclically in (i, j]
+    if ((i <= j) ? (k <= i || k > j) : (k <= i && k > j)) {
+      map[i] = map[j];
+      i = j;
+    }
+  }
+  map[i].obj_id = SPIFFS_OBJ_ID_FREE;
+  fs->obj_map_used--;
+}
+
+// Enters where an object index page is. The name is only given for object
+// index headers whose name is at hand; otherwise any known one is kept.
+static void spiffs_obj_map_put(spiffs *fs, spiffs_obj_id obj_id, spiffs_span_ix spix,
+    spiffs_page_ix pix, const u8_t *name) {
+  spiffs_obj_map_entry *map = (spiffs_obj_map_entry *)fs->obj_map;
+  obj_id &= ~SPIFFS_OBJ_ID_IX_FLAG;
+  spiffs_obj_map_entry *e = spiffs_obj_map_find(fs, obj_id, spix);
+  if (e == 0) {
+    if (fs->obj_map_used >= SPIFFS_OBJ_MAP_LOAD(fs)) {
+      u32_t i;
+      if (spix != 0) return;
+      // make room for the header by dropping another object index page,
+      // which can always be scanned for
+      for (i = 0; i < fs->obj_map_entries; i++) {
+        if (map[i].obj_id != SPIFFS_OBJ_ID_FREE && map[i].spix != 0) break;
+      }
+      if (i == fs->obj_map_entries) {
+        SPIFFS_DBG("obj_map: full, "_SPIPRIid" not entered\n", obj_id);
+        fs->obj_map_lost = 1;
+        return;
+      }
+      spiffs_obj_map_remove(fs, &map[i]);
+    }
+    e = &map[spiffs_obj_map_slot(fs, obj_id, spix)];
+    while (e->obj_id != SPIFFS_OBJ_ID_FREE) {
+      e = (e == &map[fs->obj_map_entries - 1]) ? &map[0] : e + 1;
+    }
+    e->obj_id = obj_id;
+    e->spix = spix;
+    e->name_hash = 0;
+    fs->obj_map_used++;
+  }
+  e->pix = pix;
+  if (name) {
+    e->name_hash = spiffs_obj_map_name_hash(fs, name);
+  }
+}
+
+// Removes an object index page from the map, unless the entry has already
+// moved on to another page of the same span.
+static void spiffs_obj_map_drop(spiffs *fs, spiffs_obj_id obj_id, spiffs_span_ix spix,
+    spiffs_page_ix pix) {
+  spiffs_obj_map_entry *e = spiffs_obj_map_find(fs, obj_id & ~SPIFFS_OBJ_ID_IX_FLAG, spix);
+  if (e && e->pix == pix) {
+    spiffs_obj_map_remove(fs, e);
+  }
+}
+
+// Looks an object index page up in the map and verifies it against the page
+// header. Returns SPIFFS_OK with pix set, SPIFFS_ERR_NOT_FOUND if the page
+// cannot exist, SPIFFS_VIS_COUNTINUE if the lookup pages must be scanned, or
+// an error.
+static s32_t spiffs_obj_map_find_id_and_span(
+    spiffs *fs,
+    spiffs_obj_id obj_id,
+    spiffs_span_ix spix,
+    spiffs_page_ix exclusion_pix,
+    spiffs_page_ix *pix) {
+  s32_t res;
+  spiffs_obj_map_entry *e = spiffs_obj_map_find(fs, obj_id & ~SPIFFS_OBJ_ID_IX_FLAG, spix);
+  if (e == 0) {
+    // every header is in the map unless one was lost, other index pages
+    // may have given way to headers
+    return (spix == 0 && !fs->obj_map_lost) ? SPIFFS_ERR_NOT_FOUND : SPIFFS_VIS_COUNTINUE;
+  }
+  if (e->pix == exclusion_pix) {
+    return SPIFFS_VIS_COUNTINUE;
+  }
+  res = spiffs_obj_lu_find_id_and_span_v(fs, obj_id,
+      SPIFFS_BLOCK_FOR_PAGE(fs, e->pix), SPIFFS_OBJ_LOOKUP_ENTRY_FOR_PAGE(fs, e->pix),
+      0, &spix);
+  if (res == SPIFFS_OK) {
+    *pix = e->pix;
+  } else if (res == SPIFFS_VIS_COUNTINUE) {
+    SPIFFS_DBG("obj_map: "_SPIPRIid":"_SPIPRIsp" not at "_SPIPRIpg", scanning\n", obj_id, spix, e->pix);
+    spiffs_obj_map_remove(fs, e);
+  }
+  return res;
+}
+
+// Finds an object index header by name among the headers in the map.
+// Returns like spiffs_obj_map_find_id_and_span.
+static s32_t spiffs_obj_map_find_name(
+    spiffs *fs,
+    const u8_t name[SPIFFS_OBJ_NAME_LEN],
+    spiffs_page_ix *pix) {
+  s32_t res;
+  spiffs_obj_map_entry *map = (spiffs_obj_map_entry *)fs->obj_map;
+  u16_t name_hash = spiffs_obj_map_name_hash(fs, name);
+  spiffs_page_object_ix_header objix_hdr;
+  u32_t i;
+  if (fs->obj_map_lost) {
+    return SPIFFS_VIS_COUNTINUE;
+  }
+  for (i = 0; i < fs->obj_map_entries; i++) {
+    spiffs_obj_map_entry *e = &map[i];
+    if (e->obj_id == SPIFFS_OBJ_ID_FREE || e->spix != 0) continue;
+    if (e->name_hash != 0 && e->name_hash != name_hash) continue;
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+        0, SPIFFS_PAGE_TO_PADDR(fs, e->pix), sizeof(spiffs_page_object_ix_header), (u8_t *)&objix_hdr);
+    SPIFFS_CHECK_RES(res);
+    if (objix_hdr.p_hdr.obj_id != (e->obj_id | SPIFFS_OBJ_ID_IX_FLAG) ||
+        objix_hdr.p_hdr.span_ix != 0 ||
+        (objix_hdr.p_hdr.flags & (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_IXDELE)) !=
+            (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_IXDELE)) {
+      SPIFFS_DBG("obj_map: header "_SPIPRIid" not at "_SPIPRIpg", scanning\n", e->obj_id, e->pix);
+      spiffs_obj_map_remove(fs, e);
+      return SPIFFS_VIS_COUNTINUE;
+    }
+    if (strcmp((const char*)name, (char*)objix_hdr.name) == 0) {
+      e->name_hash = name_hash;
+      *pix = e->pix;
+      return SPIFFS_OK;
+    }
+    e->name_hash = spiffs_obj_map_name_hash(fs, objix_hdr.name);
+  }
+  return SPIFFS_ERR_NOT_FOUND;
+}
+
+static s32_t spiffs_obj_map_rebuild_v(
+    spiffs *fs,
+    spiffs_obj_id obj_id,
+    spiffs_block_ix bix,
+    int ix_entry,
+    const void *user_const_p,
+    void *user_var_p) {
+  (void)user_const_p;
+  (void)user_var_p;
+  s32_t res;
+  spiffs_page_object_ix_header objix_hdr;
+  spiffs_page_ix pix = SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, bix, ix_entry);
+  if (obj_id == SPIFFS_OBJ_ID_FREE || obj_id == SPIFFS_OBJ_ID_DELETED ||
+      (obj_id & SPIFFS_OBJ_ID_IX_FLAG) == 0) {
+    return SPIFFS_VIS_COUNTINUE;
+  }
+  res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+      0, SPIFFS_PAGE_TO_PADDR(fs, pix), sizeof(spiffs_page_object_ix_header), (u8_t *)&objix_hdr);
+  SPIFFS_CHECK_RES(res);
+  // enter the pages spiffs_obj_lu_find_id_and_span would find
+  if (objix_hdr.p_hdr.obj_id == obj_id &&
+      (objix_hdr.p_hdr.flags & (SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_USED)) == SPIFFS_PH_FLAG_DELET &&
+      !((objix_hdr.p_hdr.flags & SPIFFS_PH_FLAG_IXDELE) == 0 && objix_hdr.p_hdr.span_ix == 0)) {
+    spiffs_obj_map_put(fs, obj_id, objix_hdr.p_hdr.span_ix, pix,
+        objix_hdr.p_hdr.span_ix == 0 ? objix_hdr.name : 0);
+  }
+  return SPIFFS_VIS_COUNTINUE;
+}
+
+// Builds the object index page map from the lookup pages
+s32_t spiffs_obj_map_rebuild(spiffs *fs) {
+  s32_t res;
+  memset(fs->obj_map, 0xff, fs->obj_map_entries * sizeof(spiffs_obj_map_entry));
+  fs->obj_map_used = 0;
+  fs->obj_map_lost = 0;
+  res = spiffs_obj_lu_find_entry_visitor(fs, 0, 0, 0, 0, spiffs_obj_map_rebuild_v, 0, 0, 0, 0);
+  if (res == SPIFFS_VIS_END) {
+    res = SPIFFS_OK;
+  }
+  SPIFFS_DBG("obj_map: "_SPIPRIi" of "_SPIPRIi" entries used%s\n",
+      fs->obj_map_used, fs->obj_map_entries, fs->obj_map_lost ? ", headers lost" : "");
+  return res;
+}
+
+// Takes the map back after a check, which may have moved any page
+void spiffs_obj_map_resume(spiffs *fs, void *obj_map) {
+  fs->obj_map = obj_map;
+  if (obj_map && spiffs_obj_map_rebuild(fs) != SPIFFS_OK) {
+    // lookups scan until the map is given again
+    fs->obj_map = 0;
+  }
+}
+
+#endif // SPIFFS_OBJ_MAP
+
 // Find object lookup entry containing given id and span index
 // Iterate over object lookup pages in each block until a given object id entry is found
 s32_t spiffs_obj_lu_find_id_and_span(
@@ -534,6 +771,22 @@ s32_t spiffs_obj_lu_find_id_and_span(
   spiffs_block_ix bix;
   int entry;
 
+#if SPIFFS_OBJ_MAP
+  if (fs->obj_map && (obj_id & SPIFFS_OBJ_ID_IX_FLAG)) {
+    spiffs_page_ix map_pix = 0;
+    res = spiffs_obj_map_find_id_and_span(fs, obj_id, spix, exclusion_pix, &map_pix);
+    if (res != SPIFFS_VIS_COUNTINUE) {
+      SPIFFS_CHECK_RES(res);
+      fs->obj_map_hits++;
+      if (pix) {
+        *pix = map_pix;
+      }
+      return res;
+    }
+    fs->obj_map_scans++;
+  }
+#endif
+
   res = spiffs_obj_lu_find_entry_visitor(fs,
       fs->cursor_block_ix,
       fs->cursor_obj_lu_entry,
@@ -558,6 +811,12 @@ s32_t spiffs_obj_lu_find_id_and_span(
   fs->cursor_block_ix = bix;
   fs->cursor_obj_lu_entry = entry;
 
+#if SPIFFS_OBJ_MAP
+  if (fs->obj_map && (obj_id & SPIFFS_OBJ_ID_IX_FLAG)) {
+    spiffs_obj_map_put(fs, obj_id, spix, SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, bix, entry), 0);
+  }
+#endif
+
   return res;
 }
 
@@ -831,6 +1090,15 @@ s32_t spiffs_page_move(
 
   if (dst_pix) *dst_pix = free_pix;
 
+  // mark entry in destination object lookup, before the page as
+  // spiffs_page_allocate_data does: a cut in between leaves no written page
+  // behind a free entry, which SPIFFS_check_fast does not read
+  res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_UPDT,
+      0, SPIFFS_BLOCK_TO_PADDR(fs, SPIFFS_BLOCK_FOR_PAGE(fs, free_pix)) + SPIFFS_OBJ_LOOKUP_ENTRY_FOR_PAGE(fs, free_pix) * sizeof(spiffs_page_ix),
+      sizeof(spiffs_obj_id),
+      (u8_t *)&obj_id);
+  SPIFFS_CHECK_RES(res);
+
   p_hdr = page_data ? (spiffs_page_header *)page_data : page_hdr;
   if (page_data) {
     // got page data
@@ -846,13 +1114,6 @@ s32_t spiffs_page_move(
   }
   SPIFFS_CHECK_RES(res);
 
-  // mark entry in destination object lookup
-  res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_UPDT,
-      0, SPIFFS_BLOCK_TO_PADDR(fs, SPIFFS_BLOCK_FOR_PAGE(fs, free_pix)) + SPIFFS_OBJ_LOOKUP_ENTRY_FOR_PAGE(fs, free_pix) * sizeof(spiffs_page_ix),
-      sizeof(spiffs_obj_id),
-      (u8_t *)&obj_id);
-  SPIFFS_CHECK_RES(res);
-
   fs->stats_p_allocated++;
 
   if (was_final) {
@@ -877,18 +1138,6 @@ s32_t spiffs_page_delete(
     spiffs *fs,
     spiffs_page_ix pix) {
   s32_t res;
-  // mark deleted entry in source object lookup
-  spiffs_obj_id d_obj_id = SPIFFS_OBJ_ID_DELETED;
-  res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_DELE,
-      0,
-      SPIFFS_BLOCK_TO_PADDR(fs, SPIFFS_BLOCK_FOR_PAGE(fs, pix)) + SPIFFS_OBJ_LOOKUP_ENTRY_FOR_PAGE(fs, pix) * sizeof(spiffs_page_ix),
-      sizeof(spiffs_obj_id),
-      (u8_t *)&d_obj_id);
-  SPIFFS_CHECK_RES(res);
-
-  fs->stats_p_deleted++;
-  fs->stats_p_allocated--;
-
 #if SPIFFS_SECURE_ERASE
   // Secure erase
   unsigned char data[SPIFFS_CFG_LOG_PAGE_SZ(fs) - sizeof(spiffs_page_header)];
@@ -912,6 +1161,21 @@ s32_t spiffs_page_delete(
       0,
       SPIFFS_PAGE_TO_PADDR(fs, pix) + offsetof(spiffs_page_header, flags),
       sizeof(flags), &flags);
+  SPIFFS_CHECK_RES(res);
+
+  // mark deleted entry in source object lookup, after the page: a cut in
+  // between leaves no live page behind a deleted entry, which
+  // SPIFFS_check_fast does not read
+  spiffs_obj_id d_obj_id = SPIFFS_OBJ_ID_DELETED;
+  res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_DELE,
+      0,
+      SPIFFS_BLOCK_TO_PADDR(fs, SPIFFS_BLOCK_FOR_PAGE(fs, pix)) + SPIFFS_OBJ_LOOKUP_ENTRY_FOR_PAGE(fs, pix) * sizeof(spiffs_page_ix),
+      sizeof(spiffs_obj_id),
+      (u8_t *)&d_obj_id);
+  SPIFFS_CHECK_RES(res);
+
+  fs->stats_p_deleted++;
+  fs->stats_p_allocated--;
 
   return res;
 }
@@ -1126,6 +1390,19 @@ void spiffs_cb_object_event(
     }
   } // fd update loop
 
+#if SPIFFS_OBJ_MAP
+  // update object index page map, the name is in objix unless the page was
+  // moved by its header alone
+  if (fs->obj_map) {
+    if (ev == SPIFFS_EV_IX_DEL) {
+      spiffs_obj_map_drop(fs, obj_id, spix, new_pix);
+    } else {
+      spiffs_obj_map_put(fs, obj_id, spix, new_pix,
+          (spix == 0 && ev != SPIFFS_EV_IX_MOV) ? ((spiffs_page_object_ix_header *)objix)->name : 0);
+    }
+  }
+#endif
+
 #if SPIFFS_IX_MAP
 
   // update index maps
@@ -1708,6 +1985,22 @@ s32_t spiffs_object_find_object_index_header_by_name(
   spiffs_block_ix bix;
   int entry;
 
+#if SPIFFS_OBJ_MAP
+  if (fs->obj_map) {
+    spiffs_page_ix map_pix = 0;
+    res = spiffs_obj_map_find_name(fs, name, &map_pix);
+    if (res != SPIFFS_VIS_COUNTINUE) {
+      SPIFFS_CHECK_RES(res);
+      fs->obj_map_hits++;
+      if (pix) {
+        *pix = map_pix;
+      }
+      return res;
+    }
+    fs->obj_map_scans++;
+  }
+#endif
+
   res = spiffs_obj_lu_find_entry_visitor(fs,
       fs->cursor_block_ix,
       fs->cursor_obj_lu_entry,
@@ -1839,7 +2132,11 @@ s32_t spiffs_object_truncate(
 
     SPIFFS_DBG("truncate: got data pix "_SPIPRIpg"\n", data_pix);
 
-    if (new_size == 0 || remove_full || cur_size - new_size >= SPIFFS_DATA_PAGE_SIZE(fs)) {
+    // the whole page goes unless the new end lies within it: a partially
+    // filled last page may be less than a page past the new end and still
+    // lie wholly beyond it
+    if (new_size == 0 || remove_full ||
+        new_size <= (u32_t)data_spix * SPIFFS_DATA_PAGE_SIZE(fs)) {
       // delete full data page
       res = spiffs_page_data_check(fs, fd, data_pix, data_spix);
       if (res != SPIFFS_ERR_DELETED && res != SPIFFS_OK && res != SPIFFS_ERR_INDEX_REF_FREE) {
@@ -2237,20 +2534,6 @@ s32_t spiffs_obj_lu_find_free_obj_id(spiffs *fs, spiffs_obj_id *obj_id, const u8
 }
 #endif // !SPIFFS_READ_ONLY
 
-#if SPIFFS_TEMPORAL_FD_CACHE
-// djb2 hash
-static u32_t spiffs_hash(spiffs *fs, const u8_t *name) {
-  (void)fs;
-  u32_t hash = 5381;
-  u8_t c;
-  int i = 0;
-  while ((c = name[i++]) && i < SPIFFS_OBJ_NAME_LEN) {
-    hash = (hash * 33) ^ c;
-  }
-  return hash;
-}
-#endif
-
 s32_t spiffs_fd_find_new(spiffs *fs, spiffs_fd **fd, const char *name) {
 #if SPIFFS_TEMPORAL_FD_CACHE
   u32_t i;
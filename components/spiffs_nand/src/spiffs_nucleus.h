@@ -383,6 +383,7 @@
 #define SPIFFS_CACHE_FLAG_OBJLU       (1<<2)
 #define SPIFFS_CACHE_FLAG_OBJIX       (1<<3)
 #define SPIFFS_CACHE_FLAG_DATA        (1<<4)
+#define SPIFFS_CACHE_FLAG_HOT         (1<<5)
 #define SPIFFS_CACHE_FLAG_TYPE_WR     (1<<7)
 
 #define SPIFFS_CACHE_PAGE_SIZE(fs) \
@@ -432,6 +433,11 @@ typedef struct {
   u32_t cpage_use_map;
   u32_t cpage_use_mask;
   u8_t *cpages;
+#if SPIFFS_CACHE_2Q
+  // ring of recently evicted pages
+  spiffs_page_ix ghosts[SPIFFS_CACHE_2Q_GHOSTS];
+  u8_t ghost_next;
+#endif
 } spiffs_cache;
 
 #endif
@@ -633,6 +639,15 @@ s32_t spiffs_obj_lu_find_id_and_span_by_phdr(
     spiffs_page_ix exclusion_pix,
     spiffs_page_ix *pix);
 
+#if SPIFFS_OBJ_MAP
+s32_t spiffs_obj_map_rebuild(
+    spiffs *fs);
+
+void spiffs_obj_map_resume(
+    spiffs *fs,
+    void *obj_map);
+#endif
+
 // ---------------
 
 s32_t spiffs_page_allocate_data(
@@ -763,6 +778,11 @@ s32_t spiffs_gc_clean(
 s32_t spiffs_gc_quick(
     spiffs *fs, u16_t max_free_pages);
 
+#if SPIFFS_GC_INCREMENTAL
+s32_t spiffs_gc_step(
+    spiffs *fs, u32_t max_moves);
+#endif
+
 // ---------------
 
 s32_t spiffs_fd_find_new(
@@ -819,6 +839,16 @@ s32_t spiffs_page_consistency_check(
 s32_t spiffs_object_index_consistency_check(
     spiffs *fs);
 
+#if SPIFFS_CHECK_FAST
+s32_t spiffs_check_fast(
+    spiffs *fs,
+    u8_t *work,
+    u32_t work_size);
+
+u32_t spiffs_check_fast_work_size(
+    spiffs *fs);
+#endif
+
 // memcpy macro,
 // checked in test builds, otherwise plain memcpy (unless already defined)
 #ifdef _SPIFFS_TEST
@@ -95,6 +95,28 @@ esp_err_t sps30_stop_measurement(sps30_handle_t handle);
 esp_err_t sps30_read_measurement(sps30_handle_t handle, 
                                  sps30_measurement_t *measurement);
 
+/*
+ * @brief Send the read measurement command without waiting for the data
+ *
+ * Read the data with sps30_fetch_measurement() once ready_ms have passed;
+ * the bus is free in between.
+ *
+ * @param[in] handle SPS30 device handle
+ * @param[out] ready_ms Milliseconds until the data can be fetched
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t sps30_start_read_measurement(sps30_handle_t handle, uint32_t *ready_ms);
+
+/*
+ * @brief Fetch the data of a read started with sps30_start_read_measurement()
+ *
+ * @param[in] handle SPS30 device handle
+ * @param[out] measurement Measurement data structure
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t sps30_fetch_measurement(sps30_handle_t handle,
+                                  sps30_measurement_t *measurement);
+
 /*
  * @brief Soft-reset SPS30 sensor
  *
@@ -121,6 +143,24 @@ esp_err_t sps30_read_status_register(sps30_handle_t handle, uint32_t *status);
  */
 esp_err_t sps30_read_data_ready(sps30_handle_t handle, bool *ready);
 
+/*
+ * @brief Send the data-ready command without waiting for the flag
+ *
+ * @param[in] handle SPS30 device handle
+ * @param[out] ready_ms Milliseconds until the flag can be fetched
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t sps30_start_read_data_ready(sps30_handle_t handle, uint32_t *ready_ms);
+
+/*
+ * @brief Fetch the flag of a check started with sps30_start_read_data_ready()
+ *
+ * @param[in] handle SPS30 device handle
+ * @param[out] ready True if data is ready
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t sps30_fetch_data_ready(sps30_handle_t handle, bool *ready);
+
 /*
  * @brief Enter sleep mode (power <50 μA)
  *
@@ -137,6 +177,17 @@ esp_err_t sps30_sleep(sps30_handle_t handle);
  */
 esp_err_t sps30_wakeup(sps30_handle_t handle);
 
+/*
+ * @brief Send the wake-up command without waiting
+ *
+ * The sensor accepts no command until ready_ms have passed.
+ *
+ * @param[in] handle SPS30 device handle
+ * @param[out] ready_ms Milliseconds until the next command
+ * @return esp_err_t ESP_OK on success
+ */
+esp_err_t sps30_send_wakeup(sps30_handle_t handle, uint32_t *ready_ms);
+
 /*
  * @brief Remove and delete SPS30 device handle
  *
@@ -228,9 +228,9 @@ static float extract_float_i2c(const uint8_t *data)
  * 1 Float (4 bytes) = 2 words = 6 bytes ([MSB][LSB][CRC][MSB][LSB][CRC])
  * 10 Floats = 60 bytes total
  */
-esp_err_t sps30_read_measurement(sps30_handle_t handle, sps30_measurement_t *measurement)
+esp_err_t sps30_start_read_measurement(sps30_handle_t handle, uint32_t *ready_ms)
 {
-    if (!handle || !measurement) {
+    if (!handle || !ready_ms) {
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -246,12 +246,20 @@ esp_err_t sps30_read_measurement(sps30_handle_t handle, sps30_measurement_t *mea
         return ret;
     }
 
-    // Delay for sensor to prepare data
-    vTaskDelay(pdMS_TO_TICKS(10));
+    // Time for sensor to prepare data
+    *ready_ms = 10;
+    return ESP_OK;
+}
+
+esp_err_t sps30_fetch_measurement(sps30_handle_t handle, sps30_measurement_t *measurement)
+{
+    if (!handle || !measurement) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
     // Read 60 bytes: 10 floats × 6 bytes (4 data + 2 CRC)
     uint8_t buffer[60];
-    ret = sps30_i2c_read(handle, buffer, 60);
+    esp_err_t ret = sps30_i2c_read(handle, buffer, 60);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to read measurement data");
         return ret;
@@ -275,6 +283,24 @@ esp_err_t sps30_read_measurement(sps30_handle_t handle, sps30_measurement_t *mea
     return ESP_OK;
 }
 
+esp_err_t sps30_read_measurement(sps30_handle_t handle, sps30_measurement_t *measurement)
+{
+    if (!handle || !measurement) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t ready_ms = 0;
+    esp_err_t ret = sps30_start_read_measurement(handle, &ready_ms);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Delay for sensor to prepare data
+    vTaskDelay(pdMS_TO_TICKS(ready_ms));
+
+    return sps30_fetch_measurement(handle, measurement);
+}
+
 /*
  * Reset
  */
@@ -338,9 +364,9 @@ esp_err_t sps30_read_status_register(sps30_handle_t handle, uint32_t *status)
 /*
  * Read Data-Ready Flag (0x0202)
  */
-esp_err_t sps30_read_data_ready(sps30_handle_t handle, bool *ready)
+esp_err_t sps30_start_read_data_ready(sps30_handle_t handle, uint32_t *ready_ms)
 {
-    if (!handle || !ready) {
+    if (!handle || !ready_ms) {
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -351,11 +377,19 @@ esp_err_t sps30_read_data_ready(sps30_handle_t handle, bool *ready)
         return ret;
     }
 
-    vTaskDelay(pdMS_TO_TICKS(5));
+    *ready_ms = 5;
+    return ESP_OK;
+}
+
+esp_err_t sps30_fetch_data_ready(sps30_handle_t handle, bool *ready)
+{
+    if (!handle || !ready) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
     // Read 3 bytes: [MSB][LSB][CRC]
     uint8_t buffer[3];
-    ret = sps30_i2c_read(handle, buffer, 3);
+    esp_err_t ret = sps30_i2c_read(handle, buffer, 3);
     if (ret != ESP_OK) {
         return ret;
     }
@@ -363,10 +397,27 @@ esp_err_t sps30_read_data_ready(sps30_handle_t handle, bool *ready)
     uint16_t flag = ((uint16_t)buffer[0] << 8) | buffer[1];
     *ready = (flag == 0x0001);
     
-    ESP_LOGI(TAG, "Data-ready flag: 0x%04X (%s)", flag, *ready ? "READY" : "NOT READY");
+    ESP_LOGD(TAG, "Data-ready flag: 0x%04X (%s)", flag, *ready ? "READY" : "NOT READY");
     return ESP_OK;
 }
 
+esp_err_t sps30_read_data_ready(sps30_handle_t handle, bool *ready)
+{
+    if (!handle || !ready) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t ready_ms = 0;
+    esp_err_t ret = sps30_start_read_data_ready(handle, &ready_ms);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(ready_ms));
+
+    return sps30_fetch_data_ready(handle, ready);
+}
+
 /*
  * Enter sleep mode (CMD 0x1001) - power consumption <50 μA
  */
@@ -394,9 +445,9 @@ esp_err_t sps30_sleep(sps30_handle_t handle)
  * Wake up from sleep mode (CMD 0x1103)
  * Special sequence: send wake-up, wait 100ms
  */
-esp_err_t sps30_wakeup(sps30_handle_t handle)
+esp_err_t sps30_send_wakeup(sps30_handle_t handle, uint32_t *ready_ms)
 {
-    if (!handle) {
+    if (!handle || !ready_ms) {
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -410,7 +461,19 @@ esp_err_t sps30_wakeup(sps30_handle_t handle)
     }
 
     // Wake-up requires 100ms before next command per datasheet
-    vTaskDelay(pdMS_TO_TICKS(100));
+    *ready_ms = 100;
+    return ESP_OK;
+}
+
+esp_err_t sps30_wakeup(sps30_handle_t handle)
+{
+    uint32_t ready_ms = 0;
+    esp_err_t ret = sps30_send_wakeup(handle, &ready_ms);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(ready_ms));
     ESP_LOGI(TAG, "SPS30 woke up from sleep");
     return ESP_OK;
 }
@@ -147,6 +147,49 @@ esp_err_t stcc4_stop_continuous_measurement(stcc4_dev_t *dev);
  */
 esp_err_t stcc4_read_measurement(stcc4_dev_t *dev, stcc4_measurement_t *measurement);
 
+/**
+ * @brief Send the read measurement command without waiting for it
+ * 
+ * First half of stcc4_read_measurement(): call stcc4_fetch_measurement()
+ * once ready_ms have passed. The bus is free in between.
+ * 
+ * @param dev Device handle
+ * @param[out] ready_ms Milliseconds until the data can be fetched
+ * @return ESP_OK on success
+ */
+esp_err_t stcc4_start_read_measurement(stcc4_dev_t *dev, uint32_t *ready_ms);
+
+/**
+ * @brief Fetch the data of a read started with stcc4_start_read_measurement()
+ * 
+ * @param dev Device handle
+ * @param[out] measurement Measurement data structure
+ * @return ESP_OK on success, ESP_ERR_INVALID_RESPONSE if no data available
+ */
+esp_err_t stcc4_fetch_measurement(stcc4_dev_t *dev, stcc4_measurement_t *measurement);
+
+/**
+ * @brief Send the stop continuous measurement command without waiting
+ * 
+ * The sensor takes ready_ms to stop and accepts no command before then.
+ * 
+ * @param dev Device handle
+ * @param[out] ready_ms Milliseconds until the sensor is idle
+ * @return ESP_OK on success
+ */
+esp_err_t stcc4_send_stop_continuous_measurement(stcc4_dev_t *dev, uint32_t *ready_ms);
+
+/**
+ * @brief Send the conditioning command without waiting
+ * 
+ * As stcc4_perform_conditioning(); the sensor is busy for ready_ms.
+ * 
+ * @param dev Device handle
+ * @param[out] ready_ms Milliseconds until conditioning completes
+ * @return ESP_OK on success
+ */
+esp_err_t stcc4_send_conditioning(stcc4_dev_t *dev, uint32_t *ready_ms);
+
 /**
  * @brief Perform single-shot measurement
  * 
@@ -223,8 +223,8 @@ esp_err_t stcc4_start_continuous_measurement(stcc4_dev_t *dev) {
     return ESP_OK;
 }
 
-esp_err_t stcc4_stop_continuous_measurement(stcc4_dev_t *dev) {
-    if (!dev || !dev->initialized) {
+esp_err_t stcc4_send_stop_continuous_measurement(stcc4_dev_t *dev, uint32_t *ready_ms) {
+    if (!dev || !dev->initialized || !ready_ms) {
         return ESP_ERR_INVALID_STATE;
     }
     
@@ -234,14 +234,25 @@ esp_err_t stcc4_stop_continuous_measurement(stcc4_dev_t *dev) {
         return ret;
     }
     
-    vTaskDelay(pdMS_TO_TICKS(STCC4_EXEC_STOP_CONTINUOUS));
+    *ready_ms = STCC4_EXEC_STOP_CONTINUOUS;
+    return ESP_OK;
+}
+
+esp_err_t stcc4_stop_continuous_measurement(stcc4_dev_t *dev) {
+    uint32_t ready_ms = 0;
+    esp_err_t ret = stcc4_send_stop_continuous_measurement(dev, &ready_ms);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    vTaskDelay(pdMS_TO_TICKS(ready_ms));
     
     ESP_LOGI(TAG, "Continuous measurement stopped");
     return ESP_OK;
 }
 
-esp_err_t stcc4_read_measurement(stcc4_dev_t *dev, stcc4_measurement_t *measurement) {
-    if (!dev || !dev->initialized || !measurement) {
+esp_err_t stcc4_start_read_measurement(stcc4_dev_t *dev, uint32_t *ready_ms) {
+    if (!dev || !dev->initialized || !ready_ms) {
         return ESP_ERR_INVALID_ARG;
     }
     
@@ -252,11 +263,18 @@ esp_err_t stcc4_read_measurement(stcc4_dev_t *dev, stcc4_measurement_t *measurem
         return ret;
     }
     
-    vTaskDelay(pdMS_TO_TICKS(STCC4_EXEC_READ_MEASUREMENT));
+    *ready_ms = STCC4_EXEC_READ_MEASUREMENT;
+    return ESP_OK;
+}
+
+esp_err_t stcc4_fetch_measurement(stcc4_dev_t *dev, stcc4_measurement_t *measurement) {
+    if (!dev || !dev->initialized || !measurement) {
+        return ESP_ERR_INVALID_ARG;
+    }
     
     // Read all measurement data (12 bytes: 4 words × (2 bytes + 1 CRC))
     uint8_t buf[12];
-    ret = stcc4_i2c_read(dev, buf, 12);
+    esp_err_t ret = stcc4_i2c_read(dev, buf, 12);
     if (ret != ESP_OK) {
         ESP_LOGW(TAG, "Failed to read measurement data: %s", esp_err_to_name(ret));
         return ret;
@@ -300,6 +318,22 @@ esp_err_t stcc4_read_measurement(stcc4_dev_t *dev, stcc4_measurement_t *measurem
     return ESP_OK;
 }
 
+esp_err_t stcc4_read_measurement(stcc4_dev_t *dev, stcc4_measurement_t *measurement) {
+    if (!dev || !dev->initialized || !measurement) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    uint32_t ready_ms = 0;
+    esp_err_t ret = stcc4_start_read_measurement(dev, &ready_ms);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    vTaskDelay(pdMS_TO_TICKS(ready_ms));
+    
+    return stcc4_fetch_measurement(dev, measurement);
+}
+
 esp_err_t stcc4_measure_single_shot(stcc4_dev_t *dev) {
     if (!dev || !dev->initialized) {
         return ESP_ERR_INVALID_STATE;
@@ -368,8 +402,8 @@ esp_err_t stcc4_set_pressure_compensation(stcc4_dev_t *dev, uint16_t pressure_pa
     return ESP_OK;
 }
 
-esp_err_t stcc4_perform_conditioning(stcc4_dev_t *dev) {
-    if (!dev || !dev->initialized) {
+esp_err_t stcc4_send_conditioning(stcc4_dev_t *dev, uint32_t *ready_ms) {
+    if (!dev || !dev->initialized || !ready_ms) {
         return ESP_ERR_INVALID_STATE;
     }
     
@@ -379,7 +413,18 @@ esp_err_t stcc4_perform_conditioning(stcc4_dev_t *dev) {
         return ret;
     }
     
-    vTaskDelay(pdMS_TO_TICKS(STCC4_EXEC_CONDITIONING));
+    *ready_ms = STCC4_EXEC_CONDITIONING;
+    return ESP_OK;
+}
+
+esp_err_t stcc4_perform_conditioning(stcc4_dev_t *dev) {
+    uint32_t ready_ms = 0;
+    esp_err_t ret = stcc4_send_conditioning(dev, &ready_ms);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    vTaskDelay(pdMS_TO_TICKS(ready_ms));
     
     ESP_LOGI(TAG, "Sensor conditioning completed");
     return ESP_OK;
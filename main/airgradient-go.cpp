@@ -6,6 +6,8 @@
 #include "color_utils.h"
 #include "led_effects.h"
 #include "sensor.h"
+#include "sensor_bus.h"
+#include "spi_bus.h"
 #include "ui_display.h"
 #include "i2c_scanner.h"
 
@@ -26,6 +28,7 @@
 #include "epaper_panel.h"
 #include "lvgl.h"
 
+#include <math.h>
 #include <string.h>
 
 // Display resolution selector
@@ -72,9 +75,20 @@
 #define HW_WD_PULSE_MS 20
 #define HW_WD_KICK_INTERVAL_MS (4 * 60 * 1000ULL) // Kick before 5 min timeout
 
+// Sensor task: one frame a second, published this long after the 1 s grid
+// the sensor reads are aligned to, once their fetches have come back
+#define SENSOR_FRAME_PERIOD_MS 1000
+#define SENSOR_FRAME_PHASE_MS 100
+// A sensor pass this close before the frame publishes it, so the frame
+// costs no wakeup of its own (the +60 ms SPS30 fetch usually carries it)
+#define SENSOR_FRAME_EARLY_MS 50
+#define SENSOR_TASK_PRIORITY 5  // Above the display and LVGL tasks
+#define STORAGE_SINK_PRIORITY 2
+
 static SemaphoreHandle_t lvgl_mux = NULL;
 static bool shutdown_requested = false;
 static volatile bool display_task_running = true;
+static volatile bool sensor_task_running = true;
 static Display *g_display = nullptr;
 static epd_handle_t g_epd = nullptr;
 static lv_display_t *g_disp = nullptr;
@@ -84,6 +98,8 @@ static CAP1203 *g_buttons = nullptr;
 static GPS *g_gps = nullptr;
 static Sensors *g_sensors = nullptr;
 static TaskHandle_t g_display_task_handle = nullptr;
+static TaskHandle_t g_sensor_task_handle = nullptr;
+static SemaphoreHandle_t g_sensor_task_done = nullptr;  // Given as sensor_task exits
 static Display::FocusTile g_focus_tile = Display::FocusTile::CO2;
 static volatile bool g_focus_dirty = true;
 static volatile bool g_lvgl_refresh_requested = false;
@@ -109,10 +125,9 @@ struct BatterySOCState {
 
 static BatterySOCState g_battery_soc = {};
 
+// Sensor values reach display_task through its own sensor bus subscription
 struct DisplaySnapshot {
-  sensor_values_t sensor = {};
-  bool sensor_valid = false;
-  uint64_t sensor_update_ms = 0;
+  bool alert = false;
   int battery_percent = 0;
   bool battery_charging = false;
   bool battery_valid = false;
@@ -196,6 +211,11 @@ static void initiate_shutdown(void);
 static void qon_button_task(void *arg);
 static void lv_handler_task(void *arg);
 static void display_task(void *arg);
+static void sensor_task(void *arg);
+static void storage_sink_task(void *arg);
+static esp_err_t start_sensor_tasks(Sensors *sensors);
+static bool air_alert_from_values(const sensor_values_t &values);
+static void log_sensor_bus_stats(const char *tag);
 
 // Application entry point.
 // Phase 1.1: Dashboard display with real sensor data
@@ -254,18 +274,22 @@ extern "C" void app_main(void) {
   // Initialize LVGL
   lv_init();
 
+  // SPI2 is shared with the NAND; refreshes claim it through the arbiter
+  ESP_ERROR_CHECK(spi_bus_arbiter_init());
+  const spi_bus_profile_t *epd_bus = spi_bus_profile(SPI_BUS_DEV_EPD);
+
   // Configure e-paper display (hardware width is byte-aligned for driver)
   // MISO is set to GPIO24 to share SPI bus with W25N512 NAND flash
   epd_config_t epd_cfg = EPD_CONFIG_DEFAULT();
   epd_cfg.pins.busy = 10; // IO10
   epd_cfg.pins.rst = 9;   // IO9
   epd_cfg.pins.dc = 15;   // IO15
-  epd_cfg.pins.cs = 0;    // IO0
+  epd_cfg.pins.cs = epd_bus->cs_pin; // IO0
   epd_cfg.pins.sck = 23;  // IO23
   epd_cfg.pins.mosi = 25; // IO25
   epd_cfg.pins.miso = 24; // IO24 - shared with NAND flash
   epd_cfg.spi.host = SPI2_HOST;
-  epd_cfg.spi.speed_hz = 4000000; // 4 MHz (same as working ESP32-C6 code)
+  epd_cfg.spi.speed_hz = epd_bus->clock_hz; // 4 MHz (same as working ESP32-C6 code)
   epd_cfg.panel.type = DISPLAY_PANEL_TYPE; // Panel type based on resolution
   epd_cfg.panel.width = DISPLAY_HW_WIDTH;
   epd_cfg.panel.height = DISPLAY_HEIGHT;
@@ -537,10 +561,18 @@ extern "C" void app_main(void) {
                           6, // High priority for shutdown detection
                           NULL, tskNO_AFFINITY);
 
+  // ==================== SENSOR TASK ====================
+  ret = start_sensor_tasks(&sensors_static);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start sensor task: %s", esp_err_to_name(ret));
+  }
+
   ESP_LOGI(TAG, "Sensor mode active; auto-updating every 1s.");
-  uint64_t static_last_sensor_update_ms = 0;
-  uint64_t static_last_display_update_ms = 0;
-  const uint64_t STATIC_DISPLAY_UPDATE_INTERVAL_MS = 100;  // Update display snapshot every 100ms
+  uint64_t static_last_gps_update_ms = 0;
+  uint64_t static_last_frame_poll_ms = 0;
+  const uint64_t STATIC_FRAME_POLL_INTERVAL_MS = 100;  // LED and alert frames
+  uint32_t static_alert_seq = 0;
+  bool static_alert = false;
   uint64_t static_last_summary_ms = 0;
   const uint64_t STATIC_SUMMARY_INTERVAL_MS = 5000;  // Log summary every 5 seconds
   const uint64_t STATIC_GPS_UI_UPDATE_INTERVAL_MS = 1000;  // Update GPS UI every 1 second
@@ -584,50 +616,56 @@ extern "C" void app_main(void) {
 #if LED_ENABLED
   AirLevel prev_pm_level = AirLevel::Green;  // Track previous PM2.5 level
   AirLevel prev_co2_level = AirLevel::Green;  // Track previous CO2 level
+  uint32_t prev_led_seq = 0;
 #endif
   
   while (true) {
     int64_t now_ms = esp_timer_get_time() / 1000;
     uint64_t now_ms_u = (uint64_t)now_ms;
     
-    // Update GPS and sensors periodically (every 100ms)
-    if (now_ms_u - static_last_sensor_update_ms >= 100) {
+    // Update GPS periodically (every 100ms); sensors run in sensor_task
+    if (now_ms_u - static_last_gps_update_ms >= 100) {
       gps_static.update(now_ms_u);
-      sensors_static.update(now_ms);
-      static_last_sensor_update_ms = now_ms_u;
+      static_last_gps_update_ms = now_ms_u;
     }
     
-    // Update display snapshot every 100ms (like DISPLAY_STATIC_TEST 0)
-    if (now_ms_u - static_last_display_update_ms >= STATIC_DISPLAY_UPDATE_INTERVAL_MS) {
-      static_last_display_update_ms = now_ms_u;
-      
-      sensor_values_t values = {};
-      sensors_static.getValues(now_ms, &values);
-      
-      // Update display snapshot for display_task to consume
-      if (g_display_data_mux &&
-          xSemaphoreTake(g_display_data_mux, pdMS_TO_TICKS(10)) == pdTRUE) {
-        g_display_snapshot.sensor = values;
-        g_display_snapshot.sensor_valid = true;
-        g_display_snapshot.sensor_update_ms = now_ms_u;
-        
-        // Battery status is updated separately in the charger logging section
-        // Don't overwrite here with hardcoded values
-        
-        xSemaphoreGive(g_display_data_mux);
+    // Take the LED and alert frames every 100ms
+    if (now_ms_u - static_last_frame_poll_ms >= STATIC_FRAME_POLL_INTERVAL_MS) {
+      static_last_frame_poll_ms = now_ms_u;
+      sensor_frame_t frame;
+
+      // Alerts see every frame, so a single bad reading is not missed
+      bool alert = static_alert;
+      while (sensor_bus_receive(SENSOR_SUB_ALERTS, &frame, 0)) {
+        static_alert_seq = frame.seq;
+        alert = air_alert_from_values(frame.values);
+      }
+      if (static_alert_seq != 0 && alert != static_alert) {
+        static_alert = alert;
+        ESP_LOGW(TAG, "Air quality alert %s (frame %lu)", alert ? "raised" : "cleared",
+                 (unsigned long)static_alert_seq);
+        if (g_display_data_mux &&
+            xSemaphoreTake(g_display_data_mux, pdMS_TO_TICKS(10)) == pdTRUE) {
+          g_display_snapshot.alert = alert;
+          xSemaphoreGive(g_display_data_mux);
+        }
       }
       
 #if LED_ENABLED
       // Update LED bar only if air quality levels changed
-      AirLevel pm_level = pm25_level_from_ugm3(values.pm25_mass);
-      AirLevel co2_level = values.have_co2_avg ? 
-                          co2_level_from_ppm(values.co2_ppm_avg) : AirLevel::Off;
-      
-      if (g_led_driver != nullptr && 
-          (pm_level != prev_pm_level || co2_level != prev_co2_level)) {
-        led_show_air_levels(pm_level, co2_level);
-        prev_pm_level = pm_level;
-        prev_co2_level = co2_level;
+      if (sensor_bus_latest(SENSOR_SUB_LED, &frame) && frame.seq != prev_led_seq) {
+        prev_led_seq = frame.seq;
+        const sensor_values_t &values = frame.values;
+        AirLevel pm_level = pm25_level_from_ugm3(values.pm25_mass);
+        AirLevel co2_level = values.have_co2_avg ? 
+                            co2_level_from_ppm(values.co2_ppm_avg) : AirLevel::Off;
+        
+        if (g_led_driver != nullptr && 
+            (pm_level != prev_pm_level || co2_level != prev_co2_level)) {
+          led_show_air_levels(pm_level, co2_level);
+          prev_pm_level = pm_level;
+          prev_co2_level = co2_level;
+        }
       }
 #endif
     }
@@ -722,8 +760,10 @@ extern "C" void app_main(void) {
         }
 
         if (vbus_stable_event) {
+          sensor_frame_t frame;
           bool sps30_reading =
-              sensors_static.isSps30Reading(now_ms, STATIC_SPS30_READ_STALE_MS);
+              sensor_bus_latest(SENSOR_SUB_SYSTEM, &frame) && frame.sps30_read_ms > 0 &&
+              now_ms - frame.sps30_read_ms <= STATIC_SPS30_READ_STALE_MS;
           if (!sps30_reading) {
             ESP_LOGW(TAG, "VBUS changed (%s), SPS30 not reading",
                      vbus_stable_present ? "present" : "absent");
@@ -1059,8 +1099,9 @@ extern "C" void app_main(void) {
     if (now_ms_u - static_last_summary_ms >= STATIC_SUMMARY_INTERVAL_MS) {
       static_last_summary_ms = now_ms_u;
       
-      sensor_values_t values = {};
-      sensors_static.getValues(now_ms, &values);
+      sensor_frame_t frame = {};
+      sensor_bus_latest(SENSOR_SUB_SYSTEM, &frame);
+      const sensor_values_t &values = frame.values;
 
       bool gps_fix_valid = gps_static.has_fix();
       bool gps_has_sentence = gps_static.has_recent_sentence(now_ms_u, 5000);
@@ -1073,6 +1114,9 @@ extern "C" void app_main(void) {
       ESP_LOGI(TAG, "  PM2.5: %.1f µg/m³ | VOC: %d | NOx: %d",
                values.pm25_mass, values.voc_index, values.nox_index);
       ESP_LOGI(TAG, "  Pressure: %.1f hPa", values.pressure_pa / 100.0f);
+      ESP_LOGI(TAG, "  Sensor update: worst %lld us | frame %lu",
+               (long long)frame.update_worst_us, (unsigned long)frame.seq);
+      log_sensor_bus_stats(TAG);
       ESP_LOGI(TAG, "  GPS: %s | Lat: %.6f | Lon: %.6f | ANT: %s",
                gps_state, gps_static.latitude_deg(), gps_static.longitude_deg(),
                antenna_status_to_string(ant_status));
@@ -1416,12 +1460,22 @@ extern "C" void app_main(void) {
                           6, // High priority for shutdown detection
                           NULL, tskNO_AFFINITY);
 
+  // ==================== SENSOR TASK ====================
+
+  ret = start_sensor_tasks(&sensors);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start sensor task: %s", esp_err_to_name(ret));
+  }
+
   // ==================== MAIN LOOP ====================
 
   ESP_LOGI(TAG, "Starting normal operation with real sensor values...");
 
-  uint64_t last_display_update_ms = 0;
-  const uint64_t DISPLAY_UPDATE_INTERVAL_MS = 100; // Update values every 100ms
+  uint64_t last_frame_poll_ms = 0;
+  const uint64_t FRAME_POLL_INTERVAL_MS = 100; // LED and alert frames every 100ms
+  uint32_t alert_seq = 0;
+  bool alert_active = false;
+  uint32_t last_led_seq = 0;
   const uint64_t GPS_UI_UPDATE_INTERVAL_MS = 1000;
   const uint64_t GPS_SENTENCE_TIMEOUT_MS = 3000;
   const uint64_t GPS_FIX_TIMEOUT_MS = 5000;
@@ -1469,48 +1523,56 @@ extern "C" void app_main(void) {
     int64_t now_ms = esp_timer_get_time() / 1000;
     uint64_t now_ms_u = (uint64_t)now_ms;
 
-    // Update sensors
-    sensors.update(now_ms);
-
     // Update GPS parser
     if (gps_ready) {
       gps.update(now_ms_u);
       gps.log_status(now_ms_u, GPS_SENTENCE_TIMEOUT_MS, GPS_FIX_TIMEOUT_MS);
     }
 
-    // Update display data snapshot for the display task
-    if (now_ms_u - last_display_update_ms >= DISPLAY_UPDATE_INTERVAL_MS) {
-      last_display_update_ms = now_ms_u;
-
-      sensor_values_t vals;
-      sensors.getValues(now_ms, &vals);
-
-      AirLevel pm_level = pm25_level_from_ugm3(vals.pm25_mass);
-      AirLevel co2_level =
-          vals.have_co2_avg ? co2_level_from_ppm(vals.co2_ppm_avg)
-                            : AirLevel::Off;
-      if (!led_levels_initialized || pm_level != last_pm_level ||
-          co2_level != last_co2_level) {
-        led_show_air_levels(pm_level, co2_level);
-        last_pm_level = pm_level;
-        last_co2_level = co2_level;
-        led_levels_initialized = true;
+    // Take the LED and alert frames; display_task reads its own
+    if (now_ms_u - last_frame_poll_ms >= FRAME_POLL_INTERVAL_MS) {
+      last_frame_poll_ms = now_ms_u;
+      sensor_frame_t frame;
+
+      bool alert = alert_active;
+      while (sensor_bus_receive(SENSOR_SUB_ALERTS, &frame, 0)) {
+        alert_seq = frame.seq;
+        alert = air_alert_from_values(frame.values);
+      }
+      if (alert_seq != 0 && alert != alert_active) {
+        alert_active = alert;
+        ESP_LOGW(TAG, "Air quality alert %s (frame %lu)", alert ? "raised" : "cleared",
+                 (unsigned long)alert_seq);
+        if (g_display_data_mux &&
+            xSemaphoreTake(g_display_data_mux, pdMS_TO_TICKS(10)) == pdTRUE) {
+          g_display_snapshot.alert = alert;
+          xSemaphoreGive(g_display_data_mux);
+        }
       }
 
-      if (g_display_data_mux &&
-          xSemaphoreTake(g_display_data_mux, pdMS_TO_TICKS(10)) == pdTRUE) {
-        g_display_snapshot.sensor = vals;
-        g_display_snapshot.sensor_valid = true;
-        g_display_snapshot.sensor_update_ms = now_ms_u;
-        xSemaphoreGive(g_display_data_mux);
+      if (sensor_bus_latest(SENSOR_SUB_LED, &frame) && frame.seq != last_led_seq) {
+        last_led_seq = frame.seq;
+        const sensor_values_t &vals = frame.values;
+        AirLevel pm_level = pm25_level_from_ugm3(vals.pm25_mass);
+        AirLevel co2_level =
+            vals.have_co2_avg ? co2_level_from_ppm(vals.co2_ppm_avg)
+                              : AirLevel::Off;
+        if (!led_levels_initialized || pm_level != last_pm_level ||
+            co2_level != last_co2_level) {
+          led_show_air_levels(pm_level, co2_level);
+          last_pm_level = pm_level;
+          last_co2_level = co2_level;
+          led_levels_initialized = true;
+        }
       }
     }
 
     // Consolidated sensor summary log every 5 seconds
     if (now_ms_u - last_sensor_summary_ms >= SENSOR_SUMMARY_INTERVAL_MS) {
       last_sensor_summary_ms = now_ms_u;
-      sensor_values_t vals;
-      sensors.getValues(now_ms, &vals);
+      sensor_frame_t frame = {};
+      sensor_bus_latest(SENSOR_SUB_SYSTEM, &frame);
+      const sensor_values_t &vals = frame.values;
 
       int battery_percent = -1;
       bool battery_valid = false;
@@ -1536,6 +1598,9 @@ extern "C" void app_main(void) {
       ESP_LOGI(TAG, "  PM2.5: %.1f µg/m³ | VOC: %d | NOx: %d",
                vals.pm25_mass, vals.voc_index, vals.nox_index);
       ESP_LOGI(TAG, "  Pressure: %.1f hPa", vals.pressure_pa / 100.0f);
+      ESP_LOGI(TAG, "  Sensor update: worst %lld us | frame %lu",
+               (long long)frame.update_worst_us, (unsigned long)frame.seq);
+      log_sensor_bus_stats(TAG);
       ESP_LOGI(TAG, "  GPS: %s | Lat: %.6f | Lon: %.6f | ANT: %s",
                gps_state, gps_ready ? gps.latitude_deg() : 0.0f,
                gps_ready ? gps.longitude_deg() : 0.0f,
@@ -1638,7 +1703,10 @@ extern "C" void app_main(void) {
       }
 
       if (vbus_stable_event) {
-        bool sps30_reading = sensors.isSps30Reading(now_ms, SPS30_READ_STALE_MS);
+        sensor_frame_t frame;
+        bool sps30_reading =
+            sensor_bus_latest(SENSOR_SUB_SYSTEM, &frame) && frame.sps30_read_ms > 0 &&
+            now_ms - frame.sps30_read_ms <= SPS30_READ_STALE_MS;
         if (!sps30_reading) {
           ESP_LOGW(TAG, "VBUS changed (%s), SPS30 not reading",
                    vbus_stable_present ? "present" : "absent");
@@ -2188,6 +2256,14 @@ static AirLevel co2_level_from_ppm(int co2_ppm) {
   return AirLevel::PurpleRed;
 }
 
+// Alert while PM2.5 or CO2 is at Red or worse on the LED scale
+static bool air_alert_from_values(const sensor_values_t &values) {
+  AirLevel pm_level = pm25_level_from_ugm3(values.pm25_mass);
+  AirLevel co2_level =
+      values.have_co2_avg ? co2_level_from_ppm(values.co2_ppm_avg) : AirLevel::Off;
+  return pm_level >= AirLevel::Red || co2_level >= AirLevel::Red;
+}
+
 static void apply_led_pattern(uint8_t first_index, int8_t step,
                               const LedPattern &pattern) {
   int idx = first_index;
@@ -2476,8 +2552,19 @@ static void initiate_shutdown(void) {
     g_led_driver->set_global_off(true);
   }
 
+  // Stop the sensor task so no read is in flight on the I2C bus from here.
   // Note: Sensors class doesn't have stop() yet, but I2C will be released
   // when device enters ship mode. SPS30 fan will stop with power off.
+  sensor_task_running = false;
+  if (g_sensor_task_handle) {
+    xTaskNotifyGive(g_sensor_task_handle);
+    if (xSemaphoreTake(g_sensor_task_done, pdMS_TO_TICKS(1000)) == pdTRUE) {
+      g_sensor_task_handle = nullptr;
+      ESP_LOGI(TAG, "Sensor task stopped");
+    } else {
+      ESP_LOGW(TAG, "Sensor task still running after 1000 ms");
+    }
+  }
   ESP_LOGI(TAG, "Phase 1 complete");
 
   // Phase 2: Stopping recording
@@ -2507,12 +2594,16 @@ static void initiate_shutdown(void) {
   request_lvgl_refresh();
   vTaskDelay(pdMS_TO_TICKS(800));
 
-  // Flush and close log storage (NAND flash)
+  // Write out queued records, then flush and close log storage (NAND flash)
+  log_storage_drain(3000);
   if (log_storage_is_ready()) {
     ESP_LOGI(TAG, "Flushing log storage...");
     log_storage_flush();
     ESP_LOGI(TAG, "Deinitializing log storage...");
-    log_storage_deinit();
+    esp_err_t err = log_storage_deinit();
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Log storage deinit failed: %s", esp_err_to_name(err));
+    }
   }
   ESP_LOGI(TAG, "Phase 2 complete");
 
@@ -2687,7 +2778,10 @@ static void lv_handler_task(void *arg) {
     if (lvgl_lock(-1)) {
       task_delay_ms = lv_timer_handler();
       if (do_refresh && g_disp) {
+        // Storage gives the bus up within its slice budget
+        spi_bus_acquire(SPI_BUS_DEV_EPD, SPI_BUS_PRIO_INTERACTIVE, portMAX_DELAY);
         epd_lvgl_refresh(g_disp);
+        spi_bus_release(SPI_BUS_DEV_EPD);
       }
       lvgl_unlock();
     }
@@ -2703,10 +2797,11 @@ static void lv_handler_task(void *arg) {
 static void display_task(void *arg) {
   Display *display = static_cast<Display *>(arg);
   DisplaySnapshot snapshot = {};
-  uint64_t last_sensor_update_ms = 0;
+  sensor_frame_t frame = {};
+  uint32_t last_frame_seq = 0;
   uint64_t last_display_refresh_ms = 0;
   uint64_t last_ui_refresh_ms = 0;
-  bool sensor_initialized = false;
+  bool last_alert = false;
   bool gps_initialized = false;
   bool battery_initialized = false;
   Display::GPSStatus last_gps_status = Display::GPSStatus::Off;
@@ -2727,25 +2822,25 @@ static void display_task(void *arg) {
     bool request_refresh = false;
     bool request_refresh_urgent = false;
 
+    bool have_frame = sensor_bus_latest(SENSOR_SUB_DISPLAY, &frame);
+
     if (lvgl_lock(100)) {
-      if (snapshot.sensor_valid &&
-          (!sensor_initialized ||
-           snapshot.sensor_update_ms != last_sensor_update_ms)) {
-        sensor_initialized = true;
-        last_sensor_update_ms = snapshot.sensor_update_ms;
-
-        if (snapshot.sensor.have_co2_avg) {
-          display->setCO2(snapshot.sensor.co2_ppm_avg);
-          display->setTempCf(snapshot.sensor.temp_c_avg);
-          display->setRHf(snapshot.sensor.rh_avg);
+      if (have_frame && frame.seq != last_frame_seq) {
+        last_frame_seq = frame.seq;
+        const sensor_values_t &values = frame.values;
+
+        if (values.have_co2_avg) {
+          display->setCO2(values.co2_ppm_avg);
+          display->setTempCf(values.temp_c_avg);
+          display->setRHf(values.rh_avg);
         }
-        display->setPM25f(snapshot.sensor.pm25_mass);
-        display->setVOC(snapshot.sensor.voc_index);
-        display->setNOx(snapshot.sensor.nox_index);
+        display->setPM25f(values.pm25_mass);
+        display->setVOC(values.voc_index);
+        display->setNOx(values.nox_index);
         
         // Set pressure from sensor (convert Pa to hPa)
-        int pressure_hpa = (snapshot.sensor.pressure_pa > 0) ? 
-                          (int)(snapshot.sensor.pressure_pa / 100.0f) : 1013;
+        int pressure_hpa = (values.pressure_pa > 0) ? 
+                          (int)(values.pressure_pa / 100.0f) : 1013;
         display->setPressure(pressure_hpa);
 
         if (!last_display_refresh_ms) {
@@ -2754,6 +2849,12 @@ static void display_task(void *arg) {
         request_refresh = true;
       }
 
+      if (snapshot.alert != last_alert) {
+        last_alert = snapshot.alert;
+        display->setAlert(snapshot.alert);
+        request_refresh = true;
+      }
+
       if (snapshot.battery_valid &&
           (!battery_initialized ||
            snapshot.battery_percent != last_battery_percent ||
@@ -2820,3 +2921,125 @@ static void display_task(void *arg) {
   ESP_LOGI("DisplayTask", "Display task exiting");
   vTaskDelete(NULL);
 }
+
+// Sole owner of Sensors once started: runs the sensor steps as they fall
+// due, sleeping in between, and publishes a frame a second on the sensor
+// bus. Nothing a consumer does can hold up a read.
+static void sensor_task(void *arg) {
+  Sensors *sensors = static_cast<Sensors *>(arg);
+  int64_t next_frame_ms = 0;
+
+  while (sensor_task_running) {
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    int64_t wait_ms = sensors->update(now_ms);
+
+    if (now_ms >= next_frame_ms - SENSOR_FRAME_EARLY_MS) {
+      sensor_values_t values;
+      sensors->getValues(now_ms, &values);
+      sensor_bus_publish(now_ms, sensors->sps30LastReadMs(), sensors->updateWorstUs(),
+                         &values);
+      next_frame_ms = (now_ms / SENSOR_FRAME_PERIOD_MS + 1) * SENSOR_FRAME_PERIOD_MS +
+                      SENSOR_FRAME_PHASE_MS;
+    }
+    if (next_frame_ms - now_ms < wait_ms) {
+      wait_ms = next_frame_ms - now_ms;
+    }
+
+    // Round up to whole ticks: waking a tick early only finds nothing due.
+    // Shutdown notifies to cut the wait short.
+    TickType_t ticks =
+        wait_ms > 0 ? (TickType_t)((wait_ms * configTICK_RATE_HZ + 999) / 1000) : 1;
+    ulTaskNotifyTake(pdTRUE, ticks);
+  }
+
+  ESP_LOGI("SensorTask", "Sensor task exiting");
+  xSemaphoreGive(g_sensor_task_done);
+  vTaskDelete(NULL);
+}
+
+// Every frame into the log. Frames taken while storage still mounts wait in
+// the log queue and are written once it is up. The only caller of
+// sensor_record_enqueue(), which wants a single producer.
+static void storage_sink_task(void *arg) {
+  (void)arg;
+  sensor_frame_t frame;
+  uint32_t rejected = 0;
+
+  for (;;) {
+    if (!sensor_bus_receive(SENSOR_SUB_STORAGE, &frame, portMAX_DELAY)) {
+      continue;
+    }
+    const sensor_values_t &v = frame.values;
+    sensor_record_t rec = {};
+    rec.timestamp_ms = (uint32_t)frame.timestamp_ms;
+    if (v.have_co2_avg) {
+      rec.co2_ppm = (uint16_t)v.co2_ppm_avg;
+      rec.temp_c_x100 = (int16_t)lroundf(v.temp_c_avg * 100.0f);
+      rec.rh_x100 = (int16_t)lroundf(v.rh_avg * 100.0f);
+    }
+    rec.pm25_x10 = (uint16_t)lroundf(v.pm25_mass * 10.0f);
+    rec.pm1_x10 = (uint16_t)lroundf(v.pm1_mass * 10.0f);
+    rec.pm10_x10 = (uint16_t)lroundf(v.pm10_mass * 10.0f);
+    rec.pm4_x10 = (uint16_t)lroundf(v.pm4_mass * 10.0f);
+    rec.pn05_cm3 = (uint16_t)lroundf(v.pn05_count);
+    rec.pn10_cm3 = (uint16_t)lroundf(v.pn10_count);
+    rec.pn25_cm3 = (uint16_t)lroundf(v.pn25_count);
+    rec.voc_index = (uint16_t)v.voc_index;
+    rec.nox_index = (uint16_t)v.nox_index;
+    rec.pressure_pa = (uint32_t)v.pressure_pa;
+    if (v.have_accel) {
+      rec.accel_x_mg = v.accel_x_mg;
+      rec.accel_y_mg = v.accel_y_mg;
+      rec.accel_z_mg = v.accel_z_mg;
+    }
+
+    // A full log queue counts its own drops; note the first of a run here
+    if (sensor_record_enqueue(&rec) != ESP_OK) {
+      if (rejected++ == 0) {
+        ESP_LOGW("StorageSink", "Log queue rejected frame %lu", (unsigned long)frame.seq);
+      }
+    } else {
+      rejected = 0;
+    }
+  }
+}
+
+// Create the sensor bus, then the task that owns sensors and the storage
+// sink. After this only sensor_task may call into sensors.
+static esp_err_t start_sensor_tasks(Sensors *sensors) {
+  esp_err_t ret = sensor_bus_init();
+  if (ret != ESP_OK) {
+    return ret;
+  }
+  if (!g_sensor_task_done) {
+    g_sensor_task_done = xSemaphoreCreateBinary();
+    if (!g_sensor_task_done) {
+      return ESP_ERR_NO_MEM;
+    }
+  }
+  if (xTaskCreatePinnedToCore(storage_sink_task, "StorageSink", 3 * 1024, NULL,
+                              STORAGE_SINK_PRIORITY, NULL, tskNO_AFFINITY) != pdPASS) {
+    return ESP_ERR_NO_MEM;
+  }
+  if (xTaskCreatePinnedToCore(sensor_task, "SensorTask", 4 * 1024, sensors,
+                              SENSOR_TASK_PRIORITY, &g_sensor_task_handle,
+                              tskNO_AFFINITY) != pdPASS) {
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+static void log_sensor_bus_stats(const char *tag) {
+  sensor_bus_stats_t stats;
+  if (sensor_bus_get_stats(&stats) != ESP_OK) {
+    return;
+  }
+  for (int i = 0; i < SENSOR_SUB_COUNT; i++) {
+    const sensor_bus_sub_stats_t &sub = stats.sub[i];
+    ESP_LOGI(tag, "  Bus %-7s: lag %lu (%lu/%lu ms) | drop %lu | skip %lu | queue %lu/%lu",
+             sensor_bus_sub_name((sensor_sub_t)i), (unsigned long)sub.lag_frames,
+             (unsigned long)sub.last_lag_ms, (unsigned long)sub.max_lag_ms,
+             (unsigned long)sub.dropped, (unsigned long)sub.skipped,
+             (unsigned long)sub.queued, (unsigned long)sub.high_water);
+  }
+}
@@ -0,0 +1,76 @@
+/**
+ * @file crc16.cpp
+ * @brief CRC-16/CCITT-FALSE shared by log storage and the record codec
+ *
+ * Table driven: one lookup per byte instead of eight shift/xor steps.
+ * Buffers of kSliceMinBytes or more (segment slots, block verification)
+ * use slicing-by-4, folding four bytes per iteration through four tables.
+ */
+
+#include "crc16.h"
+
+// Slicing-by-4 costs 1.5 KB more flash for its extra tables
+#ifndef CRC16_SLICE_BY_4
+#define CRC16_SLICE_BY_4 1
+#endif
+
+namespace {
+
+constexpr uint16_t kPoly = 0x1021;
+constexpr size_t kSliceMinBytes = 16;
+
+struct Crc16Tables {
+  uint16_t t[4][256];
+};
+
+// t[0][b] is the CRC register update for byte b; t[k][b] is the same byte
+// followed by k zero bytes.
+constexpr Crc16Tables make_tables() {
+  Crc16Tables tables{};
+  for (int b = 0; b < 256; b++) {
+    uint16_t crc = (uint16_t)(b << 8);
+    for (int j = 0; j < 8; j++) {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ kPoly) : (uint16_t)(crc << 1);
+    }
+    tables.t[0][b] = crc;
+  }
+  for (int k = 1; k < 4; k++) {
+    for (int b = 0; b < 256; b++) {
+      uint16_t prev = tables.t[k - 1][b];
+      tables.t[k][b] = (uint16_t)((prev << 8) ^ tables.t[0][prev >> 8]);
+    }
+  }
+  return tables;
+}
+
+constexpr Crc16Tables kTables = make_tables();
+
+static_assert(kTables.t[0][1] == kPoly, "CRC16 table generation");
+
+inline uint16_t update_bytewise(uint16_t crc, const uint8_t *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    crc = (uint16_t)((crc << 8) ^ kTables.t[0][(crc >> 8) ^ data[i]]);
+  }
+  return crc;
+}
+
+}  // namespace
+
+uint16_t crc16_ccitt_update(uint16_t crc, const uint8_t *data, size_t len) {
+#if CRC16_SLICE_BY_4
+  if (len >= kSliceMinBytes) {
+    // The 16-bit register only overlaps the first two bytes of each group
+    while (len >= 4) {
+      crc = kTables.t[3][data[0] ^ (crc >> 8)] ^ kTables.t[2][data[1] ^ (crc & 0xFF)] ^
+            kTables.t[1][data[2]] ^ kTables.t[0][data[3]];
+      data += 4;
+      len -= 4;
+    }
+  }
+#endif
+  return update_bytewise(crc, data, len);
+}
+
+uint16_t crc16_ccitt(const uint8_t *data, size_t len) {
+  return crc16_ccitt_final(crc16_ccitt_update(crc16_ccitt_init(), data, len));
+}
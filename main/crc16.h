@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF, no reflection, no xor-out).
+// Used for sensor record, segment header and block integrity checks.
+uint16_t crc16_ccitt(const uint8_t *data, size_t len);
+
+// Streaming form for data that arrives in pieces:
+//   uint16_t crc = crc16_ccitt_init();
+//   crc = crc16_ccitt_update(crc, part, part_len);  // repeat
+//   crc = crc16_ccitt_final(crc);
+// Gives the same result as crc16_ccitt() over the concatenated data.
+static inline uint16_t crc16_ccitt_init(void) { return 0xFFFF; }
+uint16_t crc16_ccitt_update(uint16_t crc, const uint8_t *data, size_t len);
+static inline uint16_t crc16_ccitt_final(uint16_t crc) { return crc; }
+
+#ifdef __cplusplus
+}
+#endif
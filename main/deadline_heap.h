@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary min-heap of up to N deadlines, each naming a job by a small id:
+// the earliest is at the top, push and pop cost O(log N). A job should be in
+// the heap at most once; equal deadlines come out in no set order.
+//
+// All-zero bytes are an empty heap, so it can sit in memset state.
+template <size_t N>
+class DeadlineHeap {
+  static_assert(N > 0 && N <= 255, "DeadlineHeap capacity out of range");
+
+ public:
+  struct Entry {
+    int64_t due_ms;
+    uint8_t job;
+  };
+
+  static constexpr size_t capacity() { return N; }
+
+  void clear() { count_ = 0; }
+  size_t size() const { return count_; }
+  bool empty() const { return count_ == 0; }
+
+  // Earliest entry; only valid when not empty
+  const Entry &top() const { return heap_[0]; }
+
+  // Latest deadline before limit_ms; only valid when top() is before it.
+  // Scans every entry, which for the few jobs a heap here holds costs less
+  // than keeping a second order.
+  int64_t latest_before(int64_t limit_ms) const {
+    int64_t latest = heap_[0].due_ms;
+    for (size_t i = 1; i < count_; i++) {
+      if (heap_[i].due_ms < limit_ms && heap_[i].due_ms > latest) {
+        latest = heap_[i].due_ms;
+      }
+    }
+    return latest;
+  }
+
+  // Returns false, leaving the heap unchanged, when it is full
+  bool push(int64_t due_ms, uint8_t job) {
+    if (count_ == N) {
+      return false;
+    }
+    size_t i = count_++;
+    while (i > 0) {
+      size_t parent = (i - 1) / 2;
+      if (heap_[parent].due_ms <= due_ms) {
+        break;
+      }
+      heap_[i] = heap_[parent];
+      i = parent;
+    }
+    heap_[i] = {due_ms, job};
+    return true;
+  }
+
+  // Remove the earliest entry into *out; false when empty
+  bool pop(Entry *out) {
+    if (count_ == 0) {
+      return false;
+    }
+    *out = heap_[0];
+    const Entry last = heap_[--count_];
+    size_t i = 0;
+    for (;;) {
+      size_t child = 2 * i + 1;
+      if (child >= count_) {
+        break;
+      }
+      if (child + 1 < count_ && heap_[child + 1].due_ms < heap_[child].due_ms) {
+        child++;
+      }
+      if (last.due_ms <= heap_[child].due_ms) {
+        break;
+      }
+      heap_[i] = heap_[child];
+      i = child;
+    }
+    heap_[i] = last;
+    return true;
+  }
+
+ private:
+  Entry heap_[N];
+  size_t count_;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+
+// On-flash layout of sensors.bin slots, shared by log storage and the host
+// export tool (tools/sensors_export).
+//
+// sensors.bin is a ring of LOG_SEGMENT_BYTES slots (one NAND page each).
+// A slot starts with a slot_header_t naming the segment it holds, followed
+// by one record_codec block (see record_codec.h) filling the rest of the
+// slot. Sealed blocks are padded out; an open block ends in 0xFF.
+//
+// The slot magic gives the block's record format. Format 1 blocks hold
+// every field of the 28-byte format-1 record (sensor_record_core_t).
+// Format 2 blocks start with a record_block_header_t naming the fields they
+// hold (the schema id), so a log keeps segments of older layouts readable
+// in place after the enabled fields change.
+
+#define LOG_SEGMENT_BYTES 2048
+#define LOG_SLOT_MAGIC 0x4C53     // "SL": format 1 block
+#define LOG_SLOT_MAGIC_V2 0x3253  // "S2": format 2 block
+
+typedef struct __attribute__((packed)) {
+  uint32_t segment;  // Segment sequence number in this slot
+  uint16_t magic;    // LOG_SLOT_MAGIC or LOG_SLOT_MAGIC_V2
+  uint16_t crc16;    // CRC16 over segment and magic
+} slot_header_t;
+
+// ----------------------------------------------------------------------------
+// Record fields
+// ----------------------------------------------------------------------------
+// Every field a record can carry besides timestamp_ms: X(id, name, type).
+// name is the sensor_record_t member, type its width and signedness on
+// flash. Ids are bit numbers in a schema id and never change meaning; new
+// fields take new ids. A format 2 record stores timestamp_ms, then the
+// fields of its schema in id order. The first ids are ordered by how often
+// they change at 1 Hz, so a typical DELTA change mask fits in one byte.
+#define LOG_FIELDS(X)                  \
+  X(0, co2_ppm, uint16_t)              \
+  X(1, temp_c_x100, int16_t)           \
+  X(2, rh_x100, int16_t)               \
+  X(3, pm25_x10, uint16_t)             \
+  X(4, pm1_x10, uint16_t)              \
+  X(5, pm10_x10, uint16_t)             \
+  X(6, pressure_pa, uint32_t)          \
+  X(7, voc_index, uint16_t)            \
+  X(8, nox_index, uint16_t)            \
+  X(9, pm4_x10, uint16_t)              \
+  X(10, pn05_cm3, uint16_t)            \
+  X(11, pn10_cm3, uint16_t)            \
+  X(12, pn25_cm3, uint16_t)            \
+  X(13, accel_x_mg, int16_t)           \
+  X(14, accel_y_mg, int16_t)           \
+  X(15, accel_z_mg, int16_t)           \
+  X(16, lat_e7, int32_t)               \
+  X(17, lon_e7, int32_t)
+
+typedef enum {
+#define LOG_FIELD_ENUM(id, name, type) LOG_FIELD_##name = id,
+  LOG_FIELDS(LOG_FIELD_ENUM)
+#undef LOG_FIELD_ENUM
+  LOG_FIELD_COUNT
+} log_field_id_t;
+
+#define LOG_FIELD_BIT(name) (1ul << LOG_FIELD_##name)
+
+// Field groups for LOG_STORAGE_FIELDS (log_storage.cpp)
+#define LOG_FIELDS_CORE                                                    \
+  (LOG_FIELD_BIT(co2_ppm) | LOG_FIELD_BIT(temp_c_x100) |                   \
+   LOG_FIELD_BIT(rh_x100) | LOG_FIELD_BIT(pm25_x10) | LOG_FIELD_BIT(pm1_x10) | \
+   LOG_FIELD_BIT(pm10_x10) | LOG_FIELD_BIT(pressure_pa) |                  \
+   LOG_FIELD_BIT(voc_index) | LOG_FIELD_BIT(nox_index))
+#define LOG_FIELDS_PARTICLES                                               \
+  (LOG_FIELD_BIT(pm4_x10) | LOG_FIELD_BIT(pn05_cm3) | LOG_FIELD_BIT(pn10_cm3) | \
+   LOG_FIELD_BIT(pn25_cm3))
+#define LOG_FIELDS_MOTION \
+  (LOG_FIELD_BIT(accel_x_mg) | LOG_FIELD_BIT(accel_y_mg) | LOG_FIELD_BIT(accel_z_mg))
+#define LOG_FIELDS_GPS (LOG_FIELD_BIT(lat_e7) | LOG_FIELD_BIT(lon_e7))
+#define LOG_FIELDS_ALL ((1ul << LOG_FIELD_COUNT) - 1)
+
+// Field type in a schema table: width in bytes, plus LOG_FIELD_SIGNED
+#define LOG_FIELD_SIGNED 0x80
+#define LOG_FIELD_TYPE(type) \
+  ((uint8_t)(sizeof(type) | (((type)-1 < (type)1) ? LOG_FIELD_SIGNED : 0)))
+
+typedef struct __attribute__((packed)) {
+  uint8_t id;    // log_field_id_t
+  uint8_t type;  // LOG_FIELD_TYPE()
+} log_field_desc_t;
+
+// ----------------------------------------------------------------------------
+// Schema header
+// ----------------------------------------------------------------------------
+// Stored after the ring meta in both meta copies of sensors.idx: the schema
+// new segments are written with, and the type of every field id this
+// firmware knows, so readers built before a field existed can still size it.
+
+#define LOG_SCHEMA_MAGIC 0x414D4353  // "SCMA"
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;        // LOG_SCHEMA_MAGIC
+  uint32_t schema_id;    // Field mask of the segments being written now
+  uint8_t field_count;   // Entries used in fields
+  uint8_t reserved;
+  log_field_desc_t fields[32];
+  uint16_t crc16;        // CRC16 over all preceding bytes
+} log_schema_header_t;
+
+// Header at the start of every format 2 block
+typedef struct __attribute__((packed)) {
+  uint8_t encoding;    // 'R' fixed-width records, 'D' delta-coded
+  uint8_t version;     // 2
+  uint32_t schema_id;  // Field mask: bit n set if field id n is stored
+} record_block_header_t;
@@ -0,0 +1,100 @@
+/**
+ * @file log_fs.cpp
+ * @brief Sensor log file access: stdio/FATFS by default, or a host backend
+ */
+
+#include "log_fs.h"
+
+#include "esp_vfs_fat_nand.h"
+#include "log_storage.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+// ============================================================================
+// stdio backend (FATFS on the NAND)
+// ============================================================================
+
+static log_fs_file_t *stdio_open(const char *path, bool write) {
+  FILE *f = fopen(path, write ? "r+b" : "rb");
+  if (!f && write) {
+    f = fopen(path, "w+b");
+  }
+  return (log_fs_file_t *)f;
+}
+
+static size_t stdio_read_at(log_fs_file_t *f, long offset, void *buf, size_t len) {
+  if (fseek((FILE *)f, offset, SEEK_SET) != 0) {
+    return 0;
+  }
+  return fread(buf, 1, len, (FILE *)f);
+}
+
+static size_t stdio_write_at(log_fs_file_t *f, long offset, const void *buf, size_t len) {
+  if (fseek((FILE *)f, offset, SEEK_SET) != 0) {
+    return 0;
+  }
+  return fwrite(buf, 1, len, (FILE *)f);
+}
+
+static long stdio_size(log_fs_file_t *f) {
+  if (fseek((FILE *)f, 0, SEEK_END) != 0) {
+    return -1;
+  }
+  return ftell((FILE *)f);
+}
+
+static int stdio_close(log_fs_file_t *f) { return fclose((FILE *)f); }
+
+static long stdio_stat_size(const char *path) {
+  struct stat st;
+  return (stat(path, &st) == 0) ? (long)st.st_size : -1;
+}
+
+static esp_err_t stdio_info(uint64_t *total_bytes, uint64_t *free_bytes) {
+  return esp_vfs_fat_info(LOG_STORAGE_MOUNT_POINT, total_bytes, free_bytes);
+}
+
+static const log_fs_ops_t kStdioOps = {
+    .open = stdio_open,
+    .read_at = stdio_read_at,
+    .write_at = stdio_write_at,
+    .size = stdio_size,
+    .close = stdio_close,
+    .remove = remove,
+    .rename = rename,
+    .stat_size = stdio_stat_size,
+    .info = stdio_info,
+};
+
+static const log_fs_ops_t *g_ops = &kStdioOps;
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+void log_fs_set_ops(const log_fs_ops_t *ops) { g_ops = ops ? ops : &kStdioOps; }
+
+log_fs_file_t *log_fs_open(const char *path, bool write) { return g_ops->open(path, write); }
+
+size_t log_fs_read_at(log_fs_file_t *f, long offset, void *buf, size_t len) {
+  return g_ops->read_at(f, offset, buf, len);
+}
+
+size_t log_fs_write_at(log_fs_file_t *f, long offset, const void *buf, size_t len) {
+  return g_ops->write_at(f, offset, buf, len);
+}
+
+long log_fs_size(log_fs_file_t *f) { return g_ops->size(f); }
+
+int log_fs_close(log_fs_file_t *f) { return g_ops->close(f); }
+
+int log_fs_remove(const char *path) { return g_ops->remove(path); }
+
+int log_fs_rename(const char *from, const char *to) { return g_ops->rename(from, to); }
+
+long log_fs_stat_size(const char *path) { return g_ops->stat_size(path); }
+
+esp_err_t log_fs_info(uint64_t *total_bytes, uint64_t *free_bytes) {
+  return g_ops->info(total_bytes, free_bytes);
+}
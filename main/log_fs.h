@@ -0,0 +1,51 @@
+#pragma once
+
+#include "esp_err.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// File access for the sensor log (log_storage and its rollup tiers). By
+// default it goes through stdio to FATFS on the NAND; host tools install
+// other backends, such as the power-cut NAND simulator in tools/nand_sim.
+
+typedef struct log_fs_file log_fs_file_t;
+
+typedef struct {
+  // Open path for reading, or for in-place writes (created empty if missing)
+  log_fs_file_t *(*open)(const char *path, bool write);
+  size_t (*read_at)(log_fs_file_t *f, long offset, void *buf, size_t len);
+  size_t (*write_at)(log_fs_file_t *f, long offset, const void *buf, size_t len);
+  long (*size)(log_fs_file_t *f);
+  // Close, committing writes (FATFS: f_sync). Returns 0 on success.
+  int (*close)(log_fs_file_t *f);
+  int (*remove)(const char *path);
+  int (*rename)(const char *from, const char *to);
+  // Size of the file at path, or -1 if there is none
+  long (*stat_size)(const char *path);
+  // Capacity and free space of the volume
+  esp_err_t (*info)(uint64_t *total_bytes, uint64_t *free_bytes);
+} log_fs_ops_t;
+
+// Route log file access to ops (kept by pointer); nullptr restores stdio.
+// Only while log storage is not running.
+void log_fs_set_ops(const log_fs_ops_t *ops);
+
+log_fs_file_t *log_fs_open(const char *path, bool write);
+size_t log_fs_read_at(log_fs_file_t *f, long offset, void *buf, size_t len);
+size_t log_fs_write_at(log_fs_file_t *f, long offset, const void *buf, size_t len);
+long log_fs_size(log_fs_file_t *f);
+int log_fs_close(log_fs_file_t *f);
+int log_fs_remove(const char *path);
+int log_fs_rename(const char *from, const char *to);
+long log_fs_stat_size(const char *path);
+esp_err_t log_fs_info(uint64_t *total_bytes, uint64_t *free_bytes);
+
+#ifdef __cplusplus
+}
+#endif
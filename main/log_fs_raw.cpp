@@ -0,0 +1,519 @@
+/**
+ * @file log_fs_raw.cpp
+ * @brief Log files on raw spi_nand_flash sectors (no FATFS)
+ *
+ * Volume layout, in sectors from the start of the range:
+ *   0, 1   superblock copies; commits alternate and carry a sequence
+ *          number, so the newest intact copy wins after a torn write
+ *   2...   chunks of kChunkSectors sectors
+ *
+ * The superblock names up to kMaxFiles files with their sizes and maps
+ * each chunk to (file, chunk index in file). A file's chunks need not be
+ * contiguous; unallocated parts of a file read as zeros.
+ *
+ * Like FATFS, an open file buffers one sector for partial-sector writes
+ * and programs it when the file moves to another sector or is closed.
+ * Whole-sector writes (ring slots) go straight to the device. Data is
+ * always written before the superblock commit that makes it reachable.
+ */
+
+#include "log_fs_raw.h"
+
+#include "crc16.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "log_fs_raw";
+
+static const uint32_t kMagic = 0x57524C47;  // "GLRW"
+static const uint16_t kVersion = 1;
+static const uint32_t kSuperblockSectors = 2;
+static const uint32_t kChunkSectors = 64;  // 128 KB with 2 KB sectors
+static const uint32_t kMaxFiles = 8;
+static const uint32_t kNameBytes = 24;
+static const uint32_t kMaxChunks = 900;
+static const uint16_t kChunkFree = 0xFFFF;
+static const uint32_t kChunkIndexBits = 12;
+static const uint32_t kNoSector = 0xFFFFFFFF;
+
+typedef struct __attribute__((packed)) {
+  char name[kNameBytes];  // NUL-padded; empty if the entry is unused
+  uint32_t size;
+} raw_file_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t chunk_sectors;
+  uint32_t seq;          // Bumped per commit; newest valid copy wins
+  uint32_t chunk_count;
+  raw_file_t files[kMaxFiles];
+  uint16_t chunks[kMaxChunks];  // file << kChunkIndexBits | index, or kChunkFree
+  uint16_t crc16;               // CRC16 over all preceding bytes
+} raw_superblock_t;
+
+static_assert(sizeof(raw_superblock_t) <= 2048, "superblock must fit one sector");
+
+struct log_fs_file {
+  uint8_t file;
+  bool write;
+  bool dirty;
+  uint32_t buf_sector;  // File sector held in buf, or kNoSector
+  uint32_t buf_generation;
+  uint8_t *buf;
+};
+
+static spi_nand_flash_device_t *g_dev = nullptr;
+static SemaphoreHandle_t g_lock = nullptr;
+static uint32_t g_first_sector = 0;
+static uint32_t g_sector_bytes = 0;
+static uint8_t *g_sector = nullptr;  // Superblock I/O buffer
+static raw_superblock_t g_sb;
+static bool g_sb_dirty = false;
+static uint32_t g_generation = 0;  // Bumped per sector write; stale read buffers reload
+
+// ============================================================================
+// Superblock
+// ============================================================================
+
+static uint16_t superblock_crc(const raw_superblock_t *sb) {
+  return crc16_ccitt((const uint8_t *)sb, sizeof(*sb) - sizeof(uint16_t));
+}
+
+static bool superblock_read(uint32_t copy, raw_superblock_t *sb) {
+  if (spi_nand_flash_read_sector(g_dev, g_sector, g_first_sector + copy) != ESP_OK) {
+    return false;
+  }
+  memcpy(sb, g_sector, sizeof(*sb));
+  return sb->magic == kMagic && sb->version == kVersion &&
+         sb->chunk_sectors == kChunkSectors && sb->chunk_count <= kMaxChunks &&
+         sb->crc16 == superblock_crc(sb);
+}
+
+static esp_err_t superblock_commit(void) {
+  g_sb.seq++;
+  g_sb.crc16 = superblock_crc(&g_sb);
+  memset(g_sector, 0xFF, g_sector_bytes);
+  memcpy(g_sector, &g_sb, sizeof(g_sb));
+  esp_err_t ret =
+      spi_nand_flash_write_sector(g_dev, g_sector, g_first_sector + g_sb.seq % 2);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Superblock write failed: %s", esp_err_to_name(ret));
+    return ret;
+  }
+  g_sb_dirty = false;
+  return ESP_OK;
+}
+
+// ============================================================================
+// Files and chunks
+// ============================================================================
+
+// Entry name for path: the part after the last '/'
+static const char *path_name(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+static int file_find(const char *path) {
+  const char *name = path_name(path);
+  for (uint32_t i = 0; i < kMaxFiles; i++) {
+    if (g_sb.files[i].name[0] && strncmp(g_sb.files[i].name, name, kNameBytes) == 0) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+static int file_create(const char *path) {
+  const char *name = path_name(path);
+  if (!name[0] || strlen(name) >= kNameBytes) {
+    return -1;
+  }
+  for (uint32_t i = 0; i < kMaxFiles; i++) {
+    if (!g_sb.files[i].name[0]) {
+      memset(&g_sb.files[i], 0, sizeof(g_sb.files[i]));
+      strncpy(g_sb.files[i].name, name, kNameBytes - 1);
+      g_sb_dirty = true;
+      return (int)i;
+    }
+  }
+  ESP_LOGE(TAG, "No free file entry for %s", name);
+  return -1;
+}
+
+static void file_release(int file) {
+  for (uint32_t c = 0; c < g_sb.chunk_count; c++) {
+    if (g_sb.chunks[c] != kChunkFree && (g_sb.chunks[c] >> kChunkIndexBits) == (uint32_t)file) {
+      g_sb.chunks[c] = kChunkFree;
+    }
+  }
+  memset(&g_sb.files[file], 0, sizeof(g_sb.files[file]));
+  g_sb_dirty = true;
+}
+
+// Device sector holding file sector `sector`, taking a free chunk if alloc
+// is set. kNoSector if unallocated (or the volume is full).
+static uint32_t sector_map(int file, uint32_t sector, bool alloc) {
+  uint32_t index = sector / kChunkSectors;
+  if (index >= (1u << kChunkIndexBits)) {
+    return kNoSector;
+  }
+  uint16_t owner = (uint16_t)((uint32_t)file << kChunkIndexBits | index);
+  int64_t free_chunk = -1;
+  for (uint32_t c = 0; c < g_sb.chunk_count; c++) {
+    if (g_sb.chunks[c] == owner) {
+      return g_first_sector + kSuperblockSectors + c * kChunkSectors + sector % kChunkSectors;
+    }
+    if (free_chunk < 0 && g_sb.chunks[c] == kChunkFree) {
+      free_chunk = c;
+    }
+  }
+  if (!alloc || free_chunk < 0) {
+    return kNoSector;
+  }
+  g_sb.chunks[free_chunk] = owner;
+  g_sb_dirty = true;
+  return g_first_sector + kSuperblockSectors + (uint32_t)free_chunk * kChunkSectors +
+         sector % kChunkSectors;
+}
+
+static esp_err_t sector_read(int file, uint32_t sector, uint8_t *buf) {
+  uint32_t dev_sector = sector_map(file, sector, false);
+  if (dev_sector == kNoSector) {
+    memset(buf, 0, g_sector_bytes);
+    return ESP_OK;
+  }
+  return spi_nand_flash_read_sector(g_dev, buf, dev_sector);
+}
+
+static esp_err_t sector_write(int file, uint32_t sector, const uint8_t *buf) {
+  uint32_t dev_sector = sector_map(file, sector, true);
+  if (dev_sector == kNoSector) {
+    return ESP_ERR_NO_MEM;
+  }
+  g_generation++;
+  return spi_nand_flash_write_sector(g_dev, buf, dev_sector);
+}
+
+static bool buf_flush(log_fs_file_t *f) {
+  if (!f->dirty) {
+    return true;
+  }
+  if (sector_write(f->file, f->buf_sector, f->buf) != ESP_OK) {
+    return false;
+  }
+  f->dirty = false;
+  f->buf_generation = g_generation;
+  return true;
+}
+
+static bool buf_load(log_fs_file_t *f, uint32_t sector) {
+  if (f->buf_sector == sector && (f->dirty || f->buf_generation == g_generation)) {
+    return true;
+  }
+  if (!buf_flush(f)) {
+    return false;
+  }
+  f->buf_sector = kNoSector;
+  if (sector_read(f->file, sector, f->buf) != ESP_OK) {
+    return false;
+  }
+  f->buf_sector = sector;
+  f->buf_generation = g_generation;
+  return true;
+}
+
+// ============================================================================
+// log_fs backend
+// ============================================================================
+
+static log_fs_file_t *raw_open(const char *path, bool write) {
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  int file = file_find(path);
+  if (file < 0 && write) {
+    file = file_create(path);
+    if (file >= 0 && superblock_commit() != ESP_OK) {
+      memset(&g_sb.files[file], 0, sizeof(g_sb.files[file]));
+      file = -1;
+    }
+  }
+  log_fs_file_t *f = nullptr;
+  if (file >= 0) {
+    f = (log_fs_file_t *)calloc(1, sizeof(*f));
+    uint8_t *buf = (uint8_t *)malloc(g_sector_bytes);
+    if (f && buf) {
+      f->file = (uint8_t)file;
+      f->write = write;
+      f->buf_sector = kNoSector;
+      f->buf = buf;
+    } else {
+      free(buf);
+      free(f);
+      f = nullptr;
+    }
+  }
+  xSemaphoreGive(g_lock);
+  return f;
+}
+
+static size_t raw_read_at(log_fs_file_t *f, long offset, void *buf, size_t len) {
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  uint32_t size = g_sb.files[f->file].size;
+  if (offset < 0 || (uint32_t)offset >= size) {
+    len = 0;
+  } else if (len > size - (uint32_t)offset) {
+    len = size - (uint32_t)offset;
+  }
+  size_t done = 0;
+  while (done < len) {
+    uint32_t pos = (uint32_t)offset + done;
+    uint32_t sector = pos / g_sector_bytes;
+    uint32_t in = pos % g_sector_bytes;
+    size_t n = g_sector_bytes - in;
+    if (n > len - done) {
+      n = len - done;
+    }
+    uint8_t *dst = (uint8_t *)buf + done;
+    if (n == g_sector_bytes && !(f->dirty && f->buf_sector == sector)) {
+      if (sector_read(f->file, sector, dst) != ESP_OK) {
+        break;
+      }
+    } else {
+      if (!buf_load(f, sector)) {
+        break;
+      }
+      memcpy(dst, &f->buf[in], n);
+    }
+    done += n;
+  }
+  xSemaphoreGive(g_lock);
+  return done;
+}
+
+static size_t raw_write_at(log_fs_file_t *f, long offset, const void *buf, size_t len) {
+  if (!f->write || offset < 0) {
+    return 0;
+  }
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  size_t done = 0;
+  while (done < len) {
+    uint32_t pos = (uint32_t)offset + done;
+    uint32_t sector = pos / g_sector_bytes;
+    uint32_t in = pos % g_sector_bytes;
+    size_t n = g_sector_bytes - in;
+    if (n > len - done) {
+      n = len - done;
+    }
+    const uint8_t *src = (const uint8_t *)buf + done;
+    if (n == g_sector_bytes) {
+      if (f->buf_sector == sector) {
+        f->dirty = false;
+        f->buf_sector = kNoSector;
+      }
+      if (sector_write(f->file, sector, src) != ESP_OK) {
+        break;
+      }
+    } else {
+      if (!buf_load(f, sector)) {
+        break;
+      }
+      memcpy(&f->buf[in], src, n);
+      f->dirty = true;
+    }
+    done += n;
+    raw_file_t *entry = &g_sb.files[f->file];
+    if (pos + n > entry->size) {
+      entry->size = pos + n;
+      g_sb_dirty = true;
+    }
+  }
+  xSemaphoreGive(g_lock);
+  return done;
+}
+
+static long raw_size(log_fs_file_t *f) {
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  long size = (long)g_sb.files[f->file].size;
+  xSemaphoreGive(g_lock);
+  return size;
+}
+
+// Programs the buffered sector, then commits sizes and chunks it added
+static int raw_close(log_fs_file_t *f) {
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  bool ok = buf_flush(f);
+  if (ok && f->write && g_sb_dirty) {
+    ok = superblock_commit() == ESP_OK;
+  }
+  xSemaphoreGive(g_lock);
+  free(f->buf);
+  free(f);
+  return ok ? 0 : -1;
+}
+
+static int raw_remove(const char *path) {
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  int file = file_find(path);
+  esp_err_t ret = ESP_ERR_NOT_FOUND;
+  if (file >= 0) {
+    file_release(file);
+    ret = superblock_commit();
+  }
+  xSemaphoreGive(g_lock);
+  return (ret == ESP_OK) ? 0 : -1;
+}
+
+// Atomic: one superblock commit renames (and drops an existing target)
+static int raw_rename(const char *from, const char *to) {
+  const char *name = path_name(to);
+  if (!name[0] || strlen(name) >= kNameBytes) {
+    return -1;
+  }
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  int file = file_find(from);
+  esp_err_t ret = ESP_ERR_NOT_FOUND;
+  if (file >= 0) {
+    int existing = file_find(to);
+    if (existing >= 0 && existing != file) {
+      file_release(existing);
+    }
+    memset(g_sb.files[file].name, 0, kNameBytes);
+    strncpy(g_sb.files[file].name, name, kNameBytes - 1);
+    ret = superblock_commit();
+  }
+  xSemaphoreGive(g_lock);
+  return (ret == ESP_OK) ? 0 : -1;
+}
+
+static long raw_stat_size(const char *path) {
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  int file = file_find(path);
+  long size = (file >= 0) ? (long)g_sb.files[file].size : -1;
+  xSemaphoreGive(g_lock);
+  return size;
+}
+
+static esp_err_t raw_info(uint64_t *total_bytes, uint64_t *free_bytes) {
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  uint32_t free_chunks = 0;
+  for (uint32_t c = 0; c < g_sb.chunk_count; c++) {
+    free_chunks += (g_sb.chunks[c] == kChunkFree);
+  }
+  uint64_t chunk_bytes = (uint64_t)kChunkSectors * g_sector_bytes;
+  *total_bytes = g_sb.chunk_count * chunk_bytes;
+  *free_bytes = free_chunks * chunk_bytes;
+  xSemaphoreGive(g_lock);
+  return ESP_OK;
+}
+
+static const log_fs_ops_t kRawOps = {
+    .open = raw_open,
+    .read_at = raw_read_at,
+    .write_at = raw_write_at,
+    .size = raw_size,
+    .close = raw_close,
+    .remove = raw_remove,
+    .rename = raw_rename,
+    .stat_size = raw_stat_size,
+    .info = raw_info,
+};
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+esp_err_t log_fs_raw_mount(spi_nand_flash_device_t *dev, uint32_t first_sector,
+                           uint32_t sector_count) {
+  uint32_t capacity = 0;
+  uint32_t sector_bytes = 0;
+  esp_err_t ret = spi_nand_flash_get_capacity(dev, &capacity);
+  if (ret == ESP_OK) {
+    ret = spi_nand_flash_get_sector_size(dev, &sector_bytes);
+  }
+  if (ret != ESP_OK) {
+    return ret;
+  }
+  if (sector_bytes < sizeof(raw_superblock_t) || first_sector >= capacity) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  if (sector_count == 0 || sector_count > capacity - first_sector) {
+    sector_count = capacity - first_sector;
+  }
+  uint32_t chunks = (sector_count > kSuperblockSectors)
+                        ? (sector_count - kSuperblockSectors) / kChunkSectors
+                        : 0;
+  if (chunks == 0) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (chunks > kMaxChunks) {
+    chunks = kMaxChunks;
+  }
+
+  if (!g_lock) {
+    g_lock = xSemaphoreCreateMutex();
+    if (!g_lock) {
+      return ESP_ERR_NO_MEM;
+    }
+  }
+  free(g_sector);
+  g_sector = (uint8_t *)malloc(sector_bytes);
+  if (!g_sector) {
+    return ESP_ERR_NO_MEM;
+  }
+  g_dev = dev;
+  g_first_sector = first_sector;
+  g_sector_bytes = sector_bytes;
+  g_sb_dirty = false;
+
+  raw_superblock_t copies[kSuperblockSectors];
+  int newest = -1;
+  for (uint32_t i = 0; i < kSuperblockSectors; i++) {
+    if (superblock_read(i, &copies[i]) &&
+        (newest < 0 || copies[i].seq - copies[newest].seq < 0x80000000u)) {
+      newest = (int)i;
+    }
+  }
+  if (newest >= 0 && copies[newest].chunk_count <= chunks) {
+    g_sb = copies[newest];
+    ESP_LOGI(TAG, "Mounted: %lu chunks of %lu KB, superblock %lu", g_sb.chunk_count,
+             (kChunkSectors * sector_bytes) / 1024, g_sb.seq);
+    return ESP_OK;
+  }
+
+  ESP_LOGW(TAG, "No log volume in sectors %lu-%lu, formatting", first_sector,
+           first_sector + sector_count - 1);
+  memset(&g_sb, 0, sizeof(g_sb));
+  g_sb.magic = kMagic;
+  g_sb.version = kVersion;
+  g_sb.chunk_sectors = kChunkSectors;
+  g_sb.seq = (newest >= 0) ? copies[newest].seq : 0;
+  g_sb.chunk_count = chunks;
+  for (uint32_t c = 0; c < kMaxChunks; c++) {
+    g_sb.chunks[c] = kChunkFree;
+  }
+  return superblock_commit();
+}
+
+void log_fs_raw_unmount(void) {
+  if (g_lock) {
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+  }
+  if (g_dev && g_sb_dirty) {
+    superblock_commit();
+  }
+  g_dev = nullptr;
+  free(g_sector);
+  g_sector = nullptr;
+  if (g_lock) {
+    xSemaphoreGive(g_lock);
+  }
+}
+
+const log_fs_ops_t *log_fs_raw_ops(void) {
+  return &kRawOps;
+}
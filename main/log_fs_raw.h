@@ -0,0 +1,33 @@
+#pragma once
+
+#include "log_fs.h"
+#include "spi_nand_flash.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Log files straight on spi_nand_flash sectors, without FATFS: a dedicated
+// sector range (Dhara still does wear levelling and bad blocks) holds a
+// superblock and 128 KB chunks that files take as they grow.
+//
+// Sector writes are atomic under Dhara, so a data write needs exactly one
+// sector program. The superblock (file names, sizes and the chunk map) is
+// written only when a file is created, removed, renamed or outgrows its
+// committed size: once the log rings are full, appends never touch it.
+
+// Mount the volume in sectors [first_sector, first_sector + sector_count) of
+// dev; sector_count 0 takes the rest of the device. An unformatted range is
+// formatted, erasing whatever was there.
+esp_err_t log_fs_raw_mount(spi_nand_flash_device_t *dev, uint32_t first_sector,
+                           uint32_t sector_count);
+void log_fs_raw_unmount(void);
+
+// log_fs backend for the mounted volume (pass to log_fs_set_ops)
+const log_fs_ops_t *log_fs_raw_ops(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,457 @@
+/**
+ * @file log_fs_spiffs.cpp
+ * @brief Log files in SPIFFS on spi_nand_flash sectors
+ *
+ * HAL: SPIFFS addresses bytes as if on NOR flash. The volume's sector range
+ * is mapped linearly, one SPIFFS page per sector and one block per 64
+ * sectors. Writes only clear bits (SPIFFS never relies on setting one), so
+ * each is ANDed into a one-sector write-back buffer. The buffer is written
+ * when SPIFFS moves to another sector and whenever a log_fs call returns
+ * with data that must persist. Sectors are therefore programmed in the
+ * order SPIFFS wrote them, and a power cut looks to SPIFFS like a cut
+ * between two of its writes. An erase trims the block's sectors, last to
+ * first, which then read back as 0xFF.
+ */
+
+#include "log_fs_spiffs.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "spiffs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "log_fs_spiffs";
+
+static const uint32_t kPagesPerBlock = 64;  // 128 KB blocks of 2 KB pages
+static const uint32_t kMaxFiles = 6;
+static const uint32_t kCachePages = 4;
+// spiffs_fd and the cache structs are private to SPIFFS; these bound them.
+// SPIFFS takes as many descriptors and cache pages as fit.
+static const uint32_t kFdBytes = 96;
+static const uint32_t kCachePageOverhead = 32;
+static const uint32_t kCacheHeaderBytes = 96;  // Holds the 2Q ghost list
+static const uint32_t kNoSector = 0xFFFFFFFF;
+// Pages moved per SPIFFS_gc_step(). Each step rescans the block's lookup
+// page and rewrites an index page, so very small steps waste flash time.
+static const uint32_t kGcStepMoves = 8;
+// Object index pages looked up in RAM (SPIFFS_obj_map), 8 bytes each. An
+// index page covers about 2 MB of a file, and SPIFFS fills the table to
+// three quarters, so this holds a 64 MB ring with room for the other files.
+static const uint32_t kObjMapEntries = 64;
+
+struct log_fs_file {
+  spiffs_file fh;
+};
+
+static spiffs g_fs;
+static SemaphoreHandle_t g_lock = nullptr;
+static spi_nand_flash_device_t *g_dev = nullptr;
+static uint32_t g_first_sector = 0;
+static uint32_t g_sector_bytes = 0;
+static uint8_t *g_work = nullptr;
+static uint8_t *g_fds = nullptr;
+static uint8_t *g_cache = nullptr;
+static uint8_t *g_buf = nullptr;  // Write-back sector
+static uint8_t *g_read_buf = nullptr;
+static spiffs_obj_map_entry *g_obj_map = nullptr;
+static uint32_t g_buf_sector = kNoSector;
+static bool g_buf_dirty = false;
+
+// SPIFFS_LOCK / SPIFFS_UNLOCK (spiffs_config.h)
+extern "C" void spiffs_api_lock(struct spiffs_t *fs) {
+  (void)fs;
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+}
+
+extern "C" void spiffs_api_unlock(struct spiffs_t *fs) {
+  (void)fs;
+  xSemaphoreGive(g_lock);
+}
+
+// ============================================================================
+// HAL
+// ============================================================================
+
+static esp_err_t buf_flush(void) {
+  if (!g_buf_dirty) {
+    return ESP_OK;
+  }
+  esp_err_t ret = spi_nand_flash_write_sector(g_dev, g_buf, g_buf_sector);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Sector %lu write failed: %s", g_buf_sector, esp_err_to_name(ret));
+    return ret;
+  }
+  g_buf_dirty = false;
+  return ESP_OK;
+}
+
+static esp_err_t buf_load(uint32_t sector) {
+  if (g_buf_sector == sector) {
+    return ESP_OK;
+  }
+  esp_err_t ret = buf_flush();
+  if (ret != ESP_OK) {
+    return ret;
+  }
+  g_buf_sector = kNoSector;
+  ret = spi_nand_flash_read_sector(g_dev, g_buf, sector);
+  if (ret == ESP_OK) {
+    g_buf_sector = sector;
+  }
+  return ret;
+}
+
+static s32_t hal_read(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *dst) {
+  (void)fs;
+  while (size > 0) {
+    uint32_t sector = g_first_sector + addr / g_sector_bytes;
+    uint32_t in = addr % g_sector_bytes;
+    uint32_t n = g_sector_bytes - in;
+    if (n > size) {
+      n = size;
+    }
+    if (sector == g_buf_sector) {
+      memcpy(dst, &g_buf[in], n);
+    } else if (n == g_sector_bytes) {
+      if (spi_nand_flash_read_sector(g_dev, dst, sector) != ESP_OK) {
+        return SPIFFS_ERR_NOT_READABLE;
+      }
+    } else {
+      if (spi_nand_flash_read_sector(g_dev, g_read_buf, sector) != ESP_OK) {
+        return SPIFFS_ERR_NOT_READABLE;
+      }
+      memcpy(dst, &g_read_buf[in], n);
+    }
+    addr += n;
+    dst += n;
+    size -= n;
+  }
+  return SPIFFS_OK;
+}
+
+static s32_t hal_write(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *src) {
+  (void)fs;
+  while (size > 0) {
+    uint32_t sector = g_first_sector + addr / g_sector_bytes;
+    uint32_t in = addr % g_sector_bytes;
+    uint32_t n = g_sector_bytes - in;
+    if (n > size) {
+      n = size;
+    }
+    if (buf_load(sector) != ESP_OK) {
+      return SPIFFS_ERR_NOT_WRITABLE;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      g_buf[in + i] &= src[i];
+    }
+    g_buf_dirty = true;
+    addr += n;
+    src += n;
+    size -= n;
+  }
+  return SPIFFS_OK;
+}
+
+static s32_t hal_erase(struct spiffs_t *fs, u32_t addr, u32_t size) {
+  (void)fs;
+  uint32_t first = g_first_sector + addr / g_sector_bytes;
+  uint32_t count = size / g_sector_bytes;
+  if (g_buf_sector >= first && g_buf_sector < first + count) {
+    g_buf_sector = kNoSector;
+    g_buf_dirty = false;
+  } else if (buf_flush() != ESP_OK) {  // Keep it ahead of the erase
+    return SPIFFS_ERR_ERASE_FAIL;
+  }
+  // Last sector first: until the cut-short erase is redone, the lookup page
+  // still lists every page that is left (SPIFFS_check_fast relies on it)
+  for (uint32_t s = first + count; s-- > first;) {
+    if (spi_nand_flash_trim(g_dev, s) != ESP_OK) {
+      return SPIFFS_ERR_ERASE_FAIL;
+    }
+  }
+  return SPIFFS_OK;
+}
+
+// Program the write-back sector outside a SPIFFS call
+static bool hal_sync(void) {
+  xSemaphoreTake(g_lock, portMAX_DELAY);
+  bool ok = buf_flush() == ESP_OK;
+  xSemaphoreGive(g_lock);
+  return ok;
+}
+
+// ============================================================================
+// log_fs backend
+// ============================================================================
+
+// SPIFFS has no directories: the name is the part after the last '/'
+static const char *path_name(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+static log_fs_file_t *spiffs_open(const char *path, bool write) {
+  spiffs_flags flags = write ? (SPIFFS_CREAT | SPIFFS_RDWR) : SPIFFS_RDONLY;
+  spiffs_file fh = SPIFFS_open(&g_fs, path_name(path), flags, 0);
+  if (fh < 0) {
+    return nullptr;
+  }
+  log_fs_file_t *f = (log_fs_file_t *)malloc(sizeof(*f));
+  if (!f) {
+    SPIFFS_close(&g_fs, fh);
+    return nullptr;
+  }
+  f->fh = fh;
+  return f;
+}
+
+static size_t spiffs_read_at(log_fs_file_t *f, long offset, void *buf, size_t len) {
+  if (offset < 0 || SPIFFS_lseek(&g_fs, f->fh, offset, SPIFFS_SEEK_SET) < 0) {
+    return 0;
+  }
+  s32_t n = SPIFFS_read(&g_fs, f->fh, buf, (s32_t)len);
+  return (n > 0) ? (size_t)n : 0;
+}
+
+// SPIFFS cannot seek past the end; a write there fills the gap with zeros
+// first, as FATFS does
+static size_t spiffs_write_at(log_fs_file_t *f, long offset, const void *buf, size_t len) {
+  spiffs_stat st;
+  if (offset < 0 || SPIFFS_fstat(&g_fs, f->fh, &st) < 0) {
+    return 0;
+  }
+  if ((uint32_t)offset > st.size) {
+    static const uint8_t kZeros[256] = {};
+    if (SPIFFS_lseek(&g_fs, f->fh, 0, SPIFFS_SEEK_END) < 0) {
+      return 0;
+    }
+    for (uint32_t pos = st.size; pos < (uint32_t)offset;) {
+      uint32_t n = (uint32_t)offset - pos;
+      if (n > sizeof(kZeros)) {
+        n = sizeof(kZeros);
+      }
+      if (SPIFFS_write(&g_fs, f->fh, (void *)kZeros, (s32_t)n) != (s32_t)n) {
+        return 0;
+      }
+      pos += n;
+    }
+  } else if (SPIFFS_lseek(&g_fs, f->fh, offset, SPIFFS_SEEK_SET) < 0) {
+    return 0;
+  }
+  s32_t n = SPIFFS_write(&g_fs, f->fh, (void *)buf, (s32_t)len);
+  return (n > 0) ? (size_t)n : 0;
+}
+
+static long spiffs_size(log_fs_file_t *f) {
+  spiffs_stat st;
+  return (SPIFFS_fstat(&g_fs, f->fh, &st) < 0) ? -1 : (long)st.size;
+}
+
+static int spiffs_close(log_fs_file_t *f) {
+  bool ok = SPIFFS_close(&g_fs, f->fh) >= 0;
+  free(f);
+  return (hal_sync() && ok) ? 0 : -1;
+}
+
+static int spiffs_remove(const char *path) {
+  bool ok = SPIFFS_remove(&g_fs, path_name(path)) >= 0;
+  return (hal_sync() && ok) ? 0 : -1;
+}
+
+// SPIFFS refuses to rename onto an existing name, so the target goes first;
+// a cut in between leaves only the source
+static int spiffs_rename(const char *from, const char *to) {
+  SPIFFS_remove(&g_fs, path_name(to));
+  bool ok = SPIFFS_rename(&g_fs, path_name(from), path_name(to)) >= 0;
+  return (hal_sync() && ok) ? 0 : -1;
+}
+
+static long spiffs_stat_size(const char *path) {
+  spiffs_stat st;
+  return (SPIFFS_stat(&g_fs, path_name(path), &st) < 0) ? -1 : (long)st.size;
+}
+
+static esp_err_t spiffs_info(uint64_t *total_bytes, uint64_t *free_bytes) {
+  u32_t total = 0;
+  u32_t used = 0;
+  if (SPIFFS_info(&g_fs, &total, &used) < 0) {
+    return ESP_FAIL;
+  }
+  *total_bytes = total;
+  *free_bytes = (used < total) ? total - used : 0;
+  return ESP_OK;
+}
+
+static const log_fs_ops_t kSpiffsOps = {
+    .open = spiffs_open,
+    .read_at = spiffs_read_at,
+    .write_at = spiffs_write_at,
+    .size = spiffs_size,
+    .close = spiffs_close,
+    .remove = spiffs_remove,
+    .rename = spiffs_rename,
+    .stat_size = spiffs_stat_size,
+    .info = spiffs_info,
+};
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+static void buffers_free(void) {
+  free(g_work);
+  free(g_fds);
+  free(g_cache);
+  free(g_buf);
+  free(g_read_buf);
+  free(g_obj_map);
+  g_work = g_fds = g_cache = g_buf = g_read_buf = nullptr;
+  g_obj_map = nullptr;
+}
+
+// SPIFFS_check_fast() reads each page once when its page map fits the heap,
+// or checks page ranges in turn in SPIFFS's work memory when it does not
+static s32_t check_volume(void) {
+  u32_t bytes = SPIFFS_check_fast_work_size(&g_fs);
+  uint8_t *work = (uint8_t *)malloc(bytes);
+  int64_t start_us = esp_timer_get_time();
+  s32_t res = SPIFFS_check_fast(&g_fs, work, work ? bytes : 0);
+  ESP_LOGI(TAG, "Checked in %lld ms%s", (long long)(esp_timer_get_time() - start_us) / 1000,
+           work ? "" : " (no memory for the page map)");
+  free(work);
+  return res;
+}
+
+esp_err_t log_fs_spiffs_mount(spi_nand_flash_device_t *dev, uint32_t first_sector,
+                              uint32_t sector_count) {
+  uint32_t capacity = 0;
+  uint32_t sector_bytes = 0;
+  esp_err_t ret = spi_nand_flash_get_capacity(dev, &capacity);
+  if (ret == ESP_OK) {
+    ret = spi_nand_flash_get_sector_size(dev, &sector_bytes);
+  }
+  if (ret != ESP_OK) {
+    return ret;
+  }
+  if (first_sector >= capacity) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  if (sector_count == 0 || sector_count > capacity - first_sector) {
+    sector_count = capacity - first_sector;
+  }
+  // Whole blocks, and page indexes (spiffs_page_ix) fit 16 bits
+  sector_count -= sector_count % kPagesPerBlock;
+  if (sector_count > 0xFFFF - kPagesPerBlock + 1) {
+    sector_count = 0xFFFF - kPagesPerBlock + 1;
+    sector_count -= sector_count % kPagesPerBlock;
+  }
+  if (sector_count < 4 * kPagesPerBlock) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  if (!g_lock) {
+    g_lock = xSemaphoreCreateMutex();
+    if (!g_lock) {
+      return ESP_ERR_NO_MEM;
+    }
+  }
+  uint32_t fd_bytes = kMaxFiles * kFdBytes;
+  uint32_t cache_bytes = kCachePages * (sector_bytes + kCachePageOverhead) + kCacheHeaderBytes;
+  buffers_free();
+  g_work = (uint8_t *)malloc(2 * sector_bytes);
+  g_fds = (uint8_t *)malloc(fd_bytes);
+  g_cache = (uint8_t *)malloc(cache_bytes);
+  g_buf = (uint8_t *)malloc(sector_bytes);
+  g_read_buf = (uint8_t *)malloc(sector_bytes);
+  g_obj_map = (spiffs_obj_map_entry *)malloc(kObjMapEntries * sizeof(spiffs_obj_map_entry));
+  if (!g_work || !g_fds || !g_cache || !g_buf || !g_read_buf || !g_obj_map) {
+    buffers_free();
+    return ESP_ERR_NO_MEM;
+  }
+  g_dev = dev;
+  g_first_sector = first_sector;
+  g_sector_bytes = sector_bytes;
+  g_buf_sector = kNoSector;
+  g_buf_dirty = false;
+
+  spiffs_config cfg = {};
+  cfg.hal_read_f = hal_read;
+  cfg.hal_write_f = hal_write;
+  cfg.hal_erase_f = hal_erase;
+  cfg.phys_size = sector_count * sector_bytes;
+  cfg.phys_addr = 0;
+  cfg.phys_erase_block = kPagesPerBlock * sector_bytes;
+  cfg.log_block_size = kPagesPerBlock * sector_bytes;
+  cfg.log_page_size = sector_bytes;
+
+  s32_t res = SPIFFS_mount(&g_fs, &cfg, g_work, g_fds, fd_bytes, g_cache, cache_bytes, nullptr);
+  if (res >= 0) {
+    // A cut inside a SPIFFS update can leave an index pointing at a page it
+    // already deleted, or two copies of an index page. Only a check repairs
+    // that (cutting a file off before what cannot be mended), and there is
+    // no clean-shutdown marker to skip it by.
+    if (check_volume() < 0) {
+      ESP_LOGW(TAG, "Check failed (%ld)", (long)SPIFFS_errno(&g_fs));
+    }
+  } else {
+    ESP_LOGW(TAG, "No SPIFFS volume in sectors %lu-%lu (%ld), formatting", first_sector,
+             first_sector + sector_count - 1, (long)res);
+    SPIFFS_unmount(&g_fs);
+    res = SPIFFS_format(&g_fs);
+    if (res >= 0) {
+      res = SPIFFS_mount(&g_fs, &cfg, g_work, g_fds, fd_bytes, g_cache, cache_bytes, nullptr);
+    }
+  }
+  if (res >= 0 && !hal_sync()) {
+    res = SPIFFS_ERR_NOT_WRITABLE;
+  }
+  if (res < 0) {
+    ESP_LOGE(TAG, "Mount failed: %ld", (long)res);
+    SPIFFS_unmount(&g_fs);
+    buffers_free();
+    g_dev = nullptr;
+    return ESP_FAIL;
+  }
+  // Built after the check, which would throw it away again. Without it
+  // every open, stat and seek scans the lookup pages, so carry on.
+  if (SPIFFS_obj_map(&g_fs, g_obj_map, kObjMapEntries * sizeof(spiffs_obj_map_entry)) < 0) {
+    ESP_LOGW(TAG, "Object map failed (%ld), lookups will scan", (long)SPIFFS_errno(&g_fs));
+  }
+  ESP_LOGI(TAG, "Mounted: %lu blocks of %lu KB, %lu B pages, %lu index pages mapped%s",
+           g_fs.block_count, cfg.log_block_size / 1024, cfg.log_page_size, g_fs.obj_map_used,
+           g_fs.obj_map_lost ? " (map full)" : "");
+  return ESP_OK;
+}
+
+void log_fs_spiffs_unmount(void) {
+  if (!g_dev) {
+    return;
+  }
+  SPIFFS_unmount(&g_fs);
+  hal_sync();
+  g_dev = nullptr;
+  buffers_free();
+}
+
+const log_fs_ops_t *log_fs_spiffs_ops(void) {
+  return &kSpiffsOps;
+}
+
+bool log_fs_spiffs_gc(uint32_t budget_us) {
+  if (!g_dev) {
+    return false;
+  }
+  int64_t deadline = esp_timer_get_time() + budget_us;
+  s32_t res;
+  do {
+    res = SPIFFS_gc_step(&g_fs, kGcStepMoves);
+  } while (res > 0 && esp_timer_get_time() < deadline);
+  if (res < 0) {
+    ESP_LOGW(TAG, "Background GC failed (%ld)", (long)res);
+  }
+  return hal_sync() && res > 0;
+}
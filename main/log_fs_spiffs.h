@@ -0,0 +1,40 @@
+#pragma once
+
+#include "log_fs.h"
+#include "spi_nand_flash.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Log files in SPIFFS (components/spiffs_nand) on spi_nand_flash sectors.
+//
+// SPIFFS is laid out with the NAND's geometry: 2 KB logical pages (one
+// sector each) and 128 KB logical blocks (one erase block). It programs page
+// headers and lookup entries a few bytes at a time, which NAND with on-die
+// ECC cannot take in place, so it runs on top of Dhara's sectors rather
+// than the raw array: partial writes are merged into a one-sector buffer
+// and land as one sector write, and a block erase trims its sectors. The
+// 64 B spare area stays with the chip's ECC and Dhara.
+
+// Mount SPIFFS in sectors [first_sector, first_sector + sector_count) of
+// dev; sector_count 0 takes the rest of the device. A range without a
+// SPIFFS volume of that size is formatted.
+esp_err_t log_fs_spiffs_mount(spi_nand_flash_device_t *dev, uint32_t first_sector,
+                              uint32_t sector_count);
+void log_fs_spiffs_unmount(void);
+
+// log_fs backend for the mounted volume (pass to log_fs_set_ops)
+const log_fs_ops_t *log_fs_spiffs_ops(void);
+
+// Garbage collection from an idle hook, so appends rarely stall on a block
+// relocation: moves pages out of a block for about budget_us (a block erase
+// may overrun it) and erases the block once empty. Returns true while more
+// blocks want collecting.
+bool log_fs_spiffs_gc(uint32_t budget_us);
+
+#ifdef __cplusplus
+}
+#endif
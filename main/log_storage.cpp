@@ -8,6 +8,7 @@
 
 #include "log_storage.h"
 
+#include "crc16.h"
 #include "driver/spi_master.h"
 #include "esp_log.h"
 #include "esp_timer.h"
@@ -15,24 +16,122 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "log_format.h"
+#include "log_fs.h"
+#include "log_fs_raw.h"
+#include "log_fs_spiffs.h"
+#include "record_codec.h"
+#include "rollup.h"
+#include "spi_bus.h"
 #include "spi_nand_flash.h"
+#include "zone_map.h"
 
+#include <atomic>
 #include <dirent.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+// Store new sensor logs delta-coded (1) or as raw packed records (0). A log
+// written in the other format is moved aside to sensors.bak at init.
+#ifndef LOG_STORAGE_COMPRESSED
+#define LOG_STORAGE_COMPRESSED 1
+#endif
+
+// Record fields new segments store (LOG_FIELD_BIT mask, groups in
+// log_format.h). Fields left out cost no flash and read back as 0. Changing
+// the set takes effect from the next segment; older segments keep the
+// schema they were written with and stay readable in place. The default
+// holds the groups storage_sink_task() fills: the SPS30 gives the particle
+// group, while GPS waits for a fix source.
+#ifndef LOG_STORAGE_FIELDS
+#define LOG_STORAGE_FIELDS (LOG_FIELDS_CORE | LOG_FIELDS_PARTICLES | LOG_FIELDS_MOTION)
+#endif
+
+// Sensor log capacity in 2 KB segment slots (16384 = 32 MB). Clamped to 3/4
+// of the FATFS free space when the log is created, then fixed; once full the
+// oldest segment is dropped for each new one.
+#ifndef LOG_STORAGE_RING_SEGMENTS
+#define LOG_STORAGE_RING_SEGMENTS 16384
+#endif
+
+// Keep a zone map per segment (sensors.zm, zone_map.h): field counts, min,
+// max and sum, so sensor_record_aggregate() skips decoding the segments
+// inside its range. Costs 180 bytes of flash per 2 KB slot, written every
+// 8 sealed segments. Without them aggregates decode every segment.
+#ifndef LOG_STORAGE_ZONE_MAPS
+#define LOG_STORAGE_ZONE_MAPS 1
+#endif
+
+// Depth of the sensor_record_enqueue() ring in records (power of two).
+// 64 records = 3.4 KB RAM, about a minute of 1 Hz samples while the writer
+// waits on the lock or the flash.
+#ifndef LOG_STORAGE_QUEUE_DEPTH
+#define LOG_STORAGE_QUEUE_DEPTH 64
+#endif
+
+// Period of the one-line latency summary logged by the writer task; 0
+// turns it off
+#ifndef LOG_STORAGE_STATS_LOG_MS
+#define LOG_STORAGE_STATS_LOG_MS 300000
+#endif
+
+// Keep the sensor log on raw NAND sectors (log_fs_raw.h) instead of FATFS:
+// each flush programs only the sectors it changed, with no FAT or directory
+// updates. Or, with LOG_STORAGE_SPIFFS, in SPIFFS (log_fs_spiffs.h). Either
+// engine owns LOG_STORAGE_RAW_SECTORS sectors (0 = the rest of the device)
+// from LOG_STORAGE_RAW_FIRST_SECTOR and FATFS is not mounted. Switching
+// engines formats the NAND on the next boot.
+#ifndef LOG_STORAGE_RAW
+#define LOG_STORAGE_RAW 0
+#endif
+#ifndef LOG_STORAGE_SPIFFS
+#define LOG_STORAGE_SPIFFS 0
+#endif
+#if LOG_STORAGE_RAW && LOG_STORAGE_SPIFFS
+#error "LOG_STORAGE_RAW and LOG_STORAGE_SPIFFS are exclusive"
+#endif
+#define LOG_STORAGE_FATFS (!LOG_STORAGE_RAW && !LOG_STORAGE_SPIFFS)
+#ifndef LOG_STORAGE_RAW_FIRST_SECTOR
+#define LOG_STORAGE_RAW_FIRST_SECTOR 0
+#endif
+#ifndef LOG_STORAGE_RAW_SECTORS
+#define LOG_STORAGE_RAW_SECTORS 0
+#endif
+// SPIFFS engine: when its queue is empty the writer collects garbage for up
+// to this long per pass (log_fs_spiffs_gc), so appends rarely have to. 0
+// leaves all collection to the appends.
+#ifndef LOG_STORAGE_SPIFFS_GC_US
+#define LOG_STORAGE_SPIFFS_GC_US 20000
+#endif
+
+// Fast mount: no file listing or test records at boot, and the index
+// entries and rollup buckets a power cut lost are caught up in the writer's
+// first idle pass (or by the first write or rollup query, if sooner), so
+// the sensor log is ready once the ring meta and the open segment are
+// loaded. Reads walk unindexed segments meanwhile. SPIFFS still checks the
+// volume at mount: after a cut, files can fail to read until it has.
+#ifndef LOG_STORAGE_FAST_MOUNT
+#define LOG_STORAGE_FAST_MOUNT 1
+#endif
 
 static const char *TAG = "log_store";
 
 // W25N512GV SPI NAND configuration
-// Shares SPI2_HOST bus with e-paper display (already initialized)
+// Shares SPI2_HOST bus with e-paper display (already initialized); CS pin and
+// clock come from the bus arbiter's NAND profile
 static const spi_host_device_t kNandSpiHost = SPI2_HOST;
-static const int kNandPinCs = 4;
-static const int kNandClockHz = 10 * 1000 * 1000;
 
+#if LOG_STORAGE_FATFS
 // Mount point for FATFS
-static const char *kMountPoint = "/nand";
-static const char *kSensorDataFile = "/nand/sensors.bin";
+static const char *kMountPoint = LOG_STORAGE_MOUNT_POINT;
+#endif
+static const char *kSensorDataFile = LOG_STORAGE_MOUNT_POINT "/sensors.bin";
+static const char *kSensorIndexFile = LOG_STORAGE_MOUNT_POINT "/sensors.idx";
+static const char *kSensorArchiveFile = LOG_STORAGE_MOUNT_POINT "/sensors.bak";
+static const char *kSensorZoneFile = LOG_STORAGE_MOUNT_POINT "/sensors.zm";
 
 // State
 static spi_device_handle_t g_nand_spi = nullptr;
@@ -42,46 +141,1235 @@ static SemaphoreHandle_t g_storage_lock = nullptr;
 static bool g_storage_ready = false;
 static bool g_mount_started = false;
 
-// Sensor record file handle (unused for now, using open/close per operation)
-// static FILE *g_sensor_file = nullptr;
-static int32_t g_record_count = -1;
+// Live records on flash + records staged. Written under g_storage_lock;
+// atomic so sensor_record_count() can read it without the lock.
+static std::atomic<int32_t> g_record_count{-1};
+static uint32_t g_sector_size = 2048;
+
+// Index entries and rollup buckets still to catch up after a fast mount
+static bool g_catch_up_pending = false;
+
+// ----------------------------------------------------------------------------
+// Segment ring layout
+// ----------------------------------------------------------------------------
+// sensors.bin is a ring of g_ring_capacity slots (layout in log_format.h).
+// Segments are numbered from 0 forever; segment s lives in slot
+// s % capacity. The slot header names its segment, so a stale slot from the
+// previous lap is never mistaken for a live one. The block after it holds
+// fixed-width raw records, or a variable number of delta-coded records plus
+// a trailer (see record_codec.h). New blocks are format 2 with the fields of
+// LOG_STORAGE_FIELDS; format 1 slots of a log written by older firmware are
+// read as they are. The file grows to capacity slots, then wraps.
+//
+// Records are numbered from 0 forever too; the API's index 0 is the oldest
+// live record (g_head_record). Sealing a segment when the ring is full drops
+// the oldest segment (g_head_segment) in O(1): only the ring meta changes.
+//
+// sensors.idx holds two copies of ring_meta_t, each in its own sector, then
+// one segment_header_t per ring slot: first/last timestamp, first record,
+// record count and per-field min/max. The meta copies alternate with a
+// generation counter, so a torn write leaves the other copy intact. Range
+// queries binary-search the headers of live segments and read only the
+// slots that overlap; record lookups binary-search first_record. Data is
+// always written before its index entry and the meta last, so a lagging
+// index is rebuilt from sensors.bin at init. A segment's first write into a
+// slot from the previous lap puts the slot header down last.
+//
+// sensors.zm holds one zone_map_t per ring slot: per-field count, min, max
+// and sum of the segment, gathered in RAM at seal and written a few at a
+// time. Entries name their segment and carry a CRC; a missing, stale or
+// torn one (or one lost with RAM at a power cut) only means aggregates
+// decode that segment instead.
+static const size_t kSegmentBytes = LOG_SEGMENT_BYTES;
+static const size_t kBlockBytes = kSegmentBytes - sizeof(slot_header_t);
+static const size_t kZoneMapBytes = LOG_STORAGE_ZONE_MAPS ? sizeof(zone_map_t) : 0;
+static const record_encoding_t kSegmentEncoding =
+    LOG_STORAGE_COMPRESSED ? RECORD_ENCODING_DELTA : RECORD_ENCODING_RAW;
+static const uint32_t kRecordFields = (LOG_STORAGE_FIELDS) & LOG_FIELDS_ALL;
+static_assert(kRecordFields != 0, "LOG_STORAGE_FIELDS selects no known field");
+static_assert(LOG_FIELD_COUNT <= 32, "schema ids are 32-bit field masks");
+
+static const uint32_t kMetaMagic = 0x474E5253;  // "SRNG"
+static const uint16_t kMetaVersion = 2;          // 2: schema header follows
+static const uint16_t kMetaVersionFormat1 = 1;  // Format 1 slots only
+static const uint16_t kMetaFlagSorted = 0x0001;  // Segment timestamps ascend
+static const uint16_t kMetaFlagDelta = 0x0002;   // Slots are delta-coded
+static const long kMetaCopyBytes = 2048;         // One sector per copy
+static const long kIndexEntriesOffset = 2 * kMetaCopyBytes;
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t flags;
+  uint32_t generation;        // Bumped per write; newest valid copy wins
+  uint16_t segment_bytes;
+  uint16_t record_size;
+  uint32_t capacity;          // Ring slots
+  uint32_t head_segment;      // Oldest live segment
+  uint32_t head_record;       // Its first record
+  uint32_t sealed_segments;   // Segments sealed so far; the open one is next
+  uint32_t sealed_records;    // Records in those segments, head or not
+  uint32_t indexed_segments;  // Segments below this have an index entry
+  uint16_t reserved;
+  uint16_t crc16;             // CRC16 over all preceding bytes
+} ring_meta_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t first_timestamp_ms;
+  uint32_t last_timestamp_ms;
+  uint32_t first_record;  // Index of the segment's first record
+  uint16_t record_count;
+  uint16_t used_bytes;       // Encoded bytes in the block
+  sensor_record_core_t min;  // Field-wise minimum (timestamp/reserved/crc unused)
+  sensor_record_core_t max;  // Field-wise maximum
+  uint16_t crc16;            // CRC16 over all preceding bytes
+} segment_header_t;
+
+// One meta copy: the ring meta, then the schema header (file header) naming
+// the fields new segments store and the type of every known field
+typedef struct __attribute__((packed)) {
+  ring_meta_t ring;
+  log_schema_header_t schema;
+} meta_copy_t;
+
+static uint32_t g_ring_capacity = 0;    // Slots; 0 until the log is opened
+static uint32_t g_meta_generation = 0;
+static uint32_t g_head_segment = 0;     // Oldest live segment
+static uint32_t g_head_record = 0;      // Its first record
+static uint32_t g_sealed_segments = 0;  // Sealed segments (live or dropped)
+static uint32_t g_sealed_records = 0;   // First record of the open segment
+static uint32_t g_index_entries = 0;    // Segments below this are indexed
+static uint32_t g_indexed_records = 0;  // First record of segment g_index_entries
+static uint32_t g_last_sealed_ts = 0;
+static bool g_index_sorted = true;
+
+// Write-behind staging: the open (partially filled) segment is encoded in
+// RAM as the exact slot image, and rewritten to its slot in one
+// open/write/close instead of one write per sample. The slot is one NAND
+// sector, so a rewrite programs the same page an append would. Flushed when
+// the oldest unflushed record exceeds kStagingMaxAgeMs, when the slot fills
+// (sealed), on log_storage_flush() and on deinit (shutdown). Unflushed
+// records are lost on a hard power cut (at most kStagingMaxAgeMs).
+static const int64_t kStagingMaxAgeMs = 30000;
+
+// At init, rollups are rebuilt from at most this many of the newest records
+// (a day at 1 Hz), bounding the boot cost when they are new or far behind
+static const uint32_t kRollupCatchUpMax = 86400;
+
+static uint8_t g_open_image[kSegmentBytes];
+static record_encoder_t g_open_enc;
+static uint32_t g_open_flushed_records = 0;  // Of g_open_enc.count, on flash
+static int64_t g_staging_first_ms = 0;
+static segment_header_t g_open_header = {};
+static sensor_aggregate_t g_open_zone = {};  // Zone map of the open segment
+static bool g_open_regressed = false;  // Timestamp went backwards in segment
+
+// Zone maps of the newest sealed segments, consecutive from
+// g_zone_pending[0].segment, written to sensors.zm in one go once
+// kZonePendingMax have gathered or on log_storage_flush()
+static const uint32_t kZonePendingMax = 8;
+static zone_map_t g_zone_pending[kZonePendingMax];
+static uint32_t g_zone_pending_count = 0;
+
+// Scratch for reading one slot back while holding g_storage_lock
+static uint8_t g_read_image[kSegmentBytes];
+
+static log_storage_stats_t g_stats = {};
+
+// Asynchronous write path: sensor_record_enqueue() copies into a lock-free
+// single-producer/single-consumer ring and returns; the low-priority writer
+// task drains it through sensor_record_write(). Indices run freely and are
+// masked on access. The producer owns g_queue_tail, the writer g_queue_head.
+static const uint32_t kQueueDepth = LOG_STORAGE_QUEUE_DEPTH;
+static_assert((kQueueDepth & (kQueueDepth - 1)) == 0,
+              "LOG_STORAGE_QUEUE_DEPTH must be a power of two");
+static const uint32_t kWriterIdleMs = 1000;  // Retry period after a failed write
+static const uint32_t kWriterGcPauseMs = 50;  // Between garbage collection passes
+
+static sensor_record_t g_queue[kQueueDepth];
+static std::atomic<uint32_t> g_queue_head{0};
+static std::atomic<uint32_t> g_queue_tail{0};
+static std::atomic<uint32_t> g_queue_enqueued{0};
+static std::atomic<uint32_t> g_queue_dropped{0};
+static std::atomic<uint32_t> g_queue_high_water{0};
+static std::atomic<bool> g_writer_stop{false};
+static std::atomic<uint32_t> g_lock_timeouts{0};  // Counted outside the lock
+
+// SPI2 claim for the NAND, taken on the first FATFS access under the storage
+// lock and dropped with it. Bulk readers claim it as background work.
+static bool g_bus_held = false;
+static spi_bus_prio_t g_bus_prio = SPI_BUS_PRIO_STORAGE;
+static TaskHandle_t g_writer_task = nullptr;
+static SemaphoreHandle_t g_writer_done = nullptr;
+
+// File handles for slot, index and zone map reads, opened on first use
+typedef struct {
+  log_fs_file_t *data;
+  log_fs_file_t *idx;
+  log_fs_file_t *zm;
+} segment_reader_t;
 
 // ============================================================================
-// CRC16 Implementation
+// Internal Helper Functions
 // ============================================================================
 
-static uint16_t crc16_ccitt(const uint8_t *data, size_t len) {
-  uint16_t crc = 0xFFFF;
-  for (size_t i = 0; i < len; i++) {
-    crc ^= (uint16_t)data[i] << 8;
-    for (uint8_t j = 0; j < 8; j++) {
-      if (crc & 0x8000) {
-        crc = (crc << 1) ^ 0x1021;
-      } else {
-        crc <<= 1;
-      }
-    }
+// Fold the time since start_us into a latency histogram. Caller must hold
+// the lock.
+static void latency_add(log_storage_latency_t *h, int64_t start_us, bool ok) {
+  int64_t elapsed = esp_timer_get_time() - start_us;
+  uint32_t us = (elapsed <= 0) ? 0 : (elapsed >= UINT32_MAX) ? UINT32_MAX : (uint32_t)elapsed;
+  uint32_t bucket = (us == 0) ? 0 : 32 - __builtin_clz(us);
+  if (bucket >= LOG_STORAGE_HIST_BUCKETS) {
+    bucket = LOG_STORAGE_HIST_BUCKETS - 1;
+  }
+  h->count++;
+  if (!ok) {
+    h->failures++;
   }
-  return crc;
+  h->total_us += us;
+  if (us > h->max_us) {
+    h->max_us = us;
+  }
+  h->buckets[bucket]++;
 }
 
-// ============================================================================
-// Internal Helper Functions
-// ============================================================================
-
 static bool storage_lock(TickType_t timeout_ticks) {
   if (!g_storage_lock) {
     return false;
   }
-  return xSemaphoreTake(g_storage_lock, timeout_ticks) == pdTRUE;
+  int64_t start = esp_timer_get_time();
+  if (xSemaphoreTake(g_storage_lock, timeout_ticks) != pdTRUE) {
+    g_lock_timeouts.fetch_add(1, std::memory_order_relaxed);  // g_stats needs the lock
+    return false;
+  }
+  latency_add(&g_stats.lock_wait, start, true);
+  return true;
 }
 
 static void storage_unlock(void) {
+  if (g_bus_held) {
+    g_bus_held = false;
+    spi_bus_release(SPI_BUS_DEV_NAND);
+  }
+  g_bus_prio = SPI_BUS_PRIO_STORAGE;
   if (g_storage_lock) {
     xSemaphoreGive(g_storage_lock);
   }
 }
 
+// Claim SPI2 before touching FATFS; held until storage_unlock(). Caller must
+// hold the lock.
+static void nand_bus_enter(void) {
+  if (!g_bus_held) {
+    spi_bus_acquire(SPI_BUS_DEV_NAND, g_bus_prio, portMAX_DELAY);
+    g_bus_held = true;
+  }
+}
+
+static int64_t now_ms(void) { return esp_timer_get_time() / 1000; }
+
+static long segment_offset(uint32_t segment) {
+  return (long)(segment % g_ring_capacity) * (long)kSegmentBytes;
+}
+
+static long index_entry_offset(uint32_t segment) {
+  return kIndexEntriesOffset +
+         (long)(segment % g_ring_capacity) * (long)sizeof(segment_header_t);
+}
+
+static long zone_entry_offset(uint32_t segment) {
+  return (long)(segment % g_ring_capacity) * (long)sizeof(zone_map_t);
+}
+
+static void account_flash_write(long offset, size_t bytes) {
+  if (offset < 0) {
+    offset = 0;
+  }
+  uint32_t first_sector = (uint32_t)offset / g_sector_size;
+  uint32_t end_sector = ((uint32_t)offset + bytes + g_sector_size - 1) / g_sector_size;
+  g_stats.flash_bytes += (uint64_t)(end_sector - first_sector) * g_sector_size;
+}
+
+// Open an existing file for in-place writes, creating it if missing. Caller
+// must hold the lock.
+static log_fs_file_t *file_open_rw(const char *path) {
+  nand_bus_enter();
+  return log_fs_open(path, true);
+}
+
+// Caller must hold the lock
+static log_fs_file_t *file_open_ro(const char *path) {
+  nand_bus_enter();
+  return log_fs_open(path, false);
+}
+
+// Read up to len bytes at offset, timed into the fs_read histogram. Longer
+// reads go in bus slices, giving way to a waiting display refresh between
+// them. Returns bytes read. Caller must hold the lock.
+static size_t fs_read_at(log_fs_file_t *f, long offset, void *buf, size_t len) {
+  nand_bus_enter();
+  int64_t start = esp_timer_get_time();
+  size_t slice = spi_bus_slice_bytes(SPI_BUS_DEV_NAND, g_sector_size);
+  size_t got = 0;
+  while (got < len) {
+    size_t want = (len - got < slice) ? len - got : slice;
+    size_t n = log_fs_read_at(f, offset + (long)got, (uint8_t *)buf + got, want);
+    got += n;
+    if (n != want) {
+      break;
+    }
+    if (got < len) {
+      spi_bus_yield(SPI_BUS_DEV_NAND);
+    }
+  }
+  latency_add(&g_stats.fs_read, start, got == len);
+  g_stats.bytes_read += got;
+  spi_bus_yield(SPI_BUS_DEV_NAND);
+  return got;
+}
+
+// Write len bytes at offset of path in one open/seek/write/close (f_close
+// syncs FATFS buffers to NAND), timed into the fs_write histogram and
+// sliced like fs_read_at(). Caller must hold the lock.
+static esp_err_t fs_write_at(const char *path, long offset, const void *buf, size_t len) {
+  int64_t start = esp_timer_get_time();
+  log_fs_file_t *f = file_open_rw(path);
+  size_t slice = spi_bus_slice_bytes(SPI_BUS_DEV_NAND, g_sector_size);
+  size_t written = 0;
+  int close_ret = EOF;
+  if (f) {
+    while (written < len) {
+      size_t want = (len - written < slice) ? len - written : slice;
+      size_t n = log_fs_write_at(f, offset + (long)written,
+                                 (const uint8_t *)buf + written, want);
+      written += n;
+      if (n != want) {
+        break;
+      }
+      if (written < len) {
+        spi_bus_yield(SPI_BUS_DEV_NAND);
+      }
+    }
+    close_ret = log_fs_close(f);
+  }
+  bool ok = (written == len && close_ret == 0);
+  latency_add(&g_stats.fs_write, start, ok);
+  spi_bus_yield(SPI_BUS_DEV_NAND);
+  if (!ok) {
+    return ESP_FAIL;
+  }
+  g_stats.bytes_written += len;
+  account_flash_write(offset, len);
+  return ESP_OK;
+}
+
+static void reader_close(segment_reader_t *rd) {
+  if (rd->data) {
+    log_fs_close(rd->data);
+    rd->data = nullptr;
+  }
+  if (rd->idx) {
+    log_fs_close(rd->idx);
+    rd->idx = nullptr;
+  }
+  if (rd->zm) {
+    log_fs_close(rd->zm);
+    rd->zm = nullptr;
+  }
+}
+
+static void slot_header_stamp(uint8_t *image, uint32_t segment, record_format_t format) {
+  slot_header_t hdr = {
+      .segment = segment,
+      .magic = (uint16_t)((format == RECORD_FORMAT_1) ? LOG_SLOT_MAGIC : LOG_SLOT_MAGIC_V2),
+      .crc16 = 0,
+  };
+  hdr.crc16 = crc16_ccitt((const uint8_t *)&hdr, sizeof(hdr) - sizeof(uint16_t));
+  memcpy(image, &hdr, sizeof(hdr));
+}
+
+static bool slot_header_matches(const uint8_t *image, uint32_t segment) {
+  slot_header_t hdr;
+  memcpy(&hdr, image, sizeof(hdr));
+  return (hdr.magic == LOG_SLOT_MAGIC || hdr.magic == LOG_SLOT_MAGIC_V2) &&
+         hdr.segment == segment &&
+         hdr.crc16 == crc16_ccitt((const uint8_t *)&hdr, sizeof(hdr) - sizeof(uint16_t));
+}
+
+// Record format of the block in a slot image whose header checked out
+static record_format_t slot_format(const uint8_t *image) {
+  slot_header_t hdr;
+  memcpy(&hdr, image, sizeof(hdr));
+  return (hdr.magic == LOG_SLOT_MAGIC_V2) ? RECORD_FORMAT_2 : RECORD_FORMAT_1;
+}
+
+// Read the slot of `segment` into image and check it still holds that
+// segment. FATFS caches the file size at open, so a short read reopens the
+// file once in case the slot was written since.
+static bool slot_read_locked(segment_reader_t *rd, uint32_t segment, uint8_t *image) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (attempt > 0 || !rd->data) {
+      if (rd->data) {
+        log_fs_close(rd->data);
+      }
+      rd->data = file_open_ro(kSensorDataFile);
+      if (!rd->data) {
+        return false;
+      }
+    }
+    if (fs_read_at(rd->data, segment_offset(segment), image, kSegmentBytes) ==
+        kSegmentBytes) {
+      return slot_header_matches(image, segment);
+    }
+  }
+  return false;
+}
+
+static void segment_header_reset(segment_header_t *hdr) {
+  memset(hdr, 0, sizeof(*hdr));
+}
+
+// Fold one record into a segment summary (count, time span, per-field min/max
+// of the format 1 fields)
+static void segment_header_add(segment_header_t *hdr, const sensor_record_t *rec) {
+  if (hdr->record_count == 0) {
+    hdr->first_timestamp_ms = rec->timestamp_ms;
+    memcpy(&hdr->min, rec, sizeof(hdr->min));
+    memcpy(&hdr->max, rec, sizeof(hdr->max));
+  }
+  hdr->last_timestamp_ms = rec->timestamp_ms;
+  hdr->record_count++;
+
+#define SEG_MINMAX(field)                                    \
+  do {                                                       \
+    if (rec->field < hdr->min.field) hdr->min.field = rec->field; \
+    if (rec->field > hdr->max.field) hdr->max.field = rec->field; \
+  } while (0)
+  SEG_MINMAX(timestamp_ms);
+  SEG_MINMAX(co2_ppm);
+  SEG_MINMAX(temp_c_x100);
+  SEG_MINMAX(rh_x100);
+  SEG_MINMAX(pm25_x10);
+  SEG_MINMAX(pm10_x10);
+  SEG_MINMAX(pm1_x10);
+  SEG_MINMAX(voc_index);
+  SEG_MINMAX(nox_index);
+  SEG_MINMAX(pressure_pa);
+#undef SEG_MINMAX
+}
+
+static void segment_header_seal(segment_header_t *hdr) {
+  hdr->min.reserved = hdr->max.reserved = 0;
+  hdr->min.crc16 = hdr->max.crc16 = 0;
+  hdr->crc16 = crc16_ccitt((const uint8_t *)hdr,
+                           sizeof(segment_header_t) - sizeof(uint16_t));
+}
+
+static bool segment_header_valid(const segment_header_t *hdr) {
+  return hdr->crc16 == crc16_ccitt((const uint8_t *)hdr,
+                                   sizeof(segment_header_t) - sizeof(uint16_t));
+}
+
+// A version 1 copy (older firmware) is the ring meta alone; version 2 is
+// followed by the schema header, which must check out too
+static bool meta_valid(const meta_copy_t *copy, size_t len) {
+  const ring_meta_t *meta = &copy->ring;
+  if (len < sizeof(*meta) || meta->magic != kMetaMagic ||
+      (meta->version != kMetaVersion && meta->version != kMetaVersionFormat1) ||
+      meta->crc16 != crc16_ccitt((const uint8_t *)meta,
+                                 sizeof(ring_meta_t) - sizeof(uint16_t))) {
+    return false;
+  }
+  if (meta->version == kMetaVersionFormat1) {
+    return true;
+  }
+  const log_schema_header_t *schema = &copy->schema;
+  return len == sizeof(*copy) && schema->magic == LOG_SCHEMA_MAGIC &&
+         schema->crc16 == crc16_ccitt((const uint8_t *)schema,
+                                      sizeof(*schema) - sizeof(uint16_t));
+}
+
+// Load the newer valid meta copy. Returns false if neither checks out.
+static bool meta_read(log_fs_file_t *idx, meta_copy_t *out) {
+  bool found = false;
+  for (long copy = 0; copy < 2; copy++) {
+    meta_copy_t meta;
+    size_t got = fs_read_at(idx, copy * kMetaCopyBytes, &meta, sizeof(meta));
+    if (!meta_valid(&meta, got)) {
+      continue;
+    }
+    if (!found || (int32_t)(meta.ring.generation - out->ring.generation) > 0) {
+      *out = meta;
+      if (meta.ring.version == kMetaVersionFormat1) {
+        memset(&out->schema, 0, sizeof(out->schema));
+      }
+      found = true;
+    }
+  }
+  return found;
+}
+
+// Type of every known field, for the schema header
+static const log_field_desc_t kFieldTable[] = {
+#define FIELD_DESC(id, name, type) {id, LOG_FIELD_TYPE(type)},
+    LOG_FIELDS(FIELD_DESC)
+#undef FIELD_DESC
+};
+
+// Persist the ring state into the older meta copy. Caller must hold the lock.
+static esp_err_t meta_write_locked(void) {
+  meta_copy_t copy = {};
+  copy.schema.magic = LOG_SCHEMA_MAGIC;
+  copy.schema.schema_id = kRecordFields;
+  copy.schema.field_count = (uint8_t)LOG_FIELD_COUNT;
+  memcpy(copy.schema.fields, kFieldTable, sizeof(kFieldTable));
+  copy.schema.crc16 = crc16_ccitt((const uint8_t *)&copy.schema,
+                                  sizeof(copy.schema) - sizeof(uint16_t));
+
+  ring_meta_t &meta = copy.ring;
+  meta = {
+      .magic = kMetaMagic,
+      .version = kMetaVersion,
+      .flags = (uint16_t)((g_index_sorted ? kMetaFlagSorted : 0) |
+                          ((kSegmentEncoding == RECORD_ENCODING_DELTA) ? kMetaFlagDelta
+                                                                       : 0)),
+      .generation = g_meta_generation + 1,
+      .segment_bytes = (uint16_t)kSegmentBytes,
+      .record_size = (uint16_t)sizeof(sensor_record_core_t),
+      .capacity = g_ring_capacity,
+      .head_segment = g_head_segment,
+      .head_record = g_head_record,
+      .sealed_segments = g_sealed_segments,
+      .sealed_records = g_sealed_records,
+      .indexed_segments = g_index_entries,
+      .reserved = 0,
+      .crc16 = 0,
+  };
+  meta.crc16 = crc16_ccitt((const uint8_t *)&meta, sizeof(meta) - sizeof(uint16_t));
+
+  long offset = (long)(meta.generation % 2) * kMetaCopyBytes;
+  if (fs_write_at(kSensorIndexFile, offset, &copy, sizeof(copy)) != ESP_OK) {
+    return ESP_FAIL;
+  }
+  g_meta_generation = meta.generation;
+  return ESP_OK;
+}
+
+// Write the header for segment g_index_entries. Caller must hold the lock.
+static esp_err_t index_append_locked(const segment_header_t *hdr) {
+  if (fs_write_at(kSensorIndexFile, index_entry_offset(g_index_entries), hdr,
+                  sizeof(*hdr)) != ESP_OK) {
+    return ESP_FAIL;
+  }
+  g_index_entries++;
+  g_indexed_records = hdr->first_record + hdr->record_count;
+  return ESP_OK;
+}
+
+static esp_err_t index_read_locked(log_fs_file_t *f, uint32_t segment, segment_header_t *hdr) {
+  if (fs_read_at(f, index_entry_offset(segment), hdr, sizeof(*hdr)) != sizeof(*hdr)) {
+    return ESP_FAIL;
+  }
+  return segment_header_valid(hdr) ? ESP_OK : ESP_ERR_INVALID_CRC;
+}
+
+static esp_err_t reader_index_read_locked(segment_reader_t *rd, uint32_t segment,
+                                          segment_header_t *hdr) {
+  if (!rd->idx) {
+    rd->idx = file_open_ro(kSensorIndexFile);
+    if (!rd->idx) {
+      return ESP_FAIL;
+    }
+  }
+  return index_read_locked(rd->idx, segment, hdr);
+}
+
+// Write the pending zone maps. A failure only costs aggregates a decode of
+// those segments. Caller must hold the lock.
+static void zone_flush_locked(void) {
+  if (g_zone_pending_count == 0) {
+    return;
+  }
+  uint32_t first = g_zone_pending[0].segment;
+  if (fs_write_at(kSensorZoneFile, zone_entry_offset(first), g_zone_pending,
+                  g_zone_pending_count * sizeof(zone_map_t)) != ESP_OK) {
+    ESP_LOGD(TAG, "Failed to write zone maps of segments %lu-%lu", first,
+             first + g_zone_pending_count - 1);
+  }
+  g_zone_pending_count = 0;
+}
+
+// Queue the zone map of sealed segment `segment`. Caller must hold the lock.
+static void zone_write_locked(uint32_t segment, const sensor_aggregate_t *zone) {
+  if (!LOG_STORAGE_ZONE_MAPS) {
+    return;
+  }
+  // Pending entries go out as one write, so they must be adjacent in the file
+  if (g_zone_pending_count > 0 &&
+      (segment != g_zone_pending[0].segment + g_zone_pending_count ||
+       segment % g_ring_capacity == 0)) {
+    zone_flush_locked();
+  }
+  zone_map_pack(&g_zone_pending[g_zone_pending_count++], segment, zone);
+  if (g_zone_pending_count == kZonePendingMax) {
+    zone_flush_locked();
+  }
+}
+
+// Fold the zone map of `segment` into agg. Returns false, leaving agg
+// unchanged, if there is no valid one.
+static bool reader_zone_merge_locked(segment_reader_t *rd, uint32_t segment,
+                                     sensor_aggregate_t *agg) {
+  if (!LOG_STORAGE_ZONE_MAPS) {
+    return false;
+  }
+  uint32_t pending = segment - g_zone_pending[0].segment;
+  if (g_zone_pending_count > 0 && pending < g_zone_pending_count) {
+    return zone_map_merge_entry(agg, &g_zone_pending[pending], segment);
+  }
+  if (!rd->zm) {
+    rd->zm = file_open_ro(kSensorZoneFile);
+    if (!rd->zm) {
+      return false;
+    }
+  }
+  zone_map_t zm;
+  return fs_read_at(rd->zm, zone_entry_offset(segment), &zm, sizeof(zm)) == sizeof(zm) &&
+         zone_map_merge_entry(agg, &zm, segment);
+}
+
+// Point dec at the records of the open segment, from a copy of its block
+// (or the RAM image itself). Caller must hold the lock.
+static void open_decoder_init(record_decoder_t *dec, const uint8_t *block) {
+  record_decoder_init(dec, g_open_enc.encoding, g_open_enc.schema.format, block,
+                      g_open_enc.used);
+}
+
+// Read one sealed segment into g_read_image and point dec at its records.
+// A slot that cannot be read, holds another segment or fails its block CRC
+// decodes as empty.
+static bool segment_read_locked(segment_reader_t *rd, uint32_t segment,
+                                record_decoder_t *dec) {
+  uint8_t *block = &g_read_image[sizeof(slot_header_t)];
+  if (!slot_read_locked(rd, segment, g_read_image)) {
+    record_decoder_init(dec, kSegmentEncoding, RECORD_FORMAT_2, block, 0);
+    return false;
+  }
+  return record_decoder_init_sealed(dec, kSegmentEncoding, slot_format(g_read_image),
+                                    block, kBlockBytes);
+}
+
+static void segment_summarize(record_decoder_t *dec, uint32_t first_record,
+                              segment_header_t *hdr, sensor_aggregate_t *zone) {
+  segment_header_reset(hdr);
+  zone_map_clear(zone);
+  sensor_record_t rec;
+  while (record_decoder_next(dec, &rec) == 1) {
+    segment_header_add(hdr, &rec);
+    zone_map_add(zone, dec->schema.schema_id, &rec);
+  }
+  hdr->first_record = first_record;
+  hdr->used_bytes = (uint16_t)dec->used;
+  segment_header_seal(hdr);
+}
+
+// Records in sealed segment `segment`, from its index entry or its slot
+static uint32_t segment_count_locked(segment_reader_t *rd, uint32_t segment) {
+  segment_header_t hdr;
+  if (segment < g_index_entries &&
+      reader_index_read_locked(rd, segment, &hdr) == ESP_OK) {
+    return hdr.record_count;
+  }
+  record_decoder_t dec;
+  segment_read_locked(rd, segment, &dec);
+  sensor_record_t rec;
+  while (record_decoder_next(&dec, &rec) == 1) {
+  }
+  return dec.count;
+}
+
+// Write headers for sealed segments that sensors.idx does not cover yet
+// (e.g. an index write failed). Caller must hold the lock.
+static esp_err_t index_catch_up_locked(void) {
+  if (g_index_entries >= g_sealed_segments) {
+    return ESP_OK;
+  }
+  segment_reader_t rd = {};
+  esp_err_t ret = ESP_OK;
+  while (g_index_entries < g_sealed_segments) {
+    record_decoder_t dec;
+    if (!segment_read_locked(&rd, g_index_entries, &dec)) {
+      ESP_LOGW(TAG, "Segment %lu unreadable, indexing as empty", g_index_entries);
+    }
+    segment_header_t hdr;
+    sensor_aggregate_t zone;
+    segment_summarize(&dec, g_indexed_records, &hdr, &zone);
+    if (hdr.first_timestamp_ms < g_last_sealed_ts ||
+        hdr.min.timestamp_ms < hdr.first_timestamp_ms) {
+      g_index_sorted = false;
+    }
+    g_last_sealed_ts = hdr.last_timestamp_ms;
+    zone_write_locked(g_index_entries, &zone);
+    ret = index_append_locked(&hdr);
+    if (ret != ESP_OK) {
+      break;
+    }
+  }
+  reader_close(&rd);
+  return ret;
+}
+
+// Find the live sealed segment holding record `record`: binary search on
+// first_record over indexed segments, then a walk over any the index does
+// not cover yet. Caller must hold the lock.
+static esp_err_t segment_locate_locked(segment_reader_t *rd, uint32_t record,
+                                       uint32_t *segment, uint32_t *first_record) {
+  if (record < g_indexed_records) {
+    uint32_t lo = g_head_segment, hi = g_index_entries;
+    segment_header_t hdr;
+    while (hi - lo > 1) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      esp_err_t ret = reader_index_read_locked(rd, mid, &hdr);
+      if (ret != ESP_OK) {
+        return ret;
+      }
+      if (hdr.first_record <= record) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    esp_err_t ret = reader_index_read_locked(rd, lo, &hdr);
+    if (ret != ESP_OK) {
+      return ret;
+    }
+    *segment = lo;
+    *first_record = hdr.first_record;
+    return ESP_OK;
+  }
+
+  uint32_t first = g_indexed_records;
+  for (uint32_t seg = g_index_entries; seg < g_sealed_segments; seg++) {
+    uint32_t n = segment_count_locked(rd, seg);
+    if (record < first + n) {
+      *segment = seg;
+      *first_record = first;
+      return ESP_OK;
+    }
+    first += n;
+  }
+  return ESP_ERR_NOT_FOUND;
+}
+
+// Point dec at record `record` (absolute number). Sealed segments are
+// decoded from a slot read into image, the open segment from a copy of its
+// RAM image. dec runs to the end of that block; a record past the newest
+// leaves dec empty. Caller must hold g_storage_lock.
+static esp_err_t block_seek_locked(segment_reader_t *rd, uint32_t record,
+                                   uint8_t *image, record_decoder_t *dec) {
+  uint8_t *block = &image[sizeof(slot_header_t)];
+  record_decoder_init(dec, kSegmentEncoding, RECORD_FORMAT_2, block, 0);
+  if (record < g_head_record) {
+    return ESP_ERR_NOT_FOUND;  // Dropped from the ring
+  }
+  if (g_record_count <= 0 || record - g_head_record >= (uint32_t)g_record_count) {
+    return ESP_OK;  // End of data
+  }
+
+  uint32_t first = g_sealed_records;
+  if (record >= g_sealed_records) {
+    memcpy(image, g_open_image, sizeof(slot_header_t) + g_open_enc.used);
+    open_decoder_init(dec, block);
+  } else {
+    uint32_t segment = 0;
+    esp_err_t ret = segment_locate_locked(rd, record, &segment, &first);
+    if (ret != ESP_OK) {
+      return ret;
+    }
+    if (!slot_read_locked(rd, segment, image) ||
+        !record_decoder_init_sealed(dec, kSegmentEncoding, slot_format(image), block,
+                                    kBlockBytes)) {
+      return ESP_FAIL;
+    }
+  }
+
+  // RAW blocks jump straight to the record; DELTA decodes its way there
+  return record_decoder_skip(dec, record - first) ? ESP_OK : ESP_FAIL;
+}
+
+static void open_segment_reset(void) {
+  // 0xFF past the last record marks the end of an open block on flash
+  memset(g_open_image, 0xFF, sizeof(g_open_image));
+  record_encoder_init(&g_open_enc, kSegmentEncoding, kRecordFields,
+                      &g_open_image[sizeof(slot_header_t)], kBlockBytes);
+  g_open_flushed_records = 0;
+  g_staging_first_ms = 0;
+  g_open_regressed = false;
+  segment_header_reset(&g_open_header);
+  zone_map_clear(&g_open_zone);
+}
+
+// Make room for segment g_sealed_segments: when the ring is full, drop the
+// oldest segment. Only counters change; the caller persists the meta.
+static void ring_reclaim_locked(void) {
+  if (g_sealed_segments - g_head_segment < g_ring_capacity) {
+    return;
+  }
+  segment_reader_t rd = {};
+  uint32_t dropped = segment_count_locked(&rd, g_head_segment);
+  reader_close(&rd);
+
+  g_head_record += dropped;
+  g_head_segment++;
+  g_record_count -= dropped;
+  if (g_index_entries < g_head_segment) {
+    g_index_entries = g_head_segment;
+    g_indexed_records = g_head_record;
+  }
+  ESP_LOGD(TAG, "Ring full, dropped segment %lu (%lu records)",
+           g_head_segment - 1, dropped);
+}
+
+// Close the full open segment: record its header, drop the oldest segment
+// if the ring is full and start a new one. The data is already on flash; a
+// failed index write is caught up later.
+static void segment_seal_locked(void) {
+  segment_header_t hdr = g_open_header;
+  hdr.first_record = g_sealed_records;
+  hdr.used_bytes = (uint16_t)g_open_enc.used;
+  segment_header_seal(&hdr);
+
+  if (g_open_regressed || (g_sealed_segments > g_head_segment &&
+                           hdr.first_timestamp_ms < g_last_sealed_ts)) {
+    g_index_sorted = false;
+  }
+  g_last_sealed_ts = hdr.last_timestamp_ms;
+
+  uint32_t segment = g_sealed_segments++;
+  g_sealed_records += hdr.record_count;
+  if (g_index_entries == segment) {
+    zone_write_locked(segment, &g_open_zone);
+    if (index_append_locked(&hdr) != ESP_OK) {
+      ESP_LOGW(TAG, "Failed to index segment %lu, will rebuild", segment);
+    }
+  } else if (index_catch_up_locked() != ESP_OK) {
+    ESP_LOGW(TAG, "Segment index behind (%lu/%lu)", g_index_entries,
+             g_sealed_segments);
+  }
+
+  ring_reclaim_locked();
+  if (meta_write_locked() != ESP_OK) {
+    // Next seal retries; until then init resumes this segment as open
+    ESP_LOGW(TAG, "Failed to persist ring meta");
+  }
+
+  open_segment_reset();
+}
+
+// Rewrite the open segment's slot with everything staged in one write.
+// With seal, pad the block out (plus the delta trailer) and close the
+// segment. Caller must hold g_storage_lock. On failure the records stay
+// staged and the next flush rewrites the whole slot.
+static esp_err_t staging_flush_locked(bool seal) {
+  uint32_t pending = g_open_enc.count - g_open_flushed_records;
+  if (pending == 0 && !seal) {
+    return ESP_OK;
+  }
+
+  slot_header_stamp(g_open_image, g_sealed_segments, g_open_enc.schema.format);
+  if (seal) {
+    record_encoder_seal(&g_open_enc);
+  }
+  long offset = segment_offset(g_sealed_segments);
+  size_t head = kSegmentBytes;
+  esp_err_t err = ESP_OK;
+  if (g_open_flushed_records == 0 && g_sealed_segments >= g_ring_capacity) {
+    // The slot still holds the previous lap, and a write spans several
+    // flash pages: put the block down first so a cut part way leaves the
+    // old header rather than new records running on into old ones
+    head = sizeof(slot_header_t);
+    err = fs_write_at(kSensorDataFile, offset + (long)head, g_open_image + head,
+                      kSegmentBytes - head);
+  }
+  if (err == ESP_OK) {
+    err = fs_write_at(kSensorDataFile, offset, g_open_image, head);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to flush %lu staged records", pending);
+    g_stats.flush_failures++;
+    return ESP_FAIL;
+  }
+
+  g_stats.flush_count++;
+  g_stats.records_flushed += pending;
+  g_stats.bytes_flushed += kSegmentBytes;
+
+  g_open_flushed_records = g_open_enc.count;
+  g_staging_first_ms = 0;
+  if (seal) {
+    segment_seal_locked();
+  }
+
+  // Rollup buckets closed since the last flush; failures are retried on the
+  // next one
+  rollup_flush(false);
+  return ESP_OK;
+}
+
+static void records_reset_state(void) {
+  g_record_count = 0;
+  g_ring_capacity = 0;
+  g_meta_generation = 0;
+  g_head_segment = 0;
+  g_head_record = 0;
+  g_sealed_segments = 0;
+  g_sealed_records = 0;
+  g_index_entries = 0;
+  g_indexed_records = 0;
+  g_last_sealed_ts = 0;
+  g_index_sorted = true;
+  g_zone_pending_count = 0;
+  open_segment_reset();
+}
+
+// Ring slots for a new log: LOG_STORAGE_RING_SEGMENTS, or fewer if 3/4 of
+// the FATFS free space (plus `reusable` bytes of an existing log) is smaller
+static uint32_t ring_capacity_fit(uint64_t reusable) {
+  uint64_t bytes_total = 0, bytes_free = 0;
+  uint64_t fit = LOG_STORAGE_RING_SEGMENTS;
+  if (log_fs_info(&bytes_total, &bytes_free) == ESP_OK) {
+    fit = ((bytes_free + reusable) * 3 / 4) /
+          (kSegmentBytes + sizeof(segment_header_t) + kZoneMapBytes);
+  }
+  return (fit < LOG_STORAGE_RING_SEGMENTS) ? (uint32_t)fit : LOG_STORAGE_RING_SEGMENTS;
+}
+
+// Start an empty log: size the ring from FATFS free space and write its
+// first meta. Caller must hold the lock.
+static esp_err_t ring_create_locked(void) {
+  nand_bus_enter();
+  log_fs_remove(kSensorDataFile);
+  log_fs_remove(kSensorIndexFile);
+  log_fs_remove(kSensorZoneFile);
+  records_reset_state();
+
+  g_ring_capacity = ring_capacity_fit(0);
+  if (g_ring_capacity < 2) {
+    ESP_LOGE(TAG, "Not enough free space for a sensor log");
+    g_ring_capacity = 0;
+    return ESP_ERR_NO_MEM;
+  }
+  ESP_LOGI(TAG, "Creating sensor log: %lu segments (%lu KB)", g_ring_capacity,
+           g_ring_capacity * (uint32_t)kSegmentBytes / 1024);
+  return meta_write_locked();
+}
+
+// Segment number stored in physical slot `slot`, if its header is valid
+static bool slot_header_read(log_fs_file_t *data, uint32_t slot, uint32_t *segment) {
+  slot_header_t hdr;
+  if (fs_read_at(data, (long)slot * (long)kSegmentBytes, &hdr, sizeof(hdr)) !=
+      sizeof(hdr)) {
+    return false;
+  }
+  *segment = hdr.segment;
+  return slot_header_matches((const uint8_t *)&hdr, hdr.segment);
+}
+
+// Recover the ring position from slot headers after the meta was lost: the
+// newest segment becomes the open one, and the live segments are the
+// unbroken run before it. Record numbering restarts at the head. Returns
+// ESP_ERR_NOT_FOUND if sensors.bin has no ring slots, ESP_ERR_INVALID_VERSION
+// if its slots use the other encoding. Caller must hold the lock.
+static esp_err_t ring_rebuild_locked(size_t file_size) {
+  uint32_t slots = file_size / kSegmentBytes;
+  log_fs_file_t *data = file_open_ro(kSensorDataFile);
+  if (!data) {
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  bool found = false, wrapped = false;
+  uint32_t newest = 0, newest_slot = 0;
+  for (uint32_t slot = 0; slot < slots; slot++) {
+    uint32_t segment;
+    if (!slot_header_read(data, slot, &segment)) {
+      continue;
+    }
+    if (!found || segment > newest) {
+      newest = segment;
+      newest_slot = slot;
+    }
+    wrapped |= (segment != slot);
+    found = true;
+  }
+  if (!found) {
+    log_fs_close(data);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  // Check the encoding on the newest block: a format 2 block names it, a
+  // format 1 block is delta-coded if its first record decodes that way
+  uint8_t head[sizeof(slot_header_t) + 2 + sizeof(sensor_record_core_t)];
+  size_t got =
+      fs_read_at(data, (long)newest_slot * (long)kSegmentBytes, head, sizeof(head));
+  record_format_t format = slot_format(head);
+  record_decoder_t dec;
+  sensor_record_t rec;
+  record_decoder_init(&dec, RECORD_ENCODING_DELTA, format, &head[sizeof(slot_header_t)],
+                      (got > sizeof(slot_header_t)) ? got - sizeof(slot_header_t) : 0);
+  bool is_delta = (format == RECORD_FORMAT_2)
+                      ? (!dec.bad_header && dec.encoding == RECORD_ENCODING_DELTA)
+                      : (record_decoder_next(&dec, &rec) == 1);
+  if (is_delta != (kSegmentEncoding == RECORD_ENCODING_DELTA)) {
+    log_fs_close(data);
+    return ESP_ERR_INVALID_VERSION;
+  }
+
+  // The file only reaches capacity slots before it wraps
+  if (wrapped) {
+    g_ring_capacity = slots;
+  } else {
+    uint32_t fit = ring_capacity_fit(file_size);
+    g_ring_capacity = (fit > slots) ? fit : slots;
+  }
+
+  uint32_t head_segment = newest;
+  while (head_segment > 0 && newest - (head_segment - 1) < g_ring_capacity) {
+    uint32_t segment;
+    uint32_t slot = (head_segment - 1) % g_ring_capacity;
+    if (slot >= slots || !slot_header_read(data, slot, &segment) ||
+        segment != head_segment - 1) {
+      break;
+    }
+    head_segment--;
+  }
+  log_fs_close(data);
+
+  g_head_segment = head_segment;
+  g_head_record = 0;
+  g_sealed_segments = newest;
+  g_index_entries = head_segment;
+  g_indexed_records = 0;
+  segment_reader_t rd = {};
+  g_sealed_records = 0;
+  for (uint32_t seg = head_segment; seg < newest; seg++) {
+    g_sealed_records += segment_count_locked(&rd, seg);
+  }
+  reader_close(&rd);
+  return ESP_OK;
+}
+
+// Decode records [first, first + count) (absolute numbers) into out.
+// Returns records copied.
+static size_t records_read_locked(uint32_t first, uint32_t count,
+                                  sensor_record_t *out) {
+  segment_reader_t rd = {};
+  size_t done = 0;
+
+  while (done < count) {
+    record_decoder_t dec;
+    if (block_seek_locked(&rd, first + done, g_read_image, &dec) != ESP_OK) {
+      break;
+    }
+    size_t before = done;
+    while (done < count && record_decoder_next(&dec, &out[done]) == 1) {
+      done++;
+    }
+    if (done == before) {
+      break;
+    }
+  }
+
+  reader_close(&rd);
+  return done;
+}
+
+// Fold records [first, end) (absolute numbers) into the rollup tiers.
+// Caller must hold the lock.
+static void rollup_catch_up_locked(uint32_t first, uint32_t end) {
+  if (end > kRollupCatchUpMax && first < end - kRollupCatchUpMax) {
+    first = end - kRollupCatchUpMax;
+  }
+  if (first < g_head_record) {
+    first = g_head_record;
+  }
+  if (first >= end) {
+    return;
+  }
+
+  segment_reader_t rd = {};
+  uint32_t number = first;
+  while (number < end) {
+    record_decoder_t dec;
+    if (block_seek_locked(&rd, number, g_read_image, &dec) != ESP_OK) {
+      break;
+    }
+    uint32_t before = number;
+    sensor_record_t rec;
+    while (number < end && record_decoder_next(&dec, &rec) == 1) {
+      rollup_add(number++, &rec);
+    }
+    if (number == before) {
+      break;
+    }
+  }
+  reader_close(&rd);
+  ESP_LOGI(TAG, "Rollups caught up over %lu records", number - first);
+}
+
+// Move an incompatible sensors.bin aside and start a new log
+static esp_err_t log_archive_locked(const char *reason) {
+  nand_bus_enter();
+  log_fs_remove(kSensorArchiveFile);
+  log_fs_rename(kSensorDataFile, kSensorArchiveFile);
+  ESP_LOGW(TAG, "Sensor log %s, moved to %s; starting a new log", reason,
+           kSensorArchiveFile);
+  return ring_create_locked();
+}
+
+// Load the ring position from the meta in sensors.idx (or rebuild it from
+// sensors.bin) and reload the open segment. Index entries and rollup
+// buckets a power cut lost are left to records_catch_up_locked(). Caller
+// must hold the lock.
+static esp_err_t records_load_locked(void) {
+  records_reset_state();
+  g_catch_up_pending = false;
+
+  nand_bus_enter();
+  long data_size = log_fs_stat_size(kSensorDataFile);
+  bool have_data = (data_size >= 0);
+
+  meta_copy_t copy;
+  ring_meta_t &meta = copy.ring;
+  bool meta_ok = false;
+  log_fs_file_t *idx = file_open_ro(kSensorIndexFile);
+  if (idx) {
+    meta_ok = meta_read(idx, &copy);
+  }
+
+  esp_err_t ret = ESP_OK;
+  if (!meta_ok) {
+    if (idx) {
+      log_fs_close(idx);
+    }
+    if (!have_data) {
+      return ring_create_locked();
+    }
+    ret = ring_rebuild_locked((size_t)data_size);
+    if (ret != ESP_OK) {
+      return log_archive_locked((ret == ESP_ERR_NOT_FOUND)
+                                    ? "has no ring slots (older format)"
+                                    : "uses another segment encoding");
+    }
+    ESP_LOGW(TAG, "Ring meta lost, rebuilt segments %lu-%lu from sensors.bin",
+             g_head_segment, g_sealed_segments);
+    meta_write_locked();
+  } else {
+    record_encoding_t file_encoding =
+        (meta.flags & kMetaFlagDelta) ? RECORD_ENCODING_DELTA : RECORD_ENCODING_RAW;
+    if (meta.segment_bytes != kSegmentBytes ||
+        meta.record_size != sizeof(sensor_record_core_t) || meta.capacity < 2 ||
+        file_encoding != kSegmentEncoding) {
+      log_fs_close(idx);
+      return log_archive_locked("uses another segment format");
+    }
+    if (meta.version == kMetaVersionFormat1) {
+      ESP_LOGI(TAG, "Format 1 log: new segments store fields 0x%05lx, older ones "
+               "are read as they are", kRecordFields);
+    } else if (copy.schema.schema_id != kRecordFields) {
+      ESP_LOGI(TAG, "Record fields 0x%05lx -> 0x%05lx; older segments keep theirs",
+               copy.schema.schema_id, kRecordFields);
+    }
+
+    g_ring_capacity = meta.capacity;
+    g_meta_generation = meta.generation;
+    g_head_segment = meta.head_segment;
+    g_head_record = meta.head_record;
+    g_sealed_segments = meta.sealed_segments;
+    g_sealed_records = meta.sealed_records;
+    g_index_sorted = (meta.flags & kMetaFlagSorted) != 0;
+
+    // Trust index entries up to the persisted mark, and only for live segments
+    g_index_entries = meta.indexed_segments;
+    if (g_index_entries > g_sealed_segments) {
+      g_index_entries = g_sealed_segments;
+    }
+    g_indexed_records = g_head_record;
+    if (g_index_entries <= g_head_segment) {
+      g_index_entries = g_head_segment;
+    } else {
+      segment_header_t last;
+      if (index_read_locked(idx, g_index_entries - 1, &last) == ESP_OK) {
+        g_last_sealed_ts = last.last_timestamp_ms;
+        g_indexed_records = last.first_record + last.record_count;
+      } else {
+        g_index_entries = g_head_segment;  // Unreadable tail entry: rebuild
+      }
+    }
+    log_fs_close(idx);
+  }
+
+  // Reload the open segment so reads and the next seal see it. Its slot may
+  // still hold a dropped segment from the previous lap, or nothing yet.
+  segment_reader_t rd = {};
+  if (slot_read_locked(&rd, g_sealed_segments, g_open_image)) {
+    // Keep filling it in its own format; the next segment gets kRecordFields
+    record_encoder_init(&g_open_enc, kSegmentEncoding,
+                        (slot_format(g_open_image) == RECORD_FORMAT_1) ? 0 : kRecordFields,
+                        &g_open_image[sizeof(slot_header_t)], kBlockBytes);
+    record_encoder_resume(&g_open_enc, g_open_enc.capacity);
+    g_open_flushed_records = g_open_enc.count;
+    memset(&g_open_image[sizeof(slot_header_t) + g_open_enc.used], 0xFF,
+           kBlockBytes - g_open_enc.used);
+
+    record_decoder_t dec;
+    open_decoder_init(&dec, g_open_enc.buf);
+    sensor_record_t rec;
+    while (record_decoder_next(&dec, &rec) == 1) {
+      if (g_open_header.record_count > 0 &&
+          rec.timestamp_ms < g_open_header.last_timestamp_ms) {
+        g_open_regressed = true;
+      }
+      segment_header_add(&g_open_header, &rec);
+      zone_map_add(&g_open_zone, dec.schema.schema_id, &rec);
+    }
+  } else {
+    open_segment_reset();
+  }
+  reader_close(&rd);
+
+  g_record_count = g_sealed_records - g_head_record + g_open_enc.count;
+  g_catch_up_pending = true;
+  return ESP_OK;
+}
+
+// Write the index entries and refold the rollup buckets a power cut lost;
+// a no-op once done. LOG_STORAGE_FAST_MOUNT defers this from init, but it
+// must come before the next record is folded into the rollups, which would
+// otherwise skip the ones refolded here. Caller must hold the lock.
+static void records_catch_up_locked(void) {
+  if (!g_catch_up_pending) {
+    return;
+  }
+  g_catch_up_pending = false;
+  int64_t start = esp_timer_get_time();
+
+  nand_bus_enter();
+  uint32_t indexed_before = g_index_entries;
+  if (index_catch_up_locked() != ESP_OK) {
+    ESP_LOGW(TAG, "Segment index rebuild incomplete (%lu/%lu)",
+             g_index_entries, g_sealed_segments);
+  }
+  if (g_index_entries != indexed_before) {
+    meta_write_locked();
+  }
+
+  // Refold what the rollup tiers have not seen: partial buckets lost with
+  // RAM at a power cut, or a log older than the tiers
+  uint32_t log_end = g_sealed_records + g_open_enc.count;
+  rollup_catch_up_locked(rollup_open(log_end), log_end);
+  latency_add(&g_stats.catch_up, start, true);
+}
+
 // ============================================================================
 // Mount Task - Runs in background to initialize NAND flash
 // ============================================================================
@@ -101,6 +1389,9 @@ static void log_storage_mount_task(void *arg) {
     }
   }
 
+  // Nothing else touches g_stats until g_storage_ready is set
+  int64_t mount_start = esp_timer_get_time();
+
   // SPI bus is already initialized by e-paper driver
   // Just add our NAND device to the bus
   ESP_LOGI(TAG, "Adding NAND device to SPI2_HOST bus...");
@@ -115,9 +1406,9 @@ static void log_storage_mount_task(void *arg) {
       .duty_cycle_pos = 128,
       .cs_ena_pretrans = 0,
       .cs_ena_posttrans = 0,
-      .clock_speed_hz = kNandClockHz,
+      .clock_speed_hz = (int)spi_bus_profile(SPI_BUS_DEV_NAND)->clock_hz,
       .input_delay_ns = 0,
-      .spics_io_num = kNandPinCs,
+      .spics_io_num = spi_bus_profile(SPI_BUS_DEV_NAND)->cs_pin,
       .flags = SPI_DEVICE_HALFDUPLEX,
       .queue_size = 10,
       .pre_cb = nullptr,
@@ -127,6 +1418,7 @@ static void log_storage_mount_task(void *arg) {
   ret = spi_bus_add_device(kNandSpiHost, &devcfg, &g_nand_spi);
   if (ret != ESP_OK) {
     ESP_LOGE(TAG, "Failed to add NAND SPI device: %s", esp_err_to_name(ret));
+    latency_add(&g_stats.mount, mount_start, false);
     vTaskDelete(nullptr);
     return;
   }
@@ -145,6 +1437,7 @@ static void log_storage_mount_task(void *arg) {
     ESP_LOGE(TAG, "Failed to init NAND device: %s", esp_err_to_name(ret));
     spi_bus_remove_device(g_nand_spi);
     g_nand_spi = nullptr;
+    latency_add(&g_stats.mount, mount_start, false);
     vTaskDelete(nullptr);
     return;
   }
@@ -155,6 +1448,9 @@ static void log_storage_mount_task(void *arg) {
   spi_nand_flash_get_sector_size(g_nand_device, &sector_size);
   spi_nand_flash_get_block_size(g_nand_device, &block_size);
   spi_nand_flash_get_block_num(g_nand_device, &num_blocks);
+  if (sector_size > 0) {
+    g_sector_size = sector_size;
+  }
 
   ESP_LOGI(TAG, "NAND Flash Info:");
   ESP_LOGI(TAG, "  - Sectors: %lu (sector size: %lu bytes)", num_sectors,
@@ -164,6 +1460,21 @@ static void log_storage_mount_task(void *arg) {
   ESP_LOGI(TAG, "  - Total capacity: %lu KB",
            (num_sectors * sector_size) / 1024);
 
+#if LOG_STORAGE_RAW
+  ESP_LOGI(TAG, "Mounting raw log volume on NAND flash...");
+  ret = log_fs_raw_mount(g_nand_device, LOG_STORAGE_RAW_FIRST_SECTOR,
+                         LOG_STORAGE_RAW_SECTORS);
+  if (ret == ESP_OK) {
+    log_fs_set_ops(log_fs_raw_ops());
+  }
+#elif LOG_STORAGE_SPIFFS
+  ESP_LOGI(TAG, "Mounting SPIFFS on NAND flash...");
+  ret = log_fs_spiffs_mount(g_nand_device, LOG_STORAGE_RAW_FIRST_SECTOR,
+                            LOG_STORAGE_RAW_SECTORS);
+  if (ret == ESP_OK) {
+    log_fs_set_ops(log_fs_spiffs_ops());
+  }
+#else
   // Mount FATFS on NAND
   ESP_LOGI(TAG, "Mounting FATFS on NAND flash...");
 
@@ -176,22 +1487,26 @@ static void log_storage_mount_task(void *arg) {
   };
 
   ret = esp_vfs_fat_nand_mount(kMountPoint, g_nand_device, &mount_config);
+#endif
   if (ret != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to mount FATFS: %s", esp_err_to_name(ret));
+    ESP_LOGE(TAG, "Failed to mount log volume: %s", esp_err_to_name(ret));
     spi_nand_flash_deinit_device(g_nand_device);
     g_nand_device = nullptr;
     spi_bus_remove_device(g_nand_spi);
     g_nand_spi = nullptr;
+    latency_add(&g_stats.mount, mount_start, false);
     vTaskDelete(nullptr);
     return;
   }
+  latency_add(&g_stats.mount, mount_start, true);
 
-  // Print FATFS size information
+  // Print volume size information
   uint64_t bytes_total = 0, bytes_free = 0;
-  esp_vfs_fat_info(kMountPoint, &bytes_total, &bytes_free);
-  ESP_LOGI(TAG, "FATFS mounted: %llu KB total, %llu KB free",
+  log_fs_info(&bytes_total, &bytes_free);
+  ESP_LOGI(TAG, "Log volume mounted: %llu KB total, %llu KB free",
            bytes_total / 1024, bytes_free / 1024);
 
+#if LOG_STORAGE_FATFS && !LOG_STORAGE_FAST_MOUNT
   // List files in mount point
   DIR *dir = opendir(kMountPoint);
   if (dir) {
@@ -207,18 +1522,165 @@ static void log_storage_mount_task(void *arg) {
         ESP_LOGI(TAG, "  - %s (size unknown)", ent->d_name);
       }
     }
-    closedir(dir);
+    closedir(dir);
+  }
+#endif
+
+  g_storage_ready = true;
+  ESP_LOGI(TAG, "=== NAND Flash Ready ===");
+
+  // Initialize sensor record storage
+  ret = sensor_record_init();
+  bool deferred = false;
+  if (storage_lock(portMAX_DELAY)) {
+    latency_add(&g_stats.ready, mount_start, ret == ESP_OK);
+    deferred = g_catch_up_pending;
+    storage_unlock();
+  }
+  ESP_LOGI(TAG, "Sensor log ready %lld ms after mount start%s",
+           (long long)(esp_timer_get_time() - mount_start) / 1000,
+           deferred ? ", catch-up deferred" : "");
+
+#if !LOG_STORAGE_FAST_MOUNT
+  // Run test
+  sensor_record_test();
+#endif
+
+  vTaskDelete(nullptr);
+}
+
+// ============================================================================
+// Writer Task - Drains the sensor_record_enqueue() ring into the log
+// ============================================================================
+
+// Write queued records oldest-first. A record leaves the queue only once
+// sensor_record_write() has taken it, so a lock timeout or a failed seal
+// just leaves it for the next wake. When stopping there is no next wake:
+// the first failure drops everything still queued.
+static void writer_drain(bool stopping) {
+  uint32_t head = g_queue_head.load(std::memory_order_relaxed);
+  uint32_t tail = g_queue_tail.load(std::memory_order_acquire);
+  while (head != tail) {
+    esp_err_t ret = sensor_record_write(&g_queue[head & (kQueueDepth - 1)]);
+    if (ret != ESP_OK) {
+      if (!stopping) {
+        return;
+      }
+      ESP_LOGW(TAG, "Writer stopping: %s, dropping %lu queued records",
+               esp_err_to_name(ret), tail - head);
+      g_queue_dropped.fetch_add(tail - head, std::memory_order_relaxed);
+      g_queue_head.store(tail, std::memory_order_release);
+      return;
+    }
+    head++;
+    g_queue_head.store(head, std::memory_order_release);
+    if (head == tail) {
+      tail = g_queue_tail.load(std::memory_order_acquire);
+    }
   }
+}
 
-  g_storage_ready = true;
-  ESP_LOGI(TAG, "=== NAND Flash Ready ===");
+// One line per histogram family: n, p50/p99/max in us and failures, then
+// byte totals. Lock failures are timeouts.
+static void stats_log(void) {
+  log_storage_stats_t stats;
+  if (log_storage_get_stats(&stats) != ESP_OK) {
+    return;
+  }
+  const struct {
+    const char *name;
+    const log_storage_latency_t *h;
+  } ops[] = {
+      {"wr", &stats.write},     {"rd", &stats.read},       {"lock", &stats.lock_wait},
+      {"fsw", &stats.fs_write}, {"fsr", &stats.fs_read},
+  };
+  char line[256];
+  int len = 0;
+  for (const auto &op : ops) {
+    if (len >= (int)sizeof(line)) {
+      break;
+    }
+    len += snprintf(&line[len], sizeof(line) - len, "%s %lu %lu/%lu/%lu !%lu ", op.name,
+                    op.h->count, log_storage_latency_percentile(op.h, 50),
+                    log_storage_latency_percentile(op.h, 99), op.h->max_us,
+                    op.h->failures);
+  }
+  ESP_LOGI(TAG, "%sio %lluK/%lluK", line, stats.bytes_read / 1024,
+           stats.bytes_written / 1024);
+
+  // SPI2 share: permille of time held, worst wait in ms, NAND yields
+  spi_bus_stats_t bus;
+  if (spi_bus_get_stats(&bus) == ESP_OK) {
+    ESP_LOGI(TAG, "bus epd %lu/1000 wait<=%lums, nand %lu/1000 wait<=%lums yield %lu",
+             spi_bus_occupancy_permille(&bus, SPI_BUS_DEV_EPD),
+             bus.dev[SPI_BUS_DEV_EPD].max_wait_us / 1000,
+             spi_bus_occupancy_permille(&bus, SPI_BUS_DEV_NAND),
+             bus.dev[SPI_BUS_DEV_NAND].max_wait_us / 1000,
+             bus.dev[SPI_BUS_DEV_NAND].yields);
+  }
+}
 
-  // Initialize sensor record storage
-  sensor_record_init();
+// The catch-up LOG_STORAGE_FAST_MOUNT deferred, once nothing is queued, at
+// background priority on SPI2
+static void writer_catch_up(void) {
+  if (!g_storage_ready || !g_catch_up_pending ||
+      g_queue_head.load(std::memory_order_relaxed) !=
+          g_queue_tail.load(std::memory_order_acquire)) {
+    return;
+  }
+  if (!storage_lock(0)) {
+    return;  // A reader has it; try again on the next wake
+  }
+  g_bus_prio = SPI_BUS_PRIO_BACKGROUND;
+  records_catch_up_locked();
+  storage_unlock();
+}
 
-  // Run test
-  sensor_record_test();
+#if LOG_STORAGE_SPIFFS
+// One pass of SPIFFS garbage collection while nothing is queued, at
+// background priority on SPI2. Returns true while more remains.
+static bool writer_gc(void) {
+  if (LOG_STORAGE_SPIFFS_GC_US == 0 || !g_storage_ready ||
+      g_queue_head.load(std::memory_order_relaxed) !=
+          g_queue_tail.load(std::memory_order_acquire)) {
+    return false;
+  }
+  if (!storage_lock(0)) {
+    return true;  // A reader has it; try again after the pause
+  }
+  g_bus_prio = SPI_BUS_PRIO_BACKGROUND;
+  nand_bus_enter();
+  bool more = log_fs_spiffs_gc(LOG_STORAGE_SPIFFS_GC_US);
+  storage_unlock();
+  return more;
+}
+#endif
+
+static void log_storage_writer_task(void *arg) {
+  int64_t last_stats_ms = now_ms();
+  bool gc_more = false;
+  for (;;) {
+    // Woken per enqueued record; the timeout retries records left behind
+    // by a failed write (storage still mounting, lock held by a reader)
+    // and paces background garbage collection
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(gc_more ? kWriterGcPauseMs : kWriterIdleMs));
+    bool stopping = g_writer_stop.load(std::memory_order_acquire);
+    writer_drain(stopping);
+    if (stopping) {
+      break;
+    }
+    writer_catch_up();
+#if LOG_STORAGE_SPIFFS
+    gc_more = writer_gc();
+#endif
+    if (LOG_STORAGE_STATS_LOG_MS > 0 && g_storage_ready &&
+        now_ms() - last_stats_ms >= LOG_STORAGE_STATS_LOG_MS) {
+      last_stats_ms = now_ms();
+      stats_log();
+    }
+  }
 
+  xSemaphoreGive(g_writer_done);
   vTaskDelete(nullptr);
 }
 
@@ -233,6 +1695,12 @@ esp_err_t log_storage_init(void) {
   }
   g_mount_started = true;
 
+  // Normally already up (app_main starts it before the display)
+  esp_err_t err = spi_bus_arbiter_init();
+  if (err != ESP_OK) {
+    return err;
+  }
+
   // Start mount task with sufficient stack
   BaseType_t ret =
       xTaskCreate(log_storage_mount_task, "LogMount", 8192, nullptr, 5, &g_mount_task);
@@ -241,6 +1709,26 @@ esp_err_t log_storage_init(void) {
     return ESP_ERR_NO_MEM;
   }
 
+  // Start the writer now so sensor_record_enqueue() works during the mount;
+  // records queued meanwhile are written once storage is ready. Priority 2
+  // keeps flash programming below the UI and sensor tasks.
+  if (!g_writer_done) {
+    g_writer_done = xSemaphoreCreateBinary();
+    if (!g_writer_done) {
+      ESP_LOGE(TAG, "Failed to create writer semaphore");
+      return ESP_ERR_NO_MEM;
+    }
+  }
+  xSemaphoreTake(g_writer_done, 0);  // Stale give from a timed-out drain
+  g_writer_stop.store(false, std::memory_order_release);
+  ret = xTaskCreate(log_storage_writer_task, "LogWriter", 6 * 1024, nullptr, 2,
+                    &g_writer_task);
+  if (ret != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create writer task");
+    g_writer_task = nullptr;
+    return ESP_ERR_NO_MEM;
+  }
+
   return ESP_OK;
 }
 
@@ -259,15 +1747,88 @@ esp_err_t log_storage_flush(void) {
     return ESP_ERR_TIMEOUT;
   }
 
-  // Sync filesystem to ensure all data is written
-  // FATFS uses f_sync internally, but we can force a general sync
-  ESP_LOGI(TAG, "Flushing storage...");
-  
+  // Push staged records to NAND (fclose runs f_sync)
+  uint32_t staged = g_open_enc.count - g_open_flushed_records;
+  esp_err_t ret = staging_flush_locked(false);
+  zone_flush_locked();
+  log_storage_stats_t stats = g_stats;
+  storage_unlock();
+
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Storage flush failed (%lu records still staged)", staged);
+    return ret;
+  }
+
+  uint32_t per_flush_x10 =
+      stats.flush_count ? (stats.records_flushed * 10) / stats.flush_count : 0;
+  uint32_t flash_per_record =
+      stats.records_flushed ? (uint32_t)(stats.flash_bytes / stats.records_flushed) : 0;
+  ESP_LOGI(TAG,
+           "Storage flush complete: %lu staged, %lu flushes, %lu.%lu rec/flush, "
+           "%lu flash B/rec",
+           staged, stats.flush_count, per_flush_x10 / 10,
+           per_flush_x10 % 10, flash_per_record);
+  return ESP_OK;
+}
+
+esp_err_t log_storage_drain(uint32_t timeout_ms) {
+  if (!g_writer_task) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  g_writer_stop.store(true, std::memory_order_release);
+  xTaskNotifyGive(g_writer_task);
+  if (xSemaphoreTake(g_writer_done, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+    ESP_LOGE(TAG, "log_storage_drain: writer still busy after %lu ms", timeout_ms);
+    return ESP_ERR_TIMEOUT;
+  }
+  g_writer_task = nullptr;
+
+  ESP_LOGI(TAG, "Writer drained: %lu enqueued, %lu dropped, high-water %lu/%lu",
+           g_queue_enqueued.load(std::memory_order_relaxed),
+           g_queue_dropped.load(std::memory_order_relaxed),
+           g_queue_high_water.load(std::memory_order_relaxed), kQueueDepth);
+  return ESP_OK;
+}
+
+esp_err_t log_storage_get_stats(log_storage_stats_t *out) {
+  if (!out) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!storage_lock(pdMS_TO_TICKS(100))) {
+    return ESP_ERR_TIMEOUT;
+  }
+  *out = g_stats;
   storage_unlock();
-  ESP_LOGI(TAG, "Storage flush complete");
+  uint32_t lock_timeouts = g_lock_timeouts.load(std::memory_order_relaxed);
+  out->lock_wait.count += lock_timeouts;
+  out->lock_wait.failures += lock_timeouts;
+  out->queue_enqueued = g_queue_enqueued.load(std::memory_order_relaxed);
+  out->queue_dropped = g_queue_dropped.load(std::memory_order_relaxed);
+  out->queue_high_water = g_queue_high_water.load(std::memory_order_relaxed);
   return ESP_OK;
 }
 
+uint32_t log_storage_latency_percentile(const log_storage_latency_t *h,
+                                        uint32_t percent) {
+  if (!h || h->count == 0) {
+    return 0;
+  }
+  uint64_t target = ((uint64_t)h->count * percent + 99) / 100;
+  if (target == 0) {
+    target = 1;
+  }
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < LOG_STORAGE_HIST_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= target) {
+      uint32_t bound = (i + 1 < LOG_STORAGE_HIST_BUCKETS) ? (1u << i) : UINT32_MAX;
+      return (bound < h->max_us) ? bound : h->max_us;
+    }
+  }
+  return h->max_us;
+}
+
 esp_err_t log_storage_deinit(void) {
   if (!g_mount_started) {
     ESP_LOGW(TAG, "log_storage_deinit: not initialized");
@@ -276,6 +1837,16 @@ esp_err_t log_storage_deinit(void) {
 
   ESP_LOGI(TAG, "Deinitializing log storage...");
 
+  // Write out anything still queued, then flush it. A writer that will not
+  // stop still uses the lock and the volume, so leave both in place.
+  if (g_writer_task) {
+    esp_err_t err = log_storage_drain(3000);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "log_storage_deinit: writer did not stop, storage left mounted");
+      return err;
+    }
+  }
+
   // Flush any pending data first
   log_storage_flush();
 
@@ -286,8 +1857,21 @@ esp_err_t log_storage_deinit(void) {
 
   esp_err_t ret = ESP_OK;
 
-  // Unmount FATFS
+  // Unmount the log volume
   if (g_storage_ready) {
+    // Close the partial rollup buckets; timestamps restart next boot
+    nand_bus_enter();
+    rollup_flush(true);
+
+#if LOG_STORAGE_RAW
+    log_fs_raw_unmount();
+    log_fs_set_ops(nullptr);
+    ESP_LOGI(TAG, "Raw log volume unmounted");
+#elif LOG_STORAGE_SPIFFS
+    log_fs_spiffs_unmount();
+    log_fs_set_ops(nullptr);
+    ESP_LOGI(TAG, "SPIFFS unmounted");
+#else
     ESP_LOGI(TAG, "Unmounting FATFS...");
     ret = esp_vfs_fat_nand_unmount(kMountPoint, g_nand_device);
     if (ret != ESP_OK) {
@@ -295,6 +1879,7 @@ esp_err_t log_storage_deinit(void) {
     } else {
       ESP_LOGI(TAG, "FATFS unmounted");
     }
+#endif
     g_storage_ready = false;
   }
 
@@ -323,12 +1908,15 @@ esp_err_t log_storage_deinit(void) {
   }
 
   g_mount_started = false;
+  records_reset_state();
+  rollup_deinit();
   g_record_count = -1;
 
   ESP_LOGI(TAG, "Log storage deinitialized successfully");
   return ret;
 }
 
+
 // ============================================================================
 // Sensor Record Storage
 // ============================================================================
@@ -339,52 +1927,107 @@ esp_err_t sensor_record_init(void) {
     return ESP_ERR_INVALID_STATE;
   }
 
-  // Check if sensor file exists and count records
-  struct stat st;
-  if (stat(kSensorDataFile, &st) == 0) {
-    g_record_count = st.st_size / sizeof(sensor_record_t);
-    ESP_LOGI(TAG, "Sensor data file exists: %ld bytes, %ld records",
-             st.st_size, g_record_count);
-  } else {
-    g_record_count = 0;
-    ESP_LOGI(TAG, "Sensor data file does not exist, will be created");
+  if (!storage_lock(pdMS_TO_TICKS(1000))) {
+    return ESP_ERR_TIMEOUT;
+  }
+
+  esp_err_t ret = records_load_locked();
+#if !LOG_STORAGE_FAST_MOUNT
+  records_catch_up_locked();
+#endif
+  storage_unlock();
+  if (ret != ESP_OK) {
+    return ret;
   }
 
+  ESP_LOGI(TAG,
+           "Sensor data: %ld records, segments %lu-%lu of %lu (%lu indexed, %s, %s)",
+           g_record_count.load(), g_head_segment, g_sealed_segments, g_ring_capacity,
+           g_index_entries - g_head_segment, g_index_sorted ? "sorted" : "unsorted",
+           (kSegmentEncoding == RECORD_ENCODING_DELTA) ? "delta" : "raw");
   return ESP_OK;
 }
 
 esp_err_t sensor_record_write(const sensor_record_t *record) {
-  if (!g_storage_ready) {
+  if (!g_storage_ready || g_ring_capacity == 0) {
     return ESP_ERR_INVALID_STATE;
   }
+  if (!record) {
+    return ESP_ERR_INVALID_ARG;
+  }
 
+  int64_t start = esp_timer_get_time();
   if (!storage_lock(pdMS_TO_TICKS(1000))) {
     return ESP_ERR_TIMEOUT;
   }
+  records_catch_up_locked();
 
-  esp_err_t result = ESP_OK;
-
-  // Open file for append in binary mode
-  FILE *f = fopen(kSensorDataFile, "ab");
-  if (!f) {
-    ESP_LOGE(TAG, "Failed to open sensor file for append");
-    storage_unlock();
-    return ESP_FAIL;
+  // Open segment full: seal it onto flash, then start the next one with this
+  // record. If the seal fails the record is rejected and the seal retried on
+  // the next call.
+  if (!record_encoder_append(&g_open_enc, record)) {
+    esp_err_t ret = staging_flush_locked(true);
+    if (ret != ESP_OK) {
+      latency_add(&g_stats.write, start, false);
+      storage_unlock();
+      return ret;
+    }
+    record_encoder_append(&g_open_enc, record);  // Always fits an empty slot
   }
 
-  // Write record
-  size_t written = fwrite(record, sizeof(sensor_record_t), 1, f);
-  if (written != 1) {
-    ESP_LOGE(TAG, "Failed to write sensor record");
-    result = ESP_FAIL;
-  } else {
-    g_record_count++;
+  int64_t now = now_ms();
+  if (g_open_enc.count - g_open_flushed_records == 1) {
+    g_staging_first_ms = now;
+  }
+  if (g_open_header.record_count > 0 &&
+      record->timestamp_ms < g_open_header.last_timestamp_ms) {
+    g_open_regressed = true;
+  }
+  segment_header_add(&g_open_header, record);
+  zone_map_add(&g_open_zone, g_open_enc.schema.schema_id, record);
+  rollup_add(g_sealed_records + g_open_enc.count - 1, record);
+  g_record_count++;
+  g_stats.records_written++;
+
+  if (now - g_staging_first_ms >= kStagingMaxAgeMs) {
+    // Record is already accepted; a failed flush is retried on the next call
+    if (staging_flush_locked(false) != ESP_OK) {
+      ESP_LOGW(TAG, "Staging flush failed, %lu records pending",
+               g_open_enc.count - g_open_flushed_records);
+    }
   }
 
-  fclose(f);
+  latency_add(&g_stats.write, start, true);
   storage_unlock();
 
-  return result;
+  return ESP_OK;
+}
+
+esp_err_t sensor_record_enqueue(const sensor_record_t *record) {
+  if (!record) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!g_writer_task || g_writer_stop.load(std::memory_order_acquire)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  uint32_t tail = g_queue_tail.load(std::memory_order_relaxed);
+  uint32_t queued = tail - g_queue_head.load(std::memory_order_acquire);
+  if (queued >= kQueueDepth) {
+    g_queue_dropped.fetch_add(1, std::memory_order_relaxed);
+    xTaskNotifyGive(g_writer_task);  // Writer may be idling after a failed write
+    return ESP_ERR_NO_MEM;
+  }
+
+  g_queue[tail & (kQueueDepth - 1)] = *record;
+  g_queue_tail.store(tail + 1, std::memory_order_release);
+  g_queue_enqueued.fetch_add(1, std::memory_order_relaxed);
+  if (queued + 1 > g_queue_high_water.load(std::memory_order_relaxed)) {
+    g_queue_high_water.store(queued + 1, std::memory_order_relaxed);
+  }
+
+  xTaskNotifyGive(g_writer_task);
+  return ESP_OK;
 }
 
 int32_t sensor_record_count(void) {
@@ -392,15 +2035,8 @@ int32_t sensor_record_count(void) {
     return -1;
   }
 
-  // Refresh count from file
-  struct stat st;
-  if (stat(kSensorDataFile, &st) == 0) {
-    g_record_count = st.st_size / sizeof(sensor_record_t);
-  } else {
-    g_record_count = 0;
-  }
-
-  return g_record_count;
+  // Maintained by init/write/seal/clear; live sealed slots plus the open one
+  return g_record_count.load(std::memory_order_relaxed);
 }
 
 esp_err_t sensor_record_read(uint32_t index, sensor_record_t *record) {
@@ -411,33 +2047,19 @@ esp_err_t sensor_record_read(uint32_t index, sensor_record_t *record) {
     return ESP_ERR_INVALID_ARG;
   }
 
+  int64_t start = esp_timer_get_time();
   if (!storage_lock(pdMS_TO_TICKS(1000))) {
     return ESP_ERR_TIMEOUT;
   }
 
   esp_err_t result = ESP_OK;
-
-  FILE *f = fopen(kSensorDataFile, "rb");
-  if (!f) {
-    storage_unlock();
-    return ESP_ERR_NOT_FOUND;
-  }
-
-  // Seek to record position
-  long offset = index * sizeof(sensor_record_t);
-  if (fseek(f, offset, SEEK_SET) != 0) {
-    fclose(f);
-    storage_unlock();
-    return ESP_ERR_INVALID_ARG;
-  }
-
-  // Read record
-  size_t read = fread(record, sizeof(sensor_record_t), 1, f);
-  if (read != 1) {
+  if (g_record_count <= 0 || index >= (uint32_t)g_record_count) {
     result = ESP_ERR_NOT_FOUND;
+  } else if (records_read_locked(g_head_record + index, 1, record) != 1) {
+    result = ESP_FAIL;
   }
 
-  fclose(f);
+  latency_add(&g_stats.read, start, result != ESP_FAIL);
   storage_unlock();
 
   return result;
@@ -448,36 +2070,408 @@ int32_t sensor_record_read_recent(uint32_t count, sensor_record_t *records) {
     return -1;
   }
 
-  int32_t total = sensor_record_count();
+  int64_t start = esp_timer_get_time();
+  if (!storage_lock(pdMS_TO_TICKS(1000))) {
+    return -1;
+  }
+
+  int32_t total = g_record_count;
   if (total <= 0) {
+    latency_add(&g_stats.read, start, true);
+    storage_unlock();
     return 0;
   }
 
   uint32_t start_idx = (total > (int32_t)count) ? (total - count) : 0;
   uint32_t actual_count = total - start_idx;
+  size_t read = records_read_locked(g_head_record + start_idx, actual_count, records);
+  latency_add(&g_stats.read, start, read == actual_count);
+  storage_unlock();
+
+  return (int32_t)read;
+}
+
+// ----------------------------------------------------------------------------
+// Streaming cursor
+// ----------------------------------------------------------------------------
+// Holds one file handle and a one-slot (page) image across calls and decodes it
+// record by record, so callers can walk any number of records with a small
+// fixed buffer of their own. The storage lock is taken per refill, not for
+// the cursor's lifetime. Positions are absolute record numbers, so records
+// dropped from the ring underneath the cursor are skipped, not repeated.
+
+struct sensor_record_cursor {
+  segment_reader_t reader;
+  uint32_t next_record;  // Absolute number of the next record dec produces
+  record_decoder_t dec;
+  uint8_t image[kSegmentBytes];
+};
+
+esp_err_t sensor_record_cursor_open(uint32_t start_index,
+                                    sensor_record_cursor_t **out_cursor) {
+  if (!out_cursor) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *out_cursor = nullptr;
+  if (!g_storage_ready) {
+    return ESP_ERR_INVALID_STATE;
+  }
 
+  sensor_record_cursor_t *cur =
+      (sensor_record_cursor_t *)calloc(1, sizeof(sensor_record_cursor_t));
+  if (!cur) {
+    return ESP_ERR_NO_MEM;
+  }
   if (!storage_lock(pdMS_TO_TICKS(1000))) {
+    free(cur);
+    return ESP_ERR_TIMEOUT;
+  }
+  cur->next_record = g_head_record + start_index;
+  storage_unlock();
+  record_decoder_init(&cur->dec, kSegmentEncoding, RECORD_FORMAT_2, cur->image, 0);
+  *out_cursor = cur;
+  return ESP_OK;
+}
+
+int32_t sensor_record_cursor_next(sensor_record_cursor_t *cursor,
+                                  sensor_record_t *records, uint32_t max_count) {
+  if (!cursor || !records) {
+    return -1;
+  }
+  if (!g_storage_ready) {
     return -1;
   }
 
-  FILE *f = fopen(kSensorDataFile, "rb");
-  if (!f) {
+  uint32_t copied = 0;
+  bool refilled = false;
+  while (copied < max_count) {
+    int ret = record_decoder_next(&cursor->dec, &records[copied]);
+    if (ret == 1) {
+      copied++;
+      cursor->next_record++;
+      refilled = false;
+      continue;
+    }
+    if (ret < 0) {
+      return copied ? (int32_t)copied : -1;
+    }
+    if (refilled) {
+      break;  // Caught up with the newest record
+    }
+
+    // Block exhausted: load the one holding next_record
+    int64_t start = esp_timer_get_time();
+    if (!storage_lock(pdMS_TO_TICKS(1000))) {
+      return copied ? (int32_t)copied : -1;
+    }
+    g_bus_prio = SPI_BUS_PRIO_BACKGROUND;
+    if (cursor->next_record < g_head_record) {
+      cursor->next_record = g_head_record;
+    }
+    esp_err_t err = block_seek_locked(&cursor->reader, cursor->next_record,
+                                      cursor->image, &cursor->dec);
+    if (cursor->reader.idx) {
+      log_fs_close(cursor->reader.idx);  // Keep only the data file open between calls
+      cursor->reader.idx = nullptr;
+    }
+    latency_add(&g_stats.read, start, err == ESP_OK);
     storage_unlock();
+    if (err != ESP_OK) {
+      return copied ? (int32_t)copied : -1;
+    }
+    refilled = true;
+  }
+  return (int32_t)copied;
+}
+
+void sensor_record_cursor_close(sensor_record_cursor_t *cursor) {
+  if (!cursor) {
+    return;
+  }
+  reader_close(&cursor->reader);
+  free(cursor);
+}
+
+// Deliver the records of one decoded segment that fall inside [t0, t1].
+// Returns false once the callback asks to stop.
+static bool query_emit(record_decoder_t *dec, uint32_t t0_ms, uint32_t t1_ms,
+                       sensor_record_cb_t cb, void *ctx, int32_t *delivered) {
+  sensor_record_t rec;
+  record_view_t view;
+  if (record_decoder_view(dec, &view)) {
+    // RAW: test timestamps in place and copy out only the records in range
+    for (uint32_t i = 0; i < view.count; i++) {
+      uint32_t ts = record_view_timestamp(&view, i);
+      if (ts < t0_ms || ts > t1_ms) {
+        continue;
+      }
+      record_view_get(&view, i, &rec);
+      (*delivered)++;
+      if (!cb(&rec, ctx)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  while (record_decoder_next(dec, &rec) == 1) {
+    if (rec.timestamp_ms < t0_ms || rec.timestamp_ms > t1_ms) {
+      continue;
+    }
+    (*delivered)++;
+    if (!cb(&rec, ctx)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int32_t sensor_record_query_range(uint32_t t0_ms, uint32_t t1_ms,
+                                  sensor_record_cb_t cb, void *ctx) {
+  if (!g_storage_ready) {
+    return -1;
+  }
+  if (!cb || t1_ms < t0_ms) {
     return -1;
   }
 
-  long offset = start_idx * sizeof(sensor_record_t);
-  if (fseek(f, offset, SEEK_SET) != 0) {
-    fclose(f);
-    storage_unlock();
+  int64_t start = esp_timer_get_time();
+  if (!storage_lock(pdMS_TO_TICKS(1000))) {
     return -1;
   }
+  g_bus_prio = SPI_BUS_PRIO_BACKGROUND;
+
+  int32_t delivered = 0;
+  bool keep_going = true;
+  bool have_index = (g_index_entries > g_head_segment);
+  segment_reader_t rd = {};
+  if (g_sealed_segments > g_head_segment) {
+    rd.idx = have_index ? file_open_ro(kSensorIndexFile) : nullptr;
+    rd.data = file_open_ro(kSensorDataFile);
+    if (!rd.data || (have_index && !rd.idx)) {
+      reader_close(&rd);
+      latency_add(&g_stats.read, start, false);
+      storage_unlock();
+      return -1;
+    }
+  }
+
+  // Indexed live segments: with ascending timestamps, binary-search the
+  // first segment ending at or after t0, then walk forward until one starts
+  // past t1. Otherwise test every header; either way only overlapping
+  // segments are read from sensors.bin.
+  uint32_t seg = g_head_segment;
+  segment_header_t hdr;
+  record_decoder_t dec;
+  if (g_index_sorted) {
+    uint32_t lo = g_head_segment, hi = g_index_entries;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (index_read_locked(rd.idx, mid, &hdr) == ESP_OK &&
+          hdr.last_timestamp_ms < t0_ms) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    seg = lo;
+  }
+  for (; keep_going && seg < g_index_entries; seg++) {
+    esp_err_t hdr_ret = index_read_locked(rd.idx, seg, &hdr);
+    if (hdr_ret == ESP_OK) {
+      if (hdr.first_timestamp_ms > t1_ms && g_index_sorted) {
+        break;
+      }
+      if (hdr.max.timestamp_ms < t0_ms || hdr.min.timestamp_ms > t1_ms) {
+        continue;
+      }
+    }
+    // Corrupt header: fall through and read the segment itself
+    segment_read_locked(&rd, seg, &dec);
+    keep_going = query_emit(&dec, t0_ms, t1_ms, cb, ctx, &delivered);
+  }
+
+  // Sealed segments missing from the index are scanned directly
+  for (seg = g_index_entries; keep_going && seg < g_sealed_segments; seg++) {
+    segment_read_locked(&rd, seg, &dec);
+    keep_going = query_emit(&dec, t0_ms, t1_ms, cb, ctx, &delivered);
+  }
+
+  reader_close(&rd);
+
+  // Open segment from RAM
+  if (keep_going && g_open_enc.count > 0 &&
+      g_open_header.max.timestamp_ms >= t0_ms &&
+      g_open_header.min.timestamp_ms <= t1_ms) {
+    open_decoder_init(&dec, g_open_enc.buf);
+    query_emit(&dec, t0_ms, t1_ms, cb, ctx, &delivered);
+  }
 
-  size_t read = fread(records, sizeof(sensor_record_t), actual_count, f);
-  fclose(f);
+  latency_add(&g_stats.read, start, true);
   storage_unlock();
+  return delivered;
+}
 
-  return (int32_t)read;
+// Fold the records of dec inside [t0_ms, t1_ms] into agg
+static void aggregate_emit(record_decoder_t *dec, uint32_t t0_ms, uint32_t t1_ms,
+                           sensor_aggregate_t *agg) {
+  uint32_t fields = dec->schema.schema_id;
+  sensor_record_t rec;
+  record_view_t view;
+  if (record_decoder_view(dec, &view)) {
+    for (uint32_t i = 0; i < view.count; i++) {
+      uint32_t ts = record_view_timestamp(&view, i);
+      if (ts >= t0_ms && ts <= t1_ms) {
+        record_view_get(&view, i, &rec);
+        zone_map_add(agg, fields, &rec);
+      }
+    }
+  } else {
+    while (record_decoder_next(dec, &rec) == 1) {
+      if (rec.timestamp_ms >= t0_ms && rec.timestamp_ms <= t1_ms) {
+        zone_map_add(agg, fields, &rec);
+      }
+    }
+  }
+  agg->segments_decoded++;
+}
+
+esp_err_t sensor_record_aggregate(uint32_t t0_ms, uint32_t t1_ms,
+                                  sensor_aggregate_t *out) {
+  if (!out || t1_ms < t0_ms) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  zone_map_clear(out);
+  if (!g_storage_ready) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  int64_t start = esp_timer_get_time();
+  if (!storage_lock(pdMS_TO_TICKS(1000))) {
+    return ESP_ERR_TIMEOUT;
+  }
+  g_bus_prio = SPI_BUS_PRIO_BACKGROUND;
+
+  bool have_index = (g_index_entries > g_head_segment);
+  segment_reader_t rd = {};
+  if (g_sealed_segments > g_head_segment) {
+    rd.idx = have_index ? file_open_ro(kSensorIndexFile) : nullptr;
+    rd.data = file_open_ro(kSensorDataFile);
+    if (!rd.data || (have_index && !rd.idx)) {
+      reader_close(&rd);
+      latency_add(&g_stats.read, start, false);
+      storage_unlock();
+      return ESP_FAIL;
+    }
+  }
+
+  // Same segment walk as sensor_record_query_range(). A segment whose
+  // timestamps all fall in the range is folded in from its zone map; the
+  // edge segments, and any without a valid zone map, are decoded.
+  uint32_t seg = g_head_segment;
+  segment_header_t hdr;
+  record_decoder_t dec;
+  if (g_index_sorted) {
+    uint32_t lo = g_head_segment, hi = g_index_entries;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (index_read_locked(rd.idx, mid, &hdr) == ESP_OK &&
+          hdr.last_timestamp_ms < t0_ms) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    seg = lo;
+  }
+  for (; seg < g_index_entries; seg++) {
+    if (index_read_locked(rd.idx, seg, &hdr) == ESP_OK) {
+      if (hdr.first_timestamp_ms > t1_ms && g_index_sorted) {
+        break;
+      }
+      if (hdr.max.timestamp_ms < t0_ms || hdr.min.timestamp_ms > t1_ms) {
+        continue;
+      }
+      if (hdr.min.timestamp_ms >= t0_ms && hdr.max.timestamp_ms <= t1_ms &&
+          reader_zone_merge_locked(&rd, seg, out)) {
+        out->segments_summarized++;
+        continue;
+      }
+    }
+    segment_read_locked(&rd, seg, &dec);
+    aggregate_emit(&dec, t0_ms, t1_ms, out);
+  }
+
+  for (seg = g_index_entries; seg < g_sealed_segments; seg++) {
+    segment_read_locked(&rd, seg, &dec);
+    aggregate_emit(&dec, t0_ms, t1_ms, out);
+  }
+
+  reader_close(&rd);
+
+  // Open segment from RAM, whose zone map is kept up to date as it fills
+  if (g_open_enc.count > 0 && g_open_header.max.timestamp_ms >= t0_ms &&
+      g_open_header.min.timestamp_ms <= t1_ms) {
+    if (g_open_header.min.timestamp_ms >= t0_ms &&
+        g_open_header.max.timestamp_ms <= t1_ms) {
+      zone_map_merge(out, &g_open_zone);
+      out->segments_summarized++;
+    } else {
+      open_decoder_init(&dec, g_open_enc.buf);
+      aggregate_emit(&dec, t0_ms, t1_ms, out);
+    }
+  }
+
+  latency_add(&g_stats.read, start, true);
+  storage_unlock();
+  return ESP_OK;
+}
+
+// ============================================================================
+// Rollups
+// ============================================================================
+
+typedef struct {
+  sensor_rollup_cb_t cb;
+  void *ctx;
+} rollup_raw_ctx_t;
+
+// Resolutions finer than the finest tier: each record is its own bucket
+static bool rollup_raw_emit(const sensor_record_t *record, void *arg) {
+  rollup_raw_ctx_t *raw = (rollup_raw_ctx_t *)arg;
+  sensor_rollup_t bucket = {};
+  bucket.start_ms = record->timestamp_ms;
+  bucket.bucket_ms = 1000;
+  bucket.count = 1;
+  memcpy(&bucket.min, record, sizeof(bucket.min));
+  bucket.max = bucket.min;
+  bucket.mean = bucket.min;
+  return raw->cb(&bucket, raw->ctx);
+}
+
+int32_t sensor_rollup_query(uint32_t t0_ms, uint32_t t1_ms, uint32_t resolution_ms,
+                            sensor_rollup_cb_t cb, void *ctx) {
+  if (!g_storage_ready || g_ring_capacity == 0) {
+    return -1;
+  }
+  if (!cb || t1_ms < t0_ms) {
+    return -1;
+  }
+
+  int tier = rollup_tier_select(resolution_ms);
+  if (tier < 0) {
+    rollup_raw_ctx_t raw = {cb, ctx};
+    return sensor_record_query_range(t0_ms, t1_ms, rollup_raw_emit, &raw);
+  }
+
+  if (!storage_lock(pdMS_TO_TICKS(1000))) {
+    return -1;
+  }
+  g_bus_prio = SPI_BUS_PRIO_BACKGROUND;
+  records_catch_up_locked();  // Lost buckets first
+  nand_bus_enter();
+  int32_t delivered = rollup_query(tier, t0_ms, t1_ms, cb, ctx);
+  storage_unlock();
+  return delivered;
 }
 
 esp_err_t sensor_record_clear(void) {
@@ -489,14 +2483,16 @@ esp_err_t sensor_record_clear(void) {
     return ESP_ERR_TIMEOUT;
   }
 
-  // Remove the file
-  remove(kSensorDataFile);
-  g_record_count = 0;
+  // Remove data, index and rollups, drop anything still staged and start a
+  // new ring
+  esp_err_t ret = ring_create_locked();  // Claims the bus for rollup_reset() too
+  rollup_reset();
+  g_catch_up_pending = false;
 
   storage_unlock();
   ESP_LOGI(TAG, "Sensor records cleared");
 
-  return ESP_OK;
+  return ret;
 }
 
 // ============================================================================
@@ -507,7 +2503,7 @@ void sensor_record_test(void) {
   ESP_LOGI(TAG, "=== Sensor Record Test ===");
 
   // Create test records
-  sensor_record_t test_records[5];
+  sensor_record_t test_records[5] = {};
 
   for (int i = 0; i < 5; i++) {
     test_records[i].timestamp_ms = esp_timer_get_time() / 1000 + i * 1000;
@@ -521,11 +2517,11 @@ void sensor_record_test(void) {
     test_records[i].nox_index = 1;
     test_records[i].pressure_pa = 101325 + i * 100;
     test_records[i].reserved = 0;
+    test_records[i].pm4_x10 = 150 + i * 6;
 
-    // Calculate CRC (excluding CRC field itself)
+    // Calculate CRC (over the fields before it)
     test_records[i].crc16 =
-        crc16_ccitt((uint8_t *)&test_records[i],
-                    sizeof(sensor_record_t) - sizeof(uint16_t));
+        crc16_ccitt((uint8_t *)&test_records[i], SENSOR_RECORD_CRC_BYTES);
   }
 
   // Write test records
@@ -555,8 +2551,7 @@ void sensor_record_test(void) {
     if (ret == ESP_OK) {
       // Verify CRC
       uint16_t calc_crc =
-          crc16_ccitt((uint8_t *)&read_record,
-                      sizeof(sensor_record_t) - sizeof(uint16_t));
+          crc16_ccitt((uint8_t *)&read_record, SENSOR_RECORD_CRC_BYTES);
       bool crc_ok = (calc_crc == read_record.crc16);
 
       ESP_LOGI(TAG,
@@ -574,8 +2569,8 @@ void sensor_record_test(void) {
 
   // Print filesystem info
   uint64_t bytes_total = 0, bytes_free = 0;
-  esp_vfs_fat_info(kMountPoint, &bytes_total, &bytes_free);
-  ESP_LOGI(TAG, "FATFS after test: %llu KB total, %llu KB free",
+  log_fs_info(&bytes_total, &bytes_free);
+  ESP_LOGI(TAG, "Log volume after test: %llu KB total, %llu KB free",
            bytes_total / 1024, bytes_free / 1024);
 
   ESP_LOGI(TAG, "=== Sensor Record Test Complete ===");
@@ -1,29 +1,48 @@
 #pragma once
 
 #include "esp_err.h"
+#include "log_format.h"
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Where FATFS is mounted; every log file lives directly under it. Host
+// builds point it at a RAM-backed directory.
+#ifndef LOG_STORAGE_MOUNT_POINT
+#define LOG_STORAGE_MOUNT_POINT "/nand"
+#endif
+
 // Initialize log storage and NAND flash
 esp_err_t log_storage_init(void);
 
-// Check if SPIFFS is mounted and ready
+// Check if the log volume is mounted. sensor_record_count() turns valid
+// once the sensor log is loaded too, shortly after.
 bool log_storage_is_ready(void);
 
-// Flush any pending writes and sync to storage
+// Flush staged sensor records to NAND and sync (call before power-off)
 esp_err_t log_storage_flush(void);
 
-// Deinitialize log storage (unmount FATFS, release resources)
+// Stop the writer task after it has written every queued record (see
+// sensor_record_enqueue). Call from shutdown before log_storage_flush(),
+// once the producer has stopped enqueuing. Returns ESP_ERR_TIMEOUT if the
+// queue did not empty within timeout_ms.
+esp_err_t log_storage_drain(uint32_t timeout_ms);
+
+// Deinitialize log storage (drain the writer, unmount FATFS, release resources).
+// If the writer does not stop, returns log_storage_drain()'s error and leaves
+// storage up; calling again retries.
 esp_err_t log_storage_deinit(void);
 
 // ============================================================================
 // Binary Sensor Record Storage
 // ============================================================================
 
-// Packed binary record for storing sensor data (32 bytes fixed size)
+// Packed binary record for storing sensor data. The first 28 bytes are the
+// format-1 record (sensor_record_core_t); the fields after crc16 exist only
+// in format 2 logs. On flash a record holds just the fields enabled when it
+// was written (LOG_STORAGE_FIELDS, see log_format.h); the others read as 0.
 typedef struct __attribute__((packed)) {
   uint32_t timestamp_ms;  // Timestamp in milliseconds since boot
   uint16_t co2_ppm;       // CO2 in ppm (0-65535)
@@ -35,33 +54,215 @@ typedef struct __attribute__((packed)) {
   uint16_t voc_index;     // VOC index (1-500)
   uint16_t nox_index;     // NOx index (1-500)
   uint32_t pressure_pa;   // Pressure in Pascals (e.g., 101325)
-  uint16_t reserved;      // Reserved for alignment/future use
-  uint16_t crc16;         // CRC16 for data integrity
+  uint16_t reserved;      // Reserved (format 1 only)
+  uint16_t crc16;         // CRC16 over the fields above
+  uint16_t pm4_x10;       // PM4.0 * 10
+  uint16_t pn05_cm3;      // Particles 0.3-0.5 µm per cm³
+  uint16_t pn10_cm3;      // Particles 0.3-1.0 µm per cm³
+  uint16_t pn25_cm3;      // Particles 0.3-2.5 µm per cm³
+  int16_t accel_x_mg;     // Acceleration in mg
+  int16_t accel_y_mg;
+  int16_t accel_z_mg;
+  int32_t lat_e7;         // GPS latitude * 1e7 (0 without a fix)
+  int32_t lon_e7;         // GPS longitude * 1e7
 } sensor_record_t;
 
-// Initialize sensor record storage (creates/opens sensor_data.bin)
+// Bytes of sensor_record_t covered by its crc16
+#define SENSOR_RECORD_CRC_BYTES 26
+
+// The format-1 record: the leading 28 bytes of sensor_record_t. Segment
+// index entries and rollup buckets summarise these fields, which keeps
+// sensors.idx and the rollup files in their original layout.
+typedef struct __attribute__((packed)) {
+  uint32_t timestamp_ms;
+  uint16_t co2_ppm;
+  int16_t temp_c_x100;
+  int16_t rh_x100;
+  uint16_t pm25_x10;
+  uint16_t pm10_x10;
+  uint16_t pm1_x10;
+  uint16_t voc_index;
+  uint16_t nox_index;
+  uint32_t pressure_pa;
+  uint16_t reserved;
+  uint16_t crc16;
+} sensor_record_core_t;
+
+// Latency histogram with log2 buckets: bucket i counts operations that took
+// [2^(i-1), 2^i) us (bucket 0: under 1 us); the last bucket also takes
+// everything slower (>= 262 ms).
+#define LOG_STORAGE_HIST_BUCKETS 20
+
+typedef struct {
+  uint32_t count;     // Operations timed
+  uint32_t failures;  // Of those, how many failed
+  uint64_t total_us;
+  uint32_t max_us;
+  uint32_t buckets[LOG_STORAGE_HIST_BUCKETS];
+} log_storage_latency_t;
+
+// Storage counters, cumulative since boot.
+// records_flushed / flush_count = records per flush (group-commit factor)
+// flash_bytes / records_flushed = NAND bytes programmed per record
+typedef struct {
+  uint32_t records_written;  // Records accepted by sensor_record_write()
+  uint32_t flush_count;      // Staging buffer flushes to FATFS
+  uint32_t records_flushed;  // Records persisted by those flushes
+  uint32_t flush_failures;   // Flushes that failed (records stay staged)
+  uint64_t bytes_flushed;    // Slot bytes handed to FATFS
+  uint64_t flash_bytes;      // NAND sectors spanned by flushes * sector size
+  uint32_t queue_enqueued;   // Records accepted by sensor_record_enqueue()
+  uint32_t queue_dropped;    // Records lost to a full queue or failed drain
+  uint32_t queue_high_water; // Most records queued at once
+  uint64_t bytes_read;       // Bytes read from FATFS (slots, index, meta)
+  uint64_t bytes_written;    // Bytes written to FATFS (slots, index, meta)
+
+  // Latencies. write and read are whole API calls including the lock wait
+  // (calls that time out on the lock only show in lock_wait, as failures);
+  // read covers sensor_record_read/read_recent, cursor_next refills and
+  // query_range, callbacks included. fs_write is open to close (the
+  // close syncs to NAND); fs_read is one positioned read. Both share SPI2
+  // with the display.
+  log_storage_latency_t write;
+  log_storage_latency_t read;
+  log_storage_latency_t lock_wait;
+  log_storage_latency_t fs_write;
+  log_storage_latency_t fs_read;
+  log_storage_latency_t mount;     // NAND init and FATFS mount
+  log_storage_latency_t ready;     // Mount start until the sensor log is loaded
+  log_storage_latency_t catch_up;  // Index and rollup catch-up after a cut
+} log_storage_stats_t;
+
+// Copy current counters
+esp_err_t log_storage_get_stats(log_storage_stats_t *out);
+
+// Upper bound in us of the bucket holding the given percentile (1-100) of
+// h, capped at h->max_us; 0 if h is empty
+uint32_t log_storage_latency_percentile(const log_storage_latency_t *h,
+                                        uint32_t percent);
+
+// Initialize sensor record storage (opens the sensors.bin segment ring and
+// loads its meta and index from sensors.idx, rebuilding them if needed)
 esp_err_t sensor_record_init(void);
 
-// Write a sensor record to flash (appends to file)
+// Queue a sensor record for flash. Records are staged in RAM and written in
+// page-sized groups; call log_storage_flush() to force them out. The log has
+// fixed capacity: once full, the oldest segment is dropped for each new one.
 esp_err_t sensor_record_write(const sensor_record_t *record);
 
-// Get total number of records stored
+// Non-blocking sensor_record_write(): copy the record into a fixed queue
+// for the low-priority writer task and return at once. Single producer:
+// call from one task only. Returns ESP_ERR_NO_MEM (and counts a drop) when
+// the queue is full, ESP_ERR_INVALID_STATE before log_storage_init() or
+// after log_storage_drain().
+esp_err_t sensor_record_enqueue(const sensor_record_t *record);
+
+// Get total number of records stored (O(1), no filesystem access)
 int32_t sensor_record_count(void);
 
-// Read a sensor record by index (0 = oldest)
+// Read a sensor record by index (0 = oldest still in the log)
 esp_err_t sensor_record_read(uint32_t index, sensor_record_t *record);
 
-// Read the most recent N records (returns actual count read)
+// Read the most recent N records (returns actual count read).
+// Needs count * sizeof(sensor_record_t) of caller RAM; for long spans use
+// the cursor API below.
 int32_t sensor_record_read_recent(uint32_t count, sensor_record_t *records);
 
-// Clear all sensor records
+// Streaming cursor: walks records oldest-first from start_index using one
+// open file and a page-sized internal buffer (~2 KB heap), so callers only
+// need a small fixed batch buffer. Records written while the cursor is open
+// are picked up when it reaches them; records dropped from the ring before
+// it reaches them are skipped.
+typedef struct sensor_record_cursor sensor_record_cursor_t;
+
+// Open a cursor at record index start_index (0 = oldest). To read the last N
+// records use sensor_record_count() - N.
+esp_err_t sensor_record_cursor_open(uint32_t start_index,
+                                    sensor_record_cursor_t **out_cursor);
+
+// Copy up to max_count next records into records. Returns records copied,
+// 0 at end of data, or -1 on error.
+int32_t sensor_record_cursor_next(sensor_record_cursor_t *cursor,
+                                  sensor_record_t *records, uint32_t max_count);
+
+// Close the cursor and release its file handle and buffer
+void sensor_record_cursor_close(sensor_record_cursor_t *cursor);
+
+// Range query callback. Return false to stop the query early.
+typedef bool (*sensor_record_cb_t)(const sensor_record_t *record, void *ctx);
+
+// Deliver every record with t0_ms <= timestamp_ms <= t1_ms, oldest first.
+// Binary-searches the per-segment index and reads only overlapping segments.
+// The callback runs with the storage lock held; do not call sensor_record_*
+// from it. Returns records delivered, or -1 on error.
+int32_t sensor_record_query_range(uint32_t t0_ms, uint32_t t1_ms,
+                                  sensor_record_cb_t cb, void *ctx);
+
+// ============================================================================
+// Aggregates
+// ============================================================================
+
+// Statistics of one field over a time range
+typedef struct {
+  uint32_t count;  // Records that store the field; the rest are not counted
+  int64_t min;     // min, max and sum are valid when count > 0
+  int64_t max;
+  int64_t sum;     // Mean = sum / count
+} sensor_field_stats_t;
+
+typedef struct {
+  uint32_t records;                              // Records in the range
+  sensor_field_stats_t fields[LOG_FIELD_COUNT];  // By log_field_id_t
+  uint32_t segments_summarized;  // Segments answered from their zone map
+  uint32_t segments_decoded;     // Segments decoded record by record
+} sensor_aggregate_t;
+
+// Count, min, max and sum of every field over the records with
+// t0_ms <= timestamp_ms <= t1_ms, e.g. max PM2.5 and mean CO2 for a UI
+// label. Segments wholly inside the range are answered from the per-segment
+// zone maps in sensors.zm without reading their records; only the edge
+// segments (and any without a zone map) are decoded. Returns ESP_OK with
+// out->records == 0 when nothing matches.
+esp_err_t sensor_record_aggregate(uint32_t t0_ms, uint32_t t1_ms,
+                                  sensor_aggregate_t *out);
+
+// ============================================================================
+// Rollups
+// ============================================================================
+
+// Summary of the records in one time bucket. Buckets are aligned to
+// bucket_ms on timestamp_ms.
+typedef struct __attribute__((packed)) {
+  uint32_t start_ms;     // timestamp_ms rounded down to bucket_ms
+  uint32_t bucket_ms;    // 1000 (single records), 60000 or 3600000
+  uint32_t count;        // Records in the bucket
+  sensor_record_core_t min;   // Field-wise minimum (timestamp/reserved/crc unused)
+  sensor_record_core_t max;   // Field-wise maximum
+  sensor_record_core_t mean;  // Field-wise mean, rounded
+} sensor_rollup_t;
+
+// Rollup query callback. Return false to stop the query early.
+typedef bool (*sensor_rollup_cb_t)(const sensor_rollup_t *bucket, void *ctx);
+
+// Deliver buckets overlapping [t0_ms, t1_ms], oldest first, from the
+// coarsest tier no coarser than resolution_ms: 1 h and 1 min tiers are kept
+// up to date as records are written (rollup_1h.bin, rollup_1m.bin), so a
+// day at 1 min costs 1440 buckets of I/O instead of 86400 records.
+// Resolutions under a minute fall back to single records from
+// sensor_record_query_range(). Same callback rules as that function.
+// Returns buckets delivered, or -1 on error.
+int32_t sensor_rollup_query(uint32_t t0_ms, uint32_t t1_ms, uint32_t resolution_ms,
+                            sensor_rollup_cb_t cb, void *ctx);
+
+// Clear all sensor records and rollups
 esp_err_t sensor_record_clear(void);
 
 // ============================================================================
 // Test Functions
 // ============================================================================
 
-// Test function: Write sample sensor data and read it back
+// Test function: Write sample sensor data and read it back. Runs at every
+// boot unless LOG_STORAGE_FAST_MOUNT.
 void sensor_record_test(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,593 @@
+/**
+ * @file record_codec.cpp
+ * @brief RAW and DELTA block encoding for sensor records
+ *
+ * Consecutive 1 Hz samples differ by a few counts per field, so DELTA
+ * stores a change mask plus zig-zag varint deltas (timestamps as
+ * delta-of-delta). A steady sample costs 4-8 bytes instead of 28.
+ *
+ * Both encodings work from a record_schema_t: which fields a block stores,
+ * where each sits in a fixed-width record and in sensor_record_t. Format 1
+ * has one fixed schema; format 2 blocks name theirs in the block header.
+ */
+
+#include "record_codec.h"
+
+#include "crc16.h"
+
+#include <stddef.h>
+#include <string.h>
+
+static const uint8_t kDeltaMagic = 'D';
+static const uint8_t kRawMagic = 'R';
+static const uint8_t kDeltaVersion = 1;
+static const uint8_t kBlockVersion2 = 2;
+static const size_t kTimestampBytes = sizeof(uint32_t);
+static const size_t kCrcBytes = sizeof(uint16_t);
+
+static_assert(sizeof(sensor_record_core_t) == 28, "format 1 record is 28 bytes");
+static_assert(offsetof(sensor_record_t, crc16) == SENSOR_RECORD_CRC_BYTES,
+              "crc16 follows the format 1 fields");
+static_assert(offsetof(sensor_record_t, pm4_x10) == sizeof(sensor_record_core_t),
+              "format 1 fields lead sensor_record_t");
+
+// Where each field id lives in sensor_record_t
+#define FIELD_OFFSET(id, name, type)                                         \
+  static_assert(sizeof(((sensor_record_t *)nullptr)->name) == sizeof(type), \
+                #name " width differs from LOG_FIELDS");
+LOG_FIELDS(FIELD_OFFSET)
+#undef FIELD_OFFSET
+
+static const uint8_t kFieldOffset[LOG_FIELD_COUNT] = {
+#define FIELD_OFFSET(id, name, type) offsetof(sensor_record_t, name),
+    LOG_FIELDS(FIELD_OFFSET)
+#undef FIELD_OFFSET
+};
+
+static const uint8_t kFieldSize[LOG_FIELD_COUNT] = {
+#define FIELD_SIZE(id, name, type) sizeof(type),
+    LOG_FIELDS(FIELD_SIZE)
+#undef FIELD_SIZE
+};
+
+// Format 1 delta-coded fields in mask bit order (bit 0 is the timestamp),
+// ordered by how often they change at 1 Hz. Fixed-width positions are the
+// sensor_record_core_t offsets.
+static const record_column_t kFormat1Columns[] = {
+    {offsetof(sensor_record_t, co2_ppm), 2, offsetof(sensor_record_core_t, co2_ppm)},
+    {offsetof(sensor_record_t, temp_c_x100), 2, offsetof(sensor_record_core_t, temp_c_x100)},
+    {offsetof(sensor_record_t, rh_x100), 2, offsetof(sensor_record_core_t, rh_x100)},
+    {offsetof(sensor_record_t, pm25_x10), 2, offsetof(sensor_record_core_t, pm25_x10)},
+    {offsetof(sensor_record_t, pm1_x10), 2, offsetof(sensor_record_core_t, pm1_x10)},
+    {offsetof(sensor_record_t, pm10_x10), 2, offsetof(sensor_record_core_t, pm10_x10)},
+    {offsetof(sensor_record_t, pressure_pa), 4, offsetof(sensor_record_core_t, pressure_pa)},
+    {offsetof(sensor_record_t, voc_index), 2, offsetof(sensor_record_core_t, voc_index)},
+    {offsetof(sensor_record_t, nox_index), 2, offsetof(sensor_record_core_t, nox_index)},
+    {offsetof(sensor_record_t, reserved), 2, offsetof(sensor_record_core_t, reserved)},
+};
+static const size_t kFormat1ColumnCount = sizeof(kFormat1Columns) / sizeof(kFormat1Columns[0]);
+
+static uint32_t field_load(const sensor_record_t *rec, const record_column_t *c) {
+  const uint8_t *p = (const uint8_t *)rec + c->offset;
+  if (c->size == 2) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static void field_store(sensor_record_t *rec, const record_column_t *c, uint32_t v) {
+  uint8_t *p = (uint8_t *)rec + c->offset;
+  if (c->size == 2) {
+    uint16_t v16 = (uint16_t)v;
+    memcpy(p, &v16, sizeof(v16));
+  } else {
+    memcpy(p, &v, sizeof(v));
+  }
+}
+
+// Difference wrapped to the field width, so -1 -> 0 costs one byte
+static int32_t field_delta(const record_column_t *c, uint32_t cur, uint32_t prev) {
+  if (c->size == 2) {
+    return (int32_t)(int16_t)(uint16_t)(cur - prev);
+  }
+  return (int32_t)(cur - prev);
+}
+
+static uint32_t zigzag_encode(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t zigzag_decode(uint32_t v) {
+  return (int32_t)((v >> 1) ^ (~(v & 1) + 1));
+}
+
+static size_t varint_put(uint8_t *out, uint32_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    out[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  out[n++] = (uint8_t)v;
+  return n;
+}
+
+static bool varint_get(const uint8_t *buf, size_t len, size_t *pos, uint32_t *out) {
+  uint32_t v = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (*pos >= len) {
+      return false;
+    }
+    uint8_t b = buf[(*pos)++];
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *out = v;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool is_erased(const uint8_t *p, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (p[i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void record_stamp_crc(sensor_record_t *rec) {
+  rec->crc16 = crc16_ccitt((const uint8_t *)rec, SENSOR_RECORD_CRC_BYTES);
+}
+
+// ============================================================================
+// Schemas
+// ============================================================================
+
+bool record_schema_init(record_schema_t *schema, record_format_t format,
+                        uint32_t schema_id) {
+  memset(schema, 0, sizeof(*schema));
+  schema->format = format;
+  if (format == RECORD_FORMAT_1) {
+    schema->schema_id = LOG_FIELDS_CORE;
+    schema->column_count = (uint8_t)kFormat1ColumnCount;
+    schema->record_bytes = (uint8_t)sizeof(sensor_record_core_t);
+    memcpy(schema->columns, kFormat1Columns, sizeof(kFormat1Columns));
+    for (size_t id = 0; id < LOG_FIELD_COUNT; id++) {
+      if (LOG_FIELDS_CORE & (1ul << id)) {
+        schema->pos[id] = kFieldOffset[id];  // Core offsets match the record
+      }
+    }
+    return true;
+  }
+
+  if (schema_id & ~(uint32_t)LOG_FIELDS_ALL) {
+    return false;
+  }
+  schema->schema_id = schema_id;
+  schema->header_bytes = (uint8_t)sizeof(record_block_header_t);
+  size_t pos = kTimestampBytes;
+  for (size_t id = 0; id < LOG_FIELD_COUNT; id++) {
+    if (!(schema_id & (1ul << id))) {
+      continue;
+    }
+    record_column_t *c = &schema->columns[schema->column_count++];
+    c->offset = kFieldOffset[id];
+    c->size = kFieldSize[id];
+    c->pos = (uint8_t)pos;
+    schema->pos[id] = (uint8_t)pos;
+    pos += c->size;
+  }
+  schema->record_bytes = (uint8_t)(pos + kCrcBytes);
+  return true;
+}
+
+// Fixed-width record of rec into out (record_bytes, or without the CRC16)
+static void fixed_store(const record_schema_t *s, const sensor_record_t *rec,
+                        uint8_t *out, bool with_crc) {
+  memcpy(out, &rec->timestamp_ms, kTimestampBytes);
+  for (size_t i = 0; i < s->column_count; i++) {
+    const record_column_t *c = &s->columns[i];
+    memcpy(&out[c->pos], (const uint8_t *)rec + c->offset, c->size);
+  }
+  if (with_crc) {
+    size_t n = s->record_bytes - kCrcBytes;
+    uint16_t crc = crc16_ccitt(out, n);
+    memcpy(&out[n], &crc, sizeof(crc));
+  }
+}
+
+static void fixed_load(const record_schema_t *s, const uint8_t *in, sensor_record_t *rec) {
+  memset(rec, 0, sizeof(*rec));
+  memcpy(&rec->timestamp_ms, in, kTimestampBytes);
+  for (size_t i = 0; i < s->column_count; i++) {
+    const record_column_t *c = &s->columns[i];
+    memcpy((uint8_t *)rec + c->offset, &in[c->pos], c->size);
+  }
+}
+
+static bool fixed_crc_ok(const record_schema_t *s, const uint8_t *in) {
+  size_t n = s->record_bytes - kCrcBytes;
+  uint16_t stored;
+  memcpy(&stored, &in[n], sizeof(stored));
+  return stored == crc16_ccitt(in, n);
+}
+
+// Parse a format 2 block header into schema and encoding
+static bool block_header_parse(const uint8_t *buf, size_t len, record_schema_t *schema,
+                               record_encoding_t *encoding) {
+  record_block_header_t hdr;
+  if (len < sizeof(hdr)) {
+    return false;
+  }
+  memcpy(&hdr, buf, sizeof(hdr));
+  if (hdr.version != kBlockVersion2 ||
+      (hdr.encoding != kRawMagic && hdr.encoding != kDeltaMagic)) {
+    return false;
+  }
+  *encoding = (hdr.encoding == kDeltaMagic) ? RECORD_ENCODING_DELTA : RECORD_ENCODING_RAW;
+  return record_schema_init(schema, RECORD_FORMAT_2, hdr.schema_id);
+}
+
+static void block_header_put(const record_schema_t *schema, record_encoding_t encoding,
+                             uint8_t *buf) {
+  if (schema->format == RECORD_FORMAT_1) {
+    if (encoding == RECORD_ENCODING_DELTA) {
+      buf[0] = kDeltaMagic;
+      buf[1] = kDeltaVersion;
+    }
+    return;
+  }
+  record_block_header_t hdr = {
+      .encoding = (encoding == RECORD_ENCODING_DELTA) ? kDeltaMagic : kRawMagic,
+      .version = kBlockVersion2,
+      .schema_id = schema->schema_id,
+  };
+  memcpy(buf, &hdr, sizeof(hdr));
+}
+
+// Bytes before the first record of a block
+static size_t block_header_bytes(const record_schema_t *s, record_encoding_t encoding) {
+  if (s->format == RECORD_FORMAT_1) {
+    return (encoding == RECORD_ENCODING_DELTA) ? 2 : 0;
+  }
+  return sizeof(record_block_header_t);
+}
+
+// Bytes of a RAW block that hold whole records
+static size_t raw_capacity(const record_schema_t *s, size_t block_size) {
+  size_t header = block_header_bytes(s, RECORD_ENCODING_RAW);
+  if (block_size < header) {
+    return 0;
+  }
+  return header + (block_size - header) / s->record_bytes * s->record_bytes;
+}
+
+// Encode rec against the previous record into out. Returns bytes written.
+static size_t delta_encode(const record_schema_t *s, const sensor_record_t *prev,
+                           uint32_t prev_ts_delta, const sensor_record_t *rec,
+                           uint8_t *out) {
+  uint32_t values[1 + LOG_FIELD_COUNT + 1];
+  uint32_t mask = 0;
+
+  uint32_t ts_delta = rec->timestamp_ms - prev->timestamp_ms;
+  values[0] = zigzag_encode((int32_t)(ts_delta - prev_ts_delta));
+  if (values[0] != 0) {
+    mask |= 1u;
+  }
+  for (size_t i = 0; i < s->column_count; i++) {
+    const record_column_t *c = &s->columns[i];
+    int32_t d = field_delta(c, field_load(rec, c), field_load(prev, c));
+    values[1 + i] = zigzag_encode(d);
+    if (d != 0) {
+      mask |= 1u << (1 + i);
+    }
+  }
+
+  size_t n = varint_put(out, mask);
+  for (size_t i = 0; i <= s->column_count; i++) {
+    if (mask & (1u << i)) {
+      n += varint_put(&out[n], values[i]);
+    }
+  }
+  return n;
+}
+
+bool record_codec_is_delta(const uint8_t *buf) {
+  return buf[0] == kDeltaMagic && buf[1] == kDeltaVersion;
+}
+
+// ============================================================================
+// Encoder
+// ============================================================================
+
+static void encoder_layout(record_encoder_t *enc) {
+  if (enc->encoding == RECORD_ENCODING_RAW) {
+    enc->capacity = raw_capacity(&enc->schema, enc->block_size);
+  } else {
+    enc->capacity = enc->block_size - sizeof(record_block_trailer_t);
+  }
+}
+
+void record_encoder_init(record_encoder_t *enc, record_encoding_t encoding,
+                         uint32_t fields, uint8_t *buf, size_t block_size) {
+  memset(enc, 0, sizeof(*enc));
+  enc->encoding = encoding;
+  enc->buf = buf;
+  enc->block_size = block_size;
+  if (fields == 0 ||
+      !record_schema_init(&enc->schema, RECORD_FORMAT_2, fields & LOG_FIELDS_ALL)) {
+    record_schema_init(&enc->schema, RECORD_FORMAT_1, 0);
+  }
+  encoder_layout(enc);
+}
+
+bool record_encoder_append(record_encoder_t *enc, const sensor_record_t *record) {
+  const record_schema_t *s = &enc->schema;
+  size_t header = (enc->count == 0) ? block_header_bytes(s, enc->encoding) : 0;
+
+  if (enc->encoding == RECORD_ENCODING_RAW) {
+    if (enc->used + header + s->record_bytes > enc->capacity) {
+      return false;
+    }
+    block_header_put(s, enc->encoding, enc->buf);
+    fixed_store(s, record, &enc->buf[enc->used + header], true);
+    enc->used += header + s->record_bytes;
+  } else if (enc->count == 0) {
+    size_t base = s->record_bytes - kCrcBytes;
+    if (header + base > enc->capacity) {
+      return false;
+    }
+    block_header_put(s, enc->encoding, enc->buf);
+    fixed_store(s, record, &enc->buf[header], false);
+    enc->used = header + base;
+    enc->prev_ts_delta = 0;
+  } else {
+    uint8_t tmp[RECORD_CODEC_MAX_DELTA_BYTES];
+    size_t n = delta_encode(s, &enc->prev, enc->prev_ts_delta, record, tmp);
+    if (enc->used + n > enc->capacity) {
+      return false;
+    }
+    memcpy(&enc->buf[enc->used], tmp, n);
+    enc->used += n;
+    enc->prev_ts_delta = record->timestamp_ms - enc->prev.timestamp_ms;
+  }
+  enc->prev = *record;
+  enc->count++;
+  return true;
+}
+
+size_t record_encoder_resume(record_encoder_t *enc, size_t used) {
+  record_decoder_t dec;
+  record_decoder_init(&dec, enc->encoding, enc->schema.format, enc->buf, used);
+
+  size_t valid = 0;
+  sensor_record_t rec;
+  while (record_decoder_next(&dec, &rec) == 1) {
+    valid = dec.pos;
+  }
+  if (dec.count > 0) {
+    // Keep appending in the block's own layout
+    enc->encoding = dec.encoding;
+    enc->schema = dec.schema;
+    encoder_layout(enc);
+  }
+  enc->used = valid;
+  enc->count = dec.count;
+  enc->prev = dec.prev;
+  enc->prev_ts_delta = dec.prev_ts_delta;
+  return valid;
+}
+
+void record_encoder_seal(record_encoder_t *enc) {
+  if (enc->encoding != RECORD_ENCODING_DELTA) {
+    memset(&enc->buf[enc->used], 0, enc->block_size - enc->used);
+    return;
+  }
+  // 0xFF never parses as a varint, so a torn seal cannot fake records
+  memset(&enc->buf[enc->used], 0xFF, enc->block_size - enc->used);
+  record_block_trailer_t trailer = {
+      .record_count = (uint16_t)enc->count,
+      .used_bytes = (uint16_t)enc->used,
+      .crc16 = crc16_ccitt(enc->buf, enc->used),
+  };
+  memcpy(&enc->buf[enc->block_size - sizeof(trailer)], &trailer, sizeof(trailer));
+}
+
+// ============================================================================
+// Decoder
+// ============================================================================
+
+void record_decoder_init(record_decoder_t *dec, record_encoding_t encoding,
+                         record_format_t format, const uint8_t *buf, size_t used) {
+  memset(dec, 0, sizeof(*dec));
+  dec->encoding = encoding;
+  dec->buf = buf;
+  dec->used = used;
+  record_schema_init(&dec->schema, RECORD_FORMAT_1, 0);
+  if (format == RECORD_FORMAT_2 && used > 0) {
+    dec->bad_header = !block_header_parse(buf, used, &dec->schema, &dec->encoding);
+    if (!dec->bad_header && dec->encoding == RECORD_ENCODING_RAW) {
+      dec->pos = dec->schema.header_bytes;
+    }
+  }
+}
+
+bool record_decoder_init_sealed(record_decoder_t *dec, record_encoding_t encoding,
+                                record_format_t format, const uint8_t *buf,
+                                size_t block_size) {
+  if (format == RECORD_FORMAT_2) {
+    record_decoder_init(dec, encoding, format, buf, block_size);
+    if (dec->bad_header) {
+      dec->used = 0;
+      return false;
+    }
+    encoding = dec->encoding;
+  }
+  if (encoding == RECORD_ENCODING_RAW) {
+    if (format == RECORD_FORMAT_2) {
+      dec->used = raw_capacity(&dec->schema, block_size);
+    } else {
+      record_decoder_init(dec, encoding, format, buf,
+                          record_codec_raw_capacity(block_size) *
+                              sizeof(sensor_record_core_t));
+    }
+    return true;
+  }
+
+  record_block_trailer_t trailer;
+  memcpy(&trailer, &buf[block_size - sizeof(trailer)], sizeof(trailer));
+  if (trailer.used_bytes > block_size - sizeof(trailer) ||
+      trailer.crc16 != crc16_ccitt(buf, trailer.used_bytes)) {
+    record_decoder_init(dec, encoding, format, buf, 0);
+    return false;
+  }
+  if (format == RECORD_FORMAT_2) {
+    dec->used = trailer.used_bytes;
+  } else {
+    record_decoder_init(dec, encoding, format, buf, trailer.used_bytes);
+  }
+  return true;
+}
+
+int record_decoder_next(record_decoder_t *dec, sensor_record_t *record) {
+  if (dec->bad_header) {
+    return -1;
+  }
+  if (dec->pos >= dec->used) {
+    return 0;
+  }
+
+  const record_schema_t *s = &dec->schema;
+  if (dec->encoding == RECORD_ENCODING_RAW) {
+    if (dec->pos + s->record_bytes > dec->used) {
+      return -1;
+    }
+    const uint8_t *p = &dec->buf[dec->pos];
+    if (is_erased(p, s->record_bytes)) {
+      return 0;  // 0xFF fill past the last record of an open block
+    }
+    // Format 1 records were checked by their reader; format 2 here
+    if (s->format == RECORD_FORMAT_2 && !fixed_crc_ok(s, p)) {
+      return -1;
+    }
+    fixed_load(s, p, record);
+    record_stamp_crc(record);
+    dec->pos += s->record_bytes;
+    dec->prev = *record;
+    dec->count++;
+    return 1;
+  }
+
+  sensor_record_t rec;
+  if (dec->count == 0) {
+    size_t header = block_header_bytes(s, RECORD_ENCODING_DELTA);
+    size_t base = s->record_bytes - kCrcBytes;
+    if (dec->used < header + base ||
+        (s->format == RECORD_FORMAT_1 && !record_codec_is_delta(dec->buf))) {
+      return -1;
+    }
+    fixed_load(s, &dec->buf[header], &rec);
+    dec->pos = header + base;
+    dec->prev_ts_delta = 0;
+  } else {
+    size_t pos = dec->pos;
+    uint32_t mask = 0;
+    if (!varint_get(dec->buf, dec->used, &pos, &mask) ||
+        (mask >> (1 + s->column_count)) != 0) {
+      return -1;
+    }
+    rec = dec->prev;
+    uint32_t v = 0;
+    uint32_t ts_delta = dec->prev_ts_delta;
+    if (mask & 1u) {
+      if (!varint_get(dec->buf, dec->used, &pos, &v)) {
+        return -1;
+      }
+      ts_delta += (uint32_t)zigzag_decode(v);
+    }
+    rec.timestamp_ms = dec->prev.timestamp_ms + ts_delta;
+    for (size_t i = 0; i < s->column_count; i++) {
+      if (!(mask & (1u << (1 + i)))) {
+        continue;
+      }
+      if (!varint_get(dec->buf, dec->used, &pos, &v)) {
+        return -1;
+      }
+      const record_column_t *c = &s->columns[i];
+      field_store(&rec, c, field_load(&dec->prev, c) + (uint32_t)zigzag_decode(v));
+    }
+    dec->pos = pos;
+    dec->prev_ts_delta = ts_delta;
+  }
+
+  record_stamp_crc(&rec);
+  dec->prev = rec;
+  dec->count++;
+  *record = rec;
+  return 1;
+}
+
+bool record_decoder_skip(record_decoder_t *dec, uint32_t n) {
+  if (n == 0) {
+    return true;
+  }
+  if (dec->encoding == RECORD_ENCODING_RAW && !dec->bad_header) {
+    // Records are contiguous: if the last one skipped is there, all are
+    size_t stride = dec->schema.record_bytes;
+    size_t last = dec->pos + (size_t)(n - 1) * stride;
+    if (last + stride > dec->used || is_erased(&dec->buf[last], stride)) {
+      return false;
+    }
+    fixed_load(&dec->schema, &dec->buf[last], &dec->prev);
+    record_stamp_crc(&dec->prev);
+    dec->pos = last + stride;
+    dec->count += n;
+    return true;
+  }
+  sensor_record_t rec;
+  for (uint32_t i = 0; i < n; i++) {
+    if (record_decoder_next(dec, &rec) != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// ============================================================================
+// Record view
+// ============================================================================
+
+bool record_decoder_view(const record_decoder_t *dec, record_view_t *view) {
+  memset(view, 0, sizeof(*view));
+  if (dec->encoding != RECORD_ENCODING_RAW || dec->bad_header) {
+    return false;
+  }
+  const record_schema_t *s = &dec->schema;
+  view->records = &dec->buf[dec->pos];
+  view->stride = s->record_bytes;
+  memcpy(view->pos, s->pos, sizeof(view->pos));
+  size_t end = dec->pos;
+  while (end + s->record_bytes <= dec->used &&
+         !is_erased(&dec->buf[end], s->record_bytes)) {
+    end += s->record_bytes;
+  }
+  view->count = (uint32_t)((end - dec->pos) / s->record_bytes);
+  return true;
+}
+
+void record_view_get(const record_view_t *view, uint32_t i, sensor_record_t *record) {
+  const uint8_t *p = view->records + (size_t)i * view->stride;
+  memset(record, 0, sizeof(*record));
+  memcpy(&record->timestamp_ms, p, kTimestampBytes);
+  for (size_t id = 0; id < LOG_FIELD_COUNT; id++) {
+    if (view->pos[id]) {
+      memcpy((uint8_t *)record + kFieldOffset[id], p + view->pos[id], kFieldSize[id]);
+    }
+  }
+  record_stamp_crc(record);
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include "log_format.h"
+#include "log_storage.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ============================================================================
+// Sensor Record Block Codec
+// ============================================================================
+//
+// Encodes a run of sensor_record_t into one fixed-size block (a segment slot
+// of sensors.bin) and streams them back out. Two record formats, picked by
+// the slot magic (log_format.h):
+//
+// Format 1 (LOG_SLOT_MAGIC): every record holds all sensor_record_core_t
+// fields.
+// RAW:   packed sensor_record_core_t back to back, each with its own CRC16.
+//        The leftover bytes at the end of the block are zero padding. An
+//        all-0xFF record ends an open block.
+// DELTA: [0]    'D' magic
+//        [1]    format version (1)
+//        [2]    first record, all fields except crc16 (26 bytes)
+//        then per record:
+//          varint change mask (bit per field, see record_codec.cpp)
+//          zig-zag varint per set bit: timestamp delta-of-delta, or the
+//          field delta from the previous record
+//        0xFF padding, then record_block_trailer_t in the last 6 bytes once
+//        the block is sealed. One CRC16 covers the whole block; decoded
+//        records get their crc16 field recomputed.
+//
+// Format 2 (LOG_SLOT_MAGIC_V2): the block starts with a
+// record_block_header_t whose schema id lists the fields stored, and which
+// gives the encoding ('R' or 'D'). A fixed-width record is timestamp_ms,
+// then those fields in id order at their LOG_FIELDS width, then a CRC16 of
+// the preceding bytes.
+// RAW:   header, then fixed-width records, ended by an all-0xFF record
+//        when open and zero padding when sealed.
+// DELTA: header, then the first record as a fixed-width record without its
+//        CRC16, then change masks and varints as in format 1 with one mask
+//        bit per stored field in id order. Same padding and trailer.
+// Fields missing from a block's schema decode as 0.
+//
+// A block that is still being filled has no trailer; decode it with
+// record_decoder_init() and the number of bytes written so far.
+
+typedef enum {
+  RECORD_ENCODING_RAW = 0,
+  RECORD_ENCODING_DELTA = 1,
+} record_encoding_t;
+
+typedef enum {
+  RECORD_FORMAT_1 = 1,
+  RECORD_FORMAT_2 = 2,
+} record_format_t;
+
+// Worst-case encoded size of one DELTA record (mask + one varint per field)
+#define RECORD_CODEC_MAX_DELTA_BYTES 72
+
+typedef struct __attribute__((packed)) {
+  uint16_t record_count;
+  uint16_t used_bytes;  // Encoded bytes from the start of the block
+  uint16_t crc16;       // CRC16 over block[0, used_bytes)
+} record_block_trailer_t;
+
+// One stored field: where it lives in sensor_record_t and in a fixed-width
+// record
+typedef struct {
+  uint8_t offset;  // In sensor_record_t
+  uint8_t size;    // 2 or 4
+  uint8_t pos;     // In a fixed-width record
+} record_column_t;
+
+// Layout of the records in one block
+typedef struct {
+  record_format_t format;
+  uint32_t schema_id;         // Fields stored (format 1: LOG_FIELDS_CORE)
+  uint8_t column_count;
+  uint8_t record_bytes;       // Fixed-width record, CRC16 included
+  uint8_t header_bytes;       // Block header before the first record
+  record_column_t columns[LOG_FIELD_COUNT + 1];  // In DELTA mask order
+  uint8_t pos[LOG_FIELD_COUNT];  // By field id; 0 if not stored
+} record_schema_t;
+
+typedef struct {
+  record_encoding_t encoding;
+  record_schema_t schema;
+  uint8_t *buf;
+  size_t block_size;
+  size_t capacity;  // Bytes usable for records (block minus trailer)
+  size_t used;
+  uint32_t count;
+  sensor_record_t prev;
+  uint32_t prev_ts_delta;
+} record_encoder_t;
+
+typedef struct {
+  record_encoding_t encoding;
+  record_schema_t schema;
+  bool bad_header;  // Format 2 block header missing or unknown
+  const uint8_t *buf;
+  size_t used;
+  size_t pos;
+  uint32_t count;  // Records decoded so far
+  sensor_record_t prev;
+  uint32_t prev_ts_delta;
+} record_decoder_t;
+
+// Fill schema for a block format. Format 2 stores the fields in schema_id
+// (a LOG_FIELD_BIT mask); format 1 ignores it. Returns false if schema_id
+// names a field this build does not know.
+bool record_schema_init(record_schema_t *schema, record_format_t format,
+                        uint32_t schema_id);
+
+// Start an empty block of block_size bytes in buf. fields selects the
+// format 2 schema (LOG_FIELD_BIT mask); 0 writes format 1.
+void record_encoder_init(record_encoder_t *enc, record_encoding_t encoding,
+                         uint32_t fields, uint8_t *buf, size_t block_size);
+
+// Append one record. Returns false (block unchanged) when it does not fit.
+bool record_encoder_append(record_encoder_t *enc, const sensor_record_t *record);
+
+// Rebuild encoder state from the first `used` bytes already in buf (e.g. a
+// partially written block reloaded after reboot). A torn trailing record is
+// dropped. A format 2 block keeps the schema and encoding of its header.
+// Returns the number of valid bytes kept.
+size_t record_encoder_resume(record_encoder_t *enc, size_t used);
+
+// Pad the block to block_size and, for DELTA, write the trailer
+void record_encoder_seal(record_encoder_t *enc);
+
+// Decode an open block holding `used` encoded bytes. Format 2 blocks take
+// their encoding from the block header.
+void record_decoder_init(record_decoder_t *dec, record_encoding_t encoding,
+                         record_format_t format, const uint8_t *buf, size_t used);
+
+// Decode a sealed block of block_size bytes. Returns false if the DELTA
+// trailer or block CRC does not check out.
+bool record_decoder_init_sealed(record_decoder_t *dec, record_encoding_t encoding,
+                                record_format_t format, const uint8_t *buf,
+                                size_t block_size);
+
+// Decode the next record. Returns 1 on success, 0 at end of block and -1 on
+// malformed data.
+int record_decoder_next(record_decoder_t *dec, sensor_record_t *record);
+
+// Skip n records. RAW blocks jump straight there. Returns false if the
+// block ends first.
+bool record_decoder_skip(record_decoder_t *dec, uint32_t n);
+
+// Records per format 1 RAW block of block_size bytes
+static inline size_t record_codec_raw_capacity(size_t block_size) {
+  return block_size / sizeof(sensor_record_core_t);
+}
+
+// True if buf starts with a format 1 DELTA block header. A raw record can
+// start with the same two bytes, so only trust this together with a sealed
+// trailer or a known log encoding.
+bool record_codec_is_delta(const uint8_t *buf);
+
+// ============================================================================
+// Zero-copy record view
+// ============================================================================
+//
+// Reads fields of fixed-width records in place from the block buffer, in
+// either format, without decoding whole records: e.g. a timestamp search or
+// one column of a page.
+
+typedef struct {
+  const uint8_t *records;  // First record
+  uint32_t count;          // Records present
+  uint8_t stride;          // Bytes per record
+  uint8_t pos[LOG_FIELD_COUNT];  // Field offsets in a record; 0 if not stored
+} record_view_t;
+
+// Point view at the records left in a RAW block dec has opened; false for
+// DELTA blocks
+bool record_decoder_view(const record_decoder_t *dec, record_view_t *view);
+
+// Copy record i out of the view
+void record_view_get(const record_view_t *view, uint32_t i, sensor_record_t *record);
+
+static inline bool record_view_has(const record_view_t *view, log_field_id_t id) {
+  return view->pos[id] != 0;
+}
+
+static inline uint32_t record_view_timestamp(const record_view_t *view, uint32_t i) {
+  uint32_t v;
+  memcpy(&v, view->records + (size_t)i * view->stride, sizeof(v));
+  return v;
+}
+
+// record_view_<field>(view, i): typed value of one field of record i, 0 if
+// the view's schema does not store it
+#define RECORD_VIEW_ACCESSOR(id, name, type)                                    \
+  static inline type record_view_##name(const record_view_t *view, uint32_t i) { \
+    type v = 0;                                                                 \
+    if (view->pos[id]) {                                                        \
+      memcpy(&v, view->records + (size_t)i * view->stride + view->pos[id],      \
+             sizeof(v));                                                        \
+    }                                                                           \
+    return v;                                                                   \
+  }
+LOG_FIELDS(RECORD_VIEW_ACCESSOR)
+#undef RECORD_VIEW_ACCESSOR
+
+#ifdef __cplusplus
+}
+#endif
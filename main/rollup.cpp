@@ -0,0 +1,455 @@
+/**
+ * @file rollup.cpp
+ * @brief 1 min and 1 h rollup tiers over the sensor log
+ *
+ * Each tier file is a ring of fixed-size entries, one per closed bucket:
+ * bucket s lives in entry s % capacity and records its own number, so the
+ * newest entry is found at open by binary search and the tier needs no
+ * separate meta. Closed buckets wait in RAM for the next storage flush.
+ *
+ * timestamp_ms restarts at every boot, so a tier is a sequence of runs of
+ * ascending start_ms. Each entry names the first bucket of its run; queries
+ * walk the runs back from the newest and binary-search each one.
+ */
+
+#include "rollup.h"
+
+#include "crc16.h"
+#include "esp_log.h"
+#include "log_fs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Tier capacities in buckets: 7 days of 1 min buckets (~1 MB) and a year of
+// 1 h buckets (~0.9 MB). Older buckets are overwritten.
+#ifndef LOG_STORAGE_ROLLUP_MINUTE_BUCKETS
+#define LOG_STORAGE_ROLLUP_MINUTE_BUCKETS 10080
+#endif
+#ifndef LOG_STORAGE_ROLLUP_HOUR_BUCKETS
+#define LOG_STORAGE_ROLLUP_HOUR_BUCKETS 8760
+#endif
+
+static const char *TAG = "rollup";
+
+typedef struct __attribute__((packed)) {
+  uint32_t seq;         // Bucket number in this tier, from 0 forever
+  uint32_t run_start;   // First bucket of the ascending run holding this one
+  uint32_t end_record;  // Absolute number of the record after this bucket
+  sensor_rollup_t bucket;
+  uint16_t crc16;       // CRC16 over all preceding bytes
+} rollup_entry_t;
+
+typedef struct {
+  int64_t timestamp_ms;
+  int64_t co2_ppm;
+  int64_t temp_c_x100;
+  int64_t rh_x100;
+  int64_t pm25_x10;
+  int64_t pm10_x10;
+  int64_t pm1_x10;
+  int64_t voc_index;
+  int64_t nox_index;
+  int64_t pressure_pa;
+} rollup_sums_t;
+
+static const uint32_t kPendingMax = 4;  // Closed buckets held between flushes
+
+typedef struct {
+  const char *path;
+  uint32_t bucket_ms;
+  uint32_t capacity;       // Entries in the file ring
+  uint32_t next_seq;       // Number of the next bucket to close
+  uint32_t run_start;      // Run of the newest closed bucket
+  uint32_t last_start_ms;  // start_ms of the newest closed bucket
+  uint32_t end_record;     // Records folded so far (absolute)
+  rollup_entry_t pending[kPendingMax];  // Closed, not yet in the file
+  uint32_t pending_count;
+  sensor_rollup_t open;    // Bucket being filled (open.count == 0: none)
+  rollup_sums_t sums;      // Field sums of the open bucket
+} rollup_tier_t;
+
+// Finest first
+static rollup_tier_t g_tiers[] = {
+    {.path = LOG_STORAGE_MOUNT_POINT "/rollup_1m.bin",
+     .bucket_ms = 60 * 1000,
+     .capacity = LOG_STORAGE_ROLLUP_MINUTE_BUCKETS},
+    {.path = LOG_STORAGE_MOUNT_POINT "/rollup_1h.bin",
+     .bucket_ms = 60 * 60 * 1000,
+     .capacity = LOG_STORAGE_ROLLUP_HOUR_BUCKETS},
+};
+static const int kTierCount = sizeof(g_tiers) / sizeof(g_tiers[0]);
+
+// ============================================================================
+// Buckets
+// ============================================================================
+
+static int64_t div_round(int64_t sum, uint32_t count) {
+  int64_t half = count / 2;
+  return (sum >= 0 ? sum + half : sum - half) / (int64_t)count;
+}
+
+static void bucket_add(sensor_rollup_t *b, rollup_sums_t *sums,
+                       const sensor_record_t *rec) {
+  if (b->count == 0) {
+    memcpy(&b->min, rec, sizeof(b->min));  // Format 1 fields lead the record
+    b->max = b->min;
+  }
+  b->count++;
+
+#define ROLLUP_FOLD(field)                                    \
+  do {                                                        \
+    if (rec->field < b->min.field) b->min.field = rec->field; \
+    if (rec->field > b->max.field) b->max.field = rec->field; \
+    sums->field += rec->field;                                \
+  } while (0)
+  ROLLUP_FOLD(timestamp_ms);
+  ROLLUP_FOLD(co2_ppm);
+  ROLLUP_FOLD(temp_c_x100);
+  ROLLUP_FOLD(rh_x100);
+  ROLLUP_FOLD(pm25_x10);
+  ROLLUP_FOLD(pm10_x10);
+  ROLLUP_FOLD(pm1_x10);
+  ROLLUP_FOLD(voc_index);
+  ROLLUP_FOLD(nox_index);
+  ROLLUP_FOLD(pressure_pa);
+#undef ROLLUP_FOLD
+}
+
+// Fill in the mean and clear the fields min/max/mean do not use
+static void bucket_finish(sensor_rollup_t *b, const rollup_sums_t *sums) {
+  memset(&b->mean, 0, sizeof(b->mean));
+#define ROLLUP_MEAN(field) \
+  b->mean.field = (decltype(b->mean.field))div_round(sums->field, b->count)
+  ROLLUP_MEAN(timestamp_ms);
+  ROLLUP_MEAN(co2_ppm);
+  ROLLUP_MEAN(temp_c_x100);
+  ROLLUP_MEAN(rh_x100);
+  ROLLUP_MEAN(pm25_x10);
+  ROLLUP_MEAN(pm10_x10);
+  ROLLUP_MEAN(pm1_x10);
+  ROLLUP_MEAN(voc_index);
+  ROLLUP_MEAN(nox_index);
+  ROLLUP_MEAN(pressure_pa);
+#undef ROLLUP_MEAN
+  b->min.reserved = b->max.reserved = 0;
+  b->min.crc16 = b->max.crc16 = 0;
+}
+
+static bool bucket_overlaps(const sensor_rollup_t *b, uint32_t t0_ms, uint32_t t1_ms) {
+  return b->start_ms <= t1_ms && (uint64_t)b->start_ms + b->bucket_ms > t0_ms;
+}
+
+// ============================================================================
+// Tier files
+// ============================================================================
+
+static void tier_reset(rollup_tier_t *t) {
+  t->next_seq = 0;
+  t->run_start = 0;
+  t->last_start_ms = 0;
+  t->end_record = 0;
+  t->pending_count = 0;
+  memset(&t->open, 0, sizeof(t->open));
+  memset(&t->sums, 0, sizeof(t->sums));
+}
+
+static uint16_t entry_crc(const rollup_entry_t *e) {
+  return crc16_ccitt((const uint8_t *)e, sizeof(*e) - sizeof(uint16_t));
+}
+
+// Read entry `pos` and check it is intact and belongs there
+static bool entry_read(log_fs_file_t *f, const rollup_tier_t *t, uint32_t pos,
+                       rollup_entry_t *e) {
+  return log_fs_read_at(f, (long)pos * (long)sizeof(*e), e, sizeof(*e)) == sizeof(*e) &&
+         e->crc16 == entry_crc(e) && e->seq % t->capacity == pos;
+}
+
+// Find the newest entry. Entries [0, k] hold the current lap of the ring
+// (seq - pos equal to entry 0's) and the rest the previous lap, so k is a
+// binary search away. A torn newest entry reads as the previous lap.
+static bool tier_find_newest(const rollup_tier_t *t, rollup_entry_t *out) {
+  log_fs_file_t *f = log_fs_open(t->path, false);
+  if (!f) {
+    return false;
+  }
+  long size = log_fs_size(f);
+  uint32_t filled = size > 0 ? (uint32_t)(size / (long)sizeof(rollup_entry_t)) : 0;
+  if (filled > t->capacity) {
+    filled = t->capacity;
+  }
+
+  bool found = false;
+  rollup_entry_t e;
+  if (filled == 0) {
+    // Empty file
+  } else if (!entry_read(f, t, 0, &e)) {
+    // Entry 0 torn while newest: the previous lap ends at the last entry
+    found = filled == t->capacity && entry_read(f, t, filled - 1, out);
+  } else {
+    uint32_t lap_base = e.seq;
+    uint32_t lo = 0;
+    uint32_t hi = filled;
+    *out = e;
+    while (hi - lo > 1) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (entry_read(f, t, mid, &e) && e.seq - mid == lap_base) {
+        lo = mid;
+        *out = e;
+      } else {
+        hi = mid;
+      }
+    }
+    found = true;
+  }
+  log_fs_close(f);
+  return found;
+}
+
+static esp_err_t tier_write_pending(rollup_tier_t *t) {
+  if (t->pending_count == 0) {
+    return ESP_OK;
+  }
+  log_fs_file_t *f = log_fs_open(t->path, true);
+  if (!f) {
+    ESP_LOGE(TAG, "Failed to open %s", t->path);
+    return ESP_FAIL;
+  }
+
+  bool ok = true;
+  for (uint32_t i = 0; i < t->pending_count && ok; i++) {
+    const rollup_entry_t *e = &t->pending[i];
+    long offset = (long)(e->seq % t->capacity) * (long)sizeof(*e);
+    ok = log_fs_write_at(f, offset, e, sizeof(*e)) == sizeof(*e);
+  }
+  if (log_fs_close(f) != 0 || !ok) {
+    ESP_LOGE(TAG, "Failed to write %lu buckets to %s", t->pending_count, t->path);
+    return ESP_FAIL;  // Kept; rewriting the same entries is harmless
+  }
+  t->pending_count = 0;
+  return ESP_OK;
+}
+
+// Move the open bucket to the pending list
+static void tier_close_bucket(rollup_tier_t *t) {
+  if (t->pending_count == kPendingMax && tier_write_pending(t) != ESP_OK) {
+    ESP_LOGW(TAG, "%s: dropping bucket %lu", t->path, t->pending[0].seq);
+    memmove(&t->pending[0], &t->pending[1],
+            (kPendingMax - 1) * sizeof(rollup_entry_t));
+    t->pending_count--;
+  }
+
+  sensor_rollup_t *b = &t->open;
+  bucket_finish(b, &t->sums);
+  if (t->next_seq == 0 || b->start_ms <= t->last_start_ms) {
+    t->run_start = t->next_seq;
+  }
+
+  rollup_entry_t *e = &t->pending[t->pending_count++];
+  e->seq = t->next_seq;
+  e->run_start = t->run_start;
+  e->end_record = t->end_record;
+  e->bucket = *b;
+  e->crc16 = entry_crc(e);
+
+  t->next_seq++;
+  t->last_start_ms = b->start_ms;
+  memset(&t->open, 0, sizeof(t->open));
+  memset(&t->sums, 0, sizeof(t->sums));
+}
+
+// ============================================================================
+// Query
+// ============================================================================
+
+typedef struct {
+  uint32_t first;
+  uint32_t end;
+} rollup_run_t;
+
+// Runs of the buckets in the file, newest first. Stops at an unreadable
+// entry (older runs are skipped). Caller frees *out.
+static size_t tier_runs(log_fs_file_t *f, const rollup_tier_t *t, uint32_t oldest,
+                        uint32_t end, rollup_run_t **out) {
+  rollup_run_t *runs = nullptr;
+  size_t count = 0;
+  size_t alloc = 0;
+  while (end > oldest) {
+    rollup_entry_t e;
+    if (!entry_read(f, t, (end - 1) % t->capacity, &e) || e.seq != end - 1 ||
+        e.run_start >= end) {
+      ESP_LOGW(TAG, "%s: bucket %lu unreadable, skipping older buckets", t->path,
+               end - 1);
+      break;
+    }
+    if (count == alloc) {
+      alloc = alloc ? alloc * 2 : 8;
+      rollup_run_t *grown = (rollup_run_t *)realloc(runs, alloc * sizeof(*runs));
+      if (!grown) {
+        break;
+      }
+      runs = grown;
+    }
+    uint32_t first = e.run_start > oldest ? e.run_start : oldest;
+    runs[count++] = {first, end};
+    end = first;
+  }
+  *out = runs;
+  return count;
+}
+
+int rollup_tier_select(uint32_t resolution_ms) {
+  for (int i = kTierCount - 1; i >= 0; i--) {
+    if (g_tiers[i].bucket_ms <= resolution_ms) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int32_t rollup_query(int tier, uint32_t t0_ms, uint32_t t1_ms,
+                     sensor_rollup_cb_t cb, void *ctx) {
+  if (tier < 0 || tier >= kTierCount || !cb) {
+    return -1;
+  }
+  rollup_tier_t *t = &g_tiers[tier];
+
+  // Buckets below file_end are in the file, the rest pending in RAM
+  uint32_t file_end = t->next_seq - t->pending_count;
+  uint32_t oldest = file_end > t->capacity ? file_end - t->capacity : 0;
+  int32_t delivered = 0;
+  bool keep_going = true;
+
+  if (file_end > oldest) {
+    log_fs_file_t *f = log_fs_open(t->path, false);
+    if (!f) {
+      return -1;
+    }
+    rollup_run_t *runs = nullptr;
+    size_t run_count = tier_runs(f, t, oldest, file_end, &runs);
+
+    // Oldest run first; within a run start_ms ascends, so binary-search the
+    // first bucket ending after t0 and read forward until one starts past t1
+    for (size_t r = run_count; r-- > 0 && keep_going;) {
+      uint32_t lo = runs[r].first;
+      uint32_t hi = runs[r].end;
+      rollup_entry_t e;
+      while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (!entry_read(f, t, mid % t->capacity, &e)) {
+          break;
+        }
+        if ((uint64_t)e.bucket.start_ms + e.bucket.bucket_ms <= t0_ms) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      for (uint32_t s = lo; s < runs[r].end && keep_going; s++) {
+        if (!entry_read(f, t, s % t->capacity, &e) || e.seq != s) {
+          continue;
+        }
+        if (e.bucket.start_ms > t1_ms) {
+          break;
+        }
+        delivered++;
+        keep_going = cb(&e.bucket, ctx);
+      }
+    }
+    free(runs);
+    log_fs_close(f);
+  }
+
+  for (uint32_t i = 0; i < t->pending_count && keep_going; i++) {
+    if (bucket_overlaps(&t->pending[i].bucket, t0_ms, t1_ms)) {
+      delivered++;
+      keep_going = cb(&t->pending[i].bucket, ctx);
+    }
+  }
+
+  if (keep_going && t->open.count > 0 && bucket_overlaps(&t->open, t0_ms, t1_ms)) {
+    sensor_rollup_t partial = t->open;
+    bucket_finish(&partial, &t->sums);
+    delivered++;
+    cb(&partial, ctx);
+  }
+  return delivered;
+}
+
+// ============================================================================
+// Public (to log storage)
+// ============================================================================
+
+uint32_t rollup_open(uint32_t log_end) {
+  uint32_t resume = log_end;
+  for (int i = 0; i < kTierCount; i++) {
+    rollup_tier_t *t = &g_tiers[i];
+    tier_reset(t);
+
+    rollup_entry_t newest;
+    if (tier_find_newest(t, &newest)) {
+      t->next_seq = newest.seq + 1;
+      t->run_start = newest.run_start;
+      t->last_start_ms = newest.bucket.start_ms;
+      t->end_record = newest.end_record;
+    }
+    if (t->end_record > log_end) {
+      ESP_LOGW(TAG, "%s is ahead of the sensor log, continuing from record %lu",
+               t->path, log_end);
+      t->end_record = log_end;
+    }
+    if (t->end_record < resume) {
+      resume = t->end_record;
+    }
+    ESP_LOGI(TAG, "%s: %lu buckets of %lu s", t->path,
+             t->next_seq < t->capacity ? t->next_seq : t->capacity,
+             t->bucket_ms / 1000);
+  }
+  return resume;
+}
+
+void rollup_add(uint32_t number, const sensor_record_t *record) {
+  for (int i = 0; i < kTierCount; i++) {
+    rollup_tier_t *t = &g_tiers[i];
+    if (number < t->end_record) {
+      continue;  // Already folded before a restart
+    }
+    uint32_t start = record->timestamp_ms - record->timestamp_ms % t->bucket_ms;
+    if (t->open.count > 0 && start != t->open.start_ms) {
+      tier_close_bucket(t);
+    }
+    if (t->open.count == 0) {
+      t->open.start_ms = start;
+      t->open.bucket_ms = t->bucket_ms;
+    }
+    bucket_add(&t->open, &t->sums, record);
+    t->end_record = number + 1;
+  }
+}
+
+esp_err_t rollup_flush(bool close_open) {
+  esp_err_t ret = ESP_OK;
+  for (int i = 0; i < kTierCount; i++) {
+    rollup_tier_t *t = &g_tiers[i];
+    if (close_open && t->open.count > 0) {
+      tier_close_bucket(t);
+    }
+    if (tier_write_pending(t) != ESP_OK) {
+      ret = ESP_FAIL;
+    }
+  }
+  return ret;
+}
+
+void rollup_reset(void) {
+  for (int i = 0; i < kTierCount; i++) {
+    log_fs_remove(g_tiers[i].path);
+    tier_reset(&g_tiers[i]);
+  }
+}
+
+void rollup_deinit(void) {
+  for (int i = 0; i < kTierCount; i++) {
+    tier_reset(&g_tiers[i]);
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "esp_err.h"
+#include "log_storage.h"
+#include <stdint.h>
+
+// Multi-resolution rollups of the sensor log (1 min and 1 h buckets),
+// maintained as records are written. Internal to log storage: callers must
+// hold the storage lock.
+
+// Open the tier files and recover each tier's newest bucket. log_end is the
+// absolute number one past the newest record in sensors.bin; a tier that
+// claims more (the log was restarted) is rebased onto it. Returns the first
+// record some tier has not folded yet.
+uint32_t rollup_open(uint32_t log_end);
+
+// Fold record `number` (absolute) into every tier that has not seen it yet.
+// A record outside the current bucket closes that bucket.
+void rollup_add(uint32_t number, const sensor_record_t *record);
+
+// Write closed buckets still held in RAM to their tier files. With
+// close_open, close the partial buckets first (shutdown: timestamps restart
+// at the next boot, so they cannot be continued).
+esp_err_t rollup_flush(bool close_open);
+
+// Coarsest tier whose buckets are no longer than resolution_ms, or -1 if
+// every tier is coarser
+int rollup_tier_select(uint32_t resolution_ms);
+
+// Deliver the buckets of `tier` that overlap [t0_ms, t1_ms], oldest first,
+// including the partial bucket still open in RAM. Returns buckets
+// delivered, or -1 on error.
+int32_t rollup_query(int tier, uint32_t t0_ms, uint32_t t1_ms,
+                     sensor_rollup_cb_t cb, void *ctx);
+
+// Delete the tier files and start empty
+void rollup_reset(void);
+
+// Forget in-RAM tier state (storage deinit)
+void rollup_deinit(void);
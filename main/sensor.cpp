@@ -1,4 +1,6 @@
 #include "sensor.h"
+#include "time_window.h"
+#include "deadline_heap.h"
 
 #include <string.h>
 #include "esp_log.h"
@@ -29,8 +31,10 @@ static const char *TAG_SENS = "sensors";
 // LIS2DH12 Accelerometer Interrupt Pin
 #define LIS2DH12_INT1_GPIO   3      // GPIO 3 - Motion detection interrupt
 
-// CO2 ring buffer capacity
-#define CO2_RING_CAP 12
+// Averaging window for display values, and samples held per signal (the
+// sensors report once a second, so 12 covers 5 s with room to spare)
+#define SENSOR_AVG_WINDOW_MS 5000
+#define SENSOR_AVG_WINDOW_CAP 12
 
 // STCC4 continuous measurement mode - reads every 1 second
 // Sensor provides new data every 1 second in continuous mode
@@ -43,13 +47,59 @@ static const char *TAG_SENS = "sensors";
 // DPS368 pressure sensor read interval (milliseconds)
 #define DPS368_READ_INTERVAL_MS 5000
 
+// SGP4x: pause before measuring again after a failed read
+#define SGP4X_READ_RETRY_MS 40
+
+// Scheduler: a sensor step that asks to run again now or earlier (e.g. a read
+// that found no data yet) is retried this much later, as the old 50 ms poll
+// did. Steps that name a later time, such as the fetch of a started
+// conversion, run when asked.
+#define SENSOR_MIN_STEP_MS 50
+
+// Scheduler: waits longer than half of this (the periodic reads) end on a
+// multiple of it, so the sensors' reads share one wakeup a second. Shorter
+// waits (state machine steps, fetches, retries) end when asked.
+#define SENSOR_ALIGN_MS 1000
+
+// Scheduler: a step that runs at most this long after its deadline runs as
+// of the deadline, so a read taken a few ms late (the caller wakes on ticks)
+// still names the next grid time rather than slipping a whole second. A
+// command sent in such a step is still timed from when it really goes out.
+// Steps due less than this after the earliest pending one wait for the last
+// of them, so a second's fetches share wakeups; none runs before its time.
+#define SENSOR_ON_TIME_MS 50
+
+// Wait update() returns when no sensor step is scheduled
+#define SENSOR_IDLE_WAIT_MS 1000
+
+// A sensor step's return: do not schedule it again
+#define SENSOR_STEP_DONE INT64_MAX
+
 enum class STCC4State {
     INIT,               // Need to start continuous measurement
     STARTING,           // Starting continuous measurement mode
     MEASURING,          // Continuous measurement active, reading every 1s
+    CONDITIONING,       // Stopped for conditioning, waiting to send it
     ERROR               // Error state, will retry
 };
 
+// SGP4x measurement: a command is out and its result is fetched next
+enum class SGP4xPhase : uint8_t {
+    IDLE,               // Next measurement starts on the 1s interval
+    FETCH,              // Measurement started, result due at sgp_fetch_at
+    RETRY               // Last read failed, measure once more
+};
+
+// Periodic steps of the sensor scheduler, one deadline each
+enum class SensorJob : uint8_t {
+    STCC4,
+    SGP4X,
+    SPS30,
+    DPS368,
+    LIS2DH12,
+    COUNT
+};
+
 // Private implementation struct - defined outside class at file scope
 struct Sensors::SensorsState {
     // I2C
@@ -64,26 +114,31 @@ struct Sensors::SensorsState {
     int64_t stcc4_state_time;
     int64_t stcc4_last_conditioning;
     int64_t stcc4_last_read;         // Last successful read time
+    bool stcc4_read_pending;         // Read command sent, data due at stcc4_fetch_at
+    int64_t stcc4_read_started;
+    int64_t stcc4_fetch_at;
 
-    // CO2/Temp/RH ring buffer for last samples (5s average)
-    int co2_ring_ppm[CO2_RING_CAP];
-    float co2_ring_temp[CO2_RING_CAP];
-    float co2_ring_rh[CO2_RING_CAP];
-    int64_t co2_ring_ts[CO2_RING_CAP];
-    int co2_ring_head;
-    int co2_ring_size;
+    // CO2/Temp/RH samples of the last 5 s
+    TimeWindow<int, SENSOR_AVG_WINDOW_CAP> co2_window;
+    TimeWindow<float, SENSOR_AVG_WINDOW_CAP> temp_window;
+    TimeWindow<float, SENSOR_AVG_WINDOW_CAP> rh_window;
 
     // SGP4x VOC/NOx sensor
     sgp4x_handle_t sgp4x_handle;
     uint16_t sgp_voc_ticks;
     uint16_t sgp_nox_ticks;
     int64_t last_sgp_read;
+    SGP4xPhase sgp_phase;
+    bool sgp_retried;                // This second's measurement was retried
+    int64_t sgp_fetch_at;
 
     // Gas Index Algorithm for VOC and NOx
     GasIndexAlgorithmParams voc_algo_params;
     GasIndexAlgorithmParams nox_algo_params;
     int32_t voc_index;  // Calculated VOC gas index (1-500), 0 during blackout
     int32_t nox_index;  // Calculated NOx gas index (1-500), 0 during blackout
+    TimeWindow<int32_t, SENSOR_AVG_WINDOW_CAP> voc_window;  // Indexes of the last 5 s
+    TimeWindow<int32_t, SENSOR_AVG_WINDOW_CAP> nox_window;
 
     // SPS30 PM sensor
     sps30_handle_t sps30_handle;
@@ -91,6 +146,7 @@ struct Sensors::SensorsState {
     int64_t sps30_last_read;
     int sps30_not_ready_count;
     int sps30_check_fail_count;  // Counter for data ready check failures (I2C errors)
+    TimeWindow<float, SENSOR_AVG_WINDOW_CAP> pm25_window;  // PM2.5 of the last 5 s
     
     // DPS368 Pressure sensor
     dps368_handle_t *dps368_handle;
@@ -104,12 +160,18 @@ struct Sensors::SensorsState {
     bool motion_detected;
     int64_t last_accel_read;
     volatile bool motion_interrupt_triggered;
+
+    // Next deadline of each scheduled SensorJob, earliest on top
+    DeadlineHeap<(size_t)SensorJob::COUNT> schedule;
+    int64_t update_worst_us;         // Longest update() pass so far
 };
 
 // Constructor
 Sensors::Sensors() {
     state = new SensorsState();
-    memset(state, 0, sizeof(*state));
+    // Zero bytes are a valid state for every member (TimeWindow included);
+    // the cast keeps -Wclass-memaccess quiet about its member initializers
+    memset((void *)state, 0, sizeof(*state));
     state->i2c_bus_handle = NULL;
     state->stcc4_state = STCC4State::INIT;
     state->stcc4_last_read = 0;
@@ -143,47 +205,6 @@ Sensors::~Sensors() {
     if (state) delete state;
 }
 
-// Push CO2, temperature, and humidity reading to circular ring buffer.
-// Overwrites oldest entry when buffer is full (capacity: 12 samples).
-// Used for 5-second moving average calculation.
-static inline void co2_ring_push(Sensors::SensorsState *st, int ppm, float t, float rh, int64_t ts_ms) {
-    st->co2_ring_ppm[st->co2_ring_head] = ppm;
-    st->co2_ring_temp[st->co2_ring_head] = t;
-    st->co2_ring_rh[st->co2_ring_head] = rh;
-    st->co2_ring_ts[st->co2_ring_head] = ts_ms;
-    st->co2_ring_head = (st->co2_ring_head + 1) % CO2_RING_CAP;
-    if (st->co2_ring_size < CO2_RING_CAP) st->co2_ring_size++;
-}
-
-// Calculate 5-second moving average for CO2, temperature, and humidity.
-// Scans ring buffer for samples within 5000 ms window from now_ms.
-// Returns true if at least one sample found, false otherwise.
-static inline bool co2_avg_last_5s(Sensors::SensorsState *st, int64_t now_ms, int *ppm_out, float *t_out, float *rh_out) {
-    int count = 0;
-    long sum_ppm = 0;
-    double sum_t = 0.0;
-    double sum_rh = 0.0;
-    int64_t window_start = now_ms - 5000;
-    for (int i = 0; i < st->co2_ring_size; ++i) {
-        int idx = (st->co2_ring_head - 1 - i + CO2_RING_CAP) % CO2_RING_CAP;
-        if (st->co2_ring_ts[idx] >= window_start) {
-            sum_ppm += st->co2_ring_ppm[idx];
-            sum_t += st->co2_ring_temp[idx];
-            sum_rh += st->co2_ring_rh[idx];
-            count++;
-        } else {
-            break; // older than 5s window
-        }
-    }
-    if (count > 0) {
-        if (ppm_out) *ppm_out = (int)(sum_ppm / count);
-        if (t_out) *t_out = (float)(sum_t / count);
-        if (rh_out) *rh_out = (float)(sum_rh / count);
-        return true;
-    }
-    return false;
-}
-
 // Initialize I2C master bus with GPIO 6 (SCL) and GPIO 7 (SDA) at 100 kHz.
 // Enables internal pull-ups for I2C lines.
 // Returns ESP_OK on success, ESP_FAIL if already initialized or bus creation fails.
@@ -378,8 +399,15 @@ static esp_err_t init_sps30_sensor(Sensors::SensorsState *state) {
 
 // Update STCC4 CO2 sensor using continuous measurement mode (non-blocking).
 // State flow: INIT → STARTING → MEASURING (continuous 1s reads).
-// Automatic conditioning every 3 hours for long-term accuracy.
-static void update_stcc4(Sensors::SensorsState *st, int64_t now_ms) {
+// Each read is split: the command goes out in one step and the data is
+// fetched in a later one, so other sensors' steps run in between.
+// Automatic conditioning every 3 hours for long-term accuracy:
+// MEASURING → CONDITIONING → STARTING, each waiting out the sensor's busy time.
+// now_ms is the step's deadline when it runs on time and keeps the reads on
+// the grid; run_ms is when it really runs, and a command's busy or ready
+// time counts from it.
+// Returns the time (ms) this state next needs a step.
+static int64_t update_stcc4(Sensors::SensorsState *st, int64_t now_ms, int64_t run_ms) {
     int64_t elapsed = now_ms - st->stcc4_state_time;
     esp_err_t ret;
     
@@ -409,30 +437,49 @@ static void update_stcc4(Sensors::SensorsState *st, int64_t now_ms) {
             break;
             
         case STCC4State::MEASURING:
-            // Read measurement every 1 second in continuous mode
-            if (now_ms - st->stcc4_last_read >= STCC4_READ_INTERVAL_MS) {
-                ret = stcc4_read_measurement(&st->co2_sensor, &st->co2_measurement);
+            if (st->stcc4_read_pending) {
+                if (now_ms < st->stcc4_fetch_at) break;
+                st->stcc4_read_pending = false;
+                ret = stcc4_fetch_measurement(&st->co2_sensor, &st->co2_measurement);
                 if (ret == ESP_OK) {
-                    st->stcc4_last_read = now_ms;
+                    st->stcc4_last_read = st->stcc4_read_started;
                     
-                    // Push to ring buffer
-                    co2_ring_push(st, (int)st->co2_measurement.co2_ppm,
-                                  st->co2_measurement.temperature_c,
-                                  st->co2_measurement.humidity_rh,
-                                  now_ms);
+                    // Push to the averaging windows
+                    st->co2_window.push(st->stcc4_last_read, (int)st->co2_measurement.co2_ppm);
+                    st->temp_window.push(st->stcc4_last_read, st->co2_measurement.temperature_c);
+                    st->rh_window.push(st->stcc4_last_read, st->co2_measurement.humidity_rh);
                     
                     // Perform conditioning if needed (every 3 hours)
                     if (now_ms - st->stcc4_last_conditioning >= (int64_t)STCC4_CONDITIONING_INTERVAL_MS) {
                         ESP_LOGI(TAG_SENS, "STCC4: Performing conditioning");
-                        stcc4_stop_continuous_measurement(&st->co2_sensor);
-                        vTaskDelay(pdMS_TO_TICKS(100));
-                        stcc4_perform_conditioning(&st->co2_sensor);
-                        st->stcc4_last_conditioning = now_ms;
-                        vTaskDelay(pdMS_TO_TICKS(100));
-                        stcc4_start_continuous_measurement(&st->co2_sensor);
+                        uint32_t busy_ms = 0;
+                        stcc4_send_stop_continuous_measurement(&st->co2_sensor, &busy_ms);
+                        st->stcc4_state = STCC4State::CONDITIONING;
+                        st->stcc4_state_time = run_ms + busy_ms;
                     }
                 }
                 // Note: ESP_ERR_INVALID_RESPONSE means no data ready yet, which is normal
+            } else if (now_ms - st->stcc4_last_read >= STCC4_READ_INTERVAL_MS) {
+                // Read measurement every 1 second in continuous mode
+                uint32_t ready_ms = 0;
+                ret = stcc4_start_read_measurement(&st->co2_sensor, &ready_ms);
+                if (ret == ESP_OK) {
+                    st->stcc4_read_pending = true;
+                    st->stcc4_read_started = now_ms;
+                    st->stcc4_fetch_at = run_ms + ready_ms;
+                }
+            }
+            break;
+            
+        case STCC4State::CONDITIONING:
+            // 100 ms after the stop completes, then the sensor is busy
+            // conditioning; STARTING restarts measurement 100 ms after that
+            if (elapsed >= 100) {
+                uint32_t busy_ms = 0;
+                stcc4_send_conditioning(&st->co2_sensor, &busy_ms);
+                st->stcc4_last_conditioning = now_ms;
+                st->stcc4_state = STCC4State::STARTING;
+                st->stcc4_state_time = run_ms + busy_ms;
             }
             break;
             
@@ -445,66 +492,137 @@ static void update_stcc4(Sensors::SensorsState *st, int64_t now_ms) {
             }
             break;
     }
+
+    switch (st->stcc4_state) {
+        case STCC4State::STARTING:
+            return st->stcc4_state_time + 100;
+        case STCC4State::MEASURING:
+            if (st->stcc4_read_pending) return st->stcc4_fetch_at;
+            return st->stcc4_last_read + STCC4_READ_INTERVAL_MS;
+        case STCC4State::CONDITIONING:
+            return st->stcc4_state_time + 100;
+        case STCC4State::ERROR:
+            return st->stcc4_state_time + 5000;
+        default:
+            return now_ms;
+    }
 }
 
 // Update SGP4x VOC/NOx sensor with 1-second sampling interval.
 // Calculates gas index (1-500 scale) from raw ticks using Sensirion algorithm.
-// Automatic retry on first read failure (40ms delay).
-static void update_sgp4x(Sensors::SensorsState *st, int64_t now_ms) {
-    if (!st->sgp4x_handle) return;
-    
-    // Read SGP4x every 1 second
-    if (now_ms - st->last_sgp_read < 1000) return;
-    st->last_sgp_read = now_ms;
+// Each measurement is started in one step and its result fetched once the
+// sensor's 50 ms conversion is done; a failed start or read is measured once
+// more 40 ms later. now_ms and run_ms as in update_stcc4().
+// Returns the time (ms) of the next step.
+static int64_t update_sgp4x(Sensors::SensorsState *st, int64_t now_ms, int64_t run_ms) {
+    if (!st->sgp4x_handle) return SENSOR_STEP_DONE;
     
-    uint16_t voc_raw = 0, nox_raw = 0;
-    esp_err_t ret = sgp4x_measure_signals(st->sgp4x_handle, &voc_raw, &nox_raw);
-    if (ret != ESP_OK) {
-        vTaskDelay(pdMS_TO_TICKS(40));
-        ret = sgp4x_measure_signals(st->sgp4x_handle, &voc_raw, &nox_raw);
+    esp_err_t ret;
+    if (st->sgp_phase == SGP4xPhase::FETCH) {
+        if (now_ms < st->sgp_fetch_at) return st->sgp_fetch_at;
+        uint16_t voc_raw = 0, nox_raw = 0;
+        ret = sgp4x_fetch_signals(st->sgp4x_handle, &voc_raw, &nox_raw);
+        if (ret == ESP_OK) {
+            st->sgp_phase = SGP4xPhase::IDLE;
+            st->sgp_voc_ticks = voc_raw;
+            st->sgp_nox_ticks = nox_raw;
+            
+            // Calculate gas index from raw ticks using Sensirion algorithm
+            int32_t voc_idx = 0, nox_idx = 0;
+            GasIndexAlgorithm_process(&st->voc_algo_params, (int32_t)voc_raw, &voc_idx);
+            GasIndexAlgorithm_process(&st->nox_algo_params, (int32_t)nox_raw, &nox_idx);
+            st->voc_index = voc_idx;
+            st->nox_index = nox_idx;
+            // The index is 0 while the algorithm is still in its blackout
+            if (voc_idx > 0) st->voc_window.push(st->last_sgp_read, voc_idx);
+            if (nox_idx > 0) st->nox_window.push(st->last_sgp_read, nox_idx);
+            return st->last_sgp_read + 1000;
+        }
+    } else {
+        if (st->sgp_phase == SGP4xPhase::IDLE) {
+            // Measure SGP4x every 1 second
+            if (now_ms - st->last_sgp_read < 1000) return st->last_sgp_read + 1000;
+            st->last_sgp_read = now_ms;
+            st->sgp_retried = false;
+        }
+        // Default compensation (25°C, 50% RH), as sgp4x_measure_signals()
+        uint32_t ready_ms = 0;
+        ret = sgp4x_start_compensated_signals(st->sgp4x_handle, 25.0f, 50.0f, &ready_ms);
+        if (ret == ESP_OK) {
+            st->sgp_phase = SGP4xPhase::FETCH;
+            st->sgp_fetch_at = run_ms + ready_ms;
+            return st->sgp_fetch_at;
+        }
     }
-    if (ret == ESP_OK) {
-        st->sgp_voc_ticks = voc_raw;
-        st->sgp_nox_ticks = nox_raw;
-        
-        // Calculate gas index from raw ticks using Sensirion algorithm
-        int32_t voc_idx = 0, nox_idx = 0;
-        GasIndexAlgorithm_process(&st->voc_algo_params, (int32_t)voc_raw, &voc_idx);
-        GasIndexAlgorithm_process(&st->nox_algo_params, (int32_t)nox_raw, &nox_idx);
-        st->voc_index = voc_idx;
-        st->nox_index = nox_idx;
+    
+    if (!st->sgp_retried) {
+        st->sgp_retried = true;
+        st->sgp_phase = SGP4xPhase::RETRY;
+        return run_ms + SGP4X_READ_RETRY_MS;
     }
+    st->sgp_phase = SGP4xPhase::IDLE;
+    return st->last_sgp_read + 1000;
 }
 
 // Update SPS30 particulate matter sensor with continuous 1-second readings.
 // Per datasheet: "New readings are available every second" (Section 4.1).
 // State machine: INIT -> START -> WARMUP -> MEASURING (continuous 1s reads)
+// Each second MEASURING -> CHECK_READY -> READ -> MEASURING: every command is
+// sent in one step and its answer fetched in a later one.
 // After initialization, sensor stays in Measurement Mode for continuous readings.
 // Startup time: 8-30 seconds depending on concentration level (Table 1).
-static void update_sps30(Sensors::SensorsState *st, int64_t now_ms) {
-    if (!st->sps30_handle) return;
+// now_ms and run_ms as in update_stcc4().
+// Returns the time (ms) this state next needs a step.
+static int64_t update_sps30(Sensors::SensorsState *st, int64_t now_ms, int64_t run_ms) {
+    if (!st->sps30_handle) return SENSOR_STEP_DONE;
     
     // SPS30 state machine for continuous measurement
     static enum { 
         SPS30_INIT,      // Initial state - need to wake up sensor
         SPS30_START,     // Start measurement mode
         SPS30_WARMUP,    // Wait for sensor warmup (8-30s per datasheet)
-        SPS30_MEASURING  // Continuous 1-second readings
+        SPS30_MEASURING, // Continuous 1-second readings
+        SPS30_CHECK_READY, // Data-ready command sent, flag due at sps30_state_time
+        SPS30_READ       // Read command sent, data due at sps30_state_time
     } sps30_state = SPS30_INIT;
     static int64_t sps30_state_time = 0;
     static int64_t last_read_time = 0;
     
     int64_t elapsed = now_ms - sps30_state_time;
     esp_err_t ret;
+    uint32_t ready_ms = 0;
+    
+    // Stop and sleep the sensor; INIT wakes it up again
+    auto restart = [&]() {
+        sps30_stop_measurement(st->sps30_handle);
+        sps30_sleep(st->sps30_handle);
+        st->sps30_check_fail_count = 0;
+        st->sps30_not_ready_count = 0;
+        st->sps30_last_read = 0;
+        sps30_state = SPS30_INIT;
+        sps30_state_time = now_ms;
+        last_read_time = 0;
+    };
+    
+    // A data-ready check failed on the bus: restart after 5 in a row
+    auto check_failed = [&]() {
+        sps30_state = SPS30_MEASURING;
+        st->sps30_check_fail_count++;
+        ESP_LOGW(TAG_SENS, "SPS30: Data ready check failed (%d/5)", st->sps30_check_fail_count);
+        if (st->sps30_check_fail_count >= 5) {
+            ESP_LOGW(TAG_SENS, "SPS30: Too many check failures, restarting sensor...");
+            restart();
+        }
+    };
     
     switch (sps30_state) {
         case SPS30_INIT:
             // Wake up sensor from sleep mode
-            ret = sps30_wakeup(st->sps30_handle);
+            ret = sps30_send_wakeup(st->sps30_handle, &ready_ms);
             if (ret == ESP_OK) {
                 ESP_LOGI(TAG_SENS, "SPS30: Waking up sensor");
                 sps30_state = SPS30_START;
-                sps30_state_time = now_ms;
+                sps30_state_time = run_ms + ready_ms;  // Awake from here
                 st->sps30_not_ready_count = 0;
                 st->sps30_check_fail_count = 0;
                 st->sps30_last_read = 0;
@@ -518,7 +636,7 @@ static void update_sps30(Sensors::SensorsState *st, int64_t now_ms) {
                 if (ret == ESP_OK) {
                     ESP_LOGI(TAG_SENS, "SPS30: Starting continuous measurement mode");
                     sps30_state = SPS30_WARMUP;
-                    sps30_state_time = now_ms;
+                    sps30_state_time = run_ms;
                     st->sps30_not_ready_count = 0;
                     st->sps30_check_fail_count = 0;
                 } else {
@@ -548,50 +666,69 @@ static void update_sps30(Sensors::SensorsState *st, int64_t now_ms) {
                 last_read_time = now_ms;
                 
                 // Check if data is ready before reading
-                bool ready = false;
-                ret = sps30_read_data_ready(st->sps30_handle, &ready);
-                
-                if (ret == ESP_OK && ready) {
-                    st->sps30_not_ready_count = 0;
-                    st->sps30_check_fail_count = 0;  // Reset on successful check
-                    ret = sps30_read_measurement(st->sps30_handle, &st->sps30_data);
-                    if (ret == ESP_OK) {
-                        st->sps30_last_read = now_ms;
-                        ESP_LOGD(TAG_SENS, "SPS30: PM1.0=%.1f, PM2.5=%.1f, PM4.0=%.1f, PM10=%.1f µg/m³",
-                                 st->sps30_data.pm1p0_mass, st->sps30_data.pm2p5_mass,
-                                 st->sps30_data.pm4p0_mass, st->sps30_data.pm10p0_mass);
-                    }
-                } else if (ret == ESP_OK && !ready) {
-                    st->sps30_not_ready_count++;
-                    if (st->sps30_not_ready_count > 2) {
-                        ESP_LOGW(TAG_SENS, "SPS30: Data-ready not ready too long, restarting");
-                        sps30_stop_measurement(st->sps30_handle);
-                        sps30_sleep(st->sps30_handle);
-                        st->sps30_not_ready_count = 0;
-                        st->sps30_last_read = 0;
-                        sps30_state = SPS30_INIT;
-                        sps30_state_time = now_ms;
-                        last_read_time = 0;
-                    }
-                } else if (ret != ESP_OK) {
-                    st->sps30_check_fail_count++;
-                    ESP_LOGW(TAG_SENS, "SPS30: Data ready check failed (%d/5)", st->sps30_check_fail_count);
-                    
-                    // Restart SPS30 after 5 consecutive failures
-                    if (st->sps30_check_fail_count >= 5) {
-                        ESP_LOGW(TAG_SENS, "SPS30: Too many check failures, restarting sensor...");
-                        sps30_stop_measurement(st->sps30_handle);
-                        sps30_sleep(st->sps30_handle);
-                        st->sps30_check_fail_count = 0;
-                        st->sps30_not_ready_count = 0;
-                        st->sps30_last_read = 0;
-                        sps30_state = SPS30_INIT;
-                        sps30_state_time = now_ms;
-                        last_read_time = 0;
-                    }
+                ret = sps30_start_read_data_ready(st->sps30_handle, &ready_ms);
+                if (ret == ESP_OK) {
+                    sps30_state = SPS30_CHECK_READY;
+                    sps30_state_time = run_ms + ready_ms;
+                } else {
+                    check_failed();
                 }
             }
             break;
+            
+        case SPS30_CHECK_READY: {
+            if (elapsed < 0) break;
+            bool ready = false;
+            ret = sps30_fetch_data_ready(st->sps30_handle, &ready);
+            
+            if (ret == ESP_OK && ready) {
+                st->sps30_not_ready_count = 0;
+                st->sps30_check_fail_count = 0;  // Reset on successful check
+                sps30_state = SPS30_MEASURING;
+                if (sps30_start_read_measurement(st->sps30_handle, &ready_ms) == ESP_OK) {
+                    sps30_state = SPS30_READ;
+                    sps30_state_time = run_ms + ready_ms;
+                }
+            } else if (ret == ESP_OK && !ready) {
+                sps30_state = SPS30_MEASURING;
+                st->sps30_not_ready_count++;
+                if (st->sps30_not_ready_count > 2) {
+                    ESP_LOGW(TAG_SENS, "SPS30: Data-ready not ready too long, restarting");
+                    restart();
+                }
+            } else {
+                check_failed();
+            }
+            break;
+        }
+            
+        case SPS30_READ:
+            if (elapsed < 0) break;
+            sps30_state = SPS30_MEASURING;
+            ret = sps30_fetch_measurement(st->sps30_handle, &st->sps30_data);
+            if (ret == ESP_OK) {
+                st->sps30_last_read = last_read_time;
+                st->pm25_window.push(last_read_time, st->sps30_data.pm2p5_mass);
+                ESP_LOGD(TAG_SENS, "SPS30: PM1.0=%.1f, PM2.5=%.1f, PM4.0=%.1f, PM10=%.1f µg/m³",
+                         st->sps30_data.pm1p0_mass, st->sps30_data.pm2p5_mass,
+                         st->sps30_data.pm4p0_mass, st->sps30_data.pm10p0_mass);
+            }
+            break;
+    }
+
+    switch (sps30_state) {
+        case SPS30_INIT:
+            // sps30_state_time is in the future after a failed start
+            return sps30_state_time > now_ms ? sps30_state_time : now_ms;
+        case SPS30_START:
+            return sps30_state_time + 100;
+        case SPS30_WARMUP:
+            return sps30_state_time + 8000;
+        case SPS30_CHECK_READY:
+        case SPS30_READ:
+            return sps30_state_time;
+        default:
+            return last_read_time + 1000;
     }
 }
 
@@ -605,60 +742,126 @@ esp_err_t Sensors::init(void) {
     if (ok2 != ESP_OK) ESP_LOGW(TAG_SENS, "SGP4x init failed: %s", esp_err_to_name(ok2));
     if (ok3 != ESP_OK) ESP_LOGW(TAG_SENS, "SPS30 init failed: %s", esp_err_to_name(ok3));
     state->stcc4_state_time = esp_timer_get_time() / 1000;
+
+    // Every sensor steps right away; each step then names its next deadline.
+    // STCC4 runs even if init failed, its state machine retries the start.
+    state->schedule.clear();
+    for (uint8_t job = 0; job < (uint8_t)SensorJob::COUNT; job++) {
+        state->schedule.push(state->stcc4_state_time, job);
+    }
     return (ok1 == ESP_OK || ok2 == ESP_OK || ok3 == ESP_OK) ? ESP_OK : ESP_FAIL;
 }
 
-void Sensors::update(int64_t current_millis) {
-    update_stcc4(state, current_millis);
-    update_sgp4x(state, current_millis);
-    update_sps30(state, current_millis);
-    
-    // Read DPS368 pressure sensor (every 5 seconds)
-    if (state->dps368_handle && (current_millis - state->last_dps_read >= DPS368_READ_INTERVAL_MS)) {
-        state->last_dps_read = current_millis;
-        esp_err_t ret = dps368_read(state->dps368_handle, &state->dps368_data);
-        if (ret == ESP_OK && state->dps368_data.pressure_valid) {
+// Read DPS368 pressure sensor (every 5 seconds).
+// Returns the time (ms) of the next read.
+static int64_t update_dps368(Sensors::SensorsState *st, int64_t now_ms) {
+    if (!st->dps368_handle) return SENSOR_STEP_DONE;
+    if (now_ms - st->last_dps_read >= DPS368_READ_INTERVAL_MS) {
+        st->last_dps_read = now_ms;
+        esp_err_t ret = dps368_read(st->dps368_handle, &st->dps368_data);
+        if (ret == ESP_OK && st->dps368_data.pressure_valid) {
             ESP_LOGD(TAG_SENS, "DPS368: Pressure=%.1f Pa (%.1f hPa), Temp=%.1f°C", 
-                     state->dps368_data.pressure_pa, state->dps368_data.pressure_pa / 100.0f, 
-                     state->dps368_data.temperature_c);
+                     st->dps368_data.pressure_pa, st->dps368_data.pressure_pa / 100.0f, 
+                     st->dps368_data.temperature_c);
         }
     }
+    return st->last_dps_read + DPS368_READ_INTERVAL_MS;
+}
 
-    // Read LIS2DH12 accelerometer (every 1 second)
-    if (state->lis2dh12 && (current_millis - state->last_accel_read >= 1000)) {
-        state->last_accel_read = current_millis;
+// Read LIS2DH12 accelerometer and pick up motion interrupts (every 1 second).
+// Returns the time (ms) of the next read.
+static int64_t update_lis2dh12(Sensors::SensorsState *st, int64_t now_ms) {
+    if (!st->lis2dh12) return SENSOR_STEP_DONE;
+    if (now_ms - st->last_accel_read >= 1000) {
+        st->last_accel_read = now_ms;
         
         // Debug: Poll INT1_SRC register to see if interrupt is being generated
         uint8_t int_src = 0;
-        esp_err_t ret = state->lis2dh12->get_int1_source(&int_src);
+        esp_err_t ret = st->lis2dh12->get_int1_source(&int_src);
         if (ret == ESP_OK && int_src != 0) {
             // Read GPIO3 pin level
             int gpio_level = gpio_get_level((gpio_num_t)LIS2DH12_INT1_GPIO);
             ESP_LOGI(TAG_SENS, "LIS2DH12: INT1_SRC=0x%02X (IA=%d) GPIO3=%d, flag=%d",
-                     int_src, (int_src >> 6) & 1, gpio_level, state->motion_interrupt_triggered);
+                     int_src, (int_src >> 6) & 1, gpio_level, st->motion_interrupt_triggered);
         }
         
         // Check if motion interrupt was triggered
-        if (state->motion_interrupt_triggered) {
-            state->motion_interrupt_triggered = false;
-            state->motion_detected = true;
+        if (st->motion_interrupt_triggered) {
+            st->motion_interrupt_triggered = false;
+            st->motion_detected = true;
             ESP_LOGI(TAG_SENS, "LIS2DH12: *** Motion interrupt via ISR! ***");
             // TODO: Trigger GPS tagging here
         }
         
         // Check if data is ready
         bool data_ready = false;
-        ret = state->lis2dh12->is_data_ready(&data_ready);
+        ret = st->lis2dh12->is_data_ready(&data_ready);
         
         if (ret == ESP_OK && data_ready) {
-            ret = state->lis2dh12->read_accel(&state->accel_data);
+            ret = st->lis2dh12->read_accel(&st->accel_data);
             if (ret == ESP_OK) {
-                state->have_accel_data = true;
+                st->have_accel_data = true;
                 ESP_LOGD(TAG_SENS, "LIS2DH12: X=%d mg, Y=%d mg, Z=%d mg",
-                         state->accel_data.x_mg, state->accel_data.y_mg, state->accel_data.z_mg);
+                         st->accel_data.x_mg, st->accel_data.y_mg, st->accel_data.z_mg);
             }
         }
     }
+    return st->last_accel_read + 1000;
+}
+
+// Run one scheduled step as of now_ms, at run_ms. Returns the time (ms) it is
+// next due, or SENSOR_STEP_DONE.
+static int64_t run_sensor_job(Sensors::SensorsState *st, SensorJob job, int64_t now_ms,
+                              int64_t run_ms) {
+    switch (job) {
+        case SensorJob::STCC4:
+            return update_stcc4(st, now_ms, run_ms);
+        case SensorJob::SGP4X:
+            return update_sgp4x(st, now_ms, run_ms);
+        case SensorJob::SPS30:
+            return update_sps30(st, now_ms, run_ms);
+        case SensorJob::DPS368:
+            return update_dps368(st, now_ms);
+        case SensorJob::LIS2DH12:
+            return update_lis2dh12(st, now_ms);
+        default:
+            return SENSOR_STEP_DONE;
+    }
+}
+
+int64_t Sensors::update(int64_t current_millis) {
+    const int64_t start_us = esp_timer_get_time();
+
+    // Only the steps whose deadline has passed run; the rest cost one look at
+    // the top of the heap
+    DeadlineHeap<(size_t)SensorJob::COUNT>::Entry due;
+    while (!state->schedule.empty() && state->schedule.top().due_ms <= current_millis) {
+        state->schedule.pop(&due);
+        const int64_t step_ms = current_millis - due.due_ms < SENSOR_ON_TIME_MS
+                                    ? due.due_ms : current_millis;
+        int64_t next = run_sensor_job(state, (SensorJob)due.job, step_ms, current_millis);
+        if (next == SENSOR_STEP_DONE) continue;
+        if (next <= current_millis) {
+            next = current_millis + SENSOR_MIN_STEP_MS;
+        } else if (next - current_millis > SENSOR_ALIGN_MS / 2) {
+            next = (next + SENSOR_ALIGN_MS - 1) / SENSOR_ALIGN_MS * SENSOR_ALIGN_MS;
+        }
+        state->schedule.push(next, due.job);
+    }
+
+    const int64_t took_us = esp_timer_get_time() - start_us;
+    if (took_us > state->update_worst_us) state->update_worst_us = took_us;
+
+    if (state->schedule.empty()) return SENSOR_IDLE_WAIT_MS;
+    // Wake for the last step due within SENSOR_ON_TIME_MS of the earliest:
+    // the earlier ones run late by less than that, and so still on time
+    const int64_t wake_ms =
+        state->schedule.latest_before(state->schedule.top().due_ms + SENSOR_ON_TIME_MS);
+    return wake_ms - current_millis;
+}
+
+int64_t Sensors::updateWorstUs(void) {
+    return state ? state->update_worst_us : 0;
 }
 
 bool Sensors::isSps30Reading(int64_t now_ms, int64_t max_age_ms) {
@@ -667,22 +870,51 @@ bool Sensors::isSps30Reading(int64_t now_ms, int64_t max_age_ms) {
     return (now_ms - state->sps30_last_read) <= max_age_ms;
 }
 
+int64_t Sensors::sps30LastReadMs(void) {
+    if (!state || !state->sps30_handle) return 0;
+    return state->sps30_last_read > 0 ? state->sps30_last_read : 0;
+}
+
 void Sensors::getValues(int64_t now_ms, sensor_values_t *out) {
     if (!out) return;
     memset(out, 0, sizeof(*out));
-    int co2_avg = 0; float t_avg = 0.0f; float rh_avg = 0.0f;
-    bool have = co2_avg_last_5s(state, now_ms, &co2_avg, &t_avg, &rh_avg);
-    out->have_co2_avg = have;
-    if (have) {
-        out->co2_ppm_avg = co2_avg;
-        out->temp_c_avg = t_avg;
-        out->rh_avg = rh_avg;
+
+    // Drop samples older than the averaging window; what is left is summed
+    // already
+    const int64_t window_start = now_ms - SENSOR_AVG_WINDOW_MS;
+    state->co2_window.evict_before(window_start);
+    state->temp_window.evict_before(window_start);
+    state->rh_window.evict_before(window_start);
+    state->pm25_window.evict_before(window_start);
+    state->voc_window.evict_before(window_start);
+    state->nox_window.evict_before(window_start);
+
+    out->have_co2_avg = !state->co2_window.empty();
+    if (out->have_co2_avg) {
+        out->co2_ppm_avg = (int)state->co2_window.mean();
+        out->temp_c_avg = (float)state->temp_window.mean();
+        out->rh_avg = (float)state->rh_window.mean();
+        out->co2_ppm_min = state->co2_window.min();
+        out->co2_ppm_max = state->co2_window.max();
     }
     out->pm25_mass = state->sps30_data.pm2p5_mass;
+    out->have_pm25_avg = !state->pm25_window.empty();
+    if (out->have_pm25_avg) {
+        out->pm25_mass_avg = (float)state->pm25_window.mean();
+        out->pm25_mass_max = state->pm25_window.max();
+    }
+    out->pm1_mass = state->sps30_data.pm1p0_mass;
+    out->pm4_mass = state->sps30_data.pm4p0_mass;
+    out->pm10_mass = state->sps30_data.pm10p0_mass;
+    out->pn05_count = state->sps30_data.pm0p5_number;
+    out->pn10_count = state->sps30_data.pm1p0_number;
+    out->pn25_count = state->sps30_data.pm2p5_number;
     out->voc_ticks = (int)state->sgp_voc_ticks;
     out->nox_ticks = (int)state->sgp_nox_ticks;
     out->voc_index = (int)state->voc_index;
     out->nox_index = (int)state->nox_index;
+    out->voc_index_avg = (int)(state->voc_window.mean() + 0.5);
+    out->nox_index_avg = (int)(state->nox_window.mean() + 0.5);
     out->pressure_pa = state->dps368_data.pressure_pa;
 
     // Accelerometer data
@@ -10,12 +10,25 @@ typedef struct {
     int co2_ppm_avg;      // averaged CO2 ppm
     float temp_c_avg;     // averaged temperature in °C
     float rh_avg;         // averaged relative humidity in %RH
+    int co2_ppm_min;      // lowest CO2 ppm in the 5s window
+    int co2_ppm_max;      // highest CO2 ppm in the 5s window
 
     float pm25_mass;      // PM2.5 µg/m³ (SPS30), 0 if unavailable
+    bool have_pm25_avg;   // true if 5s PM2.5 average is available
+    float pm25_mass_avg;  // averaged PM2.5 µg/m³
+    float pm25_mass_max;  // highest PM2.5 µg/m³ in the 5s window
+    float pm1_mass;       // PM1.0 µg/m³ (SPS30), 0 if unavailable
+    float pm4_mass;       // PM4.0 µg/m³ (SPS30), 0 if unavailable
+    float pm10_mass;      // PM10 µg/m³ (SPS30), 0 if unavailable
+    float pn05_count;     // Particles 0.3-0.5 µm per cm³ (SPS30), 0 if unavailable
+    float pn10_count;     // Particles 0.3-1.0 µm per cm³ (SPS30), 0 if unavailable
+    float pn25_count;     // Particles 0.3-2.5 µm per cm³ (SPS30), 0 if unavailable
     int voc_ticks;        // SGP4x VOC ticks, 0 if unavailable
     int nox_ticks;        // SGP4x NOx ticks, 0 if unavailable
     int voc_index;        // VOC gas index (1-500), 0 during blackout
     int nox_index;        // NOx gas index (1-500), 0 during blackout
+    int voc_index_avg;    // 5s average VOC index, 0 if none outside blackout
+    int nox_index_avg;    // 5s average NOx index, 0 if none outside blackout
     float pressure_pa;    // Atmospheric pressure in Pascals (DPS368), 0 if unavailable
 
     // LIS2DH12 3-axis accelerometer
@@ -41,15 +54,23 @@ public:
     // Initialize I2C and all sensors. Returns ESP_OK on success.
     esp_err_t init(void);
 
-    // Periodic non-blocking update; call ~every 50ms with current millis.
-    void update(int64_t current_millis);
+    // Run the sensor steps that are due at current_millis. Returns the ms
+    // until the next step is due; calling sooner is harmless.
+    int64_t update(int64_t current_millis);
 
-    // Retrieve current display-ready values. Uses 5s average for CO2/Temp/RH.
+    // Longest update() pass since boot, in microseconds.
+    int64_t updateWorstUs(void);
+
+    // Retrieve current display-ready values. Uses 5s average for CO2/Temp/RH,
+    // with the latest PM2.5 and VOC/NOx index alongside their 5s averages.
     void getValues(int64_t now_ms, sensor_values_t *out);
 
     // Check if SPS30 has a recent successful read.
     bool isSps30Reading(int64_t now_ms, int64_t max_age_ms);
 
+    // Time of the last successful SPS30 read, 0 if none yet.
+    int64_t sps30LastReadMs(void);
+
     // Get I2C bus handle (for sharing with other components like CAP1203)
     i2c_master_bus_handle_t getI2CBusHandle(void);
 
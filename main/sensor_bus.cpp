@@ -0,0 +1,232 @@
+/**
+ * @file sensor_bus.cpp
+ * @brief Sensor frames from the sensor task to its consumers
+ *
+ * Each subscriber has a small ring of frames and a latest-value slot under
+ * its own mutex, held only to copy a frame in or out. A binary semaphore,
+ * given and cleared under that mutex, is held exactly while the ring is
+ * not empty, so a receiver waits on it at most once.
+ */
+
+#include "sensor_bus.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+
+#include <atomic>
+#include <string.h>
+
+// Queue depths in frames, at one frame a second. Storage rides out a
+// NAND erase or a mount; the latest-value readers only need the slot.
+#ifndef SENSOR_BUS_DISPLAY_DEPTH
+#define SENSOR_BUS_DISPLAY_DEPTH 2
+#endif
+#ifndef SENSOR_BUS_STORAGE_DEPTH
+#define SENSOR_BUS_STORAGE_DEPTH 8
+#endif
+#ifndef SENSOR_BUS_LED_DEPTH
+#define SENSOR_BUS_LED_DEPTH 1
+#endif
+#ifndef SENSOR_BUS_ALERTS_DEPTH
+#define SENSOR_BUS_ALERTS_DEPTH 4
+#endif
+#ifndef SENSOR_BUS_SYSTEM_DEPTH
+#define SENSOR_BUS_SYSTEM_DEPTH 1
+#endif
+
+static const char *TAG = "sensor_bus";
+
+static const uint8_t kDepths[SENSOR_SUB_COUNT] = {
+    SENSOR_BUS_DISPLAY_DEPTH, SENSOR_BUS_STORAGE_DEPTH, SENSOR_BUS_LED_DEPTH,
+    SENSOR_BUS_ALERTS_DEPTH,  SENSOR_BUS_SYSTEM_DEPTH,
+};
+
+static const char *const kNames[SENSOR_SUB_COUNT] = {
+    "display", "storage", "led", "alerts", "system",
+};
+
+static constexpr size_t kPoolFrames = SENSOR_BUS_DISPLAY_DEPTH + SENSOR_BUS_STORAGE_DEPTH +
+                                      SENSOR_BUS_LED_DEPTH + SENSOR_BUS_ALERTS_DEPTH +
+                                      SENSOR_BUS_SYSTEM_DEPTH;
+
+typedef struct {
+  SemaphoreHandle_t lock;   // Guards everything below
+  SemaphoreHandle_t ready;  // Given while the ring holds a frame
+  sensor_frame_t *ring;     // kDepths[sub] frames out of g_pool
+  uint8_t head;
+  uint8_t count;
+  bool have_latest;
+  sensor_frame_t latest;
+  uint32_t taken_seq;  // seq of the last frame it took
+  sensor_bus_sub_stats_t stats;
+} bus_sub_t;
+
+static sensor_frame_t g_pool[kPoolFrames];
+static bus_sub_t g_subs[SENSOR_SUB_COUNT] = {};
+static std::atomic<uint32_t> g_seq{0};
+static bool g_ready = false;
+
+// ============================================================================
+// Internal Helper Functions (callers hold the subscriber's lock)
+// ============================================================================
+
+static void note_taken_locked(bus_sub_t *s, const sensor_frame_t *frame) {
+  if (frame->seq == s->taken_seq) {
+    return;
+  }
+  s->taken_seq = frame->seq;
+  s->stats.taken++;
+  int64_t age = esp_timer_get_time() / 1000 - frame->timestamp_ms;
+  uint32_t age_ms = age > 0 ? (uint32_t)age : 0;
+  s->stats.last_lag_ms = age_ms;
+  if (age_ms > s->stats.max_lag_ms) {
+    s->stats.max_lag_ms = age_ms;
+  }
+}
+
+static bool pop_locked(bus_sub_t *s, uint8_t depth, sensor_frame_t *out) {
+  if (s->count == 0) {
+    return false;
+  }
+  *out = s->ring[s->head];
+  s->head = (uint8_t)((s->head + 1) % depth);
+  if (--s->count == 0) {
+    xSemaphoreTake(s->ready, 0);
+  }
+  note_taken_locked(s, out);
+  return true;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+esp_err_t sensor_bus_init(void) {
+  if (g_ready) {
+    return ESP_OK;
+  }
+  size_t offset = 0;
+  for (int i = 0; i < SENSOR_SUB_COUNT; i++) {
+    bus_sub_t *s = &g_subs[i];
+    s->lock = xSemaphoreCreateMutex();
+    s->ready = xSemaphoreCreateBinary();
+    if (!s->lock || !s->ready) {
+      ESP_LOGE(TAG, "Failed to create %s queue", kNames[i]);
+      return ESP_ERR_NO_MEM;
+    }
+    s->ring = &g_pool[offset];
+    offset += kDepths[i];
+  }
+  g_ready = true;
+  ESP_LOGI(TAG, "%d subscribers, %u frames of %u bytes queued at most", SENSOR_SUB_COUNT,
+           (unsigned)kPoolFrames, (unsigned)sizeof(sensor_frame_t));
+  return ESP_OK;
+}
+
+uint32_t sensor_bus_publish(int64_t timestamp_ms, int64_t sps30_read_ms,
+                            int64_t update_worst_us, const sensor_values_t *values) {
+  if (!g_ready || !values) {
+    return 0;
+  }
+  sensor_frame_t frame;
+  frame.seq = g_seq.load(std::memory_order_relaxed) + 1;
+  frame.timestamp_ms = timestamp_ms;
+  frame.sps30_read_ms = sps30_read_ms;
+  frame.update_worst_us = update_worst_us;
+  frame.values = *values;
+  g_seq.store(frame.seq, std::memory_order_release);
+
+  for (int i = 0; i < SENSOR_SUB_COUNT; i++) {
+    bus_sub_t *s = &g_subs[i];
+    const uint8_t depth = kDepths[i];
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    if (s->count == depth) {
+      s->head = (uint8_t)((s->head + 1) % depth);
+      s->count--;
+      s->stats.dropped++;
+    }
+    s->ring[(s->head + s->count) % depth] = frame;
+    s->count++;
+    if (s->count > s->stats.high_water) {
+      s->stats.high_water = s->count;
+    }
+    s->latest = frame;
+    s->have_latest = true;
+    s->stats.published++;
+    xSemaphoreGive(s->ready);
+    xSemaphoreGive(s->lock);
+  }
+  return frame.seq;
+}
+
+bool sensor_bus_receive(sensor_sub_t sub, sensor_frame_t *out, TickType_t timeout_ticks) {
+  if (!g_ready || sub >= SENSOR_SUB_COUNT || !out) {
+    return false;
+  }
+  bus_sub_t *s = &g_subs[sub];
+  for (int attempt = 0; attempt < 2; attempt++) {
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    bool got = pop_locked(s, kDepths[sub], out);
+    xSemaphoreGive(s->lock);
+    if (got) {
+      return true;
+    }
+    // Given only while the ring is not empty, so one wait is enough
+    if (attempt == 0 && xSemaphoreTake(s->ready, timeout_ticks) == pdTRUE) {
+      xSemaphoreGive(s->ready);
+    } else {
+      break;
+    }
+  }
+  return false;
+}
+
+bool sensor_bus_latest(sensor_sub_t sub, sensor_frame_t *out) {
+  if (!g_ready || sub >= SENSOR_SUB_COUNT || !out) {
+    return false;
+  }
+  bus_sub_t *s = &g_subs[sub];
+  xSemaphoreTake(s->lock, portMAX_DELAY);
+  bool have = s->have_latest;
+  if (have) {
+    *out = s->latest;
+    // The newest frame is the last one queued; the rest are passed over
+    if (s->count > 0) {
+      s->stats.skipped += (uint32_t)(s->count - 1);
+      s->head = 0;
+      s->count = 0;
+      xSemaphoreTake(s->ready, 0);
+    }
+    note_taken_locked(s, out);
+  }
+  xSemaphoreGive(s->lock);
+  return have;
+}
+
+esp_err_t sensor_bus_get_stats(sensor_bus_stats_t *out) {
+  if (!out) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memset(out, 0, sizeof(*out));
+  if (!g_ready) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  for (int i = 0; i < SENSOR_SUB_COUNT; i++) {
+    bus_sub_t *s = &g_subs[i];
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    uint32_t seq = g_seq.load(std::memory_order_acquire);
+    out->sub[i] = s->stats;
+    out->sub[i].queued = s->count;
+    out->sub[i].lag_frames = seq - s->taken_seq;
+    if (seq > out->frames) {
+      out->frames = seq;
+    }
+    xSemaphoreGive(s->lock);
+  }
+  return ESP_OK;
+}
+
+const char *sensor_bus_sub_name(sensor_sub_t sub) {
+  return sub < SENSOR_SUB_COUNT ? kNames[sub] : "?";
+}
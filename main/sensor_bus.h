@@ -0,0 +1,90 @@
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "sensor.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ============================================================================
+// Sensor Frame Bus
+// ============================================================================
+//
+// The sensor task owns Sensors and publishes a frame of its values once a
+// second. Every subscriber gets its own copy of each frame, in a bounded
+// FIFO queue and in a latest-value slot, so what one consumer does never
+// reaches the others or the sensor task.
+//
+// Publishing never waits on a consumer: when a queue is full its oldest
+// frame is dropped and counted. A consumer that wants every frame (storage,
+// alerts) takes them with sensor_bus_receive(); one that only shows the
+// current state (display, LED) reads sensor_bus_latest(), which also clears
+// what was queued.
+//
+// Frames are copies, so a consumer may keep one as long as it likes. Each
+// subscriber is read by one task at a time.
+
+typedef enum {
+  SENSOR_SUB_DISPLAY = 0,  // display_task, newest frame
+  SENSOR_SUB_STORAGE,      // Storage sink task, every frame into the log
+  SENSOR_SUB_LED,          // LED bar levels in the main loop, newest frame
+  SENSOR_SUB_ALERTS,       // Air level alerts in the main loop, every frame
+  SENSOR_SUB_SYSTEM,       // Power path and summary log in the main loop
+  SENSOR_SUB_COUNT,
+} sensor_sub_t;
+
+typedef struct {
+  uint32_t seq;             // 1 for the first frame, then one more per frame
+  int64_t timestamp_ms;     // esp_timer time the values were taken
+  int64_t sps30_read_ms;    // Time of the last SPS30 reading (0: none yet)
+  int64_t update_worst_us;  // Longest sensor update() pass so far
+  sensor_values_t values;
+} sensor_frame_t;
+
+// Per subscriber, cumulative since sensor_bus_init()
+typedef struct {
+  uint32_t published;    // Frames offered to it
+  uint32_t taken;        // Frames it consumed
+  uint32_t dropped;      // Frames pushed out of its full queue unread
+  uint32_t skipped;      // Queued frames passed over by sensor_bus_latest()
+  uint32_t queued;       // Frames waiting now
+  uint32_t high_water;   // Most frames waiting at once
+  uint32_t lag_frames;   // Frames published after the one it took last
+  uint32_t last_lag_ms;  // Age of the last frame it took, when taken
+  uint32_t max_lag_ms;   // Oldest any frame was when taken
+} sensor_bus_sub_stats_t;
+
+typedef struct {
+  uint32_t frames;  // Frames published
+  sensor_bus_sub_stats_t sub[SENSOR_SUB_COUNT];
+} sensor_bus_stats_t;
+
+// Create the queues. Safe to call more than once.
+esp_err_t sensor_bus_init(void);
+
+// Copy a frame to every subscriber and return its seq (0 before init).
+// Never blocks on a consumer. Single producer: call from one task only.
+uint32_t sensor_bus_publish(int64_t timestamp_ms, int64_t sps30_read_ms,
+                            int64_t update_worst_us, const sensor_values_t *values);
+
+// Take sub's oldest queued frame, waiting up to timeout_ticks for one.
+// Returns false on timeout.
+bool sensor_bus_receive(sensor_sub_t sub, sensor_frame_t *out, TickType_t timeout_ticks);
+
+// Copy the newest frame published and clear sub's queue. Returns false
+// before the first frame. Compare out->seq to tell a new frame from one
+// already seen.
+bool sensor_bus_latest(sensor_sub_t sub, sensor_frame_t *out);
+
+esp_err_t sensor_bus_get_stats(sensor_bus_stats_t *out);
+
+const char *sensor_bus_sub_name(sensor_sub_t sub);
+
+#ifdef __cplusplus
+}
+#endif
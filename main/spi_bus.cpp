@@ -0,0 +1,254 @@
+/**
+ * @file spi_bus.cpp
+ * @brief Priority arbitration of SPI2_HOST between the e-paper and the NAND
+ *
+ * One state mutex guards the owner and the per-device wait slots. A
+ * release picks the next owner itself and wakes it through that device's
+ * grant semaphore, so the bus never sits free while someone is queued.
+ */
+
+#include "spi_bus.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+
+#include <string.h>
+
+// Clock profiles. The EPD controller is only reliable at 4 MHz on this
+// board; the NAND runs half-duplex at 10 MHz.
+#ifndef SPI_BUS_EPD_CLOCK_HZ
+#define SPI_BUS_EPD_CLOCK_HZ (4 * 1000 * 1000)
+#endif
+#ifndef SPI_BUS_NAND_CLOCK_HZ
+#define SPI_BUS_NAND_CLOCK_HZ (10 * 1000 * 1000)
+#endif
+
+// How long storage may keep the bus from a waiting display refresh
+#ifndef SPI_BUS_NAND_BUDGET_US
+#define SPI_BUS_NAND_BUDGET_US 5000
+#endif
+
+static const char *TAG = "spi_bus";
+
+static const spi_bus_profile_t kProfiles[SPI_BUS_DEV_COUNT] = {
+    {.name = "epd", .cs_pin = 0, .clock_hz = SPI_BUS_EPD_CLOCK_HZ, .budget_us = 0},
+    {.name = "nand",
+     .cs_pin = 4,
+     .clock_hz = SPI_BUS_NAND_CLOCK_HZ,
+     .budget_us = SPI_BUS_NAND_BUDGET_US},
+};
+
+typedef struct {
+  bool waiting;
+  spi_bus_prio_t prio;
+  uint32_t seq;  // Queue order within a class
+  SemaphoreHandle_t grant;
+} bus_waiter_t;
+
+static SemaphoreHandle_t g_state_lock = nullptr;
+static int g_owner = -1;  // spi_bus_dev_t holding the bus, or -1
+static uint32_t g_depth = 0;
+static spi_bus_prio_t g_owner_prio = SPI_BUS_PRIO_BACKGROUND;
+static int64_t g_hold_start_us = 0;
+static uint32_t g_next_seq = 0;
+static bus_waiter_t g_waiters[SPI_BUS_DEV_COUNT] = {};
+static spi_bus_stats_t g_stats = {};
+
+// ============================================================================
+// Internal Helper Functions (callers hold g_state_lock)
+// ============================================================================
+
+static void grant_locked(int dev, spi_bus_prio_t prio, int64_t now_us) {
+  g_owner = dev;
+  g_depth = 1;
+  g_owner_prio = prio;
+  g_hold_start_us = now_us;
+  g_stats.dev[dev].acquisitions++;
+}
+
+// Most urgent waiter, or -1. With `above`, only classes more urgent than it.
+static int next_waiter_locked(int above) {
+  int best = -1;
+  for (int dev = 0; dev < SPI_BUS_DEV_COUNT; dev++) {
+    const bus_waiter_t *w = &g_waiters[dev];
+    if (!w->waiting || (above >= 0 && w->prio >= above)) {
+      continue;
+    }
+    if (best < 0 || w->prio < g_waiters[best].prio ||
+        (w->prio == g_waiters[best].prio && (int32_t)(w->seq - g_waiters[best].seq) < 0)) {
+      best = dev;
+    }
+  }
+  return best;
+}
+
+// End the current hold and hand the bus to the next waiter, if any
+static void hand_off_locked(void) {
+  int64_t now = esp_timer_get_time();
+  spi_bus_dev_stats_t *s = &g_stats.dev[g_owner];
+  uint32_t held = (uint32_t)(now - g_hold_start_us);
+  s->busy_us += held;
+  if (held > s->max_hold_us) {
+    s->max_hold_us = held;
+  }
+
+  int next = next_waiter_locked(-1);
+  if (next < 0) {
+    g_owner = -1;
+    g_depth = 0;
+    return;
+  }
+  g_waiters[next].waiting = false;
+  grant_locked(next, g_waiters[next].prio, now);
+  xSemaphoreGive(g_waiters[next].grant);
+}
+
+// Queue dev and block until a release grants it the bus. Called with
+// g_state_lock held; returns with it held.
+static bool wait_for_grant_locked(int dev, spi_bus_prio_t prio, TickType_t timeout_ticks) {
+  bus_waiter_t *w = &g_waiters[dev];
+  int64_t start = esp_timer_get_time();
+  w->waiting = true;
+  w->prio = prio;
+  w->seq = g_next_seq++;
+  xSemaphoreGive(g_state_lock);
+
+  bool granted = xSemaphoreTake(w->grant, timeout_ticks) == pdTRUE;
+
+  xSemaphoreTake(g_state_lock, portMAX_DELAY);
+  spi_bus_dev_stats_t *s = &g_stats.dev[dev];
+  if (!granted) {
+    if (g_owner != dev) {
+      w->waiting = false;
+      s->timeouts++;
+      return false;
+    }
+    xSemaphoreTake(w->grant, 0);  // Granted just as the wait timed out
+  }
+  uint32_t waited = (uint32_t)(esp_timer_get_time() - start);
+  s->wait_us += waited;
+  if (waited > s->max_wait_us) {
+    s->max_wait_us = waited;
+  }
+  return true;
+}
+
+// ============================================================================
+// Public API
+// ============================================================================
+
+esp_err_t spi_bus_arbiter_init(void) {
+  if (g_state_lock) {
+    return ESP_OK;
+  }
+  for (int dev = 0; dev < SPI_BUS_DEV_COUNT; dev++) {
+    g_waiters[dev].grant = xSemaphoreCreateBinary();
+    if (!g_waiters[dev].grant) {
+      ESP_LOGE(TAG, "Failed to create grant semaphore");
+      return ESP_ERR_NO_MEM;
+    }
+  }
+  memset(&g_stats, 0, sizeof(g_stats));
+  g_stats.since_us = esp_timer_get_time();
+  g_state_lock = xSemaphoreCreateMutex();
+  if (!g_state_lock) {
+    ESP_LOGE(TAG, "Failed to create bus state mutex");
+    return ESP_ERR_NO_MEM;
+  }
+  ESP_LOGI(TAG, "SPI2 arbiter ready (nand budget %lu us)",
+           kProfiles[SPI_BUS_DEV_NAND].budget_us);
+  return ESP_OK;
+}
+
+const spi_bus_profile_t *spi_bus_profile(spi_bus_dev_t dev) {
+  return (dev < SPI_BUS_DEV_COUNT) ? &kProfiles[dev] : nullptr;
+}
+
+bool spi_bus_acquire(spi_bus_dev_t dev, spi_bus_prio_t prio, TickType_t timeout_ticks) {
+  if (!g_state_lock || dev >= SPI_BUS_DEV_COUNT) {
+    return g_state_lock == nullptr;
+  }
+  xSemaphoreTake(g_state_lock, portMAX_DELAY);
+  bool ok = true;
+  if (g_owner == (int)dev) {
+    g_depth++;
+  } else if (g_owner < 0) {
+    grant_locked(dev, prio, esp_timer_get_time());
+  } else {
+    ok = wait_for_grant_locked(dev, prio, timeout_ticks);
+    if (ok) {
+      g_stats.dev[dev].contended++;
+    }
+  }
+  xSemaphoreGive(g_state_lock);
+  return ok;
+}
+
+void spi_bus_release(spi_bus_dev_t dev) {
+  if (!g_state_lock) {
+    return;
+  }
+  xSemaphoreTake(g_state_lock, portMAX_DELAY);
+  if (g_owner == (int)dev && --g_depth == 0) {
+    hand_off_locked();
+  }
+  xSemaphoreGive(g_state_lock);
+}
+
+bool spi_bus_yield(spi_bus_dev_t dev) {
+  if (!g_state_lock) {
+    return false;
+  }
+  xSemaphoreTake(g_state_lock, portMAX_DELAY);
+  bool yielded = false;
+  if (g_owner == (int)dev && g_depth == 1 &&
+      esp_timer_get_time() - g_hold_start_us >= (int64_t)kProfiles[dev].budget_us &&
+      next_waiter_locked(g_owner_prio) >= 0) {
+    spi_bus_prio_t prio = g_owner_prio;
+    g_stats.dev[dev].yields++;
+    hand_off_locked();
+    wait_for_grant_locked(dev, prio, portMAX_DELAY);
+    yielded = true;
+  }
+  xSemaphoreGive(g_state_lock);
+  return yielded;
+}
+
+size_t spi_bus_slice_bytes(spi_bus_dev_t dev, size_t granule) {
+  if (dev >= SPI_BUS_DEV_COUNT || granule == 0) {
+    return granule;
+  }
+  const spi_bus_profile_t *p = &kProfiles[dev];
+  uint64_t bytes = (uint64_t)p->budget_us * p->clock_hz / 8 / 1000000;
+  size_t granules = (size_t)(bytes / granule);
+  return (granules > 0 ? granules : 1) * granule;
+}
+
+esp_err_t spi_bus_get_stats(spi_bus_stats_t *out) {
+  if (!out) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!g_state_lock) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  xSemaphoreTake(g_state_lock, portMAX_DELAY);
+  *out = g_stats;
+  if (g_owner >= 0) {
+    // Count the hold in progress
+    out->dev[g_owner].busy_us += esp_timer_get_time() - g_hold_start_us;
+  }
+  xSemaphoreGive(g_state_lock);
+  return ESP_OK;
+}
+
+uint32_t spi_bus_occupancy_permille(const spi_bus_stats_t *stats, spi_bus_dev_t dev) {
+  if (!stats || dev >= SPI_BUS_DEV_COUNT) {
+    return 0;
+  }
+  int64_t elapsed = esp_timer_get_time() - stats->since_us;
+  if (elapsed <= 0) {
+    return 0;
+  }
+  return (uint32_t)(stats->dev[dev].busy_us * 1000 / (uint64_t)elapsed);
+}
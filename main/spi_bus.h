@@ -0,0 +1,101 @@
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ============================================================================
+// SPI2 Bus Arbiter
+// ============================================================================
+//
+// The e-paper display and the W25N512 NAND share SPI2_HOST. The SPI driver
+// only serializes single transactions, so a partial refresh and a storage
+// flush used to interleave freely. Clients now claim the bus for a whole
+// operation; when it is released it goes to the waiting client with the
+// highest priority class, oldest first within a class.
+//
+// A holder doing a long job splits it into slices of spi_bus_slice_bytes()
+// and calls spi_bus_yield() between them: once it has held the bus for its
+// device's budget and a higher class is waiting, the bus is handed over and
+// the holder queues up again.
+//
+// Arbitration is cooperative: the SPI driver does not enforce it. Each
+// device is claimed by one task at a time (the display by the LVGL task
+// under lvgl_mux, the NAND under the storage lock); a device's claims nest.
+
+// Priority classes, most urgent first
+typedef enum {
+  SPI_BUS_PRIO_INTERACTIVE = 0,  // Display refresh the user is waiting on
+  SPI_BUS_PRIO_STORAGE,          // Log writes and flushes
+  SPI_BUS_PRIO_BACKGROUND,       // Bulk reads: cursors, range and rollup queries
+  SPI_BUS_PRIO_COUNT,
+} spi_bus_prio_t;
+
+typedef enum {
+  SPI_BUS_DEV_EPD = 0,
+  SPI_BUS_DEV_NAND,
+  SPI_BUS_DEV_COUNT,
+} spi_bus_dev_t;
+
+// Per-device clock profile, applied when the device is added to the bus
+typedef struct {
+  const char *name;
+  int cs_pin;
+  uint32_t clock_hz;
+  uint32_t budget_us;  // Longest hold while a higher class waits (0: none)
+} spi_bus_profile_t;
+
+// Bus occupancy, cumulative since spi_bus_arbiter_init()
+typedef struct {
+  uint32_t acquisitions;  // Outermost claims granted
+  uint32_t contended;     // Of those, how many had to wait
+  uint32_t timeouts;      // Claims that gave up waiting
+  uint32_t yields;        // Times the bus was handed over mid-job
+  uint64_t busy_us;       // Time held
+  uint64_t wait_us;       // Time spent waiting for it
+  uint32_t max_hold_us;   // Longest single hold
+  uint32_t max_wait_us;   // Longest single wait
+} spi_bus_dev_stats_t;
+
+typedef struct {
+  int64_t since_us;  // esp_timer time the counters started
+  spi_bus_dev_stats_t dev[SPI_BUS_DEV_COUNT];
+} spi_bus_stats_t;
+
+// Create the arbiter state. Safe to call more than once. Until it has run,
+// every claim succeeds at once.
+esp_err_t spi_bus_arbiter_init(void);
+
+const spi_bus_profile_t *spi_bus_profile(spi_bus_dev_t dev);
+
+// Claim the bus for dev in class prio. Returns false on timeout. Nested
+// claims by the holder succeed at once and keep the outer class.
+bool spi_bus_acquire(spi_bus_dev_t dev, spi_bus_prio_t prio, TickType_t timeout_ticks);
+
+// Drop one claim; the outermost release hands the bus on
+void spi_bus_release(spi_bus_dev_t dev);
+
+// Between slices of a long job: if dev has used up its budget and a higher
+// class is waiting, hand the bus over and wait for it to come back. Only
+// acts on the outermost claim. Returns true if the bus was handed over.
+bool spi_bus_yield(spi_bus_dev_t dev);
+
+// Bytes dev moves within its budget at its clock, rounded down to whole
+// units of `granule` (at least one granule)
+size_t spi_bus_slice_bytes(spi_bus_dev_t dev, size_t granule);
+
+esp_err_t spi_bus_get_stats(spi_bus_stats_t *out);
+
+// Per device, permille of the time since init the bus was held
+uint32_t spi_bus_occupancy_permille(const spi_bus_stats_t *stats, spi_bus_dev_t dev);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <type_traits>
+
+// Sliding window over the last N timestamped samples of one signal, with
+// O(1) sum, mean, min and max (and, with Variance set, variance) however
+// often they are read. push() drops the oldest sample once N are held;
+// evict_before() drops samples older than a time, so a window of "the last
+// 5 s" is push() as samples arrive and evict_before(now - 5000) before
+// reading.
+//
+// Values and timestamps live in separate arrays (no per-sample padding).
+// The sum is kept running: integers exactly in int64, floats in double. Min
+// and max come from monotonic deques of slot numbers: each sample enters
+// and leaves each deque at most once, so push is amortised O(1). Variance
+// uses Welford's update, run backwards when a sample leaves.
+//
+// Every instance starts empty, and all-zero bytes are an empty window too,
+// so it can also sit in state that is memset; clear() empties it again.
+// Timestamps must not go backwards.
+template <typename T, size_t N, bool Variance = false>
+class TimeWindow {
+  static_assert(N > 0 && N <= 65535, "TimeWindow capacity out of range");
+
+ public:
+  using sum_type =
+      typename std::conditional<std::is_floating_point<T>::value, double, int64_t>::type;
+
+  static constexpr size_t capacity() { return N; }
+
+  void clear() {
+    head_ = 0;
+    count_ = 0;
+    sum_ = 0;
+    min_.clear();
+    max_.clear();
+    mean_ = 0.0;
+    m2_ = 0.0;
+  }
+
+  void push(int64_t ts_ms, T v) {
+    if (count_ == N) {
+      pop_oldest();
+    }
+    const size_t slot = (head_ + count_) % N;
+    values_[slot] = v;
+    ts_[slot] = ts_ms;
+    count_++;
+    sum_ += static_cast<sum_type>(v);
+    while (!min_.empty() && !(values_[min_.back()] < v)) {
+      min_.pop_back();
+    }
+    min_.push_back(static_cast<index_type>(slot));
+    while (!max_.empty() && !(v < values_[max_.back()])) {
+      max_.pop_back();
+    }
+    max_.push_back(static_cast<index_type>(slot));
+    if constexpr (Variance) {
+      const double x = static_cast<double>(v);
+      const double delta = x - mean_;
+      mean_ += delta / static_cast<double>(count_);
+      m2_ += delta * (x - mean_);
+    }
+  }
+
+  // Drop samples with a timestamp before ts_ms
+  void evict_before(int64_t ts_ms) {
+    while (count_ > 0 && ts_[head_] < ts_ms) {
+      pop_oldest();
+    }
+  }
+
+  size_t size() const { return count_; }
+  bool empty() const { return count_ == 0; }
+
+  // Sample i counted from the oldest held, and its timestamp
+  T at_oldest(size_t i) const { return values_[(head_ + i) % N]; }
+  int64_t time_oldest(size_t i) const { return ts_[(head_ + i) % N]; }
+
+  sum_type sum() const { return sum_; }
+
+  // Mean of the samples held; 0 when empty
+  double mean() const {
+    return count_ ? static_cast<double>(sum_) / static_cast<double>(count_) : 0.0;
+  }
+
+  // Smallest and largest sample held; T() when empty
+  T min() const { return min_.empty() ? T() : values_[min_.front()]; }
+  T max() const { return max_.empty() ? T() : values_[max_.front()]; }
+
+  // Population variance of the samples held; 0 with fewer than two
+  double variance() const {
+    static_assert(Variance, "TimeWindow variance needs Variance = true");
+    if (count_ < 2 || m2_ <= 0.0) {
+      return 0.0;
+    }
+    return m2_ / static_cast<double>(count_);
+  }
+
+ private:
+  using index_type = typename std::conditional<(N < 256), uint8_t, uint16_t>::type;
+
+  // Ring of slot numbers, oldest first
+  struct SlotDeque {
+    index_type slots[N];
+    index_type head = 0;
+    index_type count = 0;
+
+    void clear() {
+      head = 0;
+      count = 0;
+    }
+    bool empty() const { return count == 0; }
+    index_type front() const { return slots[head]; }
+    index_type back() const { return slots[(head + count - 1u) % N]; }
+    void push_back(index_type slot) {
+      slots[(head + count) % N] = slot;
+      count++;
+    }
+    void pop_back() { count--; }
+    void pop_front() {
+      head = static_cast<index_type>((head + 1u) % N);
+      count--;
+    }
+  };
+
+  void pop_oldest() {
+    const size_t slot = head_;
+    const T v = values_[slot];
+    head_ = (head_ + 1) % N;
+    count_--;
+    // Every slot in the deques is still held, so the oldest held sample is
+    // at a deque's front if it is there at all
+    if (!min_.empty() && min_.front() == slot) {
+      min_.pop_front();
+    }
+    if (!max_.empty() && max_.front() == slot) {
+      max_.pop_front();
+    }
+    if (count_ == 0) {
+      // Start each fill from exact zeroes so float rounding cannot build up
+      sum_ = 0;
+      mean_ = 0.0;
+      m2_ = 0.0;
+      return;
+    }
+    sum_ -= static_cast<sum_type>(v);
+    if constexpr (Variance) {
+      const double x = static_cast<double>(v);
+      const double delta = x - mean_;
+      mean_ -= delta / static_cast<double>(count_);
+      m2_ -= delta * (x - mean_);
+    }
+  }
+
+  T values_[N];
+  int64_t ts_[N];
+  // Slots are written before they are read, so only the state is set here
+  size_t head_ = 0;
+  size_t count_ = 0;
+  sum_type sum_ = 0;
+  SlotDeque min_;
+  SlotDeque max_;
+  double mean_ = 0.0;  // Welford state, Variance only
+  double m2_ = 0.0;
+};
+
+static_assert(std::is_trivially_copyable<TimeWindow<float, 1>>::value,
+              "TimeWindow must stay memset and memcpy safe");
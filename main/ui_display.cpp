@@ -1,5 +1,6 @@
 #include "ui_display.h"
 #include "lvgl.h"
+#include "time_window.h"
 
 extern "C" {
 extern const lv_font_t lv_font_montserrat_32;
@@ -248,43 +249,6 @@ static void format_1dp(char *out, size_t out_sz, float v) {
   lv_snprintf(out, out_sz, "%d.%d", i_part, d_part);
 }
 
-template <size_t N>
-struct RingBuffer {
-  float values[N] = {};
-  size_t count = 0;
-  size_t head = 0;
-
-  void push(float v) {
-    values[head] = v;
-    head = (head + 1) % N;
-    if (count < N) count += 1;
-  }
-
-  size_t size() const { return count; }
-
-  float at_oldest(size_t idx) const {
-    if (count == 0) return 0.0f;
-    const size_t start = (head + N - count) % N;
-    return values[(start + idx) % N];
-  }
-
-  void min_max(float &out_min, float &out_max) const {
-    if (count == 0) {
-      out_min = 0.0f;
-      out_max = 0.0f;
-      return;
-    }
-    float mn = at_oldest(0);
-    float mx = at_oldest(0);
-    for (size_t i = 1; i < count; i += 1) {
-      const float v = at_oldest(i);
-      if (v < mn) mn = v;
-      if (v > mx) mx = v;
-    }
-    out_min = mn;
-    out_max = mx;
-  }
-};
 } // namespace
 
 struct Display::DisplayState {
@@ -378,8 +342,9 @@ struct Display::DisplayState {
 
   Display::FocusTile focus_tile = Display::FocusTile::CO2;
 
-  RingBuffer<30> pm25_hist;
-  RingBuffer<30> co2_hist;
+  // Chart history: the last 30 values, timestamped with the LVGL tick
+  TimeWindow<float, 30> pm25_hist;
+  TimeWindow<float, 30> co2_hist;
 };
 
 Display::Display() : state(new DisplayState()) {}
@@ -556,9 +521,8 @@ static void update_chart(Display::DisplayState *S, bool pm25) {
   const auto &hist = pm25 ? S->pm25_hist : S->co2_hist;
   const float fallback = pm25 ? S->latest_pm25 : S->latest_co2;
 
-  float mn = 0.0f;
-  float mx = 0.0f;
-  hist.min_max(mn, mx);
+  float mn = hist.min();
+  float mx = hist.max();
   if (hist.size() == 0) {
     mn = fallback;
     mx = fallback;
@@ -1015,14 +979,14 @@ void Display::setFocusTile(FocusTile tile) {
 void Display::setPM25(int v) {
   state->latest_pm25 = static_cast<float>(v);
   state->latest_pm25_is_float = false;
-  state->pm25_hist.push(state->latest_pm25);
+  state->pm25_hist.push(lv_tick_get(), state->latest_pm25);
   update_pm_value(state);
   if (state->focus_tile == FocusTile::PM25) update_chart(state, true);
 }
 
 void Display::setCO2(int v) {
   state->latest_co2 = static_cast<float>(v);
-  state->co2_hist.push(state->latest_co2);
+  state->co2_hist.push(lv_tick_get(), state->latest_co2);
   update_co2_value(state);
   if (state->focus_tile == FocusTile::CO2) update_chart(state, false);
 }
@@ -1057,7 +1021,7 @@ void Display::setPressure(int v) {
 void Display::setPM25f(float v) {
   state->latest_pm25 = v;
   state->latest_pm25_is_float = true;
-  state->pm25_hist.push(v);
+  state->pm25_hist.push(lv_tick_get(), v);
   update_pm_value(state);
   if (state->focus_tile == FocusTile::PM25) update_chart(state, true);
 }
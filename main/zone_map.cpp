@@ -0,0 +1,131 @@
+/**
+ * @file zone_map.cpp
+ * @brief Per-segment field statistics for aggregate queries
+ *
+ * An aggregate keeps count, min, max and sum per field id in int64, wide
+ * enough for any field over any range. A packed entry narrows them back to
+ * the field's width (the sum to twice it) so one costs 180 bytes per 2 KB
+ * slot.
+ */
+
+#include "zone_map.h"
+
+#include "crc16.h"
+
+#include <string.h>
+
+// Width and signedness of each field id, LOG_FIELD_TYPE()
+static const uint8_t kFieldType[LOG_FIELD_COUNT] = {
+#define FIELD_TYPE(id, name, type) LOG_FIELD_TYPE(type),
+    LOG_FIELDS(FIELD_TYPE)
+#undef FIELD_TYPE
+};
+
+static void stat_add(sensor_field_stats_t *s, int64_t v) {
+  if (s->count == 0) {
+    s->min = v;
+    s->max = v;
+  } else if (v < s->min) {
+    s->min = v;
+  } else if (v > s->max) {
+    s->max = v;
+  }
+  s->count++;
+  s->sum += v;
+}
+
+static void stat_merge(sensor_field_stats_t *s, const sensor_field_stats_t *from) {
+  if (from->count == 0) {
+    return;
+  }
+  if (s->count == 0) {
+    *s = *from;
+    return;
+  }
+  if (from->min < s->min) {
+    s->min = from->min;
+  }
+  if (from->max > s->max) {
+    s->max = from->max;
+  }
+  s->count += from->count;
+  s->sum += from->sum;
+}
+
+// Little-endian integers of n bytes, like every other on-flash field
+static uint8_t *stat_put(uint8_t *p, int64_t v, size_t n) {
+  memcpy(p, &v, n);
+  return p + n;
+}
+
+static const uint8_t *stat_get(const uint8_t *p, size_t n, bool is_signed, int64_t *v) {
+  uint64_t u = 0;
+  memcpy(&u, p, n);
+  if (is_signed && n < sizeof(u)) {
+    unsigned shift = 64 - 8 * (unsigned)n;
+    *v = (int64_t)(u << shift) >> shift;
+  } else {
+    *v = (int64_t)u;
+  }
+  return p + n;
+}
+
+void zone_map_clear(sensor_aggregate_t *agg) { memset(agg, 0, sizeof(*agg)); }
+
+void zone_map_add(sensor_aggregate_t *agg, uint32_t fields, const sensor_record_t *rec) {
+  agg->records++;
+#define FIELD_ADD(id, name, type)                 \
+  if (fields & (1ul << (id))) {                   \
+    stat_add(&agg->fields[id], (int64_t)rec->name); \
+  }
+  LOG_FIELDS(FIELD_ADD)
+#undef FIELD_ADD
+}
+
+void zone_map_merge(sensor_aggregate_t *agg, const sensor_aggregate_t *from) {
+  agg->records += from->records;
+  for (size_t id = 0; id < LOG_FIELD_COUNT; id++) {
+    stat_merge(&agg->fields[id], &from->fields[id]);
+  }
+}
+
+void zone_map_pack(zone_map_t *zm, uint32_t segment, const sensor_aggregate_t *agg) {
+  memset(zm, 0, sizeof(*zm));
+  zm->segment = segment;
+  zm->record_count = (uint16_t)agg->records;
+  uint8_t *p = zm->stats;
+  for (size_t id = 0; id < LOG_FIELD_COUNT; id++) {
+    const sensor_field_stats_t *s = &agg->fields[id];
+    size_t width = kFieldType[id] & ~LOG_FIELD_SIGNED;
+    if (s->count > 0) {
+      zm->fields |= 1ul << id;
+    }
+    p = stat_put(p, s->min, width);
+    p = stat_put(p, s->max, width);
+    p = stat_put(p, s->sum, 2 * width);
+  }
+  zm->crc16 = crc16_ccitt((const uint8_t *)zm, sizeof(*zm) - sizeof(uint16_t));
+}
+
+bool zone_map_merge_entry(sensor_aggregate_t *agg, const zone_map_t *zm,
+                          uint32_t segment) {
+  if (zm->segment != segment ||
+      zm->crc16 != crc16_ccitt((const uint8_t *)zm, sizeof(*zm) - sizeof(uint16_t))) {
+    return false;
+  }
+  agg->records += zm->record_count;
+  const uint8_t *p = zm->stats;
+  for (size_t id = 0; id < LOG_FIELD_COUNT; id++) {
+    size_t width = kFieldType[id] & ~LOG_FIELD_SIGNED;
+    bool is_signed = (kFieldType[id] & LOG_FIELD_SIGNED) != 0;
+    sensor_field_stats_t s = {};
+    p = stat_get(p, width, is_signed, &s.min);
+    p = stat_get(p, width, is_signed, &s.max);
+    p = stat_get(p, 2 * width, is_signed, &s.sum);
+    if (zm->fields & (1ul << id)) {
+      s.count = zm->record_count;
+      stat_merge(&agg->fields[id], &s);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "log_format.h"
+#include "log_storage.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Zone maps: count, min, max and sum of every stored field of one sealed
+// segment, so aggregate queries answer the segments that lie wholly inside
+// their time range without decoding them. Log storage keeps one entry per
+// ring slot in sensors.zm, written when the segment is sealed. Internal to
+// log storage.
+
+// Stats bytes of one field: min and max at its width, sum at twice it
+// (room for the 65535 records a segment can hold)
+#define ZONE_MAP_FIELD_BYTES(id, name, type) +4 * sizeof(type)
+#define ZONE_MAP_STATS_BYTES (0 LOG_FIELDS(ZONE_MAP_FIELD_BYTES))
+
+// The stats cover every field id this firmware knows, in id order, stored
+// or not; fields names the ones that hold values. Entries written by
+// firmware that knew other fields have another size and fail their check.
+typedef struct __attribute__((packed)) {
+  uint32_t segment;       // Segment described; a reused slot names a newer one
+  uint32_t fields;        // Field ids with stats (the block's schema id)
+  uint16_t record_count;
+  uint8_t stats[ZONE_MAP_STATS_BYTES];
+  uint16_t crc16;         // CRC16 over all preceding bytes
+} zone_map_t;
+
+// Start an empty aggregate
+void zone_map_clear(sensor_aggregate_t *agg);
+
+// Fold one record into agg. fields is the schema id of the record's block;
+// fields it does not store are not counted.
+void zone_map_add(sensor_aggregate_t *agg, uint32_t fields, const sensor_record_t *rec);
+
+// Fold aggregate `from` into agg
+void zone_map_merge(sensor_aggregate_t *agg, const sensor_aggregate_t *from);
+
+// Pack the aggregate of one segment's records into an entry for it
+void zone_map_pack(zone_map_t *zm, uint32_t segment, const sensor_aggregate_t *agg);
+
+// Fold entry zm into agg. Returns false, leaving agg unchanged, if zm fails
+// its CRC or does not describe `segment`.
+bool zone_map_merge_entry(sensor_aggregate_t *agg, const zone_map_t *zm,
+                          uint32_t segment);
@@ -0,0 +1,6 @@
+#pragma once
+
+// Host stand-in for the I2C master driver: only the bus handle type, for
+// headers that pass it around
+
+typedef struct i2c_master_bus_t *i2c_master_bus_handle_t;
@@ -0,0 +1,11 @@
+#pragma once
+
+// Host stand-in for ESP-IDF's esp_assert.h
+
+#include <assert.h>
+
+#ifdef __cplusplus
+#define ESP_STATIC_ASSERT static_assert
+#else
+#define ESP_STATIC_ASSERT _Static_assert
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+
+// Host stand-in for FATFS on NAND: the "mounted" volume is the host
+// directory named by the mount point, and its size is the RAM NAND's.
+
+#include "spi_nand_flash.h"
+
+#include <stddef.h>
+
+typedef struct {
+  bool format_if_mount_failed;
+  int max_files;
+  size_t allocation_unit_size;
+  bool disk_status_check_enable;
+  bool use_one_fat;
+} esp_vfs_fat_mount_config_t;
+
+esp_err_t esp_vfs_fat_nand_mount(const char *base_path, spi_nand_flash_device_t *handle,
+                                 const esp_vfs_fat_mount_config_t *config);
+esp_err_t esp_vfs_fat_nand_unmount(const char *base_path, spi_nand_flash_device_t *handle);
+esp_err_t esp_vfs_fat_info(const char *base_path, uint64_t *out_total_bytes,
+                           uint64_t *out_free_bytes);
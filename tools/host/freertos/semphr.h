@@ -0,0 +1,52 @@
+#pragma once
+
+// Host stand-in for FreeRTOS semaphores on std::mutex/condition_variable.
+// Mutexes are counting semaphores of one, as FreeRTOS's are apart from
+// priority inheritance.
+
+#include "FreeRTOS.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+struct HostSemaphore {
+  std::mutex mutex;
+  std::condition_variable cv;
+  int count;
+};
+typedef HostSemaphore *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+  return new HostSemaphore{{}, {}, 1};
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+  return new HostSemaphore{{}, {}, 0};
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(sem->mutex);
+  auto ready = [sem] { return sem->count > 0; };
+  if (ticks == portMAX_DELAY) {
+    sem->cv.wait(lock, ready);
+  } else if (!sem->cv.wait_for(lock, std::chrono::milliseconds(ticks), ready)) {
+    return pdFALSE;
+  }
+  sem->count--;
+  return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  {
+    std::lock_guard<std::mutex> lock(sem->mutex);
+    if (sem->count > 0) {
+      return pdFALSE;
+    }
+    sem->count = 1;
+  }
+  sem->cv.notify_one();
+  return pdTRUE;
+}
+
+static inline void vSemaphoreDelete(SemaphoreHandle_t sem) { delete sem; }
@@ -0,0 +1,68 @@
+#pragma once
+
+// Host stand-in for FreeRTOS tasks: each task is a detached std::thread.
+// Notifications go to a single process-wide counter, which is enough while
+// only one task waits on them.
+
+#include "FreeRTOS.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+static inline BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack,
+                                     void *arg, UBaseType_t priority, TaskHandle_t *handle) {
+  (void)name;
+  (void)stack;
+  (void)priority;
+  std::thread(fn, arg).detach();
+  if (handle) {
+    *handle = (TaskHandle_t)1;
+  }
+  return pdPASS;
+}
+
+static inline void vTaskDelete(TaskHandle_t task) { (void)task; }
+
+static inline void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+struct HostNotify {
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t value = 0;
+};
+
+static inline HostNotify &host_notify(void) {
+  static HostNotify notify;
+  return notify;
+}
+
+static inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+  HostNotify &n = host_notify();
+  std::unique_lock<std::mutex> lock(n.mutex);
+  n.cv.wait_for(lock, std::chrono::milliseconds(ticks), [&n] { return n.value > 0; });
+  uint32_t value = n.value;
+  if (clear) {
+    n.value = 0;
+  } else if (n.value > 0) {
+    n.value--;
+  }
+  return value;
+}
+
+static inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  (void)task;
+  HostNotify &n = host_notify();
+  {
+    std::lock_guard<std::mutex> lock(n.mutex);
+    n.value++;
+  }
+  n.cv.notify_all();
+  return pdPASS;
+}
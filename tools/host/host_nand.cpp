@@ -0,0 +1,183 @@
+/**
+ * @file host_nand.cpp
+ * @brief RAM-backed NAND and FATFS mount stand-ins for host builds
+ *
+ * The NAND is a W25N512-sized sector array in RAM, or in a file image
+ * (host_nand_set_image) that keeps it from one run to the next. Unwritten
+ * and trimmed sectors read as 0xFF. FATFS is not emulated:
+ * the mount point is a host directory (put it on tmpfs to keep the whole
+ * log in RAM) that must exist before mounting, and the volume reports the
+ * NAND's capacity minus what the directory's files use.
+ */
+
+#include "host_nand.h"
+
+#include "esp_vfs_fat_nand.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static const uint32_t kSectorBytes = 2048;
+static const uint32_t kSectorCount = 32768;  // 64 MB
+static const uint32_t kSectorsPerBlock = 64;
+
+static const size_t kImageBytes = (size_t)kSectorBytes * kSectorCount;
+
+struct spi_nand_flash_device_t {
+  std::vector<uint8_t> ram;
+  uint8_t *sectors;  // ram, or the mapped image
+  bool mapped;
+};
+
+static const char *g_image_path = nullptr;
+
+void host_nand_set_image(const char *path) {
+  g_image_path = path;
+}
+
+// Map the image, creating it erased if it is missing or the wrong size
+static uint8_t *image_map(const char *path) {
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  bool fresh = fstat(fd, &st) != 0 || (size_t)st.st_size != kImageBytes;
+  if (fresh && ftruncate(fd, (off_t)kImageBytes) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  void *p = mmap(nullptr, kImageBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return nullptr;
+  }
+  if (fresh) {
+    memset(p, 0xFF, kImageBytes);
+  }
+  return (uint8_t *)p;
+}
+
+esp_err_t spi_nand_flash_init_device(spi_nand_flash_config_t *config,
+                                     spi_nand_flash_device_t **handle) {
+  (void)config;
+  spi_nand_flash_device_t *dev = new spi_nand_flash_device_t;
+  dev->mapped = (g_image_path != nullptr);
+  if (dev->mapped) {
+    dev->sectors = image_map(g_image_path);
+    if (!dev->sectors) {
+      delete dev;
+      return ESP_ERR_NOT_FOUND;
+    }
+  } else {
+    dev->ram.assign(kImageBytes, 0xFF);
+    dev->sectors = dev->ram.data();
+  }
+  *handle = dev;
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_deinit_device(spi_nand_flash_device_t *handle) {
+  if (handle->mapped) {
+    munmap(handle->sectors, kImageBytes);
+  }
+  delete handle;
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_get_capacity(spi_nand_flash_device_t *handle, uint32_t *sectors) {
+  (void)handle;
+  *sectors = kSectorCount;
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_get_sector_size(spi_nand_flash_device_t *handle, uint32_t *bytes) {
+  (void)handle;
+  *bytes = kSectorBytes;
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_get_block_size(spi_nand_flash_device_t *handle, uint32_t *bytes) {
+  (void)handle;
+  *bytes = kSectorBytes * kSectorsPerBlock;
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_get_block_num(spi_nand_flash_device_t *handle, uint32_t *blocks) {
+  (void)handle;
+  *blocks = kSectorCount / kSectorsPerBlock;
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_read_sector(spi_nand_flash_device_t *handle, uint8_t *buffer,
+                                     uint32_t sector) {
+  if (sector >= kSectorCount) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memcpy(buffer, &handle->sectors[(size_t)sector * kSectorBytes], kSectorBytes);
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_write_sector(spi_nand_flash_device_t *handle,
+                                      const uint8_t *buffer, uint32_t sector) {
+  if (sector >= kSectorCount) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memcpy(&handle->sectors[(size_t)sector * kSectorBytes], buffer, kSectorBytes);
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_trim(spi_nand_flash_device_t *handle, uint32_t sector) {
+  if (sector >= kSectorCount) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memset(&handle->sectors[(size_t)sector * kSectorBytes], 0xFF, kSectorBytes);
+  return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_nand_mount(const char *base_path, spi_nand_flash_device_t *handle,
+                                 const esp_vfs_fat_mount_config_t *config) {
+  (void)handle;
+  (void)config;
+  struct stat st;
+  if (stat(base_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_nand_unmount(const char *base_path, spi_nand_flash_device_t *handle) {
+  (void)base_path;
+  (void)handle;
+  return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_info(const char *base_path, uint64_t *out_total_bytes,
+                           uint64_t *out_free_bytes) {
+  uint64_t used = 0;
+  DIR *dir = opendir(base_path);
+  if (!dir) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != nullptr) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", base_path, ent->d_name);
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+      used += (uint64_t)st.st_size;
+    }
+  }
+  closedir(dir);
+
+  uint64_t total = (uint64_t)kSectorBytes * kSectorCount;
+  *out_total_bytes = total;
+  *out_free_bytes = (used < total) ? total - used : 0;
+  return ESP_OK;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// RAM NAND for host builds (host_nand.cpp)
+
+// Back the next spi_nand_flash_init_device() with a file image instead of
+// RAM, so the volume outlives the run. A missing or wrong-sized image is
+// created erased. nullptr goes back to RAM.
+void host_nand_set_image(const char *path);
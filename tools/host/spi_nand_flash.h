@@ -0,0 +1,33 @@
+#pragma once
+
+// Host stand-in for the spi_nand_flash component, backed by a RAM sector
+// array (host_nand.cpp)
+
+#include "driver/spi_master.h"
+#include "esp_err.h"
+
+typedef struct spi_nand_flash_device_t spi_nand_flash_device_t;
+
+typedef enum {
+  SPI_NAND_IO_MODE_SIO = 0,
+} spi_nand_flash_io_mode_t;
+
+typedef struct {
+  spi_device_handle_t device_handle;
+  uint8_t gc_factor;
+  spi_nand_flash_io_mode_t io_mode;
+  uint32_t flags;
+} spi_nand_flash_config_t;
+
+esp_err_t spi_nand_flash_init_device(spi_nand_flash_config_t *config,
+                                     spi_nand_flash_device_t **handle);
+esp_err_t spi_nand_flash_deinit_device(spi_nand_flash_device_t *handle);
+esp_err_t spi_nand_flash_get_capacity(spi_nand_flash_device_t *handle, uint32_t *sectors);
+esp_err_t spi_nand_flash_get_sector_size(spi_nand_flash_device_t *handle, uint32_t *bytes);
+esp_err_t spi_nand_flash_get_block_size(spi_nand_flash_device_t *handle, uint32_t *bytes);
+esp_err_t spi_nand_flash_get_block_num(spi_nand_flash_device_t *handle, uint32_t *blocks);
+esp_err_t spi_nand_flash_read_sector(spi_nand_flash_device_t *handle, uint8_t *buffer,
+                                     uint32_t sector);
+esp_err_t spi_nand_flash_write_sector(spi_nand_flash_device_t *handle,
+                                      const uint8_t *buffer, uint32_t sector);
+esp_err_t spi_nand_flash_trim(spi_nand_flash_device_t *handle, uint32_t sector);
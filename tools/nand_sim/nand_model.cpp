@@ -0,0 +1,282 @@
+/**
+ * @file nand_model.cpp
+ * @brief Simulated SPI NAND with bad blocks, wear and torn operations
+ *
+ * Everything, including the RNG and the power cut countdown, sits in one
+ * shared anonymous mapping: a child process may die at any program or
+ * erase and the parent (or the next child) sees the cells exactly as the
+ * cut left them.
+ */
+
+#include "nand_model.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// SPI command overheads in bytes: page data read (13h + 3 address) then
+// read from cache (03h + 2 column + dummy); program load (02h + 2 column)
+// then execute (10h + 3 address); block erase (D8h + 3 address)
+static const uint32_t kReadCmdBytes = 4 + 4;
+static const uint32_t kProgramCmdBytes = 3 + 4;
+static const uint32_t kEraseCmdBytes = 4;
+
+enum : uint8_t {
+  kPageProgrammed = 1 << 0,  // Programmed since the last erase
+  kPageUnstable = 1 << 1,    // Torn: reads fail ECC
+};
+
+enum : uint8_t {
+  kBlockWorn = 1 << 0,  // Grown bad: programs and erases keep failing
+};
+
+struct nand_model {
+  nand_geometry_t geo;
+  nand_counters_t counters;
+  uint32_t grown_bad_ppm;
+  uint32_t rng;
+  uint32_t cut_countdown;  // 0 = disarmed
+  size_t map_bytes;
+  size_t raw_page_bytes;   // page_bytes + spare_bytes
+  uint32_t *erase_counts;  // Per block
+  uint8_t *block_flags;
+  uint8_t *page_flags;
+  uint8_t *cells;          // Raw pages, data then spare
+};
+
+nand_geometry_t nand_geometry_w25n512(void) {
+  nand_geometry_t geo = {};
+  geo.page_bytes = 2048;
+  geo.spare_bytes = 64;
+  geo.pages_per_block = 64;
+  geo.blocks = 512;
+  geo.spi_clock_hz = 10 * 1000 * 1000;
+  geo.read_us = 60;
+  geo.program_us = 250;
+  geo.erase_us = 2000;
+  return geo;
+}
+
+static uint32_t rng_next(nand_model_t *m) {
+  // xorshift32; shared so the sequence carries on across boots
+  uint32_t x = m->rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  m->rng = x;
+  return x;
+}
+
+static uint8_t *raw_page(nand_model_t *m, uint32_t page) {
+  return &m->cells[(size_t)page * m->raw_page_bytes];
+}
+
+static void bus_account(nand_model_t *m, uint32_t array_us, uint32_t bytes) {
+  m->counters.bus_bytes += bytes;
+  m->counters.busy_us += array_us + ((uint64_t)bytes * 8 * 1000000) / m->geo.spi_clock_hz;
+}
+
+// Count down to the armed cut; true if this operation is the one torn
+static bool cut_due(nand_model_t *m) {
+  if (m->cut_countdown == 0) {
+    return false;
+  }
+  return --m->cut_countdown == 0;
+}
+
+static void power_cut(nand_model_t *m) {
+  m->counters.power_cuts++;
+  _exit(NAND_POWER_CUT_EXIT);
+}
+
+static bool op_fails(nand_model_t *m, uint32_t block) {
+  if (m->block_flags[block] & kBlockWorn) {
+    return true;
+  }
+  if (m->grown_bad_ppm && rng_next(m) % 1000000 < m->grown_bad_ppm) {
+    m->block_flags[block] |= kBlockWorn;
+    return true;
+  }
+  return false;
+}
+
+nand_model_t *nand_model_create(const nand_geometry_t *geo, uint32_t factory_bad,
+                                uint32_t grown_bad_ppm, uint32_t seed) {
+  uint32_t pages = geo->blocks * geo->pages_per_block;
+  size_t raw_page_bytes = (size_t)geo->page_bytes + geo->spare_bytes;
+  size_t bytes = sizeof(nand_model_t) + geo->blocks * (sizeof(uint32_t) + 1) + pages +
+                 (size_t)pages * raw_page_bytes;
+  void *map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    return nullptr;
+  }
+
+  nand_model_t *m = (nand_model_t *)map;
+  memset(m, 0, sizeof(*m));
+  m->geo = *geo;
+  m->grown_bad_ppm = grown_bad_ppm;
+  m->rng = seed ? seed : 1;
+  m->map_bytes = bytes;
+  m->raw_page_bytes = raw_page_bytes;
+  uint8_t *p = (uint8_t *)map + sizeof(nand_model_t);
+  m->erase_counts = (uint32_t *)p;
+  p += geo->blocks * sizeof(uint32_t);
+  m->block_flags = p;
+  p += geo->blocks;
+  m->page_flags = p;
+  p += pages;
+  m->cells = p;
+
+  memset(m->erase_counts, 0, geo->blocks * sizeof(uint32_t));
+  memset(m->block_flags, 0, geo->blocks);
+  memset(m->page_flags, 0, pages);
+  memset(m->cells, 0xFF, (size_t)pages * raw_page_bytes);
+
+  // Factory marks land anywhere but block 0, which vendors guarantee good
+  for (uint32_t i = 0; i < factory_bad && geo->blocks > 1; i++) {
+    uint32_t block = 1 + rng_next(m) % (geo->blocks - 1);
+    raw_page(m, block * geo->pages_per_block)[geo->page_bytes] = 0x00;
+  }
+  return m;
+}
+
+void nand_model_destroy(nand_model_t *m) {
+  if (m) {
+    munmap(m, m->map_bytes);
+  }
+}
+
+const nand_geometry_t *nand_model_geometry(const nand_model_t *m) {
+  return &m->geo;
+}
+
+nand_status_t nand_read_page(nand_model_t *m, uint32_t page, void *data, void *spare) {
+  if (page >= m->geo.blocks * m->geo.pages_per_block) {
+    return NAND_INVALID;
+  }
+  const uint8_t *raw = raw_page(m, page);
+  uint32_t bytes = kReadCmdBytes;
+  if (data) {
+    memcpy(data, raw, m->geo.page_bytes);
+    bytes += m->geo.page_bytes;
+  }
+  if (spare) {
+    memcpy(spare, raw + m->geo.page_bytes, m->geo.spare_bytes);
+    bytes += m->geo.spare_bytes;
+  }
+  m->counters.page_reads++;
+  bus_account(m, m->geo.read_us, bytes);
+  return (m->page_flags[page] & kPageUnstable) ? NAND_ECC_FAIL : NAND_OK;
+}
+
+nand_status_t nand_program_page(nand_model_t *m, uint32_t page, const void *data,
+                                const void *spare) {
+  if (page >= m->geo.blocks * m->geo.pages_per_block) {
+    return NAND_INVALID;
+  }
+  if (m->page_flags[page] & kPageProgrammed) {
+    return NAND_NOT_ERASED;
+  }
+  uint8_t *raw = raw_page(m, page);
+  const uint8_t *src_data = (const uint8_t *)data;
+  const uint8_t *src_spare = (const uint8_t *)spare;
+  m->counters.page_programs++;
+  bus_account(m, m->geo.program_us, kProgramCmdBytes + m->raw_page_bytes);
+
+  if (cut_due(m)) {
+    // Some cells reached their level, the rest are still erased. A quarter
+    // of the time the on-die ECC misses it and the page reads back "clean".
+    for (size_t i = 0; i < m->raw_page_bytes; i++) {
+      uint8_t want = (i < m->geo.page_bytes) ? src_data[i] : src_spare[i - m->geo.page_bytes];
+      if (rng_next(m) & 1) {
+        raw[i] &= want;
+      }
+    }
+    m->page_flags[page] = kPageProgrammed | ((rng_next(m) % 4) ? kPageUnstable : 0);
+    power_cut(m);
+  }
+
+  if (op_fails(m, page / m->geo.pages_per_block)) {
+    // A failed program still disturbs the page
+    m->page_flags[page] = kPageProgrammed | kPageUnstable;
+    m->counters.program_fails++;
+    return NAND_PROGRAM_FAIL;
+  }
+  for (size_t i = 0; i < m->geo.page_bytes; i++) {
+    raw[i] &= src_data[i];
+  }
+  for (size_t i = 0; i < m->geo.spare_bytes; i++) {
+    raw[m->geo.page_bytes + i] &= src_spare[i];
+  }
+  m->page_flags[page] = kPageProgrammed;
+  return NAND_OK;
+}
+
+nand_status_t nand_erase_block(nand_model_t *m, uint32_t block) {
+  if (block >= m->geo.blocks) {
+    return NAND_INVALID;
+  }
+  uint32_t first = block * m->geo.pages_per_block;
+  m->counters.block_erases++;
+  m->erase_counts[block]++;
+  bus_account(m, m->geo.erase_us, kEraseCmdBytes);
+
+  if (cut_due(m)) {
+    // Erase does not finish: leading pages made it, the rest are unreadable
+    uint32_t done = rng_next(m) % m->geo.pages_per_block;
+    for (uint32_t p = 0; p < m->geo.pages_per_block; p++) {
+      if (p < done) {
+        memset(raw_page(m, first + p), 0xFF, m->raw_page_bytes);
+        m->page_flags[first + p] = 0;
+      } else {
+        m->page_flags[first + p] |= kPageProgrammed | kPageUnstable;
+      }
+    }
+    power_cut(m);
+  }
+
+  if (op_fails(m, block)) {
+    m->counters.erase_fails++;
+    return NAND_ERASE_FAIL;
+  }
+  memset(raw_page(m, first), 0xFF, (size_t)m->geo.pages_per_block * m->raw_page_bytes);
+  memset(&m->page_flags[first], 0, m->geo.pages_per_block);
+  return NAND_OK;
+}
+
+bool nand_block_is_bad(nand_model_t *m, uint32_t block) {
+  uint8_t mark = 0xFF;
+  if (block >= m->geo.blocks) {
+    return true;
+  }
+  mark = raw_page(m, block * m->geo.pages_per_block)[m->geo.page_bytes];
+  m->counters.page_reads++;
+  bus_account(m, m->geo.read_us, kReadCmdBytes + 1);
+  return mark != 0xFF;
+}
+
+void nand_block_mark_bad(nand_model_t *m, uint32_t block) {
+  if (block >= m->geo.blocks) {
+    return;
+  }
+  // Written even over a programmed page, as vendors recommend
+  raw_page(m, block * m->geo.pages_per_block)[m->geo.page_bytes] = 0x00;
+  m->counters.page_programs++;
+  bus_account(m, m->geo.program_us, kProgramCmdBytes + 1);
+}
+
+void nand_power_cut_arm(nand_model_t *m, uint32_t ops) {
+  m->cut_countdown = ops;
+}
+
+void nand_power_cut_disarm(nand_model_t *m) {
+  m->cut_countdown = 0;
+}
+
+nand_counters_t nand_model_counters(const nand_model_t *m) {
+  return m->counters;
+}
+
+uint32_t nand_block_erase_count(const nand_model_t *m, uint32_t block) {
+  return (block < m->geo.blocks) ? m->erase_counts[block] : 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+// Simulated SPI NAND part for host tests: pages with a spare area, erase
+// blocks, factory and grown bad blocks, per-block wear, and power loss in
+// the middle of a program or erase. State lives in a MAP_SHARED mapping so
+// it outlives a fork()ed "boot" that dies at the power cut.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Exit status of a process killed by an armed power cut
+#define NAND_POWER_CUT_EXIT 86
+
+typedef struct {
+  uint32_t page_bytes;       // Data area per page
+  uint32_t spare_bytes;      // Spare (OOB) area per page; byte 0 of page 0 is the bad block mark
+  uint32_t pages_per_block;
+  uint32_t blocks;
+  uint32_t spi_clock_hz;     // Single-bit SPI
+  uint32_t read_us;          // Array to cache register (tRD, ECC on)
+  uint32_t program_us;       // Cache register to array (tPP)
+  uint32_t erase_us;         // Block erase (tBE)
+} nand_geometry_t;
+
+// W25N512GV: 2048 + 64 byte pages, 64 pages per block, 512 blocks, typical
+// datasheet timings, on the 10 MHz bus the firmware uses
+nand_geometry_t nand_geometry_w25n512(void);
+
+typedef enum {
+  NAND_OK = 0,
+  NAND_ECC_FAIL,      // Uncorrectable page (torn program or erase); data is garbage
+  NAND_PROGRAM_FAIL,  // Status P-FAIL: retire the block
+  NAND_ERASE_FAIL,    // Status E-FAIL: retire the block
+  NAND_NOT_ERASED,    // Program over a page not erased since its last program
+  NAND_INVALID,       // Page or block out of range
+} nand_status_t;
+
+typedef struct {
+  uint64_t page_reads;
+  uint64_t page_programs;
+  uint64_t block_erases;
+  uint64_t bus_bytes;    // Bytes clocked over SPI, commands included
+  uint64_t busy_us;      // Modelled time: array operations plus transfers
+  uint32_t program_fails;
+  uint32_t erase_fails;
+  uint32_t power_cuts;
+} nand_counters_t;
+
+typedef struct nand_model nand_model_t;
+
+// Create an erased part. factory_bad blocks carry a bad block mark from the
+// start; every program and erase then fails with probability
+// grown_bad_ppm / 1e6, after which that block keeps failing (worn out).
+nand_model_t *nand_model_create(const nand_geometry_t *geo, uint32_t factory_bad,
+                                uint32_t grown_bad_ppm, uint32_t seed);
+void nand_model_destroy(nand_model_t *m);
+
+const nand_geometry_t *nand_model_geometry(const nand_model_t *m);
+
+// Read a page into data and/or spare (either may be null; only what is asked
+// for is transferred). NAND_ECC_FAIL still fills the buffers.
+nand_status_t nand_read_page(nand_model_t *m, uint32_t page, void *data, void *spare);
+
+// Program a full page. Bits only go from 1 to 0, so the page must be erased.
+nand_status_t nand_program_page(nand_model_t *m, uint32_t page, const void *data,
+                                const void *spare);
+
+nand_status_t nand_erase_block(nand_model_t *m, uint32_t block);
+
+// Bad block mark: byte 0 of page 0's spare area is not 0xFF
+bool nand_block_is_bad(nand_model_t *m, uint32_t block);
+void nand_block_mark_bad(nand_model_t *m, uint32_t block);
+
+// Cut power on the ops-th program or erase from now (1 = the next one): that
+// operation is left torn and the process exits with NAND_POWER_CUT_EXIT.
+// A torn program leaves a mix of old (erased) and new bits that may or may
+// not trip the ECC; a torn erase leaves the first pages erased and the rest
+// unreadable.
+void nand_power_cut_arm(nand_model_t *m, uint32_t ops);
+void nand_power_cut_disarm(nand_model_t *m);
+
+nand_counters_t nand_model_counters(const nand_model_t *m);
+uint32_t nand_block_erase_count(const nand_model_t *m, uint32_t block);
@@ -0,0 +1,482 @@
+/**
+ * @file nand_powercut.cpp
+ * @brief Power-cut fault injection for log storage on the simulated NAND
+ *
+ * Each boot is a fork()ed child running the real log_storage code over
+ * sim_fs: it mounts (timing recovery in modelled NAND time, up to the log
+ * being loaded and then for the first write, which runs the index and rollup
+ * catch-up a fast mount defers unless the writer got to it first), walks the log
+ * with a cursor to check what survived, then writes numbered records,
+ * calling log_storage_flush() every --flush-every records, until the armed
+ * power cut tears a program or erase and kills it. The NAND image and the
+ * harness's expectations live in shared memory, so the next boot picks up
+ * exactly what the cut left.
+ *
+ * Per boot it checks the harness records (marked in `reserved`, numbered in
+ * `pressure_pa`, every other field derived from the number):
+ *   - nothing acknowledged by a successful log_storage_flush() is missing
+ *     (durability violation),
+ *   - recovered records are consecutive and intact (gap, corrupt),
+ *   - nothing newer than the last accepted write shows up (phantom),
+ * and counts the accepted-but-unflushed records a cut lost. Exits non-zero
+ * on any violation or if a boot crashes or hangs.
+ */
+
+#include "log_storage.h"
+
+#include "crc16.h"
+#include "esp_timer.h"
+#include "nand_model.h"
+#include "sim_fs.h"
+#include "sim_port.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static const uint16_t kHarnessMarker = 0x5EED;
+// make_record() fills these beyond the core fields; CMakeLists.txt pins the
+// schema so they are stored
+static_assert((LOG_STORAGE_FIELDS & LOG_FIELDS_PARTICLES) == LOG_FIELDS_PARTICLES &&
+                  (LOG_STORAGE_FIELDS & LOG_FIELDS_MOTION) == LOG_FIELDS_MOTION,
+              "the harness records need the particle and motion fields");
+static const uint32_t kBaseTimestampMs = 1000000;
+static const uint32_t kBootTimeoutS = 60;
+static const uint32_t kCleanBootRecords = 200000;  // Cap for a boot the cut missed
+
+// Shared between the harness and its boots
+typedef struct {
+  // Carried from boot to boot
+  uint32_t acked_upto;    // Newest record sensor_record_write() accepted
+  uint32_t durable_upto;  // Newest record a successful log_storage_flush() covered
+
+  // Reported by the last boot
+  bool verified;          // Recovery finished and the log was checked
+  uint32_t newest;        // Newest harness record recovered (0: none)
+  uint32_t recovered;
+  uint32_t gaps;
+  uint32_t corrupt;
+  uint32_t written;
+  uint32_t write_failures;
+  uint64_t recovery_host_us;
+  uint64_t recovery_nand_us;
+  uint64_t recovery_page_reads;
+  uint64_t first_write_nand_us;
+  nand_counters_t append_start;  // NAND counters once writing began
+  sim_fs_stats_t fs_start;       // sim_fs stats then
+  sim_fs_stats_t fs;             // and since, up to the last record written
+} boot_state_t;
+
+typedef struct {
+  uint32_t flush_every;
+  uint32_t boots, cuts, clean, cut_in_recovery;
+  uint64_t written, lost, write_failures;
+  uint32_t lost_max;
+  uint32_t durability_violations, gaps, corrupt, phantom;
+  std::vector<uint64_t> recovery_nand_us;
+  std::vector<uint64_t> recovery_host_us;
+  std::vector<uint64_t> recovery_reads;
+  std::vector<uint64_t> first_write_nand_us;
+  std::vector<uint64_t> scan_nand_us;
+  uint64_t append_programs, append_erases, append_busy_us;
+  uint64_t fat_reads, fat_writes;
+} run_stats_t;
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--cycles N] [--flush-every F[,F...]] [--max-ops N] [--blocks N]\n"
+          "          [--bad-blocks N] [--grown-bad-ppm N] [--seed N] [--verbose]\n"
+          "  Boots log storage --cycles times per flush interval (0 = only when a\n"
+          "  segment seals), cutting power on a random program or erase within the\n"
+          "  first --max-ops of each boot.\n",
+          argv0);
+}
+
+static sensor_record_t make_record(uint32_t seq) {
+  sensor_record_t rec = {};
+  rec.timestamp_ms = kBaseTimestampMs + seq * 1000;
+  rec.co2_ppm = (uint16_t)(400 + seq % 1600);
+  rec.temp_c_x100 = (int16_t)(1500 + seq % 1500);
+  rec.rh_x100 = (int16_t)(3000 + seq % 5000);
+  rec.pm25_x10 = (uint16_t)(seq % 997);
+  rec.pm10_x10 = (uint16_t)(seq % 1009);
+  rec.pm1_x10 = (uint16_t)(seq % 211);
+  rec.voc_index = (uint16_t)(1 + seq % 500);
+  rec.nox_index = (uint16_t)(1 + seq % 7);
+  rec.pressure_pa = seq;
+  rec.crc16 = crc16_ccitt((const uint8_t *)&rec, SENSOR_RECORD_CRC_BYTES);
+  // Format 2 fields of the pinned schema (LOG_STORAGE_FIELDS); the marker
+  // tells harness records from sensor_record_test() ones
+  rec.pm4_x10 = (uint16_t)(seq % 1013);
+  rec.pn05_cm3 = (uint16_t)(seq % 3001);
+  rec.pn25_cm3 = kHarnessMarker;
+  rec.accel_x_mg = (int16_t)(seq % 2000 - 1000);
+  rec.accel_z_mg = 1000;
+  return rec;
+}
+
+// Walk the whole log and check the harness records in it, and that an
+// aggregate over all of it (zone maps plus whatever they do not cover)
+// agrees with the walk
+static bool log_verify(boot_state_t *st) {
+  sensor_record_cursor_t *cursor = nullptr;
+  if (sensor_record_cursor_open(0, &cursor) != ESP_OK) {
+    return false;
+  }
+  sensor_record_t batch[64];
+  uint32_t prev = 0;
+  uint32_t walked = 0;
+  int64_t co2_sum = 0;
+  int32_t n;
+  while ((n = sensor_record_cursor_next(cursor, batch, 64)) > 0) {
+    for (int32_t i = 0; i < n; i++) {
+      walked++;
+      co2_sum += batch[i].co2_ppm;
+      if (batch[i].pn25_cm3 != kHarnessMarker) {
+        continue;  // sensor_record_test() writes a few per boot (no fast mount)
+      }
+      uint32_t seq = batch[i].pressure_pa;
+      sensor_record_t want = make_record(seq);
+      if (memcmp(&want, &batch[i], sizeof(want)) != 0) {
+        st->corrupt++;
+        continue;
+      }
+      if (prev && seq != prev + 1) {
+        st->gaps++;
+      }
+      prev = seq;
+      st->recovered++;
+    }
+  }
+  sensor_record_cursor_close(cursor);
+  st->newest = prev;
+  if (n != 0) {
+    return false;
+  }
+
+  sensor_aggregate_t agg;
+  if (sensor_record_aggregate(0, UINT32_MAX, &agg) != ESP_OK || agg.records != walked ||
+      agg.fields[LOG_FIELD_co2_ppm].sum != co2_sum) {
+    fprintf(stderr, "aggregate: %u records, co2 sum %lld; walk: %u, %lld\n",
+            agg.records, (long long)agg.fields[LOG_FIELD_co2_ppm].sum, walked,
+            (long long)co2_sum);
+    return false;
+  }
+  return true;
+}
+
+// One boot, in the child. Returns the exit status (the armed cut exits
+// with NAND_POWER_CUT_EXIT from inside the NAND model instead).
+static int boot(nand_model_t *nand, boot_state_t *st, uint32_t cut_after,
+                uint32_t flush_every, uint32_t max_records, bool verbose) {
+  if (!verbose && !freopen("/dev/null", "w", stdout)) {
+    return 3;
+  }
+  // The cut leaves through _exit(), which drops buffered output
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  alarm(kBootTimeoutS);
+
+  st->verified = false;
+  st->newest = st->recovered = st->gaps = st->corrupt = 0;
+  st->written = st->write_failures = 0;
+  st->first_write_nand_us = 0;
+
+  sim_port_attach(nand);
+  nand_counters_t before = nand_model_counters(nand);
+  int64_t start = esp_timer_get_time();
+  if (cut_after) {
+    nand_power_cut_arm(nand, cut_after);
+  } else {
+    nand_power_cut_disarm(nand);
+  }
+  if (log_storage_init() != ESP_OK) {
+    return 4;
+  }
+  // The count turns valid inside sensor_record_init(), which holds the
+  // storage lock until the log is loaded; the read waits for that
+  while (sensor_record_count() < 0) {
+    if (esp_timer_get_time() - start > 10 * 1000 * 1000) {
+      return 5;
+    }
+    usleep(200);
+  }
+  sensor_record_t probe;
+  sensor_record_read_recent(1, &probe);
+  nand_counters_t after = nand_model_counters(nand);
+  st->recovery_host_us = (uint64_t)(esp_timer_get_time() - start);
+  st->recovery_nand_us = after.busy_us - before.busy_us;
+  st->recovery_page_reads = after.page_reads - before.page_reads;
+  st->fs = sim_fs_get_stats();
+
+  if (!log_verify(st)) {
+    return 6;
+  }
+  st->verified = true;
+  st->append_start = nand_model_counters(nand);
+  st->fs_start = st->fs;
+
+  // Carry on from what survived
+  st->acked_upto = st->newest;
+  st->durable_upto = st->newest;
+  uint32_t seq = st->newest + 1;
+  for (uint32_t i = 0; i < max_records; i++, seq++) {
+    sensor_record_t rec = make_record(seq);
+    uint64_t busy_us = nand_model_counters(nand).busy_us;
+    if (sensor_record_write(&rec) != ESP_OK) {
+      st->write_failures++;
+      break;
+    }
+    if (i == 0) {
+      st->first_write_nand_us = nand_model_counters(nand).busy_us - busy_us;
+    }
+    st->acked_upto = seq;
+    st->written++;
+    st->fs = sim_fs_get_stats();
+    if (flush_every && (i + 1) % flush_every == 0 && log_storage_flush() == ESP_OK) {
+      st->durable_upto = seq;
+    }
+  }
+  if (log_storage_flush() == ESP_OK) {
+    st->durable_upto = st->acked_upto;
+  }
+  return 0;
+}
+
+static uint64_t percentile(std::vector<uint64_t> v, uint32_t percent) {
+  if (v.empty()) {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  size_t i = (v.size() * percent + 99) / 100;
+  return v[i ? i - 1 : 0];
+}
+
+static void account_boot(run_stats_t *run, nand_model_t *nand, const boot_state_t *st,
+                         uint32_t acked, uint32_t durable) {
+  if (!st->verified) {
+    run->cut_in_recovery++;
+    return;
+  }
+  // The child may have died mid-write; the counters are in the shared image
+  nand_counters_t end = nand_model_counters(nand);
+  run->append_programs += end.page_programs - st->append_start.page_programs;
+  run->append_erases += end.block_erases - st->append_start.block_erases;
+  run->append_busy_us += end.busy_us - st->append_start.busy_us;
+  run->fat_reads += st->fs.fat_sector_reads - st->fs_start.fat_sector_reads;
+  run->fat_writes += st->fs.fat_sector_writes - st->fs_start.fat_sector_writes;
+  run->scan_nand_us.push_back(st->fs.mount_nand_us);
+  run->recovery_nand_us.push_back(st->recovery_nand_us);
+  run->recovery_host_us.push_back(st->recovery_host_us);
+  run->recovery_reads.push_back(st->recovery_page_reads);
+  if (st->written > 0) {
+    run->first_write_nand_us.push_back(st->first_write_nand_us);
+  }
+  run->gaps += st->gaps;
+  run->corrupt += st->corrupt;
+  if (st->newest < durable) {
+    run->durability_violations++;
+    fprintf(stderr, "  boot %u: records up to %u were flushed, newest recovered is %u\n",
+            run->boots, durable, st->newest);
+  }
+  if (st->newest > acked) {
+    run->phantom++;
+  } else {
+    uint32_t lost = acked - st->newest;
+    run->lost += lost;
+    run->lost_max = std::max(run->lost_max, lost);
+  }
+}
+
+static void run_print(const run_stats_t *run, nand_model_t *nand, const boot_state_t *st) {
+  nand_counters_t c = nand_model_counters(nand);
+  const nand_geometry_t *geo = nand_model_geometry(nand);
+  uint32_t wear_max = 0;
+  uint64_t wear_sum = 0;
+  for (uint32_t b = 0; b < geo->blocks; b++) {
+    uint32_t n = nand_block_erase_count(nand, b);
+    wear_max = std::max(wear_max, n);
+    wear_sum += n;
+  }
+  uint32_t cuts = run->cuts ? run->cuts : 1;
+  uint64_t written = run->written ? run->written : 1;
+
+  if (run->flush_every) {
+    printf("flush every %u records:", run->flush_every);
+  } else {
+    printf("flush on segment seal only:");
+  }
+  printf(" %u boots, %u cut (%u during recovery), %u clean\n", run->boots, run->cuts,
+         run->cut_in_recovery, run->clean);
+  printf("  recovery  NAND p50 %.1f p99 %.1f max %.1f ms (FTL scan p50 %.1f ms), "
+         "page reads p50 %llu max %llu, host p50 %.1f ms\n",
+         percentile(run->recovery_nand_us, 50) / 1000.0,
+         percentile(run->recovery_nand_us, 99) / 1000.0,
+         percentile(run->recovery_nand_us, 100) / 1000.0,
+         percentile(run->scan_nand_us, 50) / 1000.0,
+         (unsigned long long)percentile(run->recovery_reads, 50),
+         (unsigned long long)percentile(run->recovery_reads, 100),
+         percentile(run->recovery_host_us, 50) / 1000.0);
+  printf("  1st write NAND p50 %.1f p99 %.1f max %.1f ms\n",
+         percentile(run->first_write_nand_us, 50) / 1000.0,
+         percentile(run->first_write_nand_us, 99) / 1000.0,
+         percentile(run->first_write_nand_us, 100) / 1000.0);
+  printf("  records   %llu written, lost per cut mean %.1f max %u, %llu write failures\n",
+         (unsigned long long)run->written, (double)run->lost / cuts, run->lost_max,
+         (unsigned long long)run->write_failures);
+  printf("  checks    durability %u, gaps %u, corrupt %u, phantom %u; %u in the log at end\n",
+         run->durability_violations, run->gaps, run->corrupt, run->phantom, st->recovered);
+  printf("  flash     %.3f programs and %.1f us NAND busy per record (recovery included), "
+         "%llu erases (per block max %u mean %.1f), %u torn pages left, %u bad blocks\n",
+         (double)c.page_programs / written, (double)c.busy_us / written,
+         (unsigned long long)c.block_erases, wear_max, (double)wear_sum / geo->blocks,
+         st->fs.torn_pages, st->fs.bad_blocks);
+  // Writing only, from the end of recovery to the cut: the NAND-bound
+  // ceiling on the append rate
+  double append_us = (double)run->append_busy_us / written;
+  printf("  append    %.3f programs, %.4f erases and %.1f us NAND busy per record "
+         "(%.0f records/s max), FAT sectors %.2f read %.2f written per record\n",
+         (double)run->append_programs / written, (double)run->append_erases / written,
+         append_us, append_us > 0 ? 1e6 / append_us : 0.0, (double)run->fat_reads / written,
+         (double)run->fat_writes / written);
+}
+
+// xorshift32 for cut points, separate from the model's
+static uint32_t g_rng = 1;
+static uint32_t rng_next(void) {
+  g_rng ^= g_rng << 13;
+  g_rng ^= g_rng >> 17;
+  g_rng ^= g_rng << 5;
+  return g_rng;
+}
+
+static bool run(uint32_t flush_every, uint32_t cycles, uint32_t max_ops,
+                const nand_geometry_t *geo, uint32_t bad_blocks, uint32_t grown_bad_ppm,
+                uint32_t seed, bool verbose) {
+  nand_model_t *nand = nand_model_create(geo, bad_blocks, grown_bad_ppm, seed);
+  boot_state_t *st = (boot_state_t *)mmap(nullptr, sizeof(boot_state_t),
+                                          PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (!nand || st == MAP_FAILED) {
+    fprintf(stderr, "Out of memory for the simulated NAND\n");
+    return false;
+  }
+  memset(st, 0, sizeof(*st));
+  g_rng = seed ? seed : 1;
+
+  run_stats_t stats = {};
+  stats.flush_every = flush_every;
+  bool ok = true;
+  // The first and last boots have no cut and write nothing: the first
+  // formats the part, as at the factory, and the last only checks the log
+  for (uint32_t cycle = 0; cycle <= cycles + 1 && ok; cycle++) {
+    bool quiet = (cycle == 0 || cycle == cycles + 1);
+    uint32_t cut_after = quiet ? 0 : 1 + rng_next() % max_ops;
+    uint32_t acked = st->acked_upto;
+    uint32_t durable = st->durable_upto;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      _exit(boot(nand, st, cut_after, flush_every, quiet ? 0 : kCleanBootRecords, verbose));
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+      fprintf(stderr, "fork failed\n");
+      ok = false;
+      break;
+    }
+    stats.boots++;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == NAND_POWER_CUT_EXIT) {
+      stats.cuts++;
+    } else if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+      stats.clean++;
+    } else {
+      fprintf(stderr, "boot %u failed: %s %d\n", stats.boots,
+              WIFSIGNALED(status) ? "signal" : "exit",
+              WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+      ok = false;
+    }
+    account_boot(&stats, nand, st, acked, durable);
+    stats.written += st->written;
+    stats.write_failures += st->write_failures;
+  }
+
+  run_print(&stats, nand, st);
+  ok = ok && stats.durability_violations == 0 && stats.gaps == 0 && stats.corrupt == 0 &&
+       stats.phantom == 0;
+  munmap(st, sizeof(*st));
+  nand_model_destroy(nand);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  uint32_t cycles = 1000;
+  uint32_t max_ops = 48;
+  uint32_t bad_blocks = 4;
+  uint32_t grown_bad_ppm = 0;
+  uint32_t seed = 1;
+  bool verbose = false;
+  std::vector<uint32_t> flush_intervals = {1, 8, 64};
+  nand_geometry_t geo = nand_geometry_w25n512();
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (strcmp(arg, "--verbose") == 0) {
+      verbose = true;
+      continue;
+    }
+    if (!val) {
+      usage(argv[0]);
+      return 2;
+    }
+    i++;
+    if (strcmp(arg, "--cycles") == 0) {
+      cycles = (uint32_t)strtoul(val, nullptr, 0);
+    } else if (strcmp(arg, "--max-ops") == 0) {
+      max_ops = (uint32_t)strtoul(val, nullptr, 0);
+    } else if (strcmp(arg, "--blocks") == 0) {
+      geo.blocks = (uint32_t)strtoul(val, nullptr, 0);
+    } else if (strcmp(arg, "--bad-blocks") == 0) {
+      bad_blocks = (uint32_t)strtoul(val, nullptr, 0);
+    } else if (strcmp(arg, "--grown-bad-ppm") == 0) {
+      grown_bad_ppm = (uint32_t)strtoul(val, nullptr, 0);
+    } else if (strcmp(arg, "--seed") == 0) {
+      seed = (uint32_t)strtoul(val, nullptr, 0);
+    } else if (strcmp(arg, "--flush-every") == 0) {
+      flush_intervals.clear();
+      const char *p = val;
+      while (*p) {
+        char *end;
+        uint32_t every = (uint32_t)strtoul(p, &end, 0);
+        if (end == p) {
+          break;
+        }
+        flush_intervals.push_back(every);
+        p = (*end == ',') ? end + 1 : end;
+      }
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (max_ops == 0 || geo.blocks < 8 || flush_intervals.empty()) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  printf("NAND %u blocks x %u pages x %u B, %u factory bad, grown bad %u ppm, "
+         "cut within %u ops, seed %u\n",
+         geo.blocks, geo.pages_per_block, geo.page_bytes, bad_blocks, grown_bad_ppm,
+         max_ops, seed);
+  bool ok = true;
+  for (uint32_t flush_every : flush_intervals) {
+    ok = run(flush_every, cycles, max_ops, &geo, bad_blocks, grown_bad_ppm, seed, verbose) && ok;
+  }
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,1033 @@
+/**
+ * @file sim_fs.cpp
+ * @brief Log-structured file layer over the simulated NAND
+ *
+ * Pages are written in order into one active block at a time and never
+ * rewritten in place. The spare area of each page carries a tag:
+ *
+ *   data page:  file id (FNV-1a of the path), sector, version, file size
+ *               after the write, CRC32 of the data
+ *   file page:  sector kFileSector, CREATE or REMOVE; every data page of
+ *               the file older than it is dead
+ *
+ * Versions increase across the volume; for each (file, sector) the newest
+ * version is live. Garbage collection copies live pages (keeping their
+ * version) out of the block with the fewest and erases it.
+ *
+ * Torn pages: a program cut short almost always leaves a tag that no longer
+ * parses, and is then dropped wherever it sits. Only a cut that spared the
+ * whole tag can leave a page that looks intact, and that page is the last
+ * written one of its block. Mount checks the data CRC of exactly those
+ * pages and reads only spare areas elsewhere. It then carries on in the
+ * written block with the most erased pages left, as Dhara resumes at its
+ * journal head, unless that block ends in such a page.
+ *
+ * Like FATFS, each open file buffers one sector and programs it when the
+ * file moves to another sector or is closed.
+ *
+ * Two reserved file ids need no CREATE record: kDeviceFile holds the
+ * device's sectors (the spi_nand_flash view, where Dhara would sit), and
+ * kFatMetaFile takes the FAT and directory sector traffic FATFS would add
+ * on top of the file data (see "FATFS metadata").
+ */
+
+#include "sim_fs.h"
+
+#include "crc16.h"
+
+#include <mutex>
+#include <string.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+static const uint32_t kTagMagic = 0x464D4953;  // "SIMF"
+static const uint32_t kTagOffset = 4;          // Spare byte 0 is the bad block mark
+static const uint32_t kFileSector = 0xFFFFFFFF;
+static const uint32_t kGcReserveBlocks = 2;
+static const uint64_t kNoKey = ~0ULL;
+static const uint32_t kDeviceFile = 0;
+static const uint32_t kFatMetaFile = 1;
+static const uint32_t kFirstPathId = 2;
+
+enum : uint16_t {
+  kFileCreate = 1,
+  kFileRemove = 2,
+  kSectorTrim = 3,  // Device sector pages: trimmed, reads as 0xFF
+};
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint32_t file_id;
+  uint32_t sector;     // Sector of the file, or kFileSector
+  uint32_t version;
+  uint32_t file_size;  // Data pages: file size after this write
+  uint32_t data_crc;   // CRC32 of the page data
+  uint16_t kind;       // File pages: kFileCreate or kFileRemove; kSectorTrim
+  uint16_t tag_crc;    // CRC16 of the fields above
+} page_tag_t;
+
+enum : uint8_t {
+  kBlockFree,    // Erased
+  kBlockDirty,   // Needs an erase before use (torn erase)
+  kBlockActive,  // Taking programs
+  kBlockClosed,  // Written; a GC candidate
+  kBlockBad,
+};
+
+typedef struct {
+  uint8_t state;
+  uint16_t live;
+  uint16_t next_page;
+} block_info_t;
+
+typedef struct {
+  bool exists;
+  uint32_t size;
+  uint32_t generation;  // Bumped per program, invalidates readers' buffers
+  std::vector<uint32_t> clusters;  // FAT chain of the file
+} file_info_t;
+
+struct log_fs_file {
+  uint32_t id;
+  bool write;
+  bool dirty;
+  int64_t buf_sector;  // -1: nothing buffered
+  uint32_t buf_generation;
+  std::vector<uint8_t> buf;
+  bool modified;       // Directory entry needs updating on close
+  uint32_t fat_pos;    // Cluster index the handle's chain walk has reached
+};
+
+static std::mutex g_mutex;
+static nand_model_t *g_nand = nullptr;
+static nand_geometry_t g_geo;
+static std::vector<block_info_t> g_blocks;
+static std::vector<uint64_t> g_page_key;            // Live key per page, kNoKey if dead
+static std::unordered_map<uint64_t, uint32_t> g_where;  // Key -> page
+static std::unordered_map<uint32_t, file_info_t> g_files;
+static std::unordered_set<uint32_t> g_trimmed;  // Device sectors whose newest page is a trim
+static uint32_t g_version = 1;
+static int64_t g_active = -1;
+static sim_fs_stats_t g_stats;
+static std::vector<uint8_t> g_page;   // Scratch page
+static std::vector<uint8_t> g_spare;  // Scratch spare area
+static bool g_fat_mounted = false;
+static int64_t g_fat_window = -1;     // Metadata sector FATFS has buffered
+static bool g_fat_window_dirty = false;
+static uint32_t g_fat_next_cluster;   // Allocation hint, like FATFS's last_clst
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+static uint32_t crc32(const uint8_t *data, size_t len) {
+  static uint32_t table[256];
+  if (!table[1]) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+  }
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFF;
+}
+
+static uint32_t path_id(const char *path) {
+  uint32_t h = 2166136261u;
+  for (; *path; path++) {
+    h = (h ^ (uint8_t)*path) * 16777619u;
+  }
+  return (h < kFirstPathId) ? h + kFirstPathId : h;
+}
+
+static uint64_t page_key(uint32_t file_id, uint32_t sector) {
+  return ((uint64_t)file_id << 32) | sector;
+}
+
+static uint32_t key_file(uint64_t key) {
+  return (uint32_t)(key >> 32);
+}
+
+static bool spare_erased(const uint8_t *spare) {
+  for (uint32_t i = 0; i < g_geo.spare_bytes; i++) {
+    if (spare[i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool tag_parse(const uint8_t *spare, page_tag_t *tag) {
+  memcpy(tag, &spare[kTagOffset], sizeof(*tag));
+  return tag->magic == kTagMagic &&
+         tag->tag_crc == crc16_ccitt((const uint8_t *)tag, sizeof(*tag) - sizeof(uint16_t));
+}
+
+static uint32_t free_block_count(void) {
+  uint32_t n = 0;
+  for (const block_info_t &b : g_blocks) {
+    n += (b.state == kBlockFree || b.state == kBlockDirty);
+  }
+  return n;
+}
+
+// Pages that can still be programmed: erased blocks plus the active block's
+// tail, which a mount carries on in.
+static uint32_t free_page_count(void) {
+  uint32_t n = free_block_count() * g_geo.pages_per_block;
+  if (g_active >= 0) {
+    n += g_geo.pages_per_block - g_blocks[g_active].next_page;
+  }
+  return n;
+}
+
+// Point key at page (or at nothing), keeping live counts in step
+static void page_set_live(uint64_t key, int64_t page) {
+  auto it = g_where.find(key);
+  if (it != g_where.end()) {
+    g_page_key[it->second] = kNoKey;
+    g_blocks[it->second / g_geo.pages_per_block].live--;
+    g_stats.live_pages--;
+    g_where.erase(it);
+  }
+  if (page >= 0) {
+    g_where[key] = (uint32_t)page;
+    g_page_key[page] = key;
+    g_blocks[page / g_geo.pages_per_block].live++;
+    g_stats.live_pages++;
+  }
+}
+
+// ============================================================================
+// Allocation, garbage collection, bad blocks
+// ============================================================================
+
+static bool page_program(const page_tag_t *tag, const uint8_t *data, uint32_t *out_page);
+
+// Make the least worn erased block active. Wear levelling reads the model's
+// erase counters where a real FTL would keep its own.
+static bool block_open_next(void) {
+  for (;;) {
+    int64_t best = -1;
+    for (uint32_t b = 0; b < g_geo.blocks; b++) {
+      uint8_t state = g_blocks[b].state;
+      if (state != kBlockFree && state != kBlockDirty) {
+        continue;
+      }
+      if (best < 0 || (state == kBlockFree && g_blocks[best].state == kBlockDirty) ||
+          (state == g_blocks[best].state &&
+           nand_block_erase_count(g_nand, b) < nand_block_erase_count(g_nand, best))) {
+        best = b;
+      }
+    }
+    if (best < 0) {
+      return false;
+    }
+    if (g_blocks[best].state == kBlockDirty) {
+      if (nand_erase_block(g_nand, (uint32_t)best) != NAND_OK) {
+        nand_block_mark_bad(g_nand, (uint32_t)best);
+        g_blocks[best].state = kBlockBad;
+        g_stats.bad_blocks++;
+        g_stats.retired_blocks++;
+        continue;
+      }
+    }
+    g_blocks[best] = {kBlockActive, 0, 0};
+    g_active = best;
+    return true;
+  }
+}
+
+// Copy the live pages of block out, keeping their versions
+static bool block_relocate(uint32_t block) {
+  std::vector<uint8_t> data(g_geo.page_bytes);
+  std::vector<uint8_t> spare(g_geo.spare_bytes);
+  uint32_t first = block * g_geo.pages_per_block;
+  for (uint32_t p = 0; p < g_blocks[block].next_page && g_blocks[block].live > 0; p++) {
+    uint64_t key = g_page_key[first + p];
+    if (key == kNoKey) {
+      continue;
+    }
+    page_tag_t tag;
+    if (nand_read_page(g_nand, first + p, data.data(), spare.data()) != NAND_OK ||
+        !tag_parse(spare.data(), &tag)) {
+      return false;
+    }
+    uint32_t page;
+    if (!page_program(&tag, data.data(), &page)) {
+      return false;
+    }
+    page_set_live(key, page);
+    g_stats.gc_relocations++;
+  }
+  return true;
+}
+
+// Retire a block after a failed program: move its data first, so a cut
+// before the mark leaves a block that still scans
+static void block_retire(uint32_t block) {
+  if (g_active == block) {
+    g_active = -1;
+  }
+  g_blocks[block].state = kBlockBad;
+  block_relocate(block);
+  nand_block_mark_bad(g_nand, block);
+  g_stats.bad_blocks++;
+  g_stats.retired_blocks++;
+}
+
+// Reclaim blocks until kGcReserveBlocks blocks' worth of pages are free.
+// Relocating a victim takes at most pages_per_block - 1 of them, so at
+// least one block is left erased at every point a cut can land, and the
+// next mount can relocate again. Returns false when only live data is left.
+static bool gc_reserve(void) {
+  while (free_page_count() < kGcReserveBlocks * g_geo.pages_per_block) {
+    int64_t victim = -1;
+    for (uint32_t b = 0; b < g_geo.blocks; b++) {
+      if (g_blocks[b].state != kBlockClosed) {
+        continue;
+      }
+      if (victim < 0 || g_blocks[b].live < g_blocks[victim].live ||
+          (g_blocks[b].live == g_blocks[victim].live &&
+           nand_block_erase_count(g_nand, b) < nand_block_erase_count(g_nand, victim))) {
+        victim = b;
+      }
+    }
+    if (victim < 0 || g_blocks[victim].live >= g_geo.pages_per_block) {
+      return false;
+    }
+    if (!block_relocate((uint32_t)victim)) {
+      return false;
+    }
+    if (nand_erase_block(g_nand, (uint32_t)victim) == NAND_OK) {
+      g_blocks[victim] = {kBlockFree, 0, 0};
+    } else {
+      nand_block_mark_bad(g_nand, (uint32_t)victim);
+      g_blocks[victim].state = kBlockBad;
+      g_stats.bad_blocks++;
+      g_stats.retired_blocks++;
+    }
+    g_stats.gc_runs++;
+  }
+  return true;
+}
+
+static bool page_program(const page_tag_t *tag, const uint8_t *data, uint32_t *out_page) {
+  memset(g_spare.data(), 0xFF, g_spare.size());
+  memcpy(&g_spare[kTagOffset], tag, sizeof(*tag));
+  for (;;) {
+    if (g_active >= 0 && g_blocks[g_active].next_page >= g_geo.pages_per_block) {
+      g_blocks[g_active].state = kBlockClosed;
+      g_active = -1;
+    }
+    if (g_active < 0 && !block_open_next()) {
+      return false;
+    }
+    uint32_t block = (uint32_t)g_active;
+    uint32_t page = block * g_geo.pages_per_block + g_blocks[block].next_page++;
+    nand_status_t st = nand_program_page(g_nand, page, data, g_spare.data());
+    if (st == NAND_OK) {
+      *out_page = page;
+      return true;
+    }
+    if (st == NAND_NOT_ERASED) {
+      // A cut that left the spare erased but not the data: skip the block
+      g_blocks[block].state = kBlockClosed;
+      g_active = -1;
+      continue;
+    }
+    if (st != NAND_PROGRAM_FAIL) {
+      return false;
+    }
+    block_retire(block);
+    // Relocation reused the scratch spare; put this page's tag back
+    memset(g_spare.data(), 0xFF, g_spare.size());
+    memcpy(&g_spare[kTagOffset], tag, sizeof(*tag));
+  }
+}
+
+// Program a new version of (file, sector) and make it the live one
+static bool write_version(uint32_t file_id, uint32_t sector, uint16_t kind,
+                          const uint8_t *data) {
+  if (!gc_reserve()) {
+    return false;
+  }
+  page_tag_t tag = {};
+  tag.magic = kTagMagic;
+  tag.file_id = file_id;
+  tag.sector = sector;
+  tag.version = g_version++;
+  tag.file_size = g_files[file_id].size;
+  tag.data_crc = crc32(data, g_geo.page_bytes);
+  tag.kind = kind;
+  tag.tag_crc = crc16_ccitt((const uint8_t *)&tag, sizeof(tag) - sizeof(uint16_t));
+  uint32_t page;
+  if (!page_program(&tag, data, &page)) {
+    return false;
+  }
+  page_set_live(page_key(file_id, sector), page);
+  g_files[file_id].generation++;
+  return true;
+}
+
+// Write a CREATE or REMOVE record: every older page of the file dies
+static bool file_record(uint32_t file_id, uint16_t kind) {
+  std::vector<uint64_t> dead;
+  for (const auto &it : g_where) {
+    if (key_file(it.first) == file_id && (uint32_t)it.first != kFileSector) {
+      dead.push_back(it.first);
+    }
+  }
+  file_info_t &file = g_files[file_id];
+  file.size = 0;
+  std::vector<uint8_t> blank(g_geo.page_bytes, 0xFF);
+  if (!write_version(file_id, kFileSector, kind, blank.data())) {
+    return false;
+  }
+  for (uint64_t key : dead) {
+    page_set_live(key, -1);
+  }
+  file.exists = (kind == kFileCreate);
+  return true;
+}
+
+// ============================================================================
+// Mount
+// ============================================================================
+
+typedef struct {
+  uint32_t page;
+  page_tag_t tag;
+} candidate_t;
+
+bool sim_fs_mount(nand_model_t *nand) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  nand_counters_t before = nand_model_counters(nand);
+  g_nand = nand;
+  g_geo = *nand_model_geometry(nand);
+  uint32_t pages = g_geo.blocks * g_geo.pages_per_block;
+  g_blocks.assign(g_geo.blocks, block_info_t{kBlockFree, 0, 0});
+  g_page_key.assign(pages, kNoKey);
+  g_where.clear();
+  g_files.clear();
+  g_trimmed.clear();
+  g_version = 1;
+  g_active = -1;
+  g_stats = {};
+  g_page.assign(g_geo.page_bytes, 0);
+  g_spare.assign(g_geo.spare_bytes, 0xFF);
+
+  std::vector<candidate_t> found;
+  int64_t resume = -1;
+  for (uint32_t b = 0; b < g_geo.blocks; b++) {
+    if (nand_block_is_bad(nand, b)) {
+      g_blocks[b].state = kBlockBad;
+      g_stats.bad_blocks++;
+      continue;
+    }
+    uint32_t first = b * g_geo.pages_per_block;
+    nand_status_t st = nand_read_page(nand, first, nullptr, g_spare.data());
+    g_stats.mount_spare_reads++;
+    if (st == NAND_OK && spare_erased(g_spare.data())) {
+      // Pages are programmed in order, so an erased first page means an
+      // erased block, unless an erase was cut short: then the tail is not
+      st = nand_read_page(nand, first + g_geo.pages_per_block - 1, nullptr, g_spare.data());
+      g_stats.mount_spare_reads++;
+      bool erased = (st == NAND_OK && spare_erased(g_spare.data()));
+      g_blocks[b].state = erased ? kBlockFree : kBlockDirty;
+      continue;
+    }
+
+    bool last_found = false;
+    uint32_t p = 0;
+    for (; p < g_geo.pages_per_block; p++) {
+      if (p > 0) {
+        st = nand_read_page(nand, first + p, nullptr, g_spare.data());
+        g_stats.mount_spare_reads++;
+      }
+      if (st == NAND_OK && spare_erased(g_spare.data())) {
+        break;
+      }
+      last_found = false;
+      page_tag_t tag;
+      if (st != NAND_OK || !tag_parse(g_spare.data(), &tag)) {
+        g_stats.torn_pages++;
+        continue;
+      }
+      last_found = true;
+      found.push_back({first + p, tag});
+    }
+    // The block's last written page may be a torn program the ECC missed
+    bool resumable = p < g_geo.pages_per_block;
+    if (last_found) {
+      const candidate_t &c = found.back();
+      st = nand_read_page(nand, c.page, g_page.data(), nullptr);
+      g_stats.mount_page_reads++;
+      if (st != NAND_OK || crc32(g_page.data(), g_geo.page_bytes) != c.tag.data_crc) {
+        found.pop_back();
+        g_stats.torn_pages++;
+        resumable = false;  // Later pages would hide it from the next mount
+      }
+    }
+    g_blocks[b] = {kBlockClosed, 0, (uint16_t)p};
+    if (resumable && (resume < 0 || p < g_blocks[resume].next_page)) {
+      resume = b;
+    }
+  }
+  // Programs carry on in the written block with the most room. Starting a
+  // fresh block instead would strand that room at every boot, and a cut
+  // during garbage collection could leave no erased block to relocate into.
+  if (resume >= 0) {
+    g_blocks[resume].state = kBlockActive;
+    g_active = resume;
+  }
+
+  // Newest file record per file, then the newest data version after it
+  std::unordered_map<uint64_t, const candidate_t *> newest;
+  for (const candidate_t &c : found) {
+    uint64_t key = page_key(c.tag.file_id, c.tag.sector);
+    auto it = newest.find(key);
+    if (it == newest.end() || c.tag.version > it->second->tag.version) {
+      newest[key] = &c;
+    }
+    if (c.tag.version >= g_version) {
+      g_version = c.tag.version + 1;
+    }
+  }
+  std::unordered_map<uint32_t, uint32_t> size_version;
+  for (const auto &it : newest) {
+    const page_tag_t &tag = it.second->tag;
+    if (tag.sector == kFileSector) {
+      page_set_live(it.first, it.second->page);
+      g_files[tag.file_id].exists = (tag.kind == kFileCreate);
+    }
+  }
+  for (const auto &it : newest) {
+    const page_tag_t &tag = it.second->tag;
+    if (tag.sector == kFileSector) {
+      continue;
+    }
+    if (tag.file_id < kFirstPathId) {
+      page_set_live(it.first, it.second->page);
+      if (tag.file_id == kDeviceFile && tag.kind == kSectorTrim) {
+        g_trimmed.insert(tag.sector);
+      }
+      continue;
+    }
+    auto rec = newest.find(page_key(tag.file_id, kFileSector));
+    if (rec == newest.end() || rec->second->tag.version > tag.version ||
+        rec->second->tag.kind != kFileCreate) {
+      continue;  // Written before the file was removed or recreated
+    }
+    page_set_live(it.first, it.second->page);
+    file_info_t &file = g_files[tag.file_id];
+    if (tag.version > size_version[tag.file_id]) {
+      size_version[tag.file_id] = tag.version;
+      file.size = tag.file_size;
+    }
+  }
+  g_stats.free_blocks = free_block_count();
+  g_stats.mount_nand_us = nand_model_counters(nand).busy_us - before.busy_us;
+  g_fat_mounted = false;
+
+  for (const block_info_t &b : g_blocks) {
+    if (b.state != kBlockBad) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void sim_fs_unmount(void) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_nand = nullptr;
+}
+
+sim_fs_stats_t sim_fs_get_stats(void) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  sim_fs_stats_t stats = g_stats;
+  if (g_nand) {
+    stats.free_blocks = free_block_count();
+  }
+  return stats;
+}
+
+// ============================================================================
+// Device sectors
+// ============================================================================
+
+// Fixed, so a volume laid out on it survives blocks going bad: the good
+// blocks less 1/16 for bad block growth and the GC reserve
+uint32_t sim_fs_sector_count(void) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!g_nand) {
+    return 0;
+  }
+  return (g_geo.blocks - g_geo.blocks / 16 - kGcReserveBlocks) * g_geo.pages_per_block;
+}
+
+bool sim_fs_sector_read(uint32_t sector, uint8_t *buf) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!g_nand) {
+    return false;
+  }
+  auto it = g_where.find(page_key(kDeviceFile, sector));
+  if (it == g_where.end() || g_trimmed.count(sector)) {
+    memset(buf, 0xFF, g_geo.page_bytes);
+    return true;
+  }
+  return nand_read_page(g_nand, it->second, buf, nullptr) == NAND_OK;
+}
+
+bool sim_fs_sector_write(uint32_t sector, const uint8_t *buf) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!g_nand || !write_version(kDeviceFile, sector, 0, buf)) {
+    return false;
+  }
+  g_trimmed.erase(sector);
+  return true;
+}
+
+// Like Dhara, a trim of an unmapped sector costs nothing and one of a mapped
+// sector writes a page. Dhara's journal page then drops the mapping; here
+// the trim page stays as the sector's newest version, so no older one can
+// come back at the next mount.
+bool sim_fs_sector_trim(uint32_t sector) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!g_nand) {
+    return false;
+  }
+  if (g_where.find(page_key(kDeviceFile, sector)) == g_where.end() || g_trimmed.count(sector)) {
+    return true;
+  }
+  std::vector<uint8_t> blank(g_geo.page_bytes, 0xFF);
+  if (!write_version(kDeviceFile, sector, kSectorTrim, blank.data())) {
+    return false;
+  }
+  g_trimmed.insert(sector);
+  return true;
+}
+
+// ============================================================================
+// FATFS metadata
+// ============================================================================
+//
+// The tags already say where every file sector lives, so the file layer does
+// not need a FAT. FATFS does, and its metadata I/O is what a backend without
+// it saves. Once sim_fs_fat_mount() has run, the log_fs calls below replay
+// that I/O onto kFatMetaFile as FATFS would issue it: FAT16 with 16 KB
+// clusters, two FATs, a one-sector root directory, and one buffered
+// metadata sector written back when FATFS moves off it. The data in those
+// sectors is never used; only the reads and programs count.
+
+static const uint32_t kClusterBytes = 16384;
+static const uint32_t kFatBootSector = 0;
+static const uint32_t kFatFirstSector = 1;
+
+static uint32_t fat_clusters(void) {
+  uint64_t bytes = (uint64_t)(g_geo.blocks - g_geo.blocks / 16 - kGcReserveBlocks) *
+                   g_geo.pages_per_block * g_geo.page_bytes;
+  return (uint32_t)(bytes / kClusterBytes);
+}
+
+static uint32_t fat_sectors(void) {
+  uint32_t per_sector = g_geo.page_bytes / sizeof(uint16_t);
+  return (fat_clusters() + 2 + per_sector - 1) / per_sector;
+}
+
+static uint32_t fat_sector_of(uint32_t cluster) {
+  return kFatFirstSector + cluster / (g_geo.page_bytes / sizeof(uint16_t));
+}
+
+static uint32_t fat_root_sector(void) {
+  return kFatFirstSector + 2 * fat_sectors();
+}
+
+// Write the buffered sector back, to both FATs if it is a FAT sector
+static bool fat_sync(void) {
+  if (!g_fat_window_dirty) {
+    return true;
+  }
+  memset(g_page.data(), 0, g_page.size());
+  uint32_t sector = (uint32_t)g_fat_window;
+  if (!write_version(kFatMetaFile, sector, 0, g_page.data())) {
+    return false;
+  }
+  g_stats.fat_sector_writes++;
+  if (sector >= kFatFirstSector && sector < kFatFirstSector + fat_sectors()) {
+    if (!write_version(kFatMetaFile, sector + fat_sectors(), 0, g_page.data())) {
+      return false;
+    }
+    g_stats.fat_sector_writes++;
+  }
+  g_fat_window_dirty = false;
+  return true;
+}
+
+static bool fat_window(uint32_t sector) {
+  if (g_fat_window == sector) {
+    return true;
+  }
+  if (!fat_sync()) {
+    return false;
+  }
+  g_fat_window = -1;
+  auto it = g_where.find(page_key(kFatMetaFile, sector));
+  if (it != g_where.end()) {
+    if (nand_read_page(g_nand, it->second, g_page.data(), nullptr) != NAND_OK) {
+      return false;
+    }
+    g_stats.fat_sector_reads++;
+  }
+  g_fat_window = sector;
+  return true;
+}
+
+static bool fat_touch(uint32_t sector) {
+  if (!fat_window(sector)) {
+    return false;
+  }
+  g_fat_window_dirty = true;
+  return true;
+}
+
+static uint32_t fat_alloc(void) {
+  uint32_t cluster = g_fat_next_cluster++;
+  if (g_fat_next_cluster >= fat_clusters() + 2) {
+    g_fat_next_cluster = 2;
+  }
+  return cluster;
+}
+
+// Follow the file's chain to the cluster holding sector, from the handle's
+// position if that is not past it (FATFS walks forward only)
+static bool fat_seek(log_fs_file_t *f, uint32_t sector) {
+  if (!g_fat_mounted) {
+    return true;
+  }
+  const file_info_t &file = g_files[f->id];
+  uint32_t target = sector * g_geo.page_bytes / kClusterBytes;
+  if (target >= file.clusters.size()) {
+    return true;  // Not allocated yet; fat_extend() links it
+  }
+  uint32_t from = (f->fat_pos <= target) ? f->fat_pos : 0;
+  for (uint32_t i = from; i < target; i++) {
+    if (!fat_window(fat_sector_of(file.clusters[i]))) {
+      return false;
+    }
+  }
+  f->fat_pos = target;
+  return true;
+}
+
+// Allocate and link clusters until the file covers size bytes
+static bool fat_extend(uint32_t id, uint32_t size) {
+  if (!g_fat_mounted) {
+    return true;
+  }
+  file_info_t &file = g_files[id];
+  while ((uint64_t)file.clusters.size() * kClusterBytes < size) {
+    uint32_t cluster = fat_alloc();
+    if (!fat_touch(fat_sector_of(cluster))) {
+      return false;
+    }
+    if (!file.clusters.empty() && !fat_touch(fat_sector_of(file.clusters.back()))) {
+      return false;
+    }
+    file.clusters.push_back(cluster);
+  }
+  return true;
+}
+
+static bool fat_free_chain(uint32_t id) {
+  file_info_t &file = g_files[id];
+  for (uint32_t cluster : file.clusters) {
+    if (g_fat_mounted && !fat_touch(fat_sector_of(cluster))) {
+      return false;
+    }
+  }
+  file.clusters.clear();
+  return true;
+}
+
+// Directory entry update, committed like f_sync/f_unlink/f_rename do
+static bool fat_dir_commit(void) {
+  return !g_fat_mounted || (fat_touch(fat_root_sector()) && fat_sync());
+}
+
+static bool fat_dir_lookup(void) {
+  return !g_fat_mounted || fat_window(fat_root_sector());
+}
+
+bool sim_fs_fat_mount(void) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!g_nand) {
+    return false;
+  }
+  g_fat_mounted = true;
+  g_fat_window = -1;
+  g_fat_window_dirty = false;
+  g_fat_next_cluster = 2;
+  g_stats.fat_sector_reads = g_stats.fat_sector_writes = 0;
+  if (g_where.find(page_key(kFatMetaFile, kFatBootSector)) == g_where.end()) {
+    // Format: boot sector, first sector of each FAT, root directory
+    if (!fat_touch(kFatBootSector) || !fat_touch(kFatFirstSector) ||
+        !fat_touch(fat_root_sector()) || !fat_sync()) {
+      return false;
+    }
+  } else if (!fat_window(kFatBootSector)) {
+    return false;
+  }
+  // The chains themselves are not stored; lay existing files out end to end
+  for (auto &it : g_files) {
+    if (it.first < kFirstPathId || !it.second.exists) {
+      continue;
+    }
+    it.second.clusters.clear();
+    while ((uint64_t)it.second.clusters.size() * kClusterBytes < it.second.size) {
+      it.second.clusters.push_back(fat_alloc());
+    }
+  }
+  return true;
+}
+
+// ============================================================================
+// log_fs backend
+// ============================================================================
+
+static bool buf_flush(log_fs_file_t *f) {
+  if (!f->dirty) {
+    return true;
+  }
+  if (!write_version(f->id, (uint32_t)f->buf_sector, 0, f->buf.data())) {
+    return false;
+  }
+  f->dirty = false;
+  f->buf_generation = g_files[f->id].generation;
+  return true;
+}
+
+// Buffer sector, reading it unless the caller overwrites all of it
+static bool buf_load(log_fs_file_t *f, uint32_t sector, bool whole) {
+  if (f->buf_sector == sector && (f->dirty || f->buf_generation == g_files[f->id].generation)) {
+    return true;
+  }
+  if (!buf_flush(f)) {
+    return false;
+  }
+  f->buf_sector = -1;
+  if (!fat_seek(f, sector)) {
+    return false;
+  }
+  auto it = g_where.find(page_key(f->id, sector));
+  if (whole || it == g_where.end()) {
+    memset(f->buf.data(), 0, f->buf.size());
+  } else if (nand_read_page(g_nand, it->second, f->buf.data(), nullptr) != NAND_OK) {
+    return false;
+  }
+  f->buf_sector = sector;
+  f->buf_generation = g_files[f->id].generation;
+  return true;
+}
+
+static log_fs_file_t *sim_open(const char *path, bool write) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!g_nand) {
+    return nullptr;
+  }
+  uint32_t id = path_id(path);
+  if (!fat_dir_lookup()) {
+    return nullptr;
+  }
+  bool created = false;
+  auto it = g_files.find(id);
+  if (it == g_files.end() || !it->second.exists) {
+    if (!write || !file_record(id, kFileCreate)) {
+      return nullptr;
+    }
+    created = true;
+  }
+  log_fs_file_t *f = new log_fs_file_t;
+  f->id = id;
+  f->write = write;
+  f->dirty = false;
+  f->buf_sector = -1;
+  f->buf_generation = 0;
+  f->buf.assign(g_geo.page_bytes, 0);
+  f->modified = created;
+  f->fat_pos = 0;
+  return f;
+}
+
+static size_t sim_read_at(log_fs_file_t *f, long offset, void *buf, size_t len) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  uint32_t size = g_files[f->id].size;
+  if (offset < 0 || (uint64_t)offset >= size) {
+    return 0;
+  }
+  if (len > size - (uint64_t)offset) {
+    len = size - (size_t)offset;
+  }
+  size_t done = 0;
+  while (done < len) {
+    uint64_t pos = (uint64_t)offset + done;
+    uint32_t sector = (uint32_t)(pos / g_geo.page_bytes);
+    uint32_t in = (uint32_t)(pos % g_geo.page_bytes);
+    size_t n = g_geo.page_bytes - in;
+    if (n > len - done) {
+      n = len - done;
+    }
+    if (!buf_load(f, sector, false)) {
+      break;
+    }
+    memcpy((uint8_t *)buf + done, &f->buf[in], n);
+    done += n;
+  }
+  return done;
+}
+
+static size_t sim_write_at(log_fs_file_t *f, long offset, const void *buf, size_t len) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!f->write || offset < 0) {
+    return 0;
+  }
+  size_t done = 0;
+  while (done < len) {
+    uint64_t pos = (uint64_t)offset + done;
+    uint32_t sector = (uint32_t)(pos / g_geo.page_bytes);
+    uint32_t in = (uint32_t)(pos % g_geo.page_bytes);
+    size_t n = g_geo.page_bytes - in;
+    if (n > len - done) {
+      n = len - done;
+    }
+    if (!fat_extend(f->id, (uint32_t)(pos + n)) ||
+        !buf_load(f, sector, n == g_geo.page_bytes)) {
+      break;
+    }
+    memcpy(&f->buf[in], (const uint8_t *)buf + done, n);
+    f->dirty = true;
+    f->modified = true;
+    done += n;
+    file_info_t &file = g_files[f->id];
+    if (pos + n > file.size) {
+      file.size = (uint32_t)(pos + n);
+    }
+  }
+  return done;
+}
+
+static long sim_size(log_fs_file_t *f) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  return (long)g_files[f->id].size;
+}
+
+static int sim_close(log_fs_file_t *f) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  bool ok = !g_nand || (buf_flush(f) && (!f->modified || fat_dir_commit()));
+  delete f;
+  return ok ? 0 : -1;
+}
+
+static int sim_remove(const char *path) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  uint32_t id = path_id(path);
+  auto it = g_files.find(id);
+  if (!g_nand || it == g_files.end() || !it->second.exists || !fat_dir_lookup()) {
+    return -1;
+  }
+  if (!fat_free_chain(id) || !fat_dir_commit()) {
+    return -1;
+  }
+  return file_record(id, kFileRemove) ? 0 : -1;
+}
+
+// Not atomic, unlike f_rename: copy the sectors, then remove the source. A
+// cut in between leaves both files.
+static int sim_rename(const char *from, const char *to) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  uint32_t src = path_id(from);
+  uint32_t dst = path_id(to);
+  auto it = g_files.find(src);
+  if (!g_nand || it == g_files.end() || !it->second.exists || !fat_dir_lookup()) {
+    return -1;
+  }
+  // FATFS rewrites the directory entry; the chain moves over untouched
+  if (g_files[dst].exists && !fat_free_chain(dst)) {
+    return -1;
+  }
+  std::vector<uint32_t> chain;
+  chain.swap(g_files[src].clusters);
+  if (!fat_dir_commit()) {
+    return -1;
+  }
+  uint32_t size = g_files[src].size;
+  std::vector<std::pair<uint32_t, uint32_t>> sectors;  // (sector, page)
+  for (const auto &w : g_where) {
+    if (key_file(w.first) == src && (uint32_t)w.first != kFileSector) {
+      sectors.push_back({(uint32_t)w.first, w.second});
+    }
+  }
+  if (!file_record(dst, kFileCreate)) {
+    return -1;
+  }
+  g_files[dst].size = size;
+  g_files[dst].clusters.swap(chain);
+  std::vector<uint8_t> data(g_geo.page_bytes);
+  for (const auto &s : sectors) {
+    if (nand_read_page(g_nand, s.second, data.data(), nullptr) != NAND_OK ||
+        !write_version(dst, s.first, 0, data.data())) {
+      return -1;
+    }
+  }
+  return file_record(src, kFileRemove) ? 0 : -1;
+}
+
+static long sim_stat_size(const char *path) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  auto it = g_files.find(path_id(path));
+  if (!g_nand || !fat_dir_lookup() || it == g_files.end() || !it->second.exists) {
+    return -1;
+  }
+  return (long)it->second.size;
+}
+
+// Capacity is the good blocks less the GC reserve
+static esp_err_t sim_info(uint64_t *total_bytes, uint64_t *free_bytes) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!g_nand) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  uint32_t good = 0;
+  for (const block_info_t &b : g_blocks) {
+    good += (b.state != kBlockBad);
+  }
+  uint64_t usable = (good > kGcReserveBlocks) ? good - kGcReserveBlocks : 0;
+  uint64_t total = usable * g_geo.pages_per_block * g_geo.page_bytes;
+  uint64_t used = (uint64_t)g_stats.live_pages * g_geo.page_bytes;
+  *total_bytes = total;
+  *free_bytes = (used < total) ? total - used : 0;
+  return ESP_OK;
+}
+
+static const log_fs_ops_t kSimOps = {
+    .open = sim_open,
+    .read_at = sim_read_at,
+    .write_at = sim_write_at,
+    .size = sim_size,
+    .close = sim_close,
+    .remove = sim_remove,
+    .rename = sim_rename,
+    .stat_size = sim_stat_size,
+    .info = sim_info,
+};
+
+const log_fs_ops_t *sim_fs_ops(void) {
+  return &kSimOps;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Log files on the simulated NAND: a small log-structured flash translation
+// layer exposed as a log_fs backend, standing in for FATFS on Dhara, and as
+// the device sectors a backend without FATFS writes to.
+//
+// Every program writes one whole file sector (one page) out of place and
+// tags it in the spare area with the file, sector, version and data CRC, so
+// a sector write is atomic: after a power cut the newest intact version
+// wins. Mount rebuilds the tables by scanning the spare areas.
+
+#include "log_fs.h"
+#include "nand_model.h"
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t mount_spare_reads;   // Spare areas read by the last mount scan
+  uint32_t mount_page_reads;    // Full pages read by it (CRC checks)
+  uint32_t torn_pages;          // Pages the last mount dropped as torn
+  uint32_t live_pages;          // Pages holding current data or file records
+  uint32_t free_blocks;         // Erased or erasable blocks
+  uint32_t bad_blocks;          // Marked bad (factory and retired)
+  uint32_t gc_runs;             // Blocks reclaimed since mount
+  uint32_t gc_relocations;      // Live pages copied by those reclaims
+  uint32_t retired_blocks;      // Blocks retired since mount after P/E-FAIL
+  uint64_t mount_nand_us;       // Modelled NAND time of the last mount scan
+  uint32_t fat_sector_reads;    // FATFS metadata I/O since sim_fs_fat_mount()
+  uint32_t fat_sector_writes;
+} sim_fs_stats_t;
+
+// Scan the part and rebuild the volume. Returns false if the part has no
+// usable block.
+bool sim_fs_mount(nand_model_t *nand);
+void sim_fs_unmount(void);
+
+// log_fs backend for the mounted volume (pass to log_fs_set_ops)
+const log_fs_ops_t *sim_fs_ops(void);
+
+// Make sim_fs_ops() also issue the FAT and directory sector reads and
+// programs FATFS would, formatting those on first use
+bool sim_fs_fat_mount(void);
+
+// The volume's sectors as spi_nand_flash exports them: each write is one
+// atomic out-of-place program, like Dhara's. Unwritten sectors read as 0xFF.
+uint32_t sim_fs_sector_count(void);
+bool sim_fs_sector_read(uint32_t sector, uint8_t *buf);
+bool sim_fs_sector_write(uint32_t sector, const uint8_t *buf);
+// Reads as 0xFF afterwards. Like a Dhara trim, free if the sector is not
+// mapped and one program if it is.
+bool sim_fs_sector_trim(uint32_t sector);
+
+sim_fs_stats_t sim_fs_get_stats(void);
@@ -0,0 +1,115 @@
+/**
+ * @file sim_port.cpp
+ * @brief spi_nand_flash / esp_vfs_fat stand-ins backed by the NAND simulator
+ *
+ * Opening the device mounts sim_fs, which plays Dhara: sectors are sim_fs
+ * device sectors. The FATFS mount turns on sim_fs's FAT cost model and
+ * routes log_fs to its files.
+ */
+
+#include "sim_port.h"
+
+#include "esp_vfs_fat_nand.h"
+#include "log_fs.h"
+#include "sim_fs.h"
+
+struct spi_nand_flash_device_t {
+  nand_model_t *nand;
+};
+
+static nand_model_t *g_attached = nullptr;
+
+void sim_port_attach(nand_model_t *nand) {
+  g_attached = nand;
+}
+
+esp_err_t spi_nand_flash_init_device(spi_nand_flash_config_t *config,
+                                     spi_nand_flash_device_t **handle) {
+  (void)config;
+  if (!g_attached) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  if (!sim_fs_mount(g_attached)) {
+    return ESP_FAIL;
+  }
+  *handle = new spi_nand_flash_device_t{g_attached};
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_deinit_device(spi_nand_flash_device_t *handle) {
+  sim_fs_unmount();
+  delete handle;
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_get_capacity(spi_nand_flash_device_t *handle, uint32_t *sectors) {
+  (void)handle;
+  *sectors = sim_fs_sector_count();
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_get_sector_size(spi_nand_flash_device_t *handle, uint32_t *bytes) {
+  *bytes = nand_model_geometry(handle->nand)->page_bytes;
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_get_block_size(spi_nand_flash_device_t *handle, uint32_t *bytes) {
+  const nand_geometry_t *geo = nand_model_geometry(handle->nand);
+  *bytes = geo->page_bytes * geo->pages_per_block;
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_get_block_num(spi_nand_flash_device_t *handle, uint32_t *blocks) {
+  *blocks = nand_model_geometry(handle->nand)->blocks;
+  return ESP_OK;
+}
+
+esp_err_t spi_nand_flash_read_sector(spi_nand_flash_device_t *handle, uint8_t *buffer,
+                                     uint32_t sector) {
+  if (sector >= sim_fs_sector_count()) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  return sim_fs_sector_read(sector, buffer) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t spi_nand_flash_write_sector(spi_nand_flash_device_t *handle,
+                                      const uint8_t *buffer, uint32_t sector) {
+  (void)handle;
+  if (sector >= sim_fs_sector_count()) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  return sim_fs_sector_write(sector, buffer) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t spi_nand_flash_trim(spi_nand_flash_device_t *handle, uint32_t sector) {
+  (void)handle;
+  if (sector >= sim_fs_sector_count()) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  return sim_fs_sector_trim(sector) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_vfs_fat_nand_mount(const char *base_path, spi_nand_flash_device_t *handle,
+                                 const esp_vfs_fat_mount_config_t *config) {
+  (void)base_path;
+  (void)config;
+  (void)handle;
+  if (!sim_fs_fat_mount()) {
+    return ESP_FAIL;
+  }
+  log_fs_set_ops(sim_fs_ops());
+  return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_nand_unmount(const char *base_path, spi_nand_flash_device_t *handle) {
+  (void)base_path;
+  (void)handle;
+  log_fs_set_ops(nullptr);
+  return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_info(const char *base_path, uint64_t *out_total_bytes,
+                           uint64_t *out_free_bytes) {
+  (void)base_path;
+  return sim_fs_ops()->info(out_total_bytes, out_free_bytes);
+}
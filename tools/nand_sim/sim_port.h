@@ -0,0 +1,11 @@
+#pragma once
+
+// spi_nand_flash and FATFS mount calls for host builds on the simulated
+// NAND: opening the device scans the attached part with sim_fs_mount(), its
+// sectors are sim_fs device sectors, and the FATFS mount routes log_fs to
+// the simulated volume.
+
+#include "nand_model.h"
+
+// Part the next spi_nand_flash_init_device() opens
+void sim_port_attach(nand_model_t *nand);
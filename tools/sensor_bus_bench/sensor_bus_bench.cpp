@@ -0,0 +1,246 @@
+/**
+ * @file sensor_bus_bench.cpp
+ * @brief main/sensor_bus.cpp under the device's consumers, and with a stall
+ *
+ * A producer thread publishes --frames frames, one every --period-ms (the
+ * device's second, scaled down), while five consumer threads read them as
+ * the firmware does: display and LED take the newest, alerts drain every
+ * frame, storage takes every frame but stalls for --stall-frames periods
+ * on every --stall-every'th (a NAND erase or mount), and the summary log
+ * takes the newest every five periods.
+ *
+ * Each frame carries its seq in its values, so a frame torn between two
+ * publishes or delivered out of order fails the run, as does any
+ * subscriber whose counters do not add up to what was published.
+ *
+ * The same stall is then run inline in the acquiring loop, as when sensor
+ * reads and their consumers shared app_main's loop, to show how late it
+ * makes the reads.
+ */
+
+#include "sensor_bus.h"
+
+#include "esp_timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+static uint32_t g_period_ms = 20;
+static uint32_t g_stall_every = 100;
+static uint32_t g_stall_frames = 12;
+static std::atomic<bool> g_done{false};
+static std::atomic<bool> g_bad{false};
+static int64_t g_base_ms = 0;  // esp_timer ms the frame grid starts from
+
+static void sleep_ms(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+struct Seen {
+  uint32_t last_seq = 0;
+  uint32_t frames = 0;  // Distinct frames seen
+};
+
+// Newest readers may see a frame again; queue readers never
+static void check(const char *name, Seen *seen, const sensor_frame_t &f, bool strict) {
+  bool torn = f.values.co2_ppm_avg != (int)f.seq || f.values.voc_index != (int)(f.seq % 500) ||
+              f.timestamp_ms != g_base_ms + (int64_t)f.seq * g_period_ms;
+  bool order = strict ? f.seq <= seen->last_seq : f.seq < seen->last_seq;
+  if (torn || order) {
+    printf("FAIL %s: frame %u %s after %u\n", name, f.seq, torn ? "torn" : "out of order",
+           seen->last_seq);
+    g_bad = true;
+  }
+  if (f.seq != seen->last_seq) {
+    seen->frames++;
+  }
+  seen->last_seq = f.seq;
+}
+
+static void latest_reader(sensor_sub_t sub, uint32_t every_ms, Seen *seen) {
+  sensor_frame_t f;
+  while (!g_done) {
+    if (sensor_bus_latest(sub, &f)) {
+      check(sensor_bus_sub_name(sub), seen, f, false);
+    }
+    sleep_ms(every_ms);
+  }
+}
+
+static void alerts_reader(uint32_t every_ms, Seen *seen) {
+  sensor_frame_t f;
+  for (;;) {
+    bool done = g_done;
+    while (sensor_bus_receive(SENSOR_SUB_ALERTS, &f, 0)) {
+      check("alerts", seen, f, true);
+    }
+    if (done) {
+      return;
+    }
+    sleep_ms(every_ms);
+  }
+}
+
+static void storage_reader(Seen *seen) {
+  sensor_frame_t f;
+  for (;;) {
+    if (sensor_bus_receive(SENSOR_SUB_STORAGE, &f, g_period_ms)) {
+      check("storage", seen, f, true);
+      if (f.seq % g_stall_every == 0) {
+        sleep_ms(g_stall_frames * g_period_ms);
+      }
+    } else if (g_done) {
+      return;
+    }
+  }
+}
+
+struct Timing {
+  double late_mean_ms;
+  double late_max_ms;
+  uint32_t late_periods;  // Reads more than a period late
+  double publish_max_us;
+};
+
+// Acquire on the period grid; with `inline_stall` the storage stall runs in
+// this loop, otherwise each frame goes out on the bus
+static Timing produce(uint32_t frames, bool inline_stall) {
+  Timing t = {};
+  double late_sum = 0.0;
+  Clock::time_point t0 = Clock::now();
+  g_base_ms = esp_timer_get_time() / 1000;
+  for (uint32_t seq = 1; seq <= frames; seq++) {
+    Clock::time_point due = t0 + std::chrono::milliseconds((int64_t)seq * g_period_ms);
+    std::this_thread::sleep_until(due);
+    double late = std::chrono::duration<double, std::milli>(Clock::now() - due).count();
+    late_sum += late;
+    t.late_max_ms = std::max(t.late_max_ms, late);
+    t.late_periods += late > g_period_ms ? 1 : 0;
+
+    sensor_values_t v = {};
+    v.co2_ppm_avg = (int)seq;
+    v.voc_index = (int)(seq % 500);
+    if (inline_stall) {
+      if (seq % g_stall_every == 0) {
+        sleep_ms(g_stall_frames * g_period_ms);
+      }
+      continue;
+    }
+    Clock::time_point p0 = Clock::now();
+    sensor_bus_publish(g_base_ms + (int64_t)seq * g_period_ms, 0, 0, &v);
+    double us = std::chrono::duration<double, std::micro>(Clock::now() - p0).count();
+    t.publish_max_us = std::max(t.publish_max_us, us);
+  }
+  t.late_mean_ms = late_sum / frames;
+  return t;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--frames N] [--period-ms N] [--stall-every N] [--stall-frames N]\n"
+          "  Publishes --frames frames to the device's five subscribers and checks\n"
+          "  what each receives; storage stalls --stall-frames periods on every\n"
+          "  --stall-every'th frame. Then runs the stall inline for comparison.\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  uint32_t frames = 300;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    }
+    uint32_t v = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    if (strcmp(argv[i - 1], "--frames") == 0) {
+      frames = v;
+    } else if (strcmp(argv[i - 1], "--period-ms") == 0) {
+      g_period_ms = v;
+    } else if (strcmp(argv[i - 1], "--stall-every") == 0) {
+      g_stall_every = v;
+    } else if (strcmp(argv[i - 1], "--stall-frames") == 0) {
+      g_stall_frames = v;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (frames == 0 || g_period_ms < 10 || g_stall_every == 0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  if (sensor_bus_init() != ESP_OK) {
+    printf("FAIL: sensor_bus_init\n");
+    return 1;
+  }
+
+  // Poll rates scaled from the device: display 50 ms, LED and alerts
+  // 100 ms, summary 5 s, against a 1 s frame
+  Seen seen[SENSOR_SUB_COUNT];
+  std::thread readers[] = {
+      std::thread(latest_reader, SENSOR_SUB_DISPLAY, std::max(1u, g_period_ms / 20),
+                  &seen[SENSOR_SUB_DISPLAY]),
+      std::thread(storage_reader, &seen[SENSOR_SUB_STORAGE]),
+      std::thread(latest_reader, SENSOR_SUB_LED, std::max(1u, g_period_ms / 10),
+                  &seen[SENSOR_SUB_LED]),
+      std::thread(alerts_reader, std::max(1u, g_period_ms / 10), &seen[SENSOR_SUB_ALERTS]),
+      std::thread(latest_reader, SENSOR_SUB_SYSTEM, 5 * g_period_ms, &seen[SENSOR_SUB_SYSTEM]),
+  };
+  Timing bus = produce(frames, false);
+  sleep_ms(2 * g_period_ms);
+  g_done = true;
+  for (std::thread &t : readers) {
+    t.join();
+  }
+
+  sensor_bus_stats_t stats;
+  sensor_bus_get_stats(&stats);
+  printf("%u frames, one per %u ms; storage stalls %u ms every %u frames\n\n", frames,
+         g_period_ms, g_stall_frames * g_period_ms, g_stall_every);
+  printf("%-8s %6s %6s %7s %7s %6s %5s %9s %9s\n", "sub", "seen", "taken", "dropped",
+         "skipped", "queued", "peak", "lag", "lag max");
+  bool ok = !g_bad && stats.frames == frames;
+  for (int i = 0; i < SENSOR_SUB_COUNT; i++) {
+    const sensor_bus_sub_stats_t &s = stats.sub[i];
+    printf("%-8s %6u %6u %7u %7u %6u %5u %6u fr %6u ms\n", sensor_bus_sub_name((sensor_sub_t)i),
+           seen[i].frames, s.taken, s.dropped, s.skipped, s.queued, s.high_water,
+           s.lag_frames, s.max_lag_ms);
+    bool queue_reader = i == SENSOR_SUB_STORAGE || i == SENSOR_SUB_ALERTS;
+    if (s.published != frames || s.taken + s.dropped + s.skipped + s.queued != frames ||
+        s.taken != seen[i].frames || (queue_reader && s.skipped != 0)) {
+      printf("FAIL %s: counters do not add up\n", sensor_bus_sub_name((sensor_sub_t)i));
+      ok = false;
+    }
+  }
+  if (stats.sub[SENSOR_SUB_ALERTS].dropped != 0) {
+    printf("FAIL alerts: dropped frames while storage stalled\n");
+    ok = false;
+  }
+
+  Timing inl = produce(frames, true);
+  printf("\n%-26s %10s %10s %12s %12s\n", "Stall runs", "late mean", "late max",
+         "late > 1 fr", "publish max");
+  printf("%-26s %7.2f ms %7.2f ms %12u %9.1f us\n", "in storage's task (bus)", bus.late_mean_ms,
+         bus.late_max_ms, bus.late_periods, bus.publish_max_us);
+  printf("%-26s %7.2f ms %7.2f ms %12u %12s\n", "in the acquiring loop", inl.late_mean_ms,
+         inl.late_max_ms, inl.late_periods, "-");
+  printf("\nsizeof(sensor_frame_t) %zu bytes\n", sizeof(sensor_frame_t));
+  // The host scheduler alone can make a read a period late; a stall
+  // reaching the producer makes it late by the stall
+  if (bus.late_max_ms >= g_stall_frames * g_period_ms / 2.0) {
+    printf("FAIL: a consumer delayed acquisition\n");
+    ok = false;
+  }
+  if (!ok) {
+    printf("FAIL\n");
+  }
+  return ok ? 0 : 1;
+}
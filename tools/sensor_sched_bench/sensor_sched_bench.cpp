@@ -0,0 +1,511 @@
+/**
+ * @file sensor_sched_bench.cpp
+ * @brief main/deadline_heap.h against brute force, and sensor wakeups
+ *
+ * Runs --ops random pushes and pops on DeadlineHeaps of several capacities.
+ * Each popped deadline, and the latest before a random limit, is compared
+ * with a plain list, and the tool fails on any difference.
+ *
+ * Then it replays --hours of the step cadence of main/sensor.cpp's five
+ * sensors: STCC4 reads each second, SGP4x each second, SPS30 wake, start,
+ * 8 s warmup and then 1 s reads, DPS368 every 5 s, LIS2DH12 each second.
+ * STCC4 misses its data now and then (--miss-pct) and is retried. This is
+ * run two ways. The first is the old main loop, which ran every step's
+ * check each 50 ms. The second is Sensors::update()'s scheduler, with
+ * waits longer than half of each --align rounded up to a multiple of it
+ * and the caller sleeping the wait it returns, in whole 10 ms ticks. For each it prints wakeups per hour, the share of
+ * wakeups that did any sensor work, steps run per hour and how long after
+ * the time it asked for each step ran.
+ *
+ * Each step also costs what its driver calls block for: 90 us per I2C byte
+ * at 100 kHz, and each vTaskDelay(pdMS_TO_TICKS(ms)) up to ms rounded down
+ * to a 10 ms tick. A pass is one update() call, and the tool prints the
+ * longest and the mean busy pass. The scheduler is run once more with the
+ * split-phase reads: STCC4, SGP4x and SPS30 send a command in one step and
+ * fetch its answer in a later one instead of waiting in between. The SGP4x
+ * read fails now and then (--sgp-fail-pct) and is measured again 40 ms
+ * later, and STCC4 is conditioned every 3 h (stop 1 s, condition 22 ms).
+ * A fetch that runs before its command's ready time fails the tool.
+ *
+ * Last, the split reads run as update() does now: the caller sleeps until
+ * the last deadline less than SENSOR_ON_TIME_MS after the earliest, so a
+ * second's fetches share wakeups.
+ */
+
+#include "deadline_heap.h"
+
+#include <algorithm>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// As main/sensor.cpp
+static const int64_t kMinStepMs = 50;
+static const int64_t kIdleWaitMs = 1000;
+static const int64_t kAlignMs = 1000;  // SENSOR_ALIGN_MS
+static const int64_t kOnTimeMs = 50;   // SENSOR_ON_TIME_MS
+static const int64_t kStepDone = INT64_MAX;
+static const int64_t kOldPollMs = 50;
+static const int64_t kSgpRetryMs = 40;   // SGP4X_READ_RETRY_MS
+static const int64_t kConditionMs = 3LL * 60 * 60 * 1000;
+
+// As sensor_task in main/airgradient-go.cpp
+static const int64_t kFramePeriodMs = 1000;  // SENSOR_FRAME_PERIOD_MS
+static const int64_t kFramePhaseMs = 100;    // SENSOR_FRAME_PHASE_MS
+static const int64_t kFrameEarlyMs = 50;     // SENSOR_FRAME_EARLY_MS
+
+// Blocking cost of the driver calls, in us
+static const int64_t kI2cByteUs = 90;    // 9 bits at 100 kHz
+static const int64_t kTickMs = 10;       // CONFIG_FREERTOS_HZ=100
+
+static int64_t i2c(int64_t bytes) { return bytes * kI2cByteUs; }
+static int64_t delay(int64_t ms) { return ms / kTickMs * kTickMs * 1000; }
+
+static std::mt19937 g_rng(1);
+
+static uint32_t rnd(uint32_t n) { return (uint32_t)(g_rng() % n); }
+
+template <size_t N>
+static bool verify(uint32_t ops) {
+  static DeadlineHeap<N> heap;  // Zeroed, as in SensorsState
+  std::vector<int64_t> model;
+  for (uint32_t op = 0; op < ops; op++) {
+    if (rnd(2) == 0 && model.size() < N) {
+      int64_t due = rnd(1000);
+      if (!heap.push(due, (uint8_t)(due & 0xFF))) {
+        printf("FAIL heap of %zu: push refused at %zu\n", N, model.size());
+        return false;
+      }
+      model.push_back(due);
+    } else if (!model.empty()) {
+      typename DeadlineHeap<N>::Entry e = {};
+      auto it = std::min_element(model.begin(), model.end());
+      if (!heap.pop(&e) || e.due_ms != *it || e.job != (uint8_t)(*it & 0xFF)) {
+        printf("FAIL heap of %zu: popped %lld, earliest %lld\n", N, (long long)e.due_ms,
+               (long long)*it);
+        return false;
+      }
+      model.erase(it);
+    }
+    if (heap.size() != model.size() || heap.empty() != model.empty() ||
+        (model.size() == N && heap.push(0, 0))) {
+      printf("FAIL heap of %zu: size %zu, expected %zu\n", N, heap.size(), model.size());
+      return false;
+    }
+    if (!model.empty() && heap.top().due_ms != *std::min_element(model.begin(), model.end())) {
+      printf("FAIL heap of %zu: top differs\n", N);
+      return false;
+    }
+    if (!model.empty()) {
+      int64_t limit = heap.top().due_ms + 1 + rnd(200);
+      int64_t want = heap.top().due_ms;
+      for (int64_t due : model) {
+        want = due < limit ? std::max(want, due) : want;
+      }
+      if (heap.latest_before(limit) != want) {
+        printf("FAIL heap of %zu: latest before %lld is %lld, expected %lld\n", N,
+               (long long)limit, (long long)heap.latest_before(limit), (long long)want);
+        return false;
+      }
+    }
+  }
+  printf("heap of %-3zu %u ops ok\n", N, ops);
+  return true;
+}
+
+// Model of one sensor's steps: when it is next due after running at now
+struct Sensor {
+  enum Kind { STCC4, SGP4X, SPS30, DPS368, LIS2DH12 } kind;
+  int state;
+  int64_t state_time;
+  int64_t last;
+  int phase;               // Split reads: 0 idle, then one per command out
+  int64_t started;         // Grid time of the read in flight
+  int64_t fetch_at;
+  bool retried;
+  int64_t last_condition;
+};
+
+struct Stats {
+  uint64_t wakeups = 0;
+  uint64_t busy = 0;   // Wakeups that ran a step; the rest only slept again
+  int64_t elapsed_ms = 0;
+  uint64_t steps = 0;
+  int64_t late_max = 0;
+  double late_sum = 0.0;
+  int64_t pass_max_us = 0;
+  double pass_sum_us = 0.0;  // Over busy passes
+};
+
+static uint32_t g_miss_pct = 5;
+static uint32_t g_sgp_fail_pct = 1;
+static uint64_t g_early_fetches = 0;  // Fetches run before the sensor was ready
+
+// A fetch at run, due at fetch_at
+static void fetched(const Sensor *s, int64_t run) {
+  g_early_fetches += run < s->fetch_at;
+}
+
+// The STCC4 read, as update_stcc4(): blocking, or split when split is set.
+// now is the step's grid time and run when it really runs. Returns the next
+// due time.
+static int64_t step_stcc4(Sensor *s, int64_t now, int64_t run, bool split, bool *worked,
+                          int64_t *cost) {
+  // INIT, STARTING (100 ms), MEASURING (1 s reads), CONDITIONING
+  if (s->state == 0) {
+    s->state = 1;
+    s->state_time = now;
+    s->last_condition = now;
+    *worked = true;
+  } else if (s->state == 1 && now - s->state_time >= 100) {
+    s->state = 2;
+    s->last = now;
+    *cost += i2c(3);
+    *worked = true;
+  } else if (s->state == 3 && now - s->state_time >= 100) {
+    *cost += i2c(3);  // Conditioning command
+    s->last_condition = now;
+    s->state = 1;
+    s->state_time = run + 22;
+    *worked = true;
+  } else if (s->state == 2 && s->phase == 1) {
+    *worked = true;
+    fetched(s, run);
+    s->phase = 0;
+    *cost += i2c(13);
+    if (rnd(100) >= g_miss_pct) {
+      s->last = s->started;
+      if (now - s->last_condition >= kConditionMs) {
+        *cost += i2c(3);  // Stop; the sensor is busy 1 s
+        s->state = 3;
+        s->state_time = run + 1000;
+      }
+    }
+  } else if (s->state == 2 && now - s->last >= 1000) {
+    *worked = true;
+    if (split) {
+      *cost += i2c(3);
+      s->phase = 1;
+      s->started = now;
+      s->fetch_at = run + 1;
+    } else {
+      *cost += i2c(3) + delay(1) + i2c(13);
+      if (rnd(100) >= g_miss_pct) {
+        s->last = now;
+        if (now - s->last_condition >= kConditionMs) {
+          // Stop, 100 ms, condition, 100 ms, start, all in this step
+          *cost += i2c(3) + delay(1000) + delay(100) + i2c(3) + delay(22) + delay(100) + i2c(3);
+          s->last_condition = now;
+        }
+      }
+    }
+  }
+  if (s->state == 0) return now;
+  if (s->state == 1 || s->state == 3) return s->state_time + 100;
+  return s->phase == 1 ? s->fetch_at : s->last + 1000;
+}
+
+// The SGP4x read, as update_sgp4x()
+static int64_t step_sgp4x(Sensor *s, int64_t now, int64_t run, bool split, bool *worked,
+                          int64_t *cost) {
+  if (!split) {
+    if (now - s->last < 1000) return s->last + 1000;
+    s->last = now;
+    *worked = true;
+    // Command, conversion, read; a failed read is retried 5 times 2 ms
+    // apart, then the whole measurement once more 40 ms later
+    *cost += i2c(9) + delay(50);
+    if (rnd(100) < g_sgp_fail_pct) {
+      *cost += 6 * (i2c(1) + delay(2)) + delay(kSgpRetryMs) + i2c(9) + delay(50);
+    }
+    *cost += i2c(7) + delay(2);
+    return s->last + 1000;
+  }
+  // phase 0 idle, 1 fetch due, 2 retry due
+  if (s->phase == 1) {
+    *worked = true;
+    fetched(s, run);
+    if (s->retried || rnd(100) >= g_sgp_fail_pct) {
+      *cost += i2c(7);
+      s->phase = 0;
+      return s->last + 1000;
+    }
+    *cost += i2c(1);
+    s->retried = true;
+    s->phase = 2;
+    return run + kSgpRetryMs;
+  }
+  if (s->phase == 0) {
+    if (now - s->last < 1000) return s->last + 1000;
+    s->last = now;
+    s->retried = false;
+  }
+  *worked = true;
+  *cost += i2c(9);
+  s->phase = 1;
+  s->fetch_at = run + 50;
+  return s->fetch_at;
+}
+
+// The SPS30 read, as update_sps30()
+static int64_t step_sps30(Sensor *s, int64_t now, int64_t run, bool split, bool *worked,
+                          int64_t *cost) {
+  // INIT, START (100 ms), WARMUP (8 s), MEASURING (1 s reads)
+  if (s->state == 0) {
+    s->state = 1;
+    s->state_time = split ? run + 100 : now;
+    *cost += i2c(3) + (split ? 0 : delay(100));
+    *worked = true;
+  } else if (s->state == 1 && now - s->state_time >= 100) {
+    s->state = 2;
+    s->state_time = run;
+    *cost += i2c(6) + delay(20);
+    *worked = true;
+  } else if (s->state == 2 && now - s->state_time >= 8000) {
+    s->state = 3;
+    s->last = now;
+    *worked = true;
+  } else if (s->state == 3 && split && s->phase != 0 && now >= s->fetch_at) {
+    // Data-ready flag, then the read command; or the 60 data bytes
+    *worked = true;
+    fetched(s, run);
+    *cost += s->phase == 1 ? i2c(4) + i2c(3) : i2c(61);
+    s->fetch_at = run + 10;
+    s->phase = s->phase == 1 ? 2 : 0;
+  } else if (s->state == 3 && now - s->last >= 1000) {
+    s->last = now;
+    *worked = true;
+    if (split) {
+      *cost += i2c(3);
+      s->phase = 1;
+      s->fetch_at = run + 5;
+    } else {
+      *cost += i2c(3) + delay(5) + i2c(4) + i2c(3) + delay(10) + i2c(61);
+    }
+  }
+  if (s->state == 1) return s->state_time + 100;
+  if (s->state == 2) return s->state_time + 8000;
+  return s->phase != 0 ? s->fetch_at : s->last + 1000;
+}
+
+// Run sensor s as of now, at run, if its own checks say so, as update_*() do.
+// Returns the next due time, counts the step if it did anything and adds
+// what it blocked for to *cost.
+static int64_t step(Sensor *s, int64_t now, int64_t run, bool split, bool *worked,
+                    int64_t *cost) {
+  *worked = false;
+  switch (s->kind) {
+    case Sensor::STCC4:
+      return step_stcc4(s, now, run, split, worked, cost);
+    case Sensor::SGP4X:
+      return step_sgp4x(s, now, run, split, worked, cost);
+    case Sensor::SPS30:
+      return step_sps30(s, now, run, split, worked, cost);
+    default: {
+      int64_t every = s->kind == Sensor::DPS368 ? 5000 : 1000;
+      if (now - s->last >= every) {
+        s->last = now;
+        *worked = true;
+        *cost += i2c(s->kind == Sensor::DPS368 ? 16 : 17);
+      }
+      return s->last + every;
+    }
+  }
+}
+
+static void count_pass(Stats *st, bool any, int64_t cost) {
+  st->busy += any;
+  if (any) {
+    st->pass_max_us = std::max(st->pass_max_us, cost);
+    st->pass_sum_us += cost;
+  }
+}
+
+static void reset(std::vector<Sensor> *sensors) {
+  sensors->clear();
+  for (int k = Sensor::STCC4; k <= Sensor::LIS2DH12; k++) {
+    sensors->push_back({(Sensor::Kind)k, 0, 0, 0, 0, 0, 0, false, 0});
+  }
+}
+
+// The old main loop: every check every 50 ms
+static Stats run_poll(int64_t end_ms, int64_t start_ms) {
+  std::vector<Sensor> sensors;
+  reset(&sensors);
+  std::vector<int64_t> want(sensors.size(), start_ms);
+  Stats st;
+  st.elapsed_ms = end_ms - start_ms;
+  for (int64_t now = start_ms; now < end_ms; now += kOldPollMs) {
+    st.wakeups++;
+    bool any = false;
+    int64_t cost = 0;
+    for (size_t i = 0; i < sensors.size(); i++) {
+      bool worked = false;
+      int64_t next = step(&sensors[i], now, now, false, &worked, &cost);
+      if (worked) {
+        any = true;
+        st.steps++;
+        int64_t late = now - want[i];
+        st.late_max = std::max(st.late_max, late);
+        st.late_sum += late;
+      }
+      want[i] = next;
+    }
+    count_pass(&st, any, cost);
+  }
+  return st;
+}
+
+// Sensors::update() with the caller sleeping the wait it returns; with merge
+// the wait runs on to the last deadline within kOnTimeMs of the earliest.
+// With frames the caller is sensor_task, which also wakes to publish a frame
+// a second unless a pass falls within kFrameEarlyMs before it.
+static Stats run_sched(int64_t end_ms, int64_t start_ms, int64_t align_ms, bool split,
+                       bool merge, bool frames) {
+  std::vector<Sensor> sensors;
+  reset(&sensors);
+  std::vector<int64_t> want(sensors.size(), start_ms);
+  DeadlineHeap<8> heap = {};
+  for (uint8_t i = 0; i < sensors.size(); i++) {
+    heap.push(start_ms, i);
+  }
+  Stats st;
+  st.elapsed_ms = end_ms - start_ms;
+  int64_t next_frame = 0;
+  for (int64_t now = start_ms; now < end_ms;) {
+    st.wakeups++;
+    bool any = false;
+    int64_t cost = 0;
+    DeadlineHeap<8>::Entry e;
+    while (!heap.empty() && heap.top().due_ms <= now) {
+      heap.pop(&e);
+      bool worked = false;
+      const int64_t step_ms = now - e.due_ms < kOnTimeMs ? e.due_ms : now;
+      int64_t next = step(&sensors[e.job], step_ms, now, split, &worked, &cost);
+      if (worked) {
+        any = true;
+        st.steps++;
+        int64_t late = now - want[e.job];
+        st.late_max = std::max(st.late_max, late);
+        st.late_sum += late;
+      }
+      if (next == kStepDone) {
+        continue;
+      }
+      want[e.job] = next;
+      if (next <= now) {
+        next = now + kMinStepMs;
+      } else if (next - now > align_ms / 2) {
+        next = (next + align_ms - 1) / align_ms * align_ms;
+      }
+      heap.push(next, e.job);
+    }
+    count_pass(&st, any, cost);
+    int64_t wait = kIdleWaitMs;
+    if (!heap.empty()) {
+      wait = (merge ? heap.latest_before(heap.top().due_ms + kOnTimeMs) : heap.top().due_ms) - now;
+    }
+    if (frames) {
+      if (now >= next_frame - kFrameEarlyMs) {
+        next_frame = (now / kFramePeriodMs + 1) * kFramePeriodMs + kFramePhaseMs;
+      }
+      wait = std::min(wait, next_frame - now);
+    }
+    // vTaskDelay sleeps whole ticks
+    now += std::max<int64_t>((wait + kTickMs - 1) / kTickMs * kTickMs, kTickMs);
+  }
+  return st;
+}
+
+static void print(const char *name, const Stats &st, double hours) {
+  printf("%-30s %6.0f wakeups/h  %5.1f%% idle  %5.2f%% in passes  %6.0f steps/h"
+         "  late mean %5.1f ms, max %4lld ms  pass max %7.1f ms, mean %5.2f ms\n",
+         name, st.wakeups / hours, st.wakeups ? 100.0 * (st.wakeups - st.busy) / st.wakeups : 0.0,
+         st.pass_sum_us / 10.0 / st.elapsed_ms, st.steps / hours, st.steps ? st.late_sum / st.steps : 0.0, (long long)st.late_max,
+         st.pass_max_us / 1000.0, st.busy ? st.pass_sum_us / st.busy / 1000.0 : 0.0);
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--ops N] [--hours N] [--miss-pct N] [--sgp-fail-pct N]\n"
+          "          [--align MS[,MS...]]\n"
+          "  Checks DeadlineHeap against brute force over --ops random operations,\n"
+          "  then counts sensor wakeups and update() pass times over --hours for\n"
+          "  the old 50 ms poll, for the scheduler at each --align, and for the\n"
+          "  scheduler with split-phase reads, without and with merged fetches.\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  uint32_t ops = 200000;
+  uint32_t hours = 24;
+  std::vector<int64_t> aligns = {1, 250, kAlignMs};
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (strcmp(argv[i], "--ops") == 0) {
+      ops = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--hours") == 0) {
+      hours = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--miss-pct") == 0) {
+      g_miss_pct = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--sgp-fail-pct") == 0) {
+      g_sgp_fail_pct = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--align") == 0) {
+      aligns.clear();
+      for (char *p = argv[++i]; *p;) {
+        aligns.push_back((int64_t)strtoll(p, &p, 0));
+        if (*p == ',') {
+          p++;
+        }
+      }
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (hours == 0 || g_miss_pct > 100 || g_sgp_fail_pct > 100 ||
+      std::any_of(aligns.begin(), aligns.end(), [](int64_t a) { return a < 1; })) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  bool ok = true;
+  ok = verify<2>(ops) && ok;
+  ok = verify<5>(ops) && ok;
+  ok = verify<64>(ops) && ok;
+  ok = verify<255>(ops) && ok;
+  printf("\n");
+
+  // The device starts its sensors a few seconds after boot
+  const int64_t start_ms = 3217;
+  const int64_t end_ms = start_ms + (int64_t)hours * 3600 * 1000;
+  print("poll every 50 ms", run_poll(end_ms, start_ms), hours);
+  for (int64_t align : aligns) {
+    char name[32];
+    snprintf(name, sizeof(name), "scheduler, align %lld", (long long)align);
+    print(name, run_sched(end_ms, start_ms, align, false, false, false), hours);
+  }
+  print("split reads, align 1000", run_sched(end_ms, start_ms, kAlignMs, true, false, false),
+        hours);
+  print("split reads, merged fetches", run_sched(end_ms, start_ms, kAlignMs, true, true, false),
+        hours);
+  Stats device = run_sched(end_ms, start_ms, kAlignMs, true, true, true);
+  print("sensor_task, with frames", device, hours);
+  printf("\nsensor_task: %.2f wakeups/s, %.1fx fewer than the 50 ms poll\n",
+         device.wakeups / hours / 3600.0, 3600.0 * 1000 / kOldPollMs / (device.wakeups / hours));
+  if (g_early_fetches != 0) {
+    printf("FAIL: %llu fetches ran before their sensor was ready\n",
+           (unsigned long long)g_early_fetches);
+    ok = false;
+  }
+  if (!ok) {
+    printf("FAIL\n");
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,671 @@
+/**
+ * @file sensors_export.cpp
+ * @brief Host tool: export sensors.bin dumps to CSV and packed columns
+ *
+ * Usage:
+ *   sensors_export [--format auto|ring|flat] [--csv FILE|-] [--columns DIR]
+ *                  INPUT...
+ *
+ * Inputs are mmapped and walked once. Two layouts are understood:
+ *   ring  sensors.bin as written by log storage: 2 KB slots, each a slot
+ *         header plus a RAW or DELTA record_codec block (log_format.h) in
+ *         record format 1 or 2. Concatenated dumps work as long as each is
+ *         whole slots.
+ *   flat  packed 28-byte format 1 records back to back (older firmware,
+ *         sensors.bak).
+ * auto picks ring when the file is whole slots and starts with a valid slot
+ * header.
+ *
+ * Records go out in file order (a ring is not in time order once it has
+ * wrapped; sort on segment or timestamp_ms downstream). RAW records must
+ * pass their own CRC16; DELTA blocks are checked by their block CRC. Bad
+ * slots, blocks and records are skipped and reported on stderr as merged
+ * byte ranges, never fatal.
+ *
+ * --csv writes one row per record. --columns writes DIR/<field>.<type>, one
+ * little-endian array per field (u16/i16/u32/i32) plus segment.u32
+ * (0xFFFFFFFF for flat input), and DIR/columns.txt listing name, type and
+ * row count. Fields a block's schema does not store export as 0.
+ * With neither option, CSV goes to stdout.
+ */
+
+#include "crc16.h"
+#include "log_format.h"
+#include "log_storage.h"
+#include "record_codec.h"
+
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr size_t kCoreBytes = sizeof(sensor_record_core_t);
+constexpr size_t kCrcBytes = SENSOR_RECORD_CRC_BYTES;
+constexpr size_t kBlockBytes = LOG_SEGMENT_BYTES - sizeof(slot_header_t);
+constexpr uint32_t kNoSegment = 0xFFFFFFFF;
+
+struct Column {
+  const char *name;
+  const char *type;
+  size_t offset;  // In sensor_record_t
+  size_t size;
+  bool is_signed;
+  int field;  // log_field_id_t, -1 for timestamp_ms
+};
+
+// Format 1 columns first, in their original CSV order
+#define COLUMN(name, type, is_signed, field)                                \
+  {#name, type, offsetof(sensor_record_t, name),                            \
+   sizeof(((sensor_record_t *)nullptr)->name), is_signed, field}
+#define FIELD(name, type, is_signed) COLUMN(name, type, is_signed, LOG_FIELD_##name)
+const Column kColumns[] = {
+    COLUMN(timestamp_ms, "u32", false, -1), FIELD(co2_ppm, "u16", false),
+    FIELD(temp_c_x100, "i16", true),        FIELD(rh_x100, "i16", true),
+    FIELD(pm25_x10, "u16", false),          FIELD(pm10_x10, "u16", false),
+    FIELD(pm1_x10, "u16", false),           FIELD(voc_index, "u16", false),
+    FIELD(nox_index, "u16", false),         FIELD(pressure_pa, "u32", false),
+    FIELD(pm4_x10, "u16", false),           FIELD(pn05_cm3, "u16", false),
+    FIELD(pn10_cm3, "u16", false),          FIELD(pn25_cm3, "u16", false),
+    FIELD(accel_x_mg, "i16", true),         FIELD(accel_y_mg, "i16", true),
+    FIELD(accel_z_mg, "i16", true),         FIELD(lat_e7, "i32", true),
+    FIELD(lon_e7, "i32", true),
+};
+#undef FIELD
+#undef COLUMN
+constexpr size_t kColumnCount = sizeof(kColumns) / sizeof(kColumns[0]);
+static_assert(kColumnCount == 1 + LOG_FIELD_COUNT, "a log field has no column");
+
+// Where each column sits in a run of fixed-stride records; -1 if absent
+struct Layout {
+  size_t stride;
+  int offset[kColumnCount];
+};
+
+// Decoded sensor_record_t
+Layout record_layout() {
+  Layout layout = {sizeof(sensor_record_t), {}};
+  for (size_t c = 0; c < kColumnCount; c++) {
+    layout.offset[c] = (int)kColumns[c].offset;
+  }
+  return layout;
+}
+
+// Packed format 1 records (sensor_record_core_t)
+Layout core_layout() {
+  Layout layout = {kCoreBytes, {}};
+  for (size_t c = 0; c < kColumnCount; c++) {
+    bool in_core = kColumns[c].offset + kColumns[c].size <= kCoreBytes;
+    layout.offset[c] = in_core ? (int)kColumns[c].offset : -1;
+  }
+  return layout;
+}
+
+// Format 2 fixed-width records, read in place through a record view
+Layout view_layout(const record_view_t &view) {
+  Layout layout = {view.stride, {}};
+  for (size_t c = 0; c < kColumnCount; c++) {
+    int field = kColumns[c].field;
+    layout.offset[c] = field < 0 ? 0 : view.pos[field] ? view.pos[field] : -1;
+  }
+  return layout;
+}
+
+// ============================================================================
+// Output
+// ============================================================================
+
+// AoS -> SoA for one field: a fixed-stride load per element, no branches,
+// so the compiler can vectorize it
+template <typename T>
+void gather(T *dst, const uint8_t *src, size_t n, size_t stride, size_t offset) {
+  const uint8_t *p = src + offset;
+  for (size_t i = 0; i < n; i++) {
+    memcpy(&dst[i], p + i * stride, sizeof(T));
+  }
+}
+
+char *put_u32(char *p, uint32_t v) {
+  char tmp[10];
+  int n = 0;
+  do {
+    tmp[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  while (n) {
+    *p++ = tmp[--n];
+  }
+  return p;
+}
+
+char *put_i32(char *p, int32_t v) {
+  if (v < 0) {
+    *p++ = '-';
+    return put_u32(p, (uint32_t)0 - (uint32_t)v);
+  }
+  return put_u32(p, (uint32_t)v);
+}
+
+class Exporter {
+ public:
+  static constexpr size_t kBatchRecords = 1 << 16;
+
+  ~Exporter() { close(); }
+
+  bool open(const char *csv_path, const char *columns_dir) {
+    segment_.resize(kBatchRecords);
+    for (size_t c = 0; c < kColumnCount; c++) {
+      columns_[c].resize(kBatchRecords * kColumns[c].size);
+    }
+
+    if (csv_path) {
+      csv_ = strcmp(csv_path, "-") == 0 ? stdout : fopen(csv_path, "wb");
+      if (!csv_) {
+        fprintf(stderr, "%s: %s\n", csv_path, strerror(errno));
+        return false;
+      }
+      csv_buf_.resize(1 << 20);
+      fputs("segment", csv_);
+      for (const Column &col : kColumns) {
+        fprintf(csv_, ",%s", col.name);
+      }
+      fputc('\n', csv_);
+    }
+
+    if (columns_dir) {
+      if (mkdir(columns_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: %s\n", columns_dir, strerror(errno));
+        return false;
+      }
+      dir_ = columns_dir;
+      segment_file_ = fopen((dir_ + "/segment.u32").c_str(), "wb");
+      bool ok = segment_file_ != nullptr;
+      for (size_t c = 0; c < kColumnCount && ok; c++) {
+        std::string path = dir_ + "/" + kColumns[c].name + "." + kColumns[c].type;
+        column_files_[c] = fopen(path.c_str(), "wb");
+        ok = column_files_[c] != nullptr;
+      }
+      if (!ok) {
+        fprintf(stderr, "%s: cannot create column files: %s\n", columns_dir,
+                strerror(errno));
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void add(const uint8_t *records, const Layout &layout, size_t n, uint32_t segment) {
+    while (n > 0) {
+      size_t take = kBatchRecords - count_;
+      if (take > n) {
+        take = n;
+      }
+      for (size_t i = 0; i < take; i++) {
+        segment_[count_ + i] = segment;
+      }
+      for (size_t c = 0; c < kColumnCount; c++) {
+        uint8_t *dst = &columns_[c][count_ * kColumns[c].size];
+        if (layout.offset[c] < 0) {
+          memset(dst, 0, take * kColumns[c].size);
+        } else if (kColumns[c].size == 2) {
+          gather((uint16_t *)dst, records, take, layout.stride, layout.offset[c]);
+        } else {
+          gather((uint32_t *)dst, records, take, layout.stride, layout.offset[c]);
+        }
+      }
+      count_ += take;
+      records += take * layout.stride;
+      n -= take;
+      if (count_ == kBatchRecords) {
+        flush();
+      }
+    }
+  }
+
+  bool close() {
+    flush();
+    bool ok = !failed_;
+    if (csv_) {
+      ok = fflush(csv_) == 0 && ok;
+      if (csv_ != stdout) {
+        ok = fclose(csv_) == 0 && ok;
+      }
+      csv_ = nullptr;
+    }
+    if (segment_file_) {
+      ok = fclose(segment_file_) == 0 && ok;
+      segment_file_ = nullptr;
+      for (FILE *&f : column_files_) {
+        ok = fclose(f) == 0 && ok;
+        f = nullptr;
+      }
+      FILE *manifest = fopen((dir_ + "/columns.txt").c_str(), "w");
+      if (manifest) {
+        fprintf(manifest, "segment u32 %llu\n", (unsigned long long)total_);
+        for (const Column &col : kColumns) {
+          fprintf(manifest, "%s %s %llu\n", col.name, col.type,
+                  (unsigned long long)total_);
+        }
+        ok = fclose(manifest) == 0 && ok;
+      } else {
+        ok = false;
+      }
+    }
+    return ok;
+  }
+
+  uint64_t records() const { return total_ + count_; }
+
+ private:
+  uint32_t load(size_t c, size_t row) const {
+    const uint8_t *p = &columns_[c][row * kColumns[c].size];
+    if (kColumns[c].size == 2) {
+      uint16_t v;
+      memcpy(&v, p, sizeof(v));
+      return kColumns[c].is_signed ? (uint32_t)(int32_t)(int16_t)v : v;
+    }
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  void write_csv() {
+    char *buf = csv_buf_.data();
+    char *end = buf + csv_buf_.size() - 256;  // Room for one full row
+    char *p = buf;
+    for (size_t row = 0; row < count_; row++) {
+      p = put_u32(p, segment_[row]);
+      for (size_t c = 0; c < kColumnCount; c++) {
+        *p++ = ',';
+        uint32_t v = load(c, row);
+        p = kColumns[c].is_signed ? put_i32(p, (int32_t)v) : put_u32(p, v);
+      }
+      *p++ = '\n';
+      if (p >= end) {
+        failed_ |= fwrite(buf, 1, p - buf, csv_) != (size_t)(p - buf);
+        p = buf;
+      }
+    }
+    failed_ |= fwrite(buf, 1, p - buf, csv_) != (size_t)(p - buf);
+  }
+
+  void flush() {
+    if (count_ == 0) {
+      return;
+    }
+    if (csv_) {
+      write_csv();
+    }
+    if (segment_file_) {
+      failed_ |= fwrite(segment_.data(), sizeof(uint32_t), count_, segment_file_) != count_;
+      for (size_t c = 0; c < kColumnCount; c++) {
+        failed_ |= fwrite(columns_[c].data(), kColumns[c].size, count_,
+                          column_files_[c]) != count_;
+      }
+    }
+    total_ += count_;
+    count_ = 0;
+  }
+
+  FILE *csv_ = nullptr;
+  std::vector<char> csv_buf_;
+  std::string dir_;
+  FILE *segment_file_ = nullptr;
+  FILE *column_files_[kColumnCount] = {};
+  std::vector<uint32_t> segment_;
+  std::vector<uint8_t> columns_[kColumnCount];
+  size_t count_ = 0;
+  uint64_t total_ = 0;
+  bool failed_ = false;
+};
+
+// ============================================================================
+// Corrupt range reporting
+// ============================================================================
+
+// Adjacent bad byte ranges are merged into one report line
+class CorruptLog {
+ public:
+  void begin(const char *file) {
+    end_file();
+    file_ = file;
+  }
+
+  void mark(uint64_t start, uint64_t end, const char *reason) {
+    if (open_ && start == end_) {
+      end_ = end;
+      return;
+    }
+    end_range();
+    start_ = start;
+    end_ = end;
+    reason_ = reason;
+    open_ = true;
+  }
+
+  void end_file() { end_range(); }
+
+  uint64_t ranges() const { return ranges_; }
+  uint64_t bytes() const { return bytes_; }
+
+ private:
+  void end_range() {
+    if (!open_) {
+      return;
+    }
+    fprintf(stderr, "%s: corrupt bytes %llu-%llu (%llu bytes, %s)\n", file_,
+            (unsigned long long)start_, (unsigned long long)end_,
+            (unsigned long long)(end_ - start_), reason_);
+    ranges_++;
+    bytes_ += end_ - start_;
+    open_ = false;
+  }
+
+  const char *file_ = "";
+  uint64_t start_ = 0;
+  uint64_t end_ = 0;
+  const char *reason_ = "";
+  bool open_ = false;
+  uint64_t ranges_ = 0;
+  uint64_t bytes_ = 0;
+};
+
+// ============================================================================
+// Decoding
+// ============================================================================
+
+bool all_erased(const uint8_t *p, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (p[i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Record format of the slot's block, or 0 if the slot header is bad
+int slot_format(const uint8_t *slot) {
+  slot_header_t hdr;
+  memcpy(&hdr, slot, sizeof(hdr));
+  if (hdr.crc16 != crc16_ccitt(slot, sizeof(hdr) - sizeof(uint16_t))) {
+    return 0;
+  }
+  return hdr.magic == LOG_SLOT_MAGIC      ? RECORD_FORMAT_1
+         : hdr.magic == LOG_SLOT_MAGIC_V2 ? RECORD_FORMAT_2
+                                          : 0;
+}
+
+// Packed fixed-width records at file offset `offset`, each ending in a CRC16
+// of the bytes before it: validate every CRC first, then export the valid
+// runs in as few batch copies as possible
+void export_packed(const uint8_t *p, size_t n, const Layout &layout, uint64_t offset,
+                   uint32_t segment, std::vector<uint8_t> &valid, Exporter &out,
+                   CorruptLog &bad) {
+  const size_t stride = layout.stride;
+  const size_t crc_bytes = stride - sizeof(uint16_t);
+  valid.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    const uint8_t *rec = p + i * stride;
+    uint16_t stored;
+    memcpy(&stored, rec + crc_bytes, sizeof(stored));
+    valid[i] = crc16_ccitt(rec, crc_bytes) == stored;
+  }
+
+  size_t run = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (!valid[i]) {
+      out.add(p + run * stride, layout, i - run, segment);
+      bad.mark(offset + i * stride, offset + (i + 1) * stride, "record CRC");
+      run = i + 1;
+    }
+  }
+  out.add(p + run * stride, layout, n - run, segment);
+}
+
+void export_ring(const uint8_t *data, size_t size, Exporter &out, CorruptLog &bad) {
+  std::vector<uint8_t> valid;
+  std::vector<sensor_record_t> decoded(kBlockBytes);
+  const Layout decoded_layout = record_layout();
+  const Layout packed_layout = core_layout();
+  const size_t raw_capacity = record_codec_raw_capacity(kBlockBytes);
+
+  size_t off = 0;
+  for (; off + LOG_SEGMENT_BYTES <= size; off += LOG_SEGMENT_BYTES) {
+    const uint8_t *slot = data + off;
+    int format = slot_format(slot);
+    if (format == 0) {
+      bad.mark(off, off + LOG_SEGMENT_BYTES,
+               all_erased(slot, LOG_SEGMENT_BYTES) ? "erased slot" : "slot header");
+      continue;
+    }
+    uint32_t segment;
+    memcpy(&segment, slot, sizeof(segment));
+    const uint8_t *block = slot + sizeof(slot_header_t);
+    uint64_t block_off = off + sizeof(slot_header_t);
+    const bool trailer_erased =
+        all_erased(block + kBlockBytes - sizeof(record_block_trailer_t),
+                   sizeof(record_block_trailer_t));
+
+    record_decoder_t dec;
+    bool sealed;
+    bool open_delta;
+    if (format == RECORD_FORMAT_2) {
+      // The block header names the encoding and schema
+      sealed = record_decoder_init_sealed(&dec, RECORD_ENCODING_DELTA,
+                                          RECORD_FORMAT_2, block, kBlockBytes);
+      if (dec.bad_header) {
+        bad.mark(off, off + LOG_SEGMENT_BYTES, "block header");
+        continue;
+      }
+      record_view_t view;
+      if (record_decoder_view(&dec, &view)) {
+        // RAW: export the fixed-width records in place
+        export_packed(view.records, view.count, view_layout(view),
+                      block_off + (view.records - block), segment, valid, out, bad);
+        continue;
+      }
+      open_delta = !sealed && trailer_erased;
+      if (!sealed && !open_delta) {
+        bad.mark(off, off + LOG_SEGMENT_BYTES, "delta block CRC");
+        continue;
+      }
+      if (open_delta) {
+        record_decoder_init(&dec, RECORD_ENCODING_DELTA, RECORD_FORMAT_2, block,
+                            kBlockBytes);
+      }
+    } else {
+      sealed = record_decoder_init_sealed(&dec, RECORD_ENCODING_DELTA,
+                                          RECORD_FORMAT_1, block, kBlockBytes);
+      open_delta = !sealed && record_codec_is_delta(block) && trailer_erased;
+    }
+
+    // A DELTA header with a bad trailer is a damaged delta block, unless the
+    // bytes happen to be a RAW block whose first record checks out
+    if (!sealed && !open_delta && record_codec_is_delta(block)) {
+      uint16_t stored;
+      memcpy(&stored, block + kCrcBytes, sizeof(stored));
+      if (crc16_ccitt(block, kCrcBytes) != stored) {
+        bad.mark(off, off + LOG_SEGMENT_BYTES, "delta block CRC");
+        continue;
+      }
+    }
+
+    if (!sealed && !open_delta) {
+      // RAW: records up to the first erased one (end of an open block)
+      size_t n = 0;
+      while (n < raw_capacity && !all_erased(block + n * kCoreBytes, kCoreBytes)) {
+        n++;
+      }
+      export_packed(block, n, packed_layout, block_off, segment, valid, out, bad);
+      continue;
+    }
+
+    if (open_delta && format == RECORD_FORMAT_1) {
+      record_decoder_init(&dec, RECORD_ENCODING_DELTA, RECORD_FORMAT_1, block,
+                          kBlockBytes);
+    }
+    size_t n = 0;
+    int ret;
+    while ((ret = record_decoder_next(&dec, &decoded[n])) == 1) {
+      n++;
+    }
+    out.add((const uint8_t *)decoded.data(), decoded_layout, n, segment);
+    // An open block ends where the 0xFF fill starts; anything else is damage
+    if (ret < 0 && !(open_delta && block[dec.pos] == 0xFF)) {
+      bad.mark(block_off + dec.pos, off + LOG_SEGMENT_BYTES, "delta stream");
+    }
+  }
+  if (off < size) {
+    bad.mark(off, size, "partial slot");
+  }
+}
+
+void export_flat(const uint8_t *data, size_t size, Exporter &out, CorruptLog &bad) {
+  std::vector<uint8_t> valid;
+  const Layout layout = core_layout();
+  const size_t kChunk = Exporter::kBatchRecords;
+  size_t total = size / kCoreBytes;
+  for (size_t first = 0; first < total; first += kChunk) {
+    size_t n = total - first < kChunk ? total - first : kChunk;
+    export_packed(data + first * kCoreBytes, n, layout, first * kCoreBytes,
+                  kNoSegment, valid, out, bad);
+  }
+  if (total * kCoreBytes < size) {
+    bad.mark(total * kCoreBytes, size, "partial record");
+  }
+}
+
+enum class Format { kAuto, kRing, kFlat };
+
+bool export_file(const char *path, Format format, Exporter &out, CorruptLog &bad,
+                 uint64_t *bytes) {
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    ::close(fd);
+    return false;
+  }
+  size_t size = (size_t)st.st_size;
+  if (size == 0) {
+    ::close(fd);
+    return true;
+  }
+  void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: mmap: %s\n", path, strerror(errno));
+    return false;
+  }
+  madvise(map, size, MADV_SEQUENTIAL);
+  const uint8_t *data = (const uint8_t *)map;
+
+  if (format == Format::kAuto) {
+    format = (size % LOG_SEGMENT_BYTES == 0 && slot_format(data) != 0)
+                 ? Format::kRing
+                 : Format::kFlat;
+  }
+  bad.begin(path);
+  if (format == Format::kRing) {
+    export_ring(data, size, out, bad);
+  } else {
+    export_flat(data, size, out, bad);
+  }
+  bad.end_file();
+
+  munmap(map, size);
+  *bytes += size;
+  return true;
+}
+
+void usage(void) {
+  fprintf(stderr,
+          "usage: sensors_export [--format auto|ring|flat] [--csv FILE|-] "
+          "[--columns DIR] INPUT...\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Format format = Format::kAuto;
+  const char *csv_path = nullptr;
+  const char *columns_dir = nullptr;
+  std::vector<const char *> inputs;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--format") == 0 && has_value) {
+      const char *v = argv[++i];
+      if (strcmp(v, "auto") == 0) {
+        format = Format::kAuto;
+      } else if (strcmp(v, "ring") == 0) {
+        format = Format::kRing;
+      } else if (strcmp(v, "flat") == 0) {
+        format = Format::kFlat;
+      } else {
+        usage();
+        return 2;
+      }
+    } else if (strcmp(arg, "--csv") == 0 && has_value) {
+      csv_path = argv[++i];
+    } else if (strcmp(arg, "--columns") == 0 && has_value) {
+      columns_dir = argv[++i];
+    } else if (arg[0] == '-' && arg[1] != '\0') {
+      usage();
+      return 2;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+  if (inputs.empty()) {
+    usage();
+    return 2;
+  }
+  if (!csv_path && !columns_dir) {
+    csv_path = "-";
+  }
+
+  Exporter out;
+  if (!out.open(csv_path, columns_dir)) {
+    return 1;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  CorruptLog bad;
+  uint64_t bytes = 0;
+  int failed_inputs = 0;
+  for (const char *path : inputs) {
+    if (!export_file(path, format, out, bad, &bytes)) {
+      failed_inputs++;
+    }
+  }
+  uint64_t records = out.records();
+  if (!out.close()) {
+    fprintf(stderr, "write error on output\n");
+    return 1;
+  }
+  double secs =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  fprintf(stderr,
+          "%llu records from %llu bytes in %.2f s (%.0f MB/s); "
+          "%llu corrupt ranges, %llu bytes skipped\n",
+          (unsigned long long)records, (unsigned long long)bytes, secs,
+          secs > 0 ? bytes / secs / 1e6 : 0.0, (unsigned long long)bad.ranges(),
+          (unsigned long long)bad.bytes());
+  return failed_inputs ? 1 : 0;
+}
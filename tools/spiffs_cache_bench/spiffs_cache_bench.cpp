@@ -0,0 +1,289 @@
+/**
+ * @file spiffs_cache_bench.cpp
+ * @brief Replays an append-heavy trace with scans against SPIFFS's read cache
+ *
+ * SPIFFS runs on a RAM flash with the NAND's geometry (2 KB pages, 128 KB
+ * blocks) and as many cache pages as the firmware gives it. The trace
+ * appends small records to a log file, flushing every few records as the
+ * log does, and every so often runs a scan: a sequential read of a large
+ * export file, a directory listing with a stat per file, or SPIFFS_check().
+ * spiffs_cache_bench uses the 2Q replacement policy, spiffs_cache_bench_lru
+ * the least-recently-used one; both print the cache statistics and flash
+ * page reads for the appends and the scans separately.
+ */
+
+#include "spiffs.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const uint32_t kPageBytes = 2048;
+static const uint32_t kBlockBytes = 64 * kPageBytes;
+static const uint32_t kMaxFiles = 4;
+static const uint32_t kFdBytes = 96;
+static const uint32_t kCachePageOverhead = 32;
+static const uint32_t kCacheHeaderBytes = 96;
+
+static std::vector<uint8_t> g_flash;
+static uint64_t g_page_reads = 0;  // Flash pages touched by HAL reads
+
+// ============================================================================
+// RAM flash: writes clear bits, erases set them
+// ============================================================================
+
+static s32_t hal_read(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *dst) {
+  (void)fs;
+  if (size > 0) {
+    g_page_reads += (addr + size - 1) / kPageBytes - addr / kPageBytes + 1;
+  }
+  memcpy(dst, &g_flash[addr], size);
+  return SPIFFS_OK;
+}
+
+static s32_t hal_write(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *src) {
+  (void)fs;
+  for (u32_t i = 0; i < size; i++) {
+    g_flash[addr + i] &= src[i];
+  }
+  return SPIFFS_OK;
+}
+
+static s32_t hal_erase(struct spiffs_t *fs, u32_t addr, u32_t size) {
+  (void)fs;
+  memset(&g_flash[addr], 0xFF, size);
+  return SPIFFS_OK;
+}
+
+extern "C" void spiffs_api_lock(struct spiffs_t *fs) { (void)fs; }
+extern "C" void spiffs_api_unlock(struct spiffs_t *fs) { (void)fs; }
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  uint64_t promotions;
+  uint64_t page_reads;
+  int64_t us;
+} phase_t;
+
+typedef struct {
+  spiffs *fs;
+  phase_t *phase;
+  u32_t hits, misses, evictions, promotions;
+  uint64_t page_reads;
+  std::chrono::steady_clock::time_point start;
+} phase_timer_t;
+
+static phase_timer_t phase_begin(spiffs *fs, phase_t *phase) {
+  return {fs, phase, fs->cache_hits, fs->cache_misses, fs->cache_evictions,
+          fs->cache_promotions, g_page_reads, std::chrono::steady_clock::now()};
+}
+
+static void phase_end(const phase_timer_t *t) {
+  t->phase->hits += t->fs->cache_hits - t->hits;
+  t->phase->misses += t->fs->cache_misses - t->misses;
+  t->phase->evictions += t->fs->cache_evictions - t->evictions;
+  t->phase->promotions += t->fs->cache_promotions - t->promotions;
+  t->phase->page_reads += g_page_reads - t->page_reads;
+  t->phase->us += std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - t->start)
+                      .count();
+}
+
+static void phase_print(const char *name, const phase_t *p, uint32_t ops, const char *op) {
+  uint64_t lookups = p->hits + p->misses;
+  printf("%-8s %6u %-8s %8.2f page reads/%s, hits %llu misses %llu (%.1f%% hit), "
+         "evictions %llu, promotions %llu, %.1f us/%s\n",
+         name, ops, op, ops ? (double)p->page_reads / ops : 0.0, op,
+         (unsigned long long)p->hits, (unsigned long long)p->misses,
+         lookups ? 100.0 * p->hits / lookups : 0.0, (unsigned long long)p->evictions,
+         (unsigned long long)p->promotions, ops ? (double)p->us / ops : 0.0, op);
+}
+
+// ============================================================================
+// Trace
+// ============================================================================
+
+static bool file_fill(spiffs *fs, const char *name, uint32_t bytes) {
+  spiffs_file fh = SPIFFS_open(fs, name, SPIFFS_CREAT | SPIFFS_TRUNC | SPIFFS_RDWR, 0);
+  if (fh < 0) {
+    return false;
+  }
+  std::vector<uint8_t> chunk(kPageBytes);
+  for (uint32_t done = 0; done < bytes; done += (uint32_t)chunk.size()) {
+    memset(chunk.data(), (int)(done / kPageBytes), chunk.size());
+    if (SPIFFS_write(fs, fh, chunk.data(), (s32_t)chunk.size()) != (s32_t)chunk.size()) {
+      SPIFFS_close(fs, fh);
+      return false;
+    }
+  }
+  return SPIFFS_close(fs, fh) >= 0;
+}
+
+static bool scan_export(spiffs *fs) {
+  spiffs_file fh = SPIFFS_open(fs, "export.bin", SPIFFS_RDONLY, 0);
+  if (fh < 0) {
+    return false;
+  }
+  std::vector<uint8_t> chunk(kPageBytes);
+  while (SPIFFS_read(fs, fh, chunk.data(), (s32_t)chunk.size()) > 0) {
+  }
+  return SPIFFS_close(fs, fh) >= 0;
+}
+
+static bool scan_listing(spiffs *fs) {
+  spiffs_DIR dir;
+  if (!SPIFFS_opendir(fs, "/", &dir)) {
+    return false;
+  }
+  struct spiffs_dirent ent;
+  spiffs_stat st;
+  while (SPIFFS_readdir(&dir, &ent)) {
+    SPIFFS_stat(fs, (const char *)ent.name, &st);
+  }
+  return SPIFFS_closedir(&dir) >= 0;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--appends N] [--record-bytes N] [--flush-every N]\n"
+          "          [--scan-every N] [--export-kb N] [--cache-pages N] [--blocks N]\n"
+          "  Appends records to a log file and runs a scan (export read, directory\n"
+          "  listing or SPIFFS_check, in turn) every --scan-every appends.\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  uint32_t appends = 20000;
+  uint32_t record_bytes = 64;
+  uint32_t flush_every = 16;
+  uint32_t scan_every = 64;
+  uint32_t export_kb = 128;
+  uint32_t cache_pages = 4;  // As log_fs_spiffs.cpp
+  uint32_t blocks = 64;
+  for (int i = 1; i < argc; i++) {
+    uint32_t *opt = nullptr;
+    if (strcmp(argv[i], "--appends") == 0) {
+      opt = &appends;
+    } else if (strcmp(argv[i], "--record-bytes") == 0) {
+      opt = &record_bytes;
+    } else if (strcmp(argv[i], "--flush-every") == 0) {
+      opt = &flush_every;
+    } else if (strcmp(argv[i], "--scan-every") == 0) {
+      opt = &scan_every;
+    } else if (strcmp(argv[i], "--export-kb") == 0) {
+      opt = &export_kb;
+    } else if (strcmp(argv[i], "--cache-pages") == 0) {
+      opt = &cache_pages;
+    } else if (strcmp(argv[i], "--blocks") == 0) {
+      opt = &blocks;
+    }
+    if (!opt || i + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    }
+    *opt = (uint32_t)strtoul(argv[++i], nullptr, 0);
+  }
+  if (record_bytes == 0 || flush_every == 0 || scan_every == 0 || cache_pages == 0 ||
+      cache_pages > 32 || blocks < 8) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  g_flash.assign((size_t)blocks * kBlockBytes, 0xFF);
+  spiffs_config cfg = {};
+  cfg.hal_read_f = hal_read;
+  cfg.hal_write_f = hal_write;
+  cfg.hal_erase_f = hal_erase;
+  cfg.phys_size = blocks * kBlockBytes;
+  cfg.phys_addr = 0;
+  cfg.phys_erase_block = kBlockBytes;
+  cfg.log_block_size = kBlockBytes;
+  cfg.log_page_size = kPageBytes;
+
+  static spiffs fs;
+  std::vector<uint8_t> work(2 * kPageBytes);
+  std::vector<uint8_t> fds(kMaxFiles * kFdBytes);
+  std::vector<uint8_t> cache(cache_pages * (kPageBytes + kCachePageOverhead) + kCacheHeaderBytes);
+  SPIFFS_mount(&fs, &cfg, work.data(), fds.data(), (u32_t)fds.size(), cache.data(),
+               (u32_t)cache.size(), nullptr);
+  SPIFFS_unmount(&fs);
+  if (SPIFFS_format(&fs) < 0 ||
+      SPIFFS_mount(&fs, &cfg, work.data(), fds.data(), (u32_t)fds.size(), cache.data(),
+                   (u32_t)cache.size(), nullptr) < 0) {
+    fprintf(stderr, "mount failed\n");
+    return 1;
+  }
+
+  // The log's other files, for the listing, and the file the export reads
+  if (!file_fill(&fs, "sensors.idx", 4 * kPageBytes) ||
+      !file_fill(&fs, "rollup_1m.bin", 16 * kPageBytes) ||
+      !file_fill(&fs, "rollup_1h.bin", 2 * kPageBytes) ||
+      !file_fill(&fs, "export.bin", export_kb * 1024)) {
+    fprintf(stderr, "cannot create files\n");
+    return 1;
+  }
+
+  spiffs_file log = SPIFFS_open(&fs, "sensors.bin", SPIFFS_CREAT | SPIFFS_APPEND | SPIFFS_RDWR, 0);
+  if (log < 0) {
+    fprintf(stderr, "cannot create sensors.bin\n");
+    return 1;
+  }
+
+  phase_t append_phase = {};
+  phase_t scan_phase[3] = {};
+  uint32_t scans[3] = {};
+  static const char *kScanNames[3] = {"export", "listing", "check"};
+  std::vector<uint8_t> record(record_bytes);
+  for (uint32_t i = 0; i < appends; i++) {
+    memset(record.data(), (int)i, record.size());
+    phase_timer_t t = phase_begin(&fs, &append_phase);
+    bool ok = SPIFFS_write(&fs, log, record.data(), (s32_t)record.size()) == (s32_t)record.size();
+    if (ok && (i + 1) % flush_every == 0) {
+      ok = SPIFFS_fflush(&fs, log) >= 0;
+    }
+    phase_end(&t);
+    if (!ok) {
+      fprintf(stderr, "append %u failed (%d)\n", i, (int)SPIFFS_errno(&fs));
+      return 1;
+    }
+
+    if ((i + 1) % scan_every == 0) {
+      uint32_t kind = ((i + 1) / scan_every - 1) % 3;
+      phase_timer_t st = phase_begin(&fs, &scan_phase[kind]);
+      ok = (kind == 0) ? scan_export(&fs) : (kind == 1) ? scan_listing(&fs) : SPIFFS_check(&fs) >= 0;
+      phase_end(&st);
+      if (!ok) {
+        fprintf(stderr, "%s scan failed (%d)\n", kScanNames[kind], (int)SPIFFS_errno(&fs));
+        return 1;
+      }
+      scans[kind]++;
+    }
+  }
+  SPIFFS_close(&fs, log);
+
+  spiffs_stat st;
+  if (SPIFFS_stat(&fs, "sensors.bin", &st) < 0 || st.size != appends * record_bytes) {
+    fprintf(stderr, "sensors.bin is %u bytes, expected %u\n", (unsigned)st.size,
+            appends * record_bytes);
+    return 1;
+  }
+
+  printf("policy %s, %u cache pages of %u B, %u blocks of %u KB, %u B records, "
+         "flush every %u, scan every %u\n",
+         SPIFFS_CACHE_2Q ? "2Q" : "LRU", cache_pages, kPageBytes, blocks, kBlockBytes / 1024,
+         record_bytes, flush_every, scan_every);
+  phase_print("append", &append_phase, appends, "append");
+  for (int k = 0; k < 3; k++) {
+    phase_print(kScanNames[k], &scan_phase[k], scans[k], "scan");
+  }
+  SPIFFS_unmount(&fs);
+  return 0;
+}
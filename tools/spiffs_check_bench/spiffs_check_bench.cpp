@@ -0,0 +1,696 @@
+/**
+ * @file spiffs_check_bench.cpp
+ * @brief SPIFFS_check() against SPIFFS_check_fast() on populated volumes
+ *
+ * Builds a SPIFFS volume of each --mb size on a RAM flash with the NAND's
+ * geometry (2 KB pages, 128 KB blocks) and the HAL of main/log_fs_spiffs.cpp.
+ * Each sector read, program and block erase is charged the W25N512's time,
+ * as in tools/spiffs_gc_bench, and times are in that modelled time. The
+ * volume holds what the sensor log keeps: a ring file of --ring-pct of the
+ * volume with --churn-pct of its slots rewritten, which leaves deleted pages
+ * about, the ring's index file and a few small files. Each check then runs
+ * on a fresh mount of the same image: upstream SPIFFS_check(), and
+ * SPIFFS_check_fast() with SPIFFS_check_fast_work_size() bytes and with only
+ * the file system's work page.
+ *
+ * On the --corrupt-mb volume it then damages a copy of the image once for
+ * each error class the three upstream checks mend, and runs both checks on
+ * it. It fails unless both report a fix, a SPIFFS_check() afterwards finds
+ * nothing left to mend, and both leave the same files with the same
+ * contents.
+ */
+
+#include "spiffs.h"
+extern "C" {
+#include "spiffs_nucleus.h"
+}
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const uint32_t kPageBytes = 2048;
+static const uint32_t kPagesPerBlock = 64;
+static const uint32_t kBlockBytes = kPagesPerBlock * kPageBytes;
+static const uint32_t kLookupPages = 1;  // 64 two-byte entries per block
+static const uint32_t kMaxFiles = 4;
+static const uint32_t kFdBytes = 96;
+static const uint32_t kCachePages = 4;  // As log_fs_spiffs.cpp
+static const uint32_t kCachePageOverhead = 32;
+static const uint32_t kCacheHeaderBytes = 96;
+static const uint32_t kSlotBytes = 2048;  // LOG_SEGMENT_BYTES
+static const uint32_t kIndexEntryBytes = 16;
+
+// W25N512GV timings and bus, as nand_geometry_w25n512() in tools/nand_sim
+static const uint32_t kReadUs = 60;
+static const uint32_t kProgramUs = 250;
+static const uint32_t kEraseUs = 2000;
+static const uint32_t kSpiClockHz = 10000000;
+static const uint32_t kNoSector = 0xFFFFFFFF;
+
+static std::vector<uint8_t> g_flash;
+static std::vector<uint8_t> g_buf(kPageBytes);  // Write-back sector
+static uint32_t g_buf_sector = kNoSector;
+static bool g_buf_dirty = false;
+
+typedef struct {
+  uint64_t us;  // Modelled NAND time
+  uint64_t reads;
+  uint64_t programs;
+  uint64_t erases;
+} nand_time_t;
+
+static nand_time_t g_nand = {};
+
+static uint64_t transfer_us(uint32_t bytes) {
+  return (uint64_t)bytes * 8 * 1000000 / kSpiClockHz;
+}
+
+// ============================================================================
+// RAM flash behind a one-sector write-back buffer (log_fs_spiffs.cpp's HAL)
+// ============================================================================
+
+static void sector_read(uint32_t sector, uint8_t *dst) {
+  memcpy(dst, &g_flash[(size_t)sector * kPageBytes], kPageBytes);
+  g_nand.us += kReadUs + transfer_us(kPageBytes);
+  g_nand.reads++;
+}
+
+static void buf_flush(void) {
+  if (!g_buf_dirty) {
+    return;
+  }
+  memcpy(&g_flash[(size_t)g_buf_sector * kPageBytes], g_buf.data(), kPageBytes);
+  g_nand.us += kProgramUs + transfer_us(kPageBytes);
+  g_nand.programs++;
+  g_buf_dirty = false;
+}
+
+static s32_t hal_read(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *dst) {
+  (void)fs;
+  static std::vector<uint8_t> page(kPageBytes);
+  while (size > 0) {
+    uint32_t sector = addr / kPageBytes;
+    uint32_t in = addr % kPageBytes;
+    uint32_t n = std::min(kPageBytes - in, size);
+    if (sector == g_buf_sector) {
+      memcpy(dst, &g_buf[in], n);
+    } else {
+      sector_read(sector, page.data());
+      memcpy(dst, &page[in], n);
+    }
+    addr += n;
+    dst += n;
+    size -= n;
+  }
+  return SPIFFS_OK;
+}
+
+static s32_t hal_write(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *src) {
+  (void)fs;
+  while (size > 0) {
+    uint32_t sector = addr / kPageBytes;
+    uint32_t in = addr % kPageBytes;
+    uint32_t n = std::min(kPageBytes - in, size);
+    if (sector != g_buf_sector) {
+      buf_flush();
+      sector_read(sector, g_buf.data());
+      g_buf_sector = sector;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      g_buf[in + i] &= src[i];
+    }
+    g_buf_dirty = true;
+    addr += n;
+    src += n;
+    size -= n;
+  }
+  return SPIFFS_OK;
+}
+
+static s32_t hal_erase(struct spiffs_t *fs, u32_t addr, u32_t size) {
+  (void)fs;
+  uint32_t first = addr / kPageBytes;
+  if (g_buf_sector >= first && g_buf_sector < first + size / kPageBytes) {
+    g_buf_sector = kNoSector;
+    g_buf_dirty = false;
+  } else {
+    buf_flush();
+  }
+  memset(&g_flash[addr], 0xFF, size);
+  g_nand.us += (uint64_t)kEraseUs * (size / kBlockBytes);
+  g_nand.erases += size / kBlockBytes;
+  return SPIFFS_OK;
+}
+
+extern "C" void spiffs_api_lock(struct spiffs_t *fs) { (void)fs; }
+extern "C" void spiffs_api_unlock(struct spiffs_t *fs) { (void)fs; }
+
+// ============================================================================
+// Volume
+// ============================================================================
+
+static spiffs g_fs;
+static std::vector<uint8_t> g_work(2 * kPageBytes);
+static std::vector<uint8_t> g_fds(kMaxFiles * kFdBytes);
+static std::vector<uint8_t> g_cache(kCachePages * (kPageBytes + kCachePageOverhead) +
+                                    kCacheHeaderBytes);
+static uint32_t g_volume_bytes;
+
+// Fixes the checks report, as (check type, report)
+static std::vector<std::pair<int, int>> g_fixes;
+
+static void check_cb(struct spiffs_t *fs, spiffs_check_type type, spiffs_check_report report,
+                     u32_t arg1, u32_t arg2) {
+  (void)fs;
+  (void)arg1;
+  (void)arg2;
+  if (report != SPIFFS_CHECK_PROGRESS) {
+    g_fixes.push_back({type, report});
+  }
+}
+
+static void load(const std::vector<uint8_t> &image) {
+  g_flash = image;
+  g_buf_sector = kNoSector;
+  g_buf_dirty = false;
+}
+
+static bool mount(void) {
+  spiffs_config cfg = {};
+  cfg.hal_read_f = hal_read;
+  cfg.hal_write_f = hal_write;
+  cfg.hal_erase_f = hal_erase;
+  cfg.phys_size = g_volume_bytes;
+  cfg.phys_addr = 0;
+  cfg.phys_erase_block = kBlockBytes;
+  cfg.log_block_size = kBlockBytes;
+  cfg.log_page_size = kPageBytes;
+  return SPIFFS_mount(&g_fs, &cfg, g_work.data(), g_fds.data(), (u32_t)g_fds.size(),
+                      g_cache.data(), (u32_t)g_cache.size(), check_cb) >= 0;
+}
+
+static void unmount(void) {
+  SPIFFS_unmount(&g_fs);
+  buf_flush();
+}
+
+// Page contents differ per page so that a swapped reference shows
+static bool file_fill(const char *name, uint32_t bytes, uint8_t seed) {
+  spiffs_file fh = SPIFFS_open(&g_fs, name, SPIFFS_CREAT | SPIFFS_TRUNC | SPIFFS_RDWR, 0);
+  if (fh < 0) {
+    return false;
+  }
+  std::vector<uint8_t> chunk(kPageBytes);
+  for (uint32_t done = 0; done < bytes; done += (uint32_t)chunk.size()) {
+    memset(chunk.data(), (int)(seed + done / kPageBytes * 13), chunk.size());
+    s32_t n = (s32_t)std::min<uint32_t>((uint32_t)chunk.size(), bytes - done);
+    if (SPIFFS_write(&g_fs, fh, chunk.data(), n) != n) {
+      SPIFFS_close(&g_fs, fh);
+      return false;
+    }
+  }
+  return SPIFFS_close(&g_fs, fh) >= 0;
+}
+
+typedef struct {
+  spiffs_obj_id ring_obj;
+  spiffs_page_ix ring_hdr;
+  spiffs_obj_id idx_obj;
+  spiffs_page_ix idx_hdr;
+  uint32_t objects;
+  uint32_t used_pct;
+} layout_t;
+
+static bool populate(uint32_t ring_pct, uint32_t churn_pct, layout_t *layout) {
+  g_flash.assign(g_volume_bytes, 0xFF);
+  g_buf_sector = kNoSector;
+  g_buf_dirty = false;
+  mount();
+  SPIFFS_unmount(&g_fs);
+  if (SPIFFS_format(&g_fs) < 0 || !mount()) {
+    fprintf(stderr, "mount failed\n");
+    return false;
+  }
+  uint32_t slots = (uint32_t)((uint64_t)g_volume_bytes * ring_pct / 100 / kSlotBytes);
+  static const struct {
+    const char *name;
+    uint32_t bytes;
+  } kSmallFiles[] = {
+      {"rollup_hour.bin", 64 * 1024},
+      {"rollup_day.bin", 16 * 1024},
+      {"config.json", 1024},
+  };
+  bool ok = file_fill("sensors.bin", slots * kSlotBytes, 1) &&
+            file_fill("sensors.idx", slots * kIndexEntryBytes, 2);
+  for (uint32_t i = 0; ok && i < sizeof(kSmallFiles) / sizeof(kSmallFiles[0]); i++) {
+    ok = file_fill(kSmallFiles[i].name, kSmallFiles[i].bytes, (uint8_t)(3 + i));
+  }
+  spiffs_file fh = ok ? SPIFFS_open(&g_fs, "sensors.bin", SPIFFS_RDWR, 0) : -1;
+  ok = fh >= 0;
+  std::vector<uint8_t> image(kSlotBytes);
+  uint32_t rewrites = slots * churn_pct / 100;
+  for (uint32_t i = 0; ok && i < rewrites; i++) {
+    uint32_t slot = (uint32_t)((uint64_t)i * 7919 % slots);
+    memset(image.data(), (int)(0x80 + i), image.size());
+    ok = SPIFFS_lseek(&g_fs, fh, (s32_t)(slot * kSlotBytes), SPIFFS_SEEK_SET) >= 0 &&
+         SPIFFS_write(&g_fs, fh, image.data(), (s32_t)image.size()) == (s32_t)image.size() &&
+         SPIFFS_fflush(&g_fs, fh) >= 0;
+  }
+  if (fh >= 0) {
+    SPIFFS_close(&g_fs, fh);
+  }
+  spiffs_stat ring;
+  spiffs_stat idx;
+  u32_t total = 0;
+  u32_t used = 0;
+  ok = ok && SPIFFS_stat(&g_fs, "sensors.bin", &ring) >= 0 &&
+       SPIFFS_stat(&g_fs, "sensors.idx", &idx) >= 0 && SPIFFS_info(&g_fs, &total, &used) >= 0;
+  if (!ok) {
+    fprintf(stderr, "cannot populate the volume (%d)\n", (int)SPIFFS_errno(&g_fs));
+    unmount();
+    return false;
+  }
+  layout->ring_obj = ring.obj_id;
+  layout->ring_hdr = ring.pix;
+  layout->idx_obj = idx.obj_id;
+  layout->idx_hdr = idx.pix;
+  layout->objects = 2 + sizeof(kSmallFiles) / sizeof(kSmallFiles[0]);
+  layout->used_pct = (uint32_t)((uint64_t)used * 100 / total);
+  unmount();
+  return true;
+}
+
+// ============================================================================
+// Image access, for damaging it
+// ============================================================================
+
+static spiffs_page_header *page_header(spiffs_page_ix pix) {
+  return (spiffs_page_header *)&g_flash[(size_t)pix * kPageBytes];
+}
+
+static spiffs_obj_id lookup_get(spiffs_page_ix pix) {
+  spiffs_obj_id id;
+  size_t at = (size_t)(pix / kPagesPerBlock) * kBlockBytes +
+              (pix % kPagesPerBlock - kLookupPages) * sizeof(spiffs_obj_id);
+  memcpy(&id, &g_flash[at], sizeof(id));
+  return id;
+}
+
+static void lookup_set(spiffs_page_ix pix, spiffs_obj_id id) {
+  size_t at = (size_t)(pix / kPagesPerBlock) * kBlockBytes +
+              (pix % kPagesPerBlock - kLookupPages) * sizeof(spiffs_obj_id);
+  memcpy(&g_flash[at], &id, sizeof(id));
+}
+
+static size_t index_entry_at(spiffs_page_ix objix_pix, uint32_t entry) {
+  size_t header = page_header(objix_pix)->span_ix == 0 ? sizeof(spiffs_page_object_ix_header)
+                                                        : sizeof(spiffs_page_object_ix);
+  return (size_t)objix_pix * kPageBytes + header + entry * sizeof(spiffs_page_ix);
+}
+
+static spiffs_page_ix index_get(spiffs_page_ix objix_pix, uint32_t entry) {
+  spiffs_page_ix pix;
+  memcpy(&pix, &g_flash[index_entry_at(objix_pix, entry)], sizeof(pix));
+  return pix;
+}
+
+static void index_set(spiffs_page_ix objix_pix, uint32_t entry, spiffs_page_ix pix) {
+  memcpy(&g_flash[index_entry_at(objix_pix, entry)], &pix, sizeof(pix));
+}
+
+static spiffs_page_ix find_page(const std::function<bool(spiffs_page_ix)> &match) {
+  uint32_t pages = g_volume_bytes / kPageBytes;
+  for (uint32_t pix = 0; pix < pages; pix++) {
+    if (pix % kPagesPerBlock >= kLookupPages && match((spiffs_page_ix)pix)) {
+      return (spiffs_page_ix)pix;
+    }
+  }
+  return 0;
+}
+
+static spiffs_page_ix find_index_page(spiffs_obj_id obj_id, spiffs_span_ix span_ix) {
+  return find_page([&](spiffs_page_ix pix) {
+    const spiffs_page_header *p_hdr = page_header(pix);
+    return lookup_get(pix) == (obj_id | SPIFFS_OBJ_ID_IX_FLAG) && p_hdr->span_ix == span_ix &&
+           (p_hdr->flags & SPIFFS_PH_FLAG_DELET);
+  });
+}
+
+static spiffs_page_ix find_free_page(void) {
+  return find_page([](spiffs_page_ix pix) {
+    return lookup_get(pix) == SPIFFS_OBJ_ID_FREE && page_header(pix)->flags == 0xFF;
+  });
+}
+
+typedef struct {
+  const char *name;
+  // Damages g_flash, false if the volume has nothing to damage that way
+  std::function<bool(const layout_t &)> apply;
+} damage_t;
+
+static std::vector<damage_t> damages(void) {
+  // A data page of the ring, through its index header
+  auto ring_data = [](const layout_t &l, uint32_t entry) { return index_get(l.ring_hdr, entry); };
+  return {
+      {"lu free, page used",
+       [=](const layout_t &l) {
+         lookup_set(ring_data(l, 5), SPIFFS_OBJ_ID_FREE);
+         return true;
+       }},
+      {"lu deleted, page used",
+       [=](const layout_t &l) {
+         lookup_set(ring_data(l, 5), SPIFFS_OBJ_ID_DELETED);
+         return true;
+       }},
+      {"lu and page obj id differ",
+       [=](const layout_t &l) {
+         lookup_set(ring_data(l, 5), l.idx_obj);
+         return true;
+       }},
+      {"lu and page index flag differ",
+       [=](const layout_t &l) {
+         lookup_set(ring_data(l, 5), l.ring_obj | SPIFFS_OBJ_ID_IX_FLAG);
+         return true;
+       }},
+      {"lu used, page deleted",
+       [=](const layout_t &l) {
+         page_header(ring_data(l, 5))->flags &= ~SPIFFS_PH_FLAG_DELET;
+         return true;
+       }},
+      {"page not final",
+       [=](const layout_t &l) {
+         page_header(ring_data(l, 5))->flags |= SPIFFS_PH_FLAG_FINAL;
+         return true;
+       }},
+      {"index header half deleted",
+       [](const layout_t &l) {
+         page_header(l.idx_hdr)->flags &= ~SPIFFS_PH_FLAG_IXDELE;
+         return true;
+       }},
+      {"orphan index page",
+       [](const layout_t &l) {
+         spiffs_page_ix objix = find_index_page(l.ring_obj, 1);
+         if (objix == 0) {
+           return false;
+         }
+         page_header(objix)->flags &= ~SPIFFS_PH_FLAG_IXDELE;
+         page_header(l.ring_hdr)->flags &= ~SPIFFS_PH_FLAG_DELET;
+         lookup_set(l.ring_hdr, SPIFFS_OBJ_ID_DELETED);
+         return true;
+       }},
+      {"reference to a lookup page",
+       [](const layout_t &l) {
+         index_set(l.ring_hdr, 7, (spiffs_page_ix)(3 * kPagesPerBlock));
+         return true;
+       }},
+      {"reference to another span",
+       [=](const layout_t &l) {
+         spiffs_page_ix a = ring_data(l, 8);
+         index_set(l.ring_hdr, 8, ring_data(l, 9));
+         index_set(l.ring_hdr, 9, a);
+         return true;
+       }},
+      {"page referenced twice",
+       [=](const layout_t &l) {
+         index_set(l.ring_hdr, 11, ring_data(l, 10));
+         return true;
+       }},
+      {"page unreferenced",
+       [](const layout_t &l) {
+         index_set(l.ring_hdr, 12, (spiffs_page_ix)-1);
+         return true;
+       }},
+      {"index page copied",
+       [](const layout_t &l) {
+         spiffs_page_ix copy = find_free_page();
+         if (copy == 0) {
+           return false;
+         }
+         memcpy(&g_flash[(size_t)copy * kPageBytes], &g_flash[(size_t)l.ring_hdr * kPageBytes],
+                kPageBytes);
+         lookup_set(copy, l.ring_obj | SPIFFS_OBJ_ID_IX_FLAG);
+         return true;
+       }},
+  };
+}
+
+// ============================================================================
+// Checks
+// ============================================================================
+
+enum check_kind_t { CHECK_FULL, CHECK_FAST, CHECK_FAST_WORK_PAGE };
+
+typedef struct {
+  s32_t res;
+  nand_time_t nand;
+  double wall_ms;
+  uint32_t work_bytes;
+  std::vector<std::pair<int, int>> fixes;
+} check_run_t;
+
+// Runs one check on a fresh mount of g_flash, which it leaves mended
+static check_run_t run_check(check_kind_t kind) {
+  check_run_t run = {};
+  g_buf_sector = kNoSector;
+  g_buf_dirty = false;
+  if (!mount()) {
+    run.res = SPIFFS_ERR_NOT_A_FS;
+    return run;
+  }
+  std::vector<uint8_t> buf;
+  if (kind == CHECK_FAST) {
+    buf.resize(SPIFFS_check_fast_work_size(&g_fs));
+  }
+  run.work_bytes = kind == CHECK_FAST ? (uint32_t)buf.size()
+                   : kind == CHECK_FAST_WORK_PAGE ? kPageBytes
+                                                  : 2 * kPageBytes;
+  g_fixes.clear();
+  nand_time_t before = g_nand;
+  auto start = std::chrono::steady_clock::now();
+  if (kind == CHECK_FULL) {
+    run.res = SPIFFS_check(&g_fs);
+  } else {
+    run.res = SPIFFS_check_fast(&g_fs, buf.empty() ? nullptr : buf.data(), (u32_t)buf.size());
+  }
+  buf_flush();
+  auto end = std::chrono::steady_clock::now();
+  run.wall_ms = std::chrono::duration<double, std::milli>(end - start).count();
+  run.nand.us = g_nand.us - before.us;
+  run.nand.reads = g_nand.reads - before.reads;
+  run.nand.programs = g_nand.programs - before.programs;
+  run.nand.erases = g_nand.erases - before.erases;
+  run.fixes = g_fixes;
+  unmount();
+  return run;
+}
+
+typedef std::map<std::string, std::pair<uint32_t, uint64_t>> file_list_t;
+
+// Name, size and an FNV-1a hash of the contents of each file on g_flash
+static file_list_t list_files(void) {
+  file_list_t files;
+  g_buf_sector = kNoSector;
+  g_buf_dirty = false;
+  if (!mount()) {
+    return files;
+  }
+  spiffs_DIR dir;
+  struct spiffs_dirent entry;
+  std::vector<uint8_t> chunk(kPageBytes);
+  if (SPIFFS_opendir(&g_fs, "/", &dir)) {
+    while (SPIFFS_readdir(&dir, &entry)) {
+      uint64_t hash = 14695981039346656037ull;
+      uint32_t size = 0;
+      spiffs_file fh = SPIFFS_open(&g_fs, (const char *)entry.name, SPIFFS_RDONLY, 0);
+      s32_t n;
+      while (fh >= 0 && (n = SPIFFS_read(&g_fs, fh, chunk.data(), (s32_t)chunk.size())) > 0) {
+        for (s32_t i = 0; i < n; i++) {
+          hash = (hash ^ chunk[i]) * 1099511628211ull;
+        }
+        size += (uint32_t)n;
+      }
+      if (fh >= 0) {
+        SPIFFS_close(&g_fs, fh);
+      }
+      files[(const char *)entry.name] = {size, hash};
+    }
+    SPIFFS_closedir(&dir);
+  }
+  unmount();
+  return files;
+}
+
+static std::string describe_fixes(const std::vector<std::pair<int, int>> &fixes) {
+  static const char *const kTypes[] = {"LU", "IX", "PA"};
+  static const char *const kReports[] = {"progress",   "error",       "fix index",   "fix lookup",
+                                         "del orphan", "delete page", "delete file", "truncate file"};
+  std::map<std::string, int> counts;
+  for (const auto &fix : fixes) {
+    counts[std::string(kTypes[fix.first]) + " " + kReports[fix.second]]++;
+  }
+  std::string text;
+  for (const auto &count : counts) {
+    if (!text.empty()) {
+      text += ", ";
+    }
+    text += count.first;
+    if (count.second > 1) {
+      text += " x" + std::to_string(count.second);
+    }
+  }
+  return text.empty() ? "-" : text;
+}
+
+static void print_run(const char *name, const check_run_t &run) {
+  printf("  %-30s %9.1f ms %7llu reads %5llu programs %8.1f ms wall  %s\n", name,
+         run.nand.us / 1000.0, (unsigned long long)run.nand.reads,
+         (unsigned long long)run.nand.programs, run.wall_ms,
+         run.res < 0 ? "FAILED" : "");
+}
+
+// Damages the image each way and compares what the checks make of it
+static bool compare_on_damage(const std::vector<uint8_t> &image, const layout_t &layout) {
+  bool ok = true;
+  load(image);
+  file_list_t intact = list_files();
+  printf("\n  %-30s %-5s %10s  %s\n", "damage", "check", "NAND ms", "fixes");
+  for (const damage_t &damage : damages()) {
+    load(image);
+    if (!damage.apply(layout)) {
+      printf("  %-30s not applicable to this volume\n", damage.name);
+      continue;
+    }
+    std::vector<uint8_t> damaged = g_flash;
+
+    // SPIFFS_check() can leave a file it deleted lazily for the next run
+    check_run_t full = run_check(CHECK_FULL);
+    uint32_t full_runs = 1;
+    while (full_runs < 4 && !run_check(CHECK_FULL).fixes.empty()) {
+      full_runs++;
+    }
+    file_list_t full_files = list_files();
+
+    load(damaged);
+    check_run_t fast = run_check(CHECK_FAST);
+    file_list_t fast_files = list_files();
+    bool fast_clean = run_check(CHECK_FULL).fixes.empty();
+
+    std::string verdict;
+    if (full.fixes.empty() || fast.fixes.empty()) {
+      verdict = "NOT DETECTED";
+    } else if (!fast_clean) {
+      verdict = "NOT MENDED";
+    } else if (full_files != fast_files) {
+      verdict = "FILES DIFFER";
+    } else {
+      if (full_runs > 1) {
+        verdict = "SPIFFS_check needed " + std::to_string(full_runs) + " runs";
+      }
+      if (full_files != intact) {
+        verdict += verdict.empty() ? "" : ", ";
+        verdict += "both lose data";
+      }
+      verdict = verdict.empty() ? "" : "(" + verdict + ")";
+    }
+    ok = ok && (verdict.empty() || verdict[0] == '(') && full.res >= 0 && fast.res >= 0;
+    printf("  %-30s %-5s %10.1f  %s\n", damage.name, "full", full.nand.us / 1000.0,
+           describe_fixes(full.fixes).c_str());
+    printf("  %-30s %-5s %10.1f  %s %s\n", "", "fast", fast.nand.us / 1000.0,
+           describe_fixes(fast.fixes).c_str(), verdict.c_str());
+  }
+  return ok;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--mb N[,N...]] [--ring-pct N] [--churn-pct N] [--corrupt-mb N]\n"
+          "  Times SPIFFS_check() and SPIFFS_check_fast() on volumes of each\n"
+          "  size, then damages the --corrupt-mb volume (0 for none) in each way\n"
+          "  the checks mend and compares the two.\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  std::vector<uint32_t> sizes_mb = {8, 16, 32, 64};
+  uint32_t ring_pct = 50;  // As the device's ring
+  uint32_t churn_pct = 10;
+  uint32_t corrupt_mb = 8;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (strcmp(argv[i], "--mb") == 0) {
+      sizes_mb.clear();
+      for (char *p = argv[++i]; *p;) {
+        sizes_mb.push_back((uint32_t)strtoul(p, &p, 0));
+        if (*p == ',') {
+          p++;
+        }
+      }
+    } else if (strcmp(argv[i], "--ring-pct") == 0) {
+      ring_pct = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--churn-pct") == 0) {
+      churn_pct = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--corrupt-mb") == 0) {
+      corrupt_mb = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (ring_pct == 0 || ring_pct > 80 || churn_pct > 100) {
+    usage(argv[0]);
+    return 2;
+  }
+  for (uint32_t mb : sizes_mb) {
+    // Page indices are 16 bits wide
+    if (mb < 2 || mb > 64) {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  bool ok = true;
+  for (uint32_t mb : sizes_mb) {
+    g_volume_bytes = mb * 1024 * 1024;
+    layout_t layout;
+    if (!populate(ring_pct, churn_pct, &layout)) {
+      return 1;
+    }
+    std::vector<uint8_t> image = g_flash;
+
+    printf("%u MB, %u pages, %u%% used, %u files\n", mb, g_volume_bytes / kPageBytes,
+           layout.used_pct, layout.objects);
+    load(image);
+    check_run_t full = run_check(CHECK_FULL);
+    print_run("SPIFFS_check", full);
+    load(image);
+    check_run_t fast = run_check(CHECK_FAST);
+    char name[64];
+    snprintf(name, sizeof(name), "SPIFFS_check_fast, %u B", fast.work_bytes);
+    print_run(name, fast);
+    load(image);
+    check_run_t page = run_check(CHECK_FAST_WORK_PAGE);
+    snprintf(name, sizeof(name), "SPIFFS_check_fast, work page");
+    print_run(name, page);
+    if (!full.fixes.empty() || !fast.fixes.empty() || !page.fixes.empty()) {
+      fprintf(stderr, "check mended an intact volume\n");
+      ok = false;
+    }
+    ok = ok && full.res >= 0 && fast.res >= 0 && page.res >= 0;
+
+    if (mb == corrupt_mb) {
+      ok = compare_on_damage(image, layout) && ok;
+    }
+    printf("\n");
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,358 @@
+/**
+ * @file spiffs_gc_bench.cpp
+ * @brief Append latency with SPIFFS garbage collection in the writes or idle
+ *
+ * SPIFFS runs on a RAM flash with the NAND's geometry (2 KB pages, 128 KB
+ * blocks) and the HAL of main/log_fs_spiffs.cpp: partial writes merge into
+ * a one-sector write-back buffer that is programmed when SPIFFS moves to
+ * another sector. Each sector read, program and block erase is charged the
+ * W25N512's datasheet time plus the transfer on the 10 MHz bus, as in
+ * tools/nand_sim, and latencies are in that modelled time.
+ *
+ * The trace is the sensor log's flushes: each rewrites the open 2 KB slot
+ * of a preallocated ring file in place and then its index entry, which
+ * leaves deleted pages behind; a slot takes --flushes-per-slot flushes
+ * before the ring moves on. After each flush the log is idle until the
+ * next record. spiffs_gc_bench spends up to --idle-us of that time in
+ * SPIFFS_gc_step(), as the log writer does; spiffs_gc_bench_sync is built
+ * with SPIFFS_GC_INCREMENTAL=0 and leaves all collection to the writes, as
+ * upstream spiffs does. Both print flush latency percentiles and how many
+ * flushes collected garbage themselves.
+ */
+
+#include "spiffs.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const uint32_t kPageBytes = 2048;
+static const uint32_t kBlockBytes = 64 * kPageBytes;
+static const uint32_t kMaxFiles = 4;
+static const uint32_t kFdBytes = 96;
+static const uint32_t kCachePages = 4;  // As log_fs_spiffs.cpp
+static const uint32_t kCachePageOverhead = 32;
+static const uint32_t kCacheHeaderBytes = 96;
+static const uint32_t kGcStepMoves = 8;  // As log_fs_spiffs.cpp
+static const uint32_t kSlotBytes = 2048;  // LOG_SEGMENT_BYTES
+static const uint32_t kIndexEntryBytes = 16;
+
+// W25N512GV timings and bus, as nand_geometry_w25n512() in tools/nand_sim
+static const uint32_t kReadUs = 60;
+static const uint32_t kProgramUs = 250;
+static const uint32_t kEraseUs = 2000;
+static const uint32_t kSpiClockHz = 10000000;
+static const uint32_t kNoSector = 0xFFFFFFFF;
+
+static std::vector<uint8_t> g_flash;
+static std::vector<uint8_t> g_buf(kPageBytes);  // Write-back sector
+static uint32_t g_buf_sector = kNoSector;
+static bool g_buf_dirty = false;
+
+typedef struct {
+  uint64_t us;  // Modelled NAND time
+  uint64_t reads;
+  uint64_t programs;
+  uint64_t erases;
+} nand_time_t;
+
+static nand_time_t g_nand = {};
+
+static uint64_t transfer_us(uint32_t bytes) {
+  return (uint64_t)bytes * 8 * 1000000 / kSpiClockHz;
+}
+
+// ============================================================================
+// RAM flash behind a one-sector write-back buffer (log_fs_spiffs.cpp's HAL)
+// ============================================================================
+
+static void sector_read(uint32_t sector, uint8_t *dst) {
+  memcpy(dst, &g_flash[(size_t)sector * kPageBytes], kPageBytes);
+  g_nand.us += kReadUs + transfer_us(kPageBytes);
+  g_nand.reads++;
+}
+
+static void buf_flush(void) {
+  if (!g_buf_dirty) {
+    return;
+  }
+  memcpy(&g_flash[(size_t)g_buf_sector * kPageBytes], g_buf.data(), kPageBytes);
+  g_nand.us += kProgramUs + transfer_us(kPageBytes);
+  g_nand.programs++;
+  g_buf_dirty = false;
+}
+
+static s32_t hal_read(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *dst) {
+  (void)fs;
+  static std::vector<uint8_t> page(kPageBytes);
+  while (size > 0) {
+    uint32_t sector = addr / kPageBytes;
+    uint32_t in = addr % kPageBytes;
+    uint32_t n = std::min(kPageBytes - in, size);
+    if (sector == g_buf_sector) {
+      memcpy(dst, &g_buf[in], n);
+    } else {
+      sector_read(sector, page.data());
+      memcpy(dst, &page[in], n);
+    }
+    addr += n;
+    dst += n;
+    size -= n;
+  }
+  return SPIFFS_OK;
+}
+
+static s32_t hal_write(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *src) {
+  (void)fs;
+  while (size > 0) {
+    uint32_t sector = addr / kPageBytes;
+    uint32_t in = addr % kPageBytes;
+    uint32_t n = std::min(kPageBytes - in, size);
+    if (sector != g_buf_sector) {
+      buf_flush();
+      sector_read(sector, g_buf.data());
+      g_buf_sector = sector;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      g_buf[in + i] &= src[i];
+    }
+    g_buf_dirty = true;
+    addr += n;
+    src += n;
+    size -= n;
+  }
+  return SPIFFS_OK;
+}
+
+static s32_t hal_erase(struct spiffs_t *fs, u32_t addr, u32_t size) {
+  (void)fs;
+  uint32_t first = addr / kPageBytes;
+  if (g_buf_sector >= first && g_buf_sector < first + size / kPageBytes) {
+    g_buf_sector = kNoSector;
+    g_buf_dirty = false;
+  } else {
+    buf_flush();
+  }
+  memset(&g_flash[addr], 0xFF, size);
+  g_nand.us += (uint64_t)kEraseUs * (size / kBlockBytes);
+  g_nand.erases += size / kBlockBytes;
+  return SPIFFS_OK;
+}
+
+extern "C" void spiffs_api_lock(struct spiffs_t *fs) { (void)fs; }
+extern "C" void spiffs_api_unlock(struct spiffs_t *fs) { (void)fs; }
+
+// ============================================================================
+// Trace
+// ============================================================================
+
+static bool file_fill(spiffs *fs, const char *name, uint32_t bytes) {
+  spiffs_file fh = SPIFFS_open(fs, name, SPIFFS_CREAT | SPIFFS_TRUNC | SPIFFS_RDWR, 0);
+  if (fh < 0) {
+    return false;
+  }
+  std::vector<uint8_t> chunk(kPageBytes, 0xA5);
+  for (uint32_t done = 0; done < bytes; done += (uint32_t)chunk.size()) {
+    if (SPIFFS_write(fs, fh, chunk.data(), (s32_t)chunk.size()) != (s32_t)chunk.size()) {
+      SPIFFS_close(fs, fh);
+      return false;
+    }
+  }
+  return SPIFFS_close(fs, fh) >= 0;
+}
+
+static bool write_at(spiffs *fs, spiffs_file fh, uint32_t offset, const void *buf,
+                     uint32_t len) {
+  return SPIFFS_lseek(fs, fh, (s32_t)offset, SPIFFS_SEEK_SET) >= 0 &&
+         SPIFFS_write(fs, fh, (void *)buf, (s32_t)len) == (s32_t)len;
+}
+
+static uint64_t percentile(const std::vector<uint64_t> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t i = (size_t)(p / 100.0 * (double)(sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--flushes N] [--flushes-per-slot N] [--ring-kb N]\n"
+          "          [--blocks N] [--idle-us N]\n"
+          "  Rewrites the slots of a --ring-kb ring file in turn, each\n"
+          "  --flushes-per-slot times, and spends up to --idle-us of modelled\n"
+          "  time in SPIFFS_gc_step() after each flush (incremental build only).\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  uint32_t flushes = 20000;
+  uint32_t flushes_per_slot = 2;
+  uint32_t ring_kb = 4096;  // Half the volume, as on the device
+  uint32_t blocks = 64;
+  // The log writer collects in 20 ms passes (LOG_STORAGE_SPIFFS_GC_US) 50 ms
+  // apart, and records come seconds apart; this is far less than that
+  uint32_t idle_us = 250000;
+  for (int i = 1; i < argc; i++) {
+    uint32_t *opt = nullptr;
+    if (strcmp(argv[i], "--flushes") == 0) {
+      opt = &flushes;
+    } else if (strcmp(argv[i], "--flushes-per-slot") == 0) {
+      opt = &flushes_per_slot;
+    } else if (strcmp(argv[i], "--ring-kb") == 0) {
+      opt = &ring_kb;
+    } else if (strcmp(argv[i], "--blocks") == 0) {
+      opt = &blocks;
+    } else if (strcmp(argv[i], "--idle-us") == 0) {
+      opt = &idle_us;
+    }
+    if (!opt || i + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    }
+    *opt = (uint32_t)strtoul(argv[++i], nullptr, 0);
+  }
+  uint32_t slots = ring_kb * 1024 / kSlotBytes;
+  if (flushes == 0 || flushes_per_slot == 0 || blocks < 8 || slots < 2 ||
+      (uint64_t)slots * kSlotBytes >= (uint64_t)blocks * kBlockBytes) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  g_flash.assign((size_t)blocks * kBlockBytes, 0xFF);
+  spiffs_config cfg = {};
+  cfg.hal_read_f = hal_read;
+  cfg.hal_write_f = hal_write;
+  cfg.hal_erase_f = hal_erase;
+  cfg.phys_size = blocks * kBlockBytes;
+  cfg.phys_addr = 0;
+  cfg.phys_erase_block = kBlockBytes;
+  cfg.log_block_size = kBlockBytes;
+  cfg.log_page_size = kPageBytes;
+
+  static spiffs fs;
+  std::vector<uint8_t> work(2 * kPageBytes);
+  std::vector<uint8_t> fds(kMaxFiles * kFdBytes);
+  std::vector<uint8_t> cache(kCachePages * (kPageBytes + kCachePageOverhead) + kCacheHeaderBytes);
+  SPIFFS_mount(&fs, &cfg, work.data(), fds.data(), (u32_t)fds.size(), cache.data(),
+               (u32_t)cache.size(), nullptr);
+  SPIFFS_unmount(&fs);
+  if (SPIFFS_format(&fs) < 0 ||
+      SPIFFS_mount(&fs, &cfg, work.data(), fds.data(), (u32_t)fds.size(), cache.data(),
+                   (u32_t)cache.size(), nullptr) < 0) {
+    fprintf(stderr, "mount failed\n");
+    return 1;
+  }
+
+  if (!file_fill(&fs, "sensors.bin", slots * kSlotBytes) ||
+      !file_fill(&fs, "sensors.idx", slots * kIndexEntryBytes)) {
+    fprintf(stderr, "cannot create the ring (%d)\n", (int)SPIFFS_errno(&fs));
+    return 1;
+  }
+  spiffs_file data = SPIFFS_open(&fs, "sensors.bin", SPIFFS_RDWR, 0);
+  spiffs_file idx = SPIFFS_open(&fs, "sensors.idx", SPIFFS_RDWR, 0);
+  if (data < 0 || idx < 0) {
+    fprintf(stderr, "cannot open the ring\n");
+    return 1;
+  }
+
+  std::vector<uint64_t> latency;
+  latency.reserve(flushes);
+  uint32_t gc_runs_before = fs.stats_gc_runs;
+  uint32_t collecting_flushes = 0;
+  nand_time_t idle = {};
+  nand_time_t total_start = g_nand;
+  std::vector<uint8_t> image(kSlotBytes);
+  uint8_t entry[kIndexEntryBytes];
+  for (uint32_t i = 0; i < flushes; i++) {
+    uint32_t slot = (i / flushes_per_slot) % slots;
+    memset(image.data(), (int)i, image.size());
+    memset(entry, (int)i, sizeof(entry));
+    uint64_t start_us = g_nand.us;
+    uint32_t runs = fs.stats_gc_runs;
+    bool ok = write_at(&fs, data, slot * kSlotBytes, image.data(), kSlotBytes) &&
+              SPIFFS_fflush(&fs, data) >= 0 &&
+              write_at(&fs, idx, slot * kIndexEntryBytes, entry, sizeof(entry)) &&
+              SPIFFS_fflush(&fs, idx) >= 0;
+    buf_flush();  // log_fs_spiffs syncs the write-back sector per call
+    if (!ok) {
+      fprintf(stderr, "flush %u failed (%d)\n", i, (int)SPIFFS_errno(&fs));
+      return 1;
+    }
+    latency.push_back(g_nand.us - start_us);
+    if (fs.stats_gc_runs != runs) {
+      collecting_flushes++;
+    }
+
+#if SPIFFS_GC_INCREMENTAL
+    // Idle until the next record: log_fs_spiffs_gc()
+    if (idle_us > 0) {
+      nand_time_t before = g_nand;
+      s32_t res;
+      do {
+        res = SPIFFS_gc_step(&fs, kGcStepMoves);
+      } while (res > 0 && g_nand.us - before.us < idle_us);
+      buf_flush();
+      if (res < 0) {
+        fprintf(stderr, "gc step failed (%d)\n", (int)res);
+        return 1;
+      }
+      idle.us += g_nand.us - before.us;
+      idle.reads += g_nand.reads - before.reads;
+      idle.programs += g_nand.programs - before.programs;
+      idle.erases += g_nand.erases - before.erases;
+    }
+#endif
+  }
+
+  // Every slot written holds its last flush, whoever moved its pages
+  for (uint32_t slot = 0; slot < slots && slot * flushes_per_slot < flushes; slot++) {
+    uint32_t last = flushes - 1;
+    while ((last / flushes_per_slot) % slots != slot) {
+      last--;
+    }
+    if (SPIFFS_lseek(&fs, data, (s32_t)(slot * kSlotBytes), SPIFFS_SEEK_SET) < 0 ||
+        SPIFFS_read(&fs, data, image.data(), kSlotBytes) != (s32_t)kSlotBytes ||
+        image[0] != (uint8_t)last || image[kSlotBytes - 1] != (uint8_t)last) {
+      fprintf(stderr, "slot %u does not hold flush %u\n", slot, last);
+      return 1;
+    }
+  }
+  SPIFFS_close(&fs, data);
+  SPIFFS_close(&fs, idx);
+  if (SPIFFS_check(&fs) < 0) {
+    fprintf(stderr, "check failed (%d)\n", (int)SPIFFS_errno(&fs));
+    return 1;
+  }
+
+  std::vector<uint64_t> sorted = latency;
+  std::sort(sorted.begin(), sorted.end());
+  uint64_t sum = 0;
+  for (uint64_t us : latency) {
+    sum += us;
+  }
+  uint32_t gc_runs = fs.stats_gc_runs - gc_runs_before;
+
+  printf("%s gc, %u blocks of %u KB, %u KB ring, %u flushes per slot, idle budget %u us\n",
+         SPIFFS_GC_INCREMENTAL ? "incremental" : "synchronous", blocks, kBlockBytes / 1024,
+         slots * kSlotBytes / 1024, flushes_per_slot, SPIFFS_GC_INCREMENTAL ? idle_us : 0);
+  printf("flush    %u: mean %.0f us, p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu us\n",
+         flushes, (double)sum / flushes,
+         (unsigned long long)percentile(sorted, 50), (unsigned long long)percentile(sorted, 90),
+         (unsigned long long)percentile(sorted, 99), (unsigned long long)percentile(sorted, 99.9),
+         (unsigned long long)sorted.back());
+  printf("gc       %u blocks collected, %u by flushes (%.2f%% of flushes)\n", gc_runs,
+         collecting_flushes, 100.0 * collecting_flushes / flushes);
+  printf("idle     %.1f ms: %llu reads, %llu programs, %llu erases\n", idle.us / 1000.0,
+         (unsigned long long)idle.reads, (unsigned long long)idle.programs,
+         (unsigned long long)idle.erases);
+  printf("total    %.1f ms: %llu reads, %llu programs, %llu erases\n",
+         (g_nand.us - total_start.us) / 1000.0,
+         (unsigned long long)(g_nand.reads - total_start.reads),
+         (unsigned long long)(g_nand.programs - total_start.programs),
+         (unsigned long long)(g_nand.erases - total_start.erases));
+  SPIFFS_unmount(&fs);
+  return 0;
+}
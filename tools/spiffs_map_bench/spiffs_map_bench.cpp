@@ -0,0 +1,705 @@
+/**
+ * @file spiffs_map_bench.cpp
+ * @brief SPIFFS lookups with and without the object index page map
+ *
+ * Builds a SPIFFS volume of each --mb size on a RAM flash with the NAND's
+ * geometry (2 KB pages, 128 KB blocks) and the HAL of main/log_fs_spiffs.cpp.
+ * Each sector read, program and block erase is charged the W25N512's time,
+ * as in tools/spiffs_gc_bench, and times are in that modelled time. The
+ * volume holds what the sensor log keeps, as in tools/spiffs_check_bench: a
+ * ring file of --ring-pct of the volume with some of its slots rewritten,
+ * the ring's index file and a few small files.
+ *
+ * On a fresh mount of the same image it then times opening and stat'ing
+ * each file, stat'ing a file that does not exist, and seeking to random
+ * slots of the ring: once scanning the lookup pages as upstream SPIFFS
+ * does, once with a SPIFFS_obj_map() of --map-entries and once with a map
+ * too small for the files' index headers, which falls back to scanning.
+ *
+ * Then it runs --verify-ops random file operations on a --verify-mb volume
+ * with the map given: writes, appends, truncation, removal, renames, garbage
+ * collection, remounts and checks. After each it looks every index page of
+ * every file up with the map and by scanning, and compares file contents
+ * with a model now and then. It fails if any of these differ.
+ */
+
+#include "spiffs.h"
+extern "C" {
+#include "spiffs_nucleus.h"
+}
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const uint32_t kPageBytes = 2048;
+static const uint32_t kPagesPerBlock = 64;
+static const uint32_t kBlockBytes = kPagesPerBlock * kPageBytes;
+static const uint32_t kMaxFiles = 4;
+static const uint32_t kFdBytes = 96;
+static const uint32_t kCachePages = 4;  // As log_fs_spiffs.cpp
+static const uint32_t kCachePageOverhead = 32;
+static const uint32_t kCacheHeaderBytes = 96;
+static const uint32_t kSlotBytes = 2048;  // LOG_SEGMENT_BYTES
+static const uint32_t kIndexEntryBytes = 16;
+static const uint32_t kSmallMapEntries = 4;
+
+// W25N512GV timings and bus, as nand_geometry_w25n512() in tools/nand_sim
+static const uint32_t kReadUs = 60;
+static const uint32_t kProgramUs = 250;
+static const uint32_t kEraseUs = 2000;
+static const uint32_t kSpiClockHz = 10000000;
+static const uint32_t kNoSector = 0xFFFFFFFF;
+
+static std::vector<uint8_t> g_flash;
+static std::vector<uint8_t> g_buf(kPageBytes);  // Write-back sector
+static uint32_t g_buf_sector = kNoSector;
+static bool g_buf_dirty = false;
+
+typedef struct {
+  uint64_t us;  // Modelled NAND time
+  uint64_t reads;
+  uint64_t programs;
+  uint64_t erases;
+} nand_time_t;
+
+static nand_time_t g_nand = {};
+
+static uint64_t transfer_us(uint32_t bytes) {
+  return (uint64_t)bytes * 8 * 1000000 / kSpiClockHz;
+}
+
+// ============================================================================
+// RAM flash behind a one-sector write-back buffer (log_fs_spiffs.cpp's HAL)
+// ============================================================================
+
+static void sector_read(uint32_t sector, uint8_t *dst) {
+  memcpy(dst, &g_flash[(size_t)sector * kPageBytes], kPageBytes);
+  g_nand.us += kReadUs + transfer_us(kPageBytes);
+  g_nand.reads++;
+}
+
+static void buf_flush(void) {
+  if (!g_buf_dirty) {
+    return;
+  }
+  memcpy(&g_flash[(size_t)g_buf_sector * kPageBytes], g_buf.data(), kPageBytes);
+  g_nand.us += kProgramUs + transfer_us(kPageBytes);
+  g_nand.programs++;
+  g_buf_dirty = false;
+}
+
+static s32_t hal_read(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *dst) {
+  (void)fs;
+  static std::vector<uint8_t> page(kPageBytes);
+  while (size > 0) {
+    uint32_t sector = addr / kPageBytes;
+    uint32_t in = addr % kPageBytes;
+    uint32_t n = std::min(kPageBytes - in, size);
+    if (sector == g_buf_sector) {
+      memcpy(dst, &g_buf[in], n);
+    } else {
+      sector_read(sector, page.data());
+      memcpy(dst, &page[in], n);
+    }
+    addr += n;
+    dst += n;
+    size -= n;
+  }
+  return SPIFFS_OK;
+}
+
+static s32_t hal_write(struct spiffs_t *fs, u32_t addr, u32_t size, u8_t *src) {
+  (void)fs;
+  while (size > 0) {
+    uint32_t sector = addr / kPageBytes;
+    uint32_t in = addr % kPageBytes;
+    uint32_t n = std::min(kPageBytes - in, size);
+    if (sector != g_buf_sector) {
+      buf_flush();
+      sector_read(sector, g_buf.data());
+      g_buf_sector = sector;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      g_buf[in + i] &= src[i];
+    }
+    g_buf_dirty = true;
+    addr += n;
+    src += n;
+    size -= n;
+  }
+  return SPIFFS_OK;
+}
+
+static s32_t hal_erase(struct spiffs_t *fs, u32_t addr, u32_t size) {
+  (void)fs;
+  uint32_t first = addr / kPageBytes;
+  if (g_buf_sector >= first && g_buf_sector < first + size / kPageBytes) {
+    g_buf_sector = kNoSector;
+    g_buf_dirty = false;
+  } else {
+    buf_flush();
+  }
+  memset(&g_flash[addr], 0xFF, size);
+  g_nand.us += (uint64_t)kEraseUs * (size / kBlockBytes);
+  g_nand.erases += size / kBlockBytes;
+  return SPIFFS_OK;
+}
+
+extern "C" void spiffs_api_lock(struct spiffs_t *fs) { (void)fs; }
+extern "C" void spiffs_api_unlock(struct spiffs_t *fs) { (void)fs; }
+
+// ============================================================================
+// Volume
+// ============================================================================
+
+static spiffs g_fs;
+static std::vector<uint8_t> g_work(2 * kPageBytes);
+static std::vector<uint8_t> g_fds(kMaxFiles * kFdBytes);
+static std::vector<uint8_t> g_cache(kCachePages * (kPageBytes + kCachePageOverhead) +
+                                    kCacheHeaderBytes);
+static std::vector<spiffs_obj_map_entry> g_map;
+static uint32_t g_volume_bytes;
+static uint32_t g_check_fixes;
+
+static void check_cb(struct spiffs_t *fs, spiffs_check_type type, spiffs_check_report report,
+                     u32_t arg1, u32_t arg2) {
+  (void)fs;
+  (void)type;
+  (void)arg1;
+  (void)arg2;
+  if (report != SPIFFS_CHECK_PROGRESS) {
+    g_check_fixes++;
+  }
+}
+
+static void load(const std::vector<uint8_t> &image) {
+  g_flash = image;
+  g_buf_sector = kNoSector;
+  g_buf_dirty = false;
+}
+
+static bool mount(void) {
+  spiffs_config cfg = {};
+  cfg.hal_read_f = hal_read;
+  cfg.hal_write_f = hal_write;
+  cfg.hal_erase_f = hal_erase;
+  cfg.phys_size = g_volume_bytes;
+  cfg.phys_addr = 0;
+  cfg.phys_erase_block = kBlockBytes;
+  cfg.log_block_size = kBlockBytes;
+  cfg.log_page_size = kPageBytes;
+  return SPIFFS_mount(&g_fs, &cfg, g_work.data(), g_fds.data(), (u32_t)g_fds.size(),
+                      g_cache.data(), (u32_t)g_cache.size(), check_cb) >= 0;
+}
+
+static void unmount(void) {
+  SPIFFS_unmount(&g_fs);
+  buf_flush();
+}
+
+static bool map_attach(uint32_t entries) {
+  g_map.assign(entries, spiffs_obj_map_entry{});
+  return SPIFFS_obj_map(&g_fs, entries ? g_map.data() : nullptr,
+                        entries * sizeof(spiffs_obj_map_entry)) >= 0;
+}
+
+static bool format(void) {
+  g_flash.assign(g_volume_bytes, 0xFF);
+  g_buf_sector = kNoSector;
+  g_buf_dirty = false;
+  mount();
+  SPIFFS_unmount(&g_fs);
+  return SPIFFS_format(&g_fs) >= 0 && mount();
+}
+
+static bool file_fill(const char *name, uint32_t bytes, uint8_t seed) {
+  spiffs_file fh = SPIFFS_open(&g_fs, name, SPIFFS_CREAT | SPIFFS_TRUNC | SPIFFS_RDWR, 0);
+  if (fh < 0) {
+    return false;
+  }
+  std::vector<uint8_t> chunk(kPageBytes);
+  for (uint32_t done = 0; done < bytes; done += (uint32_t)chunk.size()) {
+    memset(chunk.data(), (int)(seed + done / kPageBytes * 13), chunk.size());
+    s32_t n = (s32_t)std::min<uint32_t>((uint32_t)chunk.size(), bytes - done);
+    if (SPIFFS_write(&g_fs, fh, chunk.data(), n) != n) {
+      SPIFFS_close(&g_fs, fh);
+      return false;
+    }
+  }
+  return SPIFFS_close(&g_fs, fh) >= 0;
+}
+
+static const char *const kLogFiles[] = {
+    "sensors.bin", "sensors.idx", "rollup_hour.bin", "rollup_day.bin", "config.json",
+};
+static const uint32_t kLogFileCount = sizeof(kLogFiles) / sizeof(kLogFiles[0]);
+
+// The sensor log's files, as tools/spiffs_check_bench lays them out
+static bool populate(uint32_t ring_pct, uint32_t churn_pct, uint32_t *slots_out) {
+  if (!format()) {
+    fprintf(stderr, "mount failed\n");
+    return false;
+  }
+  uint32_t slots = (uint32_t)((uint64_t)g_volume_bytes * ring_pct / 100 / kSlotBytes);
+  bool ok = file_fill("sensors.bin", slots * kSlotBytes, 1) &&
+            file_fill("sensors.idx", slots * kIndexEntryBytes, 2) &&
+            file_fill("rollup_hour.bin", 64 * 1024, 3) &&
+            file_fill("rollup_day.bin", 16 * 1024, 4) && file_fill("config.json", 1024, 5);
+  spiffs_file fh = ok ? SPIFFS_open(&g_fs, "sensors.bin", SPIFFS_RDWR, 0) : -1;
+  ok = fh >= 0;
+  std::vector<uint8_t> image(kSlotBytes);
+  uint32_t rewrites = slots * churn_pct / 100;
+  for (uint32_t i = 0; ok && i < rewrites; i++) {
+    uint32_t slot = (uint32_t)((uint64_t)i * 7919 % slots);
+    memset(image.data(), (int)(0x80 + i), image.size());
+    ok = SPIFFS_lseek(&g_fs, fh, (s32_t)(slot * kSlotBytes), SPIFFS_SEEK_SET) >= 0 &&
+         SPIFFS_write(&g_fs, fh, image.data(), (s32_t)image.size()) == (s32_t)image.size() &&
+         SPIFFS_fflush(&g_fs, fh) >= 0;
+  }
+  if (fh >= 0) {
+    SPIFFS_close(&g_fs, fh);
+  }
+  if (!ok) {
+    fprintf(stderr, "cannot populate the volume (%d)\n", (int)SPIFFS_errno(&g_fs));
+    unmount();
+    return false;
+  }
+  *slots_out = slots;
+  unmount();
+  return true;
+}
+
+// ============================================================================
+// Lookup timing
+// ============================================================================
+
+typedef struct {
+  uint32_t ops;
+  uint32_t failures;
+  nand_time_t nand;
+  double wall_us;
+} op_cost_t;
+
+static op_cost_t time_ops(uint32_t ops, const std::function<bool(uint32_t)> &op) {
+  op_cost_t cost = {};
+  cost.ops = ops;
+  nand_time_t before = g_nand;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < ops; i++) {
+    if (!op(i)) {
+      cost.failures++;
+    }
+  }
+  cost.wall_us =
+      std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  cost.nand.us = g_nand.us - before.us;
+  cost.nand.reads = g_nand.reads - before.reads;
+  return cost;
+}
+
+static void print_cost(const char *name, const op_cost_t &cost) {
+  printf("    %-16s %9.2f ms %8.1f reads %8.2f us wall per op%s\n", name,
+         cost.nand.us / 1000.0 / cost.ops, (double)cost.nand.reads / cost.ops,
+         cost.wall_us / cost.ops, cost.failures ? "  FAILED" : "");
+}
+
+static uint32_t g_rng = 1;
+
+static uint32_t rng_next(void) {
+  g_rng ^= g_rng << 13;
+  g_rng ^= g_rng >> 17;
+  g_rng ^= g_rng << 5;
+  return g_rng;
+}
+
+// Times each lookup on a fresh mount of the image with a map of the given
+// entries, or none. Returns false if any lookup failed.
+static bool time_lookups(const std::vector<uint8_t> &image, uint32_t slots, uint32_t entries,
+                         uint32_t ops) {
+  load(image);
+  if (!mount()) {
+    fprintf(stderr, "mount failed\n");
+    return false;
+  }
+  bool ok = true;
+  if (entries) {
+    op_cost_t build = time_ops(1, [&](uint32_t) { return map_attach(entries); });
+    printf("  map, %u entries: %u used%s\n", entries, g_fs.obj_map_used,
+           g_fs.obj_map_lost ? ", index headers did not fit" : "");
+    print_cost("SPIFFS_obj_map", build);
+    ok = build.failures == 0;
+  } else {
+    printf("  no map\n");
+  }
+
+  auto open_close = [&](uint32_t i) {
+    spiffs_file fh = SPIFFS_open(&g_fs, kLogFiles[i % kLogFileCount], SPIFFS_RDONLY, 0);
+    return fh >= 0 && SPIFFS_close(&g_fs, fh) >= 0;
+  };
+  auto stat = [&](uint32_t i) {
+    spiffs_stat s;
+    return SPIFFS_stat(&g_fs, kLogFiles[i % kLogFileCount], &s) >= 0;
+  };
+  auto stat_missing = [&](uint32_t i) {
+    char name[32];
+    snprintf(name, sizeof(name), "missing%u", i);
+    spiffs_stat s;
+    return SPIFFS_stat(&g_fs, name, &s) == SPIFFS_ERR_NOT_FOUND;
+  };
+  spiffs_file ring = SPIFFS_open(&g_fs, "sensors.bin", SPIFFS_RDONLY, 0);
+  auto seek_read = [&](uint32_t) {
+    uint8_t head[16];
+    s32_t offset = (s32_t)(rng_next() % slots * kSlotBytes);
+    return SPIFFS_lseek(&g_fs, ring, offset, SPIFFS_SEEK_SET) == offset &&
+           SPIFFS_read(&g_fs, ring, head, sizeof(head)) == (s32_t)sizeof(head);
+  };
+  // One round first, so that each starts with what the previous left cached
+  g_rng = 1;
+  time_ops(kLogFileCount, open_close);
+  time_ops(kLogFileCount, stat);
+  time_ops(1, stat_missing);
+  time_ops(1, seek_read);
+  op_cost_t costs[] = {
+      time_ops(ops, open_close),
+      time_ops(ops, stat),
+      time_ops(ops, stat_missing),
+      time_ops(ops, seek_read),
+  };
+  SPIFFS_close(&g_fs, ring);
+  print_cost("open + close", costs[0]);
+  print_cost("stat", costs[1]);
+  print_cost("stat, no file", costs[2]);
+  print_cost("seek + read", costs[3]);
+  if (entries) {
+    printf("    %u lookups from the map, %u scanned\n", g_fs.obj_map_hits, g_fs.obj_map_scans);
+  }
+  for (const op_cost_t &cost : costs) {
+    ok = ok && cost.failures == 0;
+  }
+  unmount();
+  return ok;
+}
+
+// ============================================================================
+// Map against scan
+// ============================================================================
+
+typedef std::map<std::string, std::vector<uint8_t>> model_t;
+
+static uint32_t g_compared;
+static uint32_t g_mismatches;
+
+static void mismatch(uint32_t op, const char *what, const std::string &name, long a, long b) {
+  if (g_mismatches++ < 10) {
+    fprintf(stderr, "op %u: %s of %s differ: %ld with the map, %ld scanning\n", op, what,
+            name.c_str(), a, b);
+  }
+}
+
+// Looks every index page of every file up with the map and again scanning
+static void compare_lookups(uint32_t op, const model_t &model,
+                            const std::vector<std::string> &names) {
+  for (const std::string &name : names) {
+    spiffs_stat mapped = {};
+    spiffs_stat scanned = {};
+    s32_t mapped_res = SPIFFS_stat(&g_fs, name.c_str(), &mapped);
+    void *map = g_fs.obj_map;
+    g_fs.obj_map = nullptr;
+    s32_t scanned_res = SPIFFS_stat(&g_fs, name.c_str(), &scanned);
+    g_fs.obj_map = map;
+    g_compared++;
+    if (mapped_res != scanned_res) {
+      mismatch(op, "stat results", name, mapped_res, scanned_res);
+      continue;
+    }
+    auto it = model.find(name);
+    if (mapped_res != SPIFFS_OK) {
+      if (it != model.end()) {
+        mismatch(op, "stat results (file exists)", name, mapped_res, scanned_res);
+      }
+      continue;
+    }
+    if (mapped.pix != scanned.pix) {
+      mismatch(op, "header pages", name, mapped.pix, scanned.pix);
+    }
+    if (it == model.end() || mapped.size != it->second.size()) {
+      mismatch(op, "sizes", name, mapped.size, it == model.end() ? -1 : (long)it->second.size());
+    }
+    uint32_t data_pages = (mapped.size + SPIFFS_DATA_PAGE_SIZE(&g_fs) - 1) /
+                          SPIFFS_DATA_PAGE_SIZE(&g_fs);
+    spiffs_span_ix last = data_pages ? SPIFFS_OBJ_IX_ENTRY_SPAN_IX(&g_fs, data_pages - 1) : 0;
+    // One past the last, which must not be found either way
+    for (spiffs_span_ix spix = 0; spix <= last + 1; spix++) {
+      spiffs_page_ix mapped_pix = 0;
+      spiffs_page_ix scanned_pix = 0;
+      spiffs_obj_id obj_id = mapped.obj_id | SPIFFS_OBJ_ID_IX_FLAG;
+      mapped_res = spiffs_obj_lu_find_id_and_span(&g_fs, obj_id, spix, 0, &mapped_pix);
+      g_fs.obj_map = nullptr;
+      scanned_res = spiffs_obj_lu_find_id_and_span(&g_fs, obj_id, spix, 0, &scanned_pix);
+      g_fs.obj_map = map;
+      g_compared++;
+      if (mapped_res != scanned_res || mapped_pix != scanned_pix) {
+        char what[48];
+        snprintf(what, sizeof(what), "index page %u", spix);
+        mismatch(op, what, name, mapped_res < 0 ? mapped_res : mapped_pix,
+                 scanned_res < 0 ? scanned_res : scanned_pix);
+      }
+    }
+  }
+}
+
+static bool compare_contents(uint32_t op, const model_t &model) {
+  for (const auto &file : model) {
+    std::vector<uint8_t> data(file.second.size() + 1);
+    spiffs_file fh = SPIFFS_open(&g_fs, file.first.c_str(), SPIFFS_RDONLY, 0);
+    s32_t n = fh < 0 ? fh : SPIFFS_read(&g_fs, fh, data.data(), (s32_t)data.size());
+    if (fh >= 0) {
+      SPIFFS_close(&g_fs, fh);
+    }
+    if (n == SPIFFS_ERR_END_OF_OBJECT) {
+      n = 0;
+    }
+    g_compared++;
+    if (n != (s32_t)file.second.size() || memcmp(data.data(), file.second.data(), n) != 0) {
+      mismatch(op, "contents", file.first, n, (long)file.second.size());
+      return false;
+    }
+  }
+  return true;
+}
+
+static void random_bytes(uint8_t *dst, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    dst[i] = (uint8_t)rng_next();
+  }
+}
+
+static bool write_at(const std::string &name, uint32_t offset, const uint8_t *data, uint32_t n,
+                     spiffs_flags flags) {
+  spiffs_file fh = SPIFFS_open(&g_fs, name.c_str(), flags | SPIFFS_RDWR, 0);
+  if (fh < 0) {
+    return false;
+  }
+  bool ok = SPIFFS_lseek(&g_fs, fh, (s32_t)offset, SPIFFS_SEEK_SET) == (s32_t)offset &&
+            SPIFFS_write(&g_fs, fh, (void *)data, (s32_t)n) == (s32_t)n;
+  return SPIFFS_close(&g_fs, fh) >= 0 && ok;
+}
+
+// Random file operations, each followed by a comparison of every lookup.
+// Files up to a few MB have index pages beyond the header.
+static bool verify(uint32_t ops, uint32_t entries) {
+  static const uint32_t kBigMax = 6 * 1024 * 1024;
+  static const uint32_t kSmallMax = 48 * 1024;
+  std::vector<std::string> names = {"big"};
+  for (int i = 0; i < 8; i++) {
+    names.push_back("f" + std::to_string(i));
+  }
+  if (!format() || !map_attach(entries)) {
+    fprintf(stderr, "mount failed\n");
+    return false;
+  }
+  model_t model;
+  std::vector<uint8_t> data(3 * 1024 * 1024);
+  random_bytes(data.data(), (uint32_t)data.size());
+  if (!write_at("big", 0, data.data(), (uint32_t)data.size(), SPIFFS_CREAT)) {
+    fprintf(stderr, "cannot write big (%d)\n", (int)SPIFFS_errno(&g_fs));
+    return false;
+  }
+  model["big"] = data;
+
+  uint32_t counts[10] = {};
+  g_check_fixes = 0;
+  g_rng = 7;
+  for (uint32_t op = 0; op < ops && g_mismatches == 0; op++) {
+    const std::string &name = names[rng_next() % names.size()];
+    auto it = model.find(name);
+    bool big = name == "big";
+    uint32_t kind = rng_next() % 10;
+    bool ok = true;
+    switch (kind) {
+    case 0: {  // create or rewrite whole
+      // SPIFFS gives up with ERR_FULL on a write of several MB while most of
+      // the volume is deleted pages it has yet to collect
+      uint32_t n = rng_next() % (big ? kBigMax / 6 : kSmallMax);
+      data.resize(n);
+      random_bytes(data.data(), n);
+      ok = write_at(name, 0, data.data(), n, SPIFFS_CREAT | SPIFFS_TRUNC);
+      model[name] = data;
+      break;
+    }
+    case 1: {  // append
+      if (it == model.end()) break;
+      uint32_t max = big ? kBigMax : kSmallMax;
+      uint32_t n = std::min<uint32_t>(1 + rng_next() % (big ? 256 * 1024 : 8 * 1024),
+                                      max - std::min<uint32_t>(max, (uint32_t)it->second.size()));
+      if (n == 0) break;
+      data.resize(n);
+      random_bytes(data.data(), n);
+      ok = write_at(name, (uint32_t)it->second.size(), data.data(), n, SPIFFS_APPEND);
+      it->second.insert(it->second.end(), data.begin(), data.end());
+      break;
+    }
+    case 2: {  // rewrite in place
+      if (it == model.end() || it->second.empty()) break;
+      uint32_t offset = rng_next() % (uint32_t)it->second.size();
+      uint32_t n = std::min<uint32_t>(1 + rng_next() % 4096, (uint32_t)it->second.size() - offset);
+      data.resize(n);
+      random_bytes(data.data(), n);
+      ok = write_at(name, offset, data.data(), n, 0);
+      memcpy(&it->second[offset], data.data(), n);
+      break;
+    }
+    case 3:  // remove
+      if (it == model.end()) break;
+      ok = SPIFFS_remove(&g_fs, name.c_str()) >= 0;
+      model.erase(it);
+      break;
+    case 4: {  // rename to a free name
+      const std::string &to = names[rng_next() % names.size()];
+      if (it == model.end() || model.count(to)) break;
+      ok = SPIFFS_rename(&g_fs, name.c_str(), to.c_str()) >= 0;
+      model[to] = it->second;
+      model.erase(name);
+      break;
+    }
+    case 5: {  // truncate
+      if (it == model.end() || it->second.empty()) break;
+      uint32_t n = rng_next() % (uint32_t)it->second.size();
+      spiffs_file fh = SPIFFS_open(&g_fs, name.c_str(), SPIFFS_RDWR, 0);
+      ok = fh >= 0 && SPIFFS_ftruncate(&g_fs, fh, n) >= 0;
+      if (fh >= 0) {
+        ok = SPIFFS_close(&g_fs, fh) >= 0 && ok;
+      }
+      it->second.resize(n);
+      break;
+    }
+    case 6: {  // collect some garbage
+      s32_t res;
+      uint32_t steps = 0;
+      while ((res = SPIFFS_gc_step(&g_fs, 8)) > 0 && ++steps < 64) {
+      }
+      ok = res >= 0;
+      break;
+    }
+    case 7:  // remount, which forgets the map until it is given again
+      unmount();
+      ok = mount() && map_attach(entries);
+      break;
+    case 8:  // check, which puts the map aside and builds it again
+      ok = SPIFFS_check_fast(&g_fs, nullptr, 0) >= 0;
+      break;
+    default:
+      ok = compare_contents(op, model);
+      break;
+    }
+    counts[kind]++;
+    if (!ok) {
+      fprintf(stderr, "op %u (kind %u on %s) failed (%d)\n", op, kind, name.c_str(),
+              (int)SPIFFS_errno(&g_fs));
+      return false;
+    }
+    compare_lookups(op, model, names);
+  }
+  compare_contents(ops, model);
+  printf("  %u ops (%u writes, %u appends, %u rewrites, %u removes, %u renames, %u truncates,\n"
+         "  %u gc, %u remounts, %u checks), %u lookups and reads compared, %u differ\n",
+         ops, counts[0], counts[1], counts[2], counts[3], counts[4], counts[5], counts[6],
+         counts[7], counts[8], g_compared, g_mismatches);
+  if (g_check_fixes) {
+    fprintf(stderr, "checks mended %u things on an intact volume\n", g_check_fixes);
+  }
+  unmount();
+  return g_mismatches == 0 && g_check_fixes == 0;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--mb N[,N...]] [--ring-pct N] [--churn-pct N] [--ops N]\n"
+          "          [--map-entries N] [--verify-mb N] [--verify-ops N]\n"
+          "  Times opening, stat'ing and seeking on volumes of each size with and\n"
+          "  without SPIFFS_obj_map(), then compares the map's answers with\n"
+          "  scans over --verify-ops random operations (0 for none).\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  std::vector<uint32_t> sizes_mb = {8, 16, 32, 64};
+  uint32_t ring_pct = 50;  // As the device's ring
+  uint32_t churn_pct = 10;
+  uint32_t ops = 200;
+  uint32_t map_entries = 64;  // As log_fs_spiffs.cpp
+  uint32_t verify_mb = 16;
+  uint32_t verify_ops = 2000;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (strcmp(argv[i], "--mb") == 0) {
+      sizes_mb.clear();
+      for (char *p = argv[++i]; *p;) {
+        sizes_mb.push_back((uint32_t)strtoul(p, &p, 0));
+        if (*p == ',') {
+          p++;
+        }
+      }
+    } else if (strcmp(argv[i], "--ring-pct") == 0) {
+      ring_pct = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--churn-pct") == 0) {
+      churn_pct = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--ops") == 0) {
+      ops = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--map-entries") == 0) {
+      map_entries = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--verify-mb") == 0) {
+      verify_mb = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--verify-ops") == 0) {
+      verify_ops = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (ring_pct == 0 || ring_pct > 80 || churn_pct > 100 || ops == 0 ||
+      map_entries <= kSmallMapEntries || verify_mb < 16 || verify_mb > 64) {
+    usage(argv[0]);
+    return 2;
+  }
+  for (uint32_t mb : sizes_mb) {
+    // Page indices are 16 bits wide
+    if (mb < 2 || mb > 64) {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  bool ok = true;
+  for (uint32_t mb : sizes_mb) {
+    g_volume_bytes = mb * 1024 * 1024;
+    uint32_t slots = 0;
+    if (!populate(ring_pct, churn_pct, &slots)) {
+      return 1;
+    }
+    std::vector<uint8_t> image = g_flash;
+    printf("%u MB, %u pages, %u files, %u KB ring\n", mb, g_volume_bytes / kPageBytes,
+           kLogFileCount, slots * kSlotBytes / 1024);
+    ok = time_lookups(image, slots, 0, ops) && ok;
+    ok = time_lookups(image, slots, map_entries, ops) && ok;
+    ok = time_lookups(image, slots, kSmallMapEntries, ops) && ok;
+    printf("\n");
+  }
+
+  if (verify_ops) {
+    g_volume_bytes = verify_mb * 1024 * 1024;
+    printf("%u MB, map of %u entries against scans\n", verify_mb, map_entries);
+    ok = verify(verify_ops, map_entries) && ok;
+  }
+  return ok ? 0 : 1;
+}
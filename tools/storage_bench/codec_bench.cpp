@@ -0,0 +1,351 @@
+/**
+ * @file codec_bench.cpp
+ * @brief main/record_codec.cpp encode and decode speed, and history per slot
+ *
+ * Encodes a trace into slot blocks as log storage does (LOG_SEGMENT_BYTES
+ * less the slot header), RAW and DELTA, in record format 1 and in format 2
+ * with the firmware's default schema. Every block is sealed, then decoded
+ * back with record_decoder_init_sealed(), and the tool fails if a record
+ * differs from what went in on any stored field, or if a field the schema
+ * leaves out does not come back as 0.
+ *
+ * For each it prints the bytes per record on flash (whole slots over the
+ * records they hold), the encode and decode rates, and how much more
+ * history the same NAND holds with DELTA: against RAW blocks of the same
+ * schema, and against the flat file of 28-byte records the log was before
+ * the codec.
+ *
+ * Synthetic traces, 1 Hz from --seed:
+ *   indoor    a device on a desk: 5 s CO2/T/RH averages, PM and particle
+ *             counts with sensor noise, pressure read every 5 s, slow gas
+ *             indices, the accelerometer at rest
+ *   commute   the same device carried: busier air, a drifting pressure and
+ *             the accelerometer in motion
+ *   sawtooth  storage_bench's make_record(): every stored field steps each
+ *             second
+ * --replay FILE adds a trace read from a CSV as tools/sensors_export writes
+ * it (a dump pulled off a device), columns matched by name. --fields MASK
+ * runs format 2 with another schema (a LOG_FIELD_BIT mask), as a different
+ * LOG_STORAGE_FIELDS would write.
+ */
+
+#include "log_format.h"
+#include "log_storage.h"
+#include "record_codec.h"
+
+#include <chrono>
+#include <random>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t kBlockBytes = LOG_SEGMENT_BYTES - sizeof(slot_header_t);
+// LOG_STORAGE_FIELDS' default (log_storage.cpp)
+static const uint32_t kDefaultFields = LOG_FIELDS_CORE | LOG_FIELDS_PARTICLES | LOG_FIELDS_MOTION;
+static const uint32_t kBaseTimestampMs = 1000000;
+static const double kFlatRecordBytes = 28.0;  // sensor_record_t before the codec
+
+typedef std::vector<sensor_record_t> Trace;
+
+static std::mt19937 g_rng;
+static uint32_t g_fields = kDefaultFields;  // Format 2 schema
+
+static double gauss(double sd) { return std::normal_distribution<double>(0.0, sd)(g_rng); }
+
+// A value that wanders by sd a step and is pulled back towards mean
+struct Walk {
+  double mean, value, sd, pull;
+  double step() {
+    value += gauss(sd) + (mean - value) * pull;
+    return value;
+  }
+};
+
+template <typename T>
+static T clamp_to(double v, double lo, double hi) {
+  return (T)(v < lo ? lo : v > hi ? hi : v);
+}
+
+// One device second: moving selects the commute profile
+static Trace synthetic(uint32_t n, bool moving) {
+  double busy = moving ? 3.0 : 1.0;
+  Walk co2 = {moving ? 650.0 : 900.0, 900.0, 1.5 * busy, 0.002};
+  Walk temp = {moving ? 1400.0 : 2250.0, 2250.0, 1.0 * busy, 0.001};
+  Walk rh = {moving ? 6500.0 : 4200.0, 4200.0, 2.0 * busy, 0.001};
+  Walk pm = {moving ? 180.0 : 60.0, 60.0, 0.8 * busy, 0.01};
+  Walk voc = {moving ? 140.0 : 100.0, 100.0, 0.3 * busy, 0.005};
+  Walk pa = {100800.0, 100800.0, moving ? 4.0 : 0.5, 0.001};
+  Trace t(n);
+  uint32_t pressure = 100800;
+  for (uint32_t i = 0; i < n; i++) {
+    sensor_record_t &r = t[i];
+    r.timestamp_ms = kBaseTimestampMs + i * 1000;
+    // STCC4 reads are 5 s averages, so they move a little every second
+    r.co2_ppm = clamp_to<uint16_t>(co2.step(), 400, 5000);
+    r.temp_c_x100 = clamp_to<int16_t>(temp.step(), -2000, 5000);
+    r.rh_x100 = clamp_to<int16_t>(rh.step(), 0, 10000);
+    // SPS30: the mass bins and counts share one noisy reading
+    double p = pm.step() + gauss(3.0 * busy);
+    p = p < 0 ? 0 : p;
+    r.pm1_x10 = clamp_to<uint16_t>(p * 0.68, 0, 10000);
+    r.pm25_x10 = clamp_to<uint16_t>(p, 0, 10000);
+    r.pm4_x10 = clamp_to<uint16_t>(p * 1.12, 0, 10000);
+    r.pm10_x10 = clamp_to<uint16_t>(p * 1.18, 0, 10000);
+    r.pn05_cm3 = clamp_to<uint16_t>(p * 0.55, 0, 65535);
+    r.pn10_cm3 = clamp_to<uint16_t>(p * 0.64, 0, 65535);
+    r.pn25_cm3 = clamp_to<uint16_t>(p * 0.66, 0, 65535);
+    // DPS368 reads every 5 s
+    double drift = pa.step();
+    if (i % 5 == 0) {
+      pressure = clamp_to<uint32_t>(drift + gauss(1.5), 30000, 120000);
+    }
+    r.pressure_pa = pressure;
+    r.voc_index = clamp_to<uint16_t>(voc.step(), 1, 500);
+    r.nox_index = (uint16_t)(moving && i % 600 < 60 ? 2 : 1);
+    // LIS2DH12 at rest is a few mg of noise round 1 g on Z
+    double shake = moving ? 120.0 : 4.0;
+    r.accel_x_mg = clamp_to<int16_t>(gauss(shake), -2000, 2000);
+    r.accel_y_mg = clamp_to<int16_t>(gauss(shake), -2000, 2000);
+    r.accel_z_mg = clamp_to<int16_t>(1000 + gauss(shake), -2000, 2000);
+  }
+  return t;
+}
+
+// As storage_bench's make_record()
+static Trace sawtooth(uint32_t n) {
+  Trace t(n);
+  for (uint32_t i = 0; i < n; i++) {
+    sensor_record_t &r = t[i];
+    r.timestamp_ms = kBaseTimestampMs + i * 1000;
+    r.co2_ppm = (uint16_t)(400 + i % 800);
+    r.temp_c_x100 = (int16_t)(2000 + i % 500);
+    r.rh_x100 = (int16_t)(4000 + i % 3000);
+    r.pm25_x10 = (uint16_t)(i % 1200);
+    r.pressure_pa = 101325 - i % 200;
+    r.pm4_x10 = (uint16_t)(i % 1300);
+    r.accel_z_mg = (int16_t)(1000 - i % 3);
+  }
+  return t;
+}
+
+// Rows of a sensors_export CSV; columns it does not know are ignored
+static bool replay(const char *path, Trace *t) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  struct Col {
+    const char *name;
+    size_t offset;
+    size_t size;
+  };
+#define REPLAY_COL(id, name, type) {#name, offsetof(sensor_record_t, name), sizeof(type)},
+  static const Col kCols[] = {
+      {"timestamp_ms", offsetof(sensor_record_t, timestamp_ms), sizeof(uint32_t)},
+      LOG_FIELDS(REPLAY_COL)};
+#undef REPLAY_COL
+  std::vector<int> map;  // CSV column -> kCols index, -1 to skip
+  char line[1024];
+  if (!fgets(line, sizeof(line), f)) {
+    fclose(f);
+    return false;
+  }
+  for (char *tok = strtok(line, ",\r\n"); tok; tok = strtok(nullptr, ",\r\n")) {
+    int found = -1;
+    for (size_t c = 0; c < sizeof(kCols) / sizeof(kCols[0]); c++) {
+      if (strcmp(tok, kCols[c].name) == 0) {
+        found = (int)c;
+      }
+    }
+    map.push_back(found);
+  }
+  while (fgets(line, sizeof(line), f)) {
+    sensor_record_t r = {};
+    char *p = line;
+    for (size_t c = 0; c < map.size() && *p; c++) {
+      char *end;
+      long long v = strtoll(p, &end, 10);
+      if (map[c] >= 0) {
+        const Col &col = kCols[map[c]];
+        if (col.size == 2) {
+          uint16_t v16 = (uint16_t)v;
+          memcpy((uint8_t *)&r + col.offset, &v16, 2);
+        } else {
+          uint32_t v32 = (uint32_t)v;
+          memcpy((uint8_t *)&r + col.offset, &v32, 4);
+        }
+      }
+      p = *end == ',' ? end + 1 : end;
+    }
+    t->push_back(r);
+  }
+  fclose(f);
+  return !t->empty();
+}
+
+// What decoding a record stored under fields (0: format 1) gives back
+static bool same_stored(const sensor_record_t &in, const sensor_record_t &out, uint32_t fields) {
+  uint32_t stored = fields ? fields : LOG_FIELDS_CORE;
+  if (in.timestamp_ms != out.timestamp_ms) {
+    return false;
+  }
+#define SAME_FIELD(id, name, type)                                         \
+  if (out.name != ((stored & LOG_FIELD_BIT(name)) ? in.name : (type)0)) { \
+    return false;                                                          \
+  }
+  LOG_FIELDS(SAME_FIELD)
+#undef SAME_FIELD
+  return true;
+}
+
+struct Result {
+  size_t blocks;
+  double bytes_per_record;
+  double records_per_block;
+  double encode_ns;  // Per record
+  double decode_ns;
+  bool ok;
+};
+
+static Result run(const Trace &t, record_encoding_t encoding, uint32_t fields) {
+  Result res = {};
+  std::vector<uint8_t> blocks;
+  std::vector<uint32_t> counts;
+  record_encoder_t enc;
+  size_t at = 0;
+
+  Clock::time_point t0 = Clock::now();
+  while (at < t.size()) {
+    blocks.resize(blocks.size() + kBlockBytes);
+    uint8_t *buf = &blocks[blocks.size() - kBlockBytes];
+    record_encoder_init(&enc, encoding, fields, buf, kBlockBytes);
+    while (at < t.size() && record_encoder_append(&enc, &t[at])) {
+      at++;
+    }
+    record_encoder_seal(&enc);
+    counts.push_back(enc.count);
+  }
+  double encode_s = std::chrono::duration<double>(Clock::now() - t0).count();
+
+  // Decode into a small batch, as the cursor does, then compare
+  res.ok = true;
+  std::vector<sensor_record_t> out(t.size());
+  size_t got = 0;
+  t0 = Clock::now();
+  for (size_t b = 0; b < counts.size(); b++) {
+    record_decoder_t dec;
+    if (!record_decoder_init_sealed(&dec, encoding,
+                                    fields ? RECORD_FORMAT_2 : RECORD_FORMAT_1,
+                                    &blocks[b * kBlockBytes], kBlockBytes)) {
+      res.ok = false;
+      break;
+    }
+    while (got < out.size() && record_decoder_next(&dec, &out[got]) == 1) {
+      got++;
+    }
+  }
+  double decode_s = std::chrono::duration<double>(Clock::now() - t0).count();
+  if (got != t.size()) {
+    res.ok = false;
+  }
+  for (size_t i = 0; res.ok && i < t.size(); i++) {
+    if (!same_stored(t[i], out[i], fields)) {
+      fprintf(stderr, "record %zu differs after decoding\n", i);
+      res.ok = false;
+    }
+  }
+
+  // The last block is partly empty; rate the full ones
+  size_t full = counts.size() > 1 ? counts.size() - 1 : 1;
+  size_t full_records = 0;
+  for (size_t b = 0; b < full; b++) {
+    full_records += counts[b];
+  }
+  res.blocks = counts.size();
+  res.records_per_block = (double)full_records / full;
+  res.bytes_per_record = (double)(full * LOG_SEGMENT_BYTES) / full_records;
+  res.encode_ns = encode_s * 1e9 / t.size();
+  res.decode_ns = decode_s * 1e9 / t.size();
+  return res;
+}
+
+static bool report(const char *name, const Trace &t) {
+  bool ok = true;
+  for (int format = 1; format <= 2; format++) {
+    uint32_t fields = format == 1 ? 0 : g_fields;
+    Result raw = run(t, RECORD_ENCODING_RAW, fields);
+    Result delta = run(t, RECORD_ENCODING_DELTA, fields);
+    for (const Result *r : {&raw, &delta}) {
+      printf("%-10s format %d %-5s %7.1f rec/block %6.2f B/rec  encode %6.1f ns/rec"
+             "  decode %6.1f ns/rec%s\n",
+             name, format, r == &raw ? "RAW" : "DELTA", r->records_per_block,
+             r->bytes_per_record, r->encode_ns, r->decode_ns, r->ok ? "" : "  FAIL");
+    }
+    printf("%-10s format %d DELTA holds %.2fx the records of RAW, %.2fx the flat 28 B log\n",
+           name, format, delta.records_per_block / raw.records_per_block,
+           kFlatRecordBytes / delta.bytes_per_record);
+    ok = ok && raw.ok && delta.ok;
+  }
+  return ok;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--records N] [--seed N] [--replay FILE.csv] [--fields MASK]\n"
+          "  Encodes and decodes --records synthetic records per trace (indoor,\n"
+          "  commute, sawtooth), and the rows of --replay (CSV as written by\n"
+          "  sensors_export), in RAW and DELTA blocks of record format 1 and 2.\n"
+          "  Format 2 stores the fields in MASK (default 0x%lx).\n",
+          argv0, (unsigned long)kDefaultFields);
+}
+
+int main(int argc, char **argv) {
+  uint32_t records = 200000;
+  uint32_t seed = 1;
+  const char *replay_path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (strcmp(argv[i], "--records") == 0) {
+      records = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--replay") == 0) {
+      replay_path = argv[++i];
+    } else if (strcmp(argv[i], "--fields") == 0) {
+      g_fields = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (records == 0 || g_fields == 0 || (g_fields & ~(uint32_t)LOG_FIELDS_ALL)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  g_rng.seed(seed);
+  bool ok = true;
+  ok = report("indoor", synthetic(records, false)) && ok;
+  ok = report("commute", synthetic(records, true)) && ok;
+  ok = report("sawtooth", sawtooth(records)) && ok;
+  if (replay_path) {
+    Trace t;
+    if (!replay(replay_path, &t)) {
+      fprintf(stderr, "%s: no records\n", replay_path);
+      return 1;
+    }
+    ok = report("replay", t) && ok;
+  }
+  if (!ok) {
+    printf("FAIL\n");
+  }
+  return ok ? 0 : 1;
+}
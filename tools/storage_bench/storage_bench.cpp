@@ -0,0 +1,492 @@
+/**
+ * @file storage_bench.cpp
+ * @brief Host run of log storage against the RAM NAND, printing its stats
+ *
+ * Mounts the log at LOG_STORAGE_MOUNT_POINT (a tmpfs directory by default),
+ * writes records directly and through the writer queue while a reader
+ * competes for the storage lock and a mock display claims SPI2, reads them
+ * back every way the API offers, then prints the latency histograms and
+ * byte counters from log_storage_get_stats() and the bus arbiter's
+ * occupancy. Exits non-zero if the counters disagree with
+ * the work done.
+ *
+ * Then it times sensor_record_aggregate() against a naive loop of
+ * sensor_record_read() over the same time windows, and fails if the two
+ * disagree on any field.
+ *
+ * Last it appends --cursor-records more records and reads all of them back
+ * twice: with a cursor into a 64-record batch, and with one
+ * sensor_record_read_recent() into a buffer for all of them. It prints the
+ * throughput and the peak heap of each, counted by the malloc wrappers
+ * below, and fails if the two disagree on any record.
+ */
+
+#include "log_storage.h"
+
+#include "esp_timer.h"
+#include "host_nand.h"
+#include "spi_bus.h"
+
+#include <atomic>
+#include <dirent.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+static const uint32_t kBaseTimestampMs = 1000000;
+static const uint32_t kCursorBatch = 64;
+
+// Heap in use and its peak, for the cursor comparison: glibc's allocator
+// wrapped, with each block counted at its usable size
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_memalign(size_t align, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static std::atomic<int64_t> g_heap_live{0};
+static std::atomic<int64_t> g_heap_peak{0};
+
+static void *heap_note(void *ptr) {
+  if (ptr) {
+    int64_t live = g_heap_live += (int64_t)malloc_usable_size(ptr);
+    int64_t peak = g_heap_peak.load(std::memory_order_relaxed);
+    while (live > peak && !g_heap_peak.compare_exchange_weak(peak, live)) {
+    }
+  }
+  return ptr;
+}
+
+static void heap_forget(void *ptr) {
+  if (ptr) {
+    g_heap_live -= (int64_t)malloc_usable_size(ptr);
+  }
+}
+
+extern "C" void *malloc(size_t size) { return heap_note(__libc_malloc(size)); }
+extern "C" void *calloc(size_t n, size_t size) { return heap_note(__libc_calloc(n, size)); }
+extern "C" void free(void *ptr) {
+  heap_forget(ptr);
+  __libc_free(ptr);
+}
+extern "C" void *realloc(void *ptr, size_t size) {
+  heap_forget(ptr);
+  return heap_note(__libc_realloc(ptr, size));
+}
+extern "C" void *memalign(size_t align, size_t size) {
+  return heap_note(__libc_memalign(align, size));
+}
+extern "C" void *aligned_alloc(size_t align, size_t size) { return memalign(align, size); }
+extern "C" int posix_memalign(void **out, size_t align, size_t size) {
+  *out = memalign(align, size);
+  return *out ? 0 : ENOMEM;
+}
+
+// Restart the peak from what is in use now; returns that
+static int64_t heap_mark(void) {
+  int64_t live = g_heap_live.load();
+  g_heap_peak.store(live);
+  return live;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--records N] [--reads N] [--cursor-records N] [--image FILE]\n"
+          "  Log files go to " LOG_STORAGE_MOUNT_POINT ", which is emptied first;\n"
+          "  the raw and SPIFFS builds put them on the RAM NAND, or in FILE (kept\n"
+          "  between runs) with --image. --cursor-records (default 1000000, 0 to\n"
+          "  skip) are appended last and read back by cursor and by read_recent.\n",
+          argv0);
+}
+
+// Start from an empty volume so every run times the same work
+static bool mount_dir_reset(void) {
+  mkdir(LOG_STORAGE_MOUNT_POINT, 0755);
+  DIR *dir = opendir(LOG_STORAGE_MOUNT_POINT);
+  if (!dir) {
+    return false;
+  }
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != nullptr) {
+    if (ent->d_name[0] == '.') {
+      continue;
+    }
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", LOG_STORAGE_MOUNT_POINT, ent->d_name);
+    unlink(path);
+  }
+  closedir(dir);
+  return true;
+}
+
+static sensor_record_t make_record(uint32_t i) {
+  sensor_record_t rec = {};
+  rec.timestamp_ms = kBaseTimestampMs + i * 1000;
+  rec.co2_ppm = (uint16_t)(400 + i % 800);
+  rec.temp_c_x100 = (int16_t)(2000 + i % 500);
+  rec.rh_x100 = (int16_t)(4000 + i % 3000);
+  rec.pm25_x10 = (uint16_t)(i % 1200);
+  rec.pressure_pa = 101325 - i % 200;
+  rec.pm4_x10 = (uint16_t)(i % 1300);
+  rec.accel_z_mg = (int16_t)(1000 - i % 3);
+  return rec;
+}
+
+// Reference for sensor_record_aggregate(): every record through
+// sensor_record_read(), every field counted
+static void naive_aggregate(uint32_t t0_ms, uint32_t t1_ms, sensor_aggregate_t *agg) {
+  memset(agg, 0, sizeof(*agg));
+  int32_t total = sensor_record_count();
+  sensor_record_t rec;
+  for (int32_t i = 0; i < total; i++) {
+    if (sensor_record_read((uint32_t)i, &rec) != ESP_OK || rec.timestamp_ms < t0_ms ||
+        rec.timestamp_ms > t1_ms) {
+      continue;
+    }
+    agg->records++;
+#define NAIVE_ADD(id, name, type)                    \
+  {                                                  \
+    sensor_field_stats_t *f = &agg->fields[id];      \
+    int64_t v = rec.name;                            \
+    f->min = (f->count == 0 || v < f->min) ? v : f->min; \
+    f->max = (f->count == 0 || v > f->max) ? v : f->max; \
+    f->count++;                                      \
+    f->sum += v;                                     \
+  }
+    LOG_FIELDS(NAIVE_ADD)
+#undef NAIVE_ADD
+  }
+}
+
+// Time both ways of aggregating [t0_ms, t1_ms]; false if they disagree.
+// Fields the log does not store are left out of the aggregate, so only the
+// stored ones are compared.
+static bool aggregate_compare(const char *name, uint32_t t0_ms, uint32_t t1_ms) {
+  log_storage_stats_t before, mid, after;
+  sensor_aggregate_t agg, naive;
+  log_storage_get_stats(&before);
+  int64_t start = esp_timer_get_time();
+  esp_err_t ret = sensor_record_aggregate(t0_ms, t1_ms, &agg);
+  int64_t agg_us = esp_timer_get_time() - start;
+  log_storage_get_stats(&mid);
+  start = esp_timer_get_time();
+  naive_aggregate(t0_ms, t1_ms, &naive);
+  int64_t naive_us = esp_timer_get_time() - start;
+  log_storage_get_stats(&after);
+
+  const sensor_field_stats_t *co2 = &agg.fields[LOG_FIELD_co2_ppm];
+  const sensor_field_stats_t *pm25 = &agg.fields[LOG_FIELD_pm25_x10];
+  printf("aggregate %-6s %6u records, mean co2 %.1f, max pm2.5 %lld: zone maps "
+         "%8.2f ms %8llu B read (%u segments summarized, %u decoded); "
+         "read loop %8.2f ms %8llu B read\n",
+         name, agg.records, co2->count ? (double)co2->sum / co2->count : 0.0,
+         (long long)pm25->max, agg_us / 1000.0,
+         (unsigned long long)(mid.bytes_read - before.bytes_read),
+         agg.segments_summarized, agg.segments_decoded, naive_us / 1000.0,
+         (unsigned long long)(after.bytes_read - mid.bytes_read));
+
+  bool ok = (ret == ESP_OK && agg.records == naive.records);
+  for (int id = 0; id < LOG_FIELD_COUNT; id++) {
+    const sensor_field_stats_t *a = &agg.fields[id];
+    const sensor_field_stats_t *n = &naive.fields[id];
+    if (a->count != 0 &&
+        (a->count != n->count || a->min != n->min || a->max != n->max || a->sum != n->sum)) {
+      fprintf(stderr, "aggregate %s: field %d differs from the read loop\n", name, id);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+static void print_latency(const char *name, const log_storage_latency_t *h) {
+  printf("%-9s n=%-8u fail=%-4u mean=%-7llu p50=%-7u p90=%-7u p99=%-7u max=%u us\n", name,
+         h->count, h->failures,
+         h->count ? (unsigned long long)(h->total_us / h->count) : 0ULL,
+         log_storage_latency_percentile(h, 50), log_storage_latency_percentile(h, 90),
+         log_storage_latency_percentile(h, 99), h->max_us);
+  printf("          ");
+  for (uint32_t i = 0; i < LOG_STORAGE_HIST_BUCKETS; i++) {
+    if (h->buckets[i]) {
+      printf(" <%uus:%u", 1u << i, h->buckets[i]);
+    }
+  }
+  printf("\n");
+}
+
+static bool count_query(const sensor_record_t *record, void *ctx) {
+  (void)record;
+  (*(uint32_t *)ctx)++;
+  return true;
+}
+
+// Append count records, then read them back with a cursor and with
+// sensor_record_read_recent(); false if they disagree
+static bool cursor_compare(uint32_t first, uint32_t count) {
+  for (uint32_t i = first; i < first + count; i++) {
+    sensor_record_t rec = make_record(i);
+    if (sensor_record_write(&rec) != ESP_OK) {
+      fprintf(stderr, "write %u failed\n", i);
+      return false;
+    }
+  }
+  if (log_storage_flush() != ESP_OK) {
+    fprintf(stderr, "flush failed\n");
+    return false;
+  }
+  int32_t total = sensor_record_count();
+  if (total < (int32_t)count) {
+    fprintf(stderr, "log holds %d records, wanted %u\n", total, count);
+    return false;
+  }
+
+  // Cursor: the caller's batch is its only buffer
+  sensor_record_t batch[kCursorBatch];
+  uint32_t walked = 0;
+  int64_t base = heap_mark();
+  int64_t start = esp_timer_get_time();
+  sensor_record_cursor_t *cursor = nullptr;
+  if (sensor_record_cursor_open((uint32_t)total - count, &cursor) != ESP_OK) {
+    fprintf(stderr, "cursor_open failed\n");
+    return false;
+  }
+  int32_t got;
+  while ((got = sensor_record_cursor_next(cursor, batch, kCursorBatch)) > 0) {
+    walked += (uint32_t)got;
+  }
+  sensor_record_cursor_close(cursor);
+  int64_t cursor_us = esp_timer_get_time() - start;
+  int64_t cursor_heap = g_heap_peak.load() - base;
+
+  // read_recent: one buffer for every record
+  base = heap_mark();
+  start = esp_timer_get_time();
+  sensor_record_t *all = (sensor_record_t *)malloc((size_t)count * sizeof(sensor_record_t));
+  int32_t read = all ? sensor_record_read_recent(count, all) : -1;
+  int64_t recent_us = esp_timer_get_time() - start;
+  int64_t recent_heap = g_heap_peak.load() - base;
+
+  // Walk again to compare record by record, outside the timing
+  bool ok = got == 0 && walked == count && read == (int32_t)count;
+  if (ok && sensor_record_cursor_open((uint32_t)total - count, &cursor) == ESP_OK) {
+    uint32_t at = 0;
+    while (ok && (got = sensor_record_cursor_next(cursor, batch, kCursorBatch)) > 0) {
+      ok = memcmp(batch, &all[at], (size_t)got * sizeof(sensor_record_t)) == 0;
+      at += (uint32_t)got;
+    }
+    sensor_record_cursor_close(cursor);
+  }
+  free(all);
+
+  printf("cursor      %8u records %8.1f ms %9.0f rec/s  peak heap %9lld B + %zu B batch\n",
+         walked, cursor_us / 1000.0, walked * 1e6 / (double)(cursor_us ? cursor_us : 1),
+         (long long)cursor_heap, sizeof(batch));
+  printf("read_recent %8d records %8.1f ms %9.0f rec/s  peak heap %9lld B\n", read,
+         recent_us / 1000.0, read * 1e6 / (double)(recent_us ? recent_us : 1),
+         (long long)recent_heap);
+  if (!ok) {
+    fprintf(stderr, "cursor and read_recent disagree\n");
+  }
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  uint32_t records = 20000;
+  uint32_t reads = 2000;
+  uint32_t cursor_records = 1000000;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--records") == 0 && i + 1 < argc) {
+      records = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--reads") == 0 && i + 1 < argc) {
+      reads = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--cursor-records") == 0 && i + 1 < argc) {
+      cursor_records = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+      host_nand_set_image(argv[++i]);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!mount_dir_reset()) {
+    fprintf(stderr, "cannot use %s\n", LOG_STORAGE_MOUNT_POINT);
+    return 1;
+  }
+
+  log_storage_init();
+  int64_t wait_start = esp_timer_get_time();
+  while (!log_storage_is_ready() || sensor_record_count() < 0) {
+    if (esp_timer_get_time() - wait_start > 10 * 1000000LL) {
+      fprintf(stderr, "storage did not come up\n");
+      return 1;
+    }
+    usleep(1000);
+  }
+  // The count turns valid before sensor_record_init() has loaded or created
+  // the ring (which takes a while on SPIFFS); a locked read waits for it.
+  // Without LOG_STORAGE_FAST_MOUNT, sensor_record_test() then writes a few
+  // records on the mount task: wait until the count has been still for 50 ms.
+  sensor_record_t probe;
+  sensor_record_read_recent(1, &probe);
+  int32_t boot_records = sensor_record_count();
+  for (int still = 0; still < 50;) {
+    usleep(1000);
+    int32_t now = sensor_record_count();
+    still = (now == boot_records) ? still + 1 : 0;
+    boot_records = now;
+  }
+
+  // Half the records straight through sensor_record_write()
+  uint32_t direct = records / 2;
+  int64_t start = esp_timer_get_time();
+  for (uint32_t i = 0; i < direct; i++) {
+    sensor_record_t rec = make_record(i);
+    if (sensor_record_write(&rec) != ESP_OK) {
+      fprintf(stderr, "write %u failed\n", i);
+      return 1;
+    }
+  }
+  int64_t direct_us = esp_timer_get_time() - start;
+
+  // The rest through the writer queue, with a reader contending for the
+  // lock and 20 ms display refreshes every 100 ms for the bus. Rejected
+  // records are retried (each rejection still counts in queue_dropped).
+  std::atomic<bool> producing{true};
+  std::thread reader([&producing] {
+    sensor_record_t recent[16];
+    while (producing.load()) {
+      sensor_record_read_recent(16, recent);
+      usleep(200);
+    }
+  });
+  std::thread display([&producing] {
+    while (producing.load()) {
+      spi_bus_acquire(SPI_BUS_DEV_EPD, SPI_BUS_PRIO_INTERACTIVE, portMAX_DELAY);
+      usleep(20000);
+      spi_bus_release(SPI_BUS_DEV_EPD);
+      usleep(80000);
+    }
+  });
+  start = esp_timer_get_time();
+  for (uint32_t i = direct; i < records; i++) {
+    sensor_record_t rec = make_record(i);
+    while (sensor_record_enqueue(&rec) != ESP_OK) {
+      usleep(100);
+    }
+  }
+  esp_err_t drained = log_storage_drain(5000);
+  int64_t queued_us = esp_timer_get_time() - start;
+  producing.store(false);
+  reader.join();
+  display.join();
+  if (drained != ESP_OK) {
+    fprintf(stderr, "drain failed: %s\n", esp_err_to_name(drained));
+    return 1;
+  }
+
+  // Read back: random single records, a cursor over everything, a query
+  int32_t total = sensor_record_count();
+  uint32_t seed = 12345;
+  sensor_record_t rec;
+  for (uint32_t i = 0; i < reads; i++) {
+    seed = seed * 1103515245u + 12345u;
+    sensor_record_read((seed >> 8) % (uint32_t)total, &rec);
+  }
+
+  sensor_record_cursor_t *cursor = nullptr;
+  uint32_t scanned = 0;
+  start = esp_timer_get_time();
+  if (sensor_record_cursor_open(0, &cursor) == ESP_OK) {
+    sensor_record_t batch[64];
+    int32_t got;
+    while ((got = sensor_record_cursor_next(cursor, batch, 64)) > 0) {
+      scanned += (uint32_t)got;
+    }
+    sensor_record_cursor_close(cursor);
+  }
+  int64_t scan_us = esp_timer_get_time() - start;
+
+  uint32_t matched = 0;
+  uint32_t t0 = kBaseTimestampMs + records / 4 * 1000;
+  sensor_record_query_range(t0, t0 + 3600 * 1000, count_query, &matched);
+
+  log_storage_stats_t stats;
+  if (log_storage_get_stats(&stats) != ESP_OK) {
+    fprintf(stderr, "log_storage_get_stats failed\n");
+    return 1;
+  }
+
+  printf("\nrecords %d (boot %d), direct %.0f rec/s, queued %.0f rec/s, scan %.0f rec/s\n",
+         total, boot_records, direct * 1e6 / (double)(direct_us ? direct_us : 1),
+         (records - direct) * 1e6 / (double)(queued_us ? queued_us : 1),
+         scanned * 1e6 / (double)(scan_us ? scan_us : 1));
+  printf("query matched %u, cursor scanned %u\n", matched, scanned);
+  printf("fatfs read %llu B, written %llu B, nand programmed %llu B, flushes %u\n",
+         (unsigned long long)stats.bytes_read, (unsigned long long)stats.bytes_written,
+         (unsigned long long)stats.flash_bytes, stats.flush_count);
+  printf("queue enqueued %u, dropped %u, high water %u\n\n", stats.queue_enqueued,
+         stats.queue_dropped, stats.queue_high_water);
+  print_latency("mount", &stats.mount);
+  print_latency("ready", &stats.ready);
+  print_latency("catch_up", &stats.catch_up);
+  print_latency("write", &stats.write);
+  print_latency("read", &stats.read);
+  print_latency("lock_wait", &stats.lock_wait);
+  print_latency("fs_write", &stats.fs_write);
+  print_latency("fs_read", &stats.fs_read);
+
+  spi_bus_stats_t bus;
+  if (spi_bus_get_stats(&bus) == ESP_OK) {
+    printf("\n");
+    for (int dev = 0; dev < SPI_BUS_DEV_COUNT; dev++) {
+      const spi_bus_dev_stats_t *d = &bus.dev[dev];
+      printf("bus %-5s occupancy %u/1000, %u claims (%u waited, %u timed out), "
+             "%u yields, max hold %u us, max wait %u us\n",
+             spi_bus_profile((spi_bus_dev_t)dev)->name,
+             spi_bus_occupancy_permille(&bus, (spi_bus_dev_t)dev), d->acquisitions,
+             d->contended, d->timeouts, d->yields, d->max_hold_us, d->max_wait_us);
+    }
+  }
+
+  // Aggregates over an hour, and over all but the first and last eighth
+  printf("\n");
+  int bad = 0;
+  uint32_t span_ms = records * 1000;
+  if (!aggregate_compare("1 h", t0, t0 + 3600 * 1000) ||
+      !aggregate_compare("3/4", kBaseTimestampMs + span_ms / 8,
+                         kBaseTimestampMs + span_ms - span_ms / 8)) {
+    bad++;
+  }
+
+  if (total != boot_records + (int32_t)records || scanned != (uint32_t)total) {
+    fprintf(stderr, "record count mismatch\n");
+    bad++;
+  }
+  if (stats.write.count < records || stats.write.failures != 0) {
+    fprintf(stderr, "write histogram does not cover the writes\n");
+    bad++;
+  }
+  if (stats.read.count < reads || stats.lock_wait.count < stats.write.count + stats.read.count) {
+    fprintf(stderr, "read or lock histograms do not cover the reads\n");
+    bad++;
+  }
+  if (stats.mount.count != 1 || stats.ready.count != 1 || stats.fs_write.failures != 0 || stats.bytes_written == 0 ||
+      stats.bytes_read == 0) {
+    fprintf(stderr, "mount or FATFS counters missing\n");
+    bad++;
+  }
+
+  if (cursor_records) {
+    printf("\n");
+    if (!cursor_compare(records, cursor_records)) {
+      bad++;
+    }
+  }
+
+  log_storage_deinit();
+  return bad ? 1 : 0;
+}
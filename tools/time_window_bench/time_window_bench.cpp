@@ -0,0 +1,351 @@
+/**
+ * @file time_window_bench.cpp
+ * @brief main/time_window.h against brute force, and its cost per read
+ *
+ * Runs --ops random pushes, time evictions and clears on windows of several
+ * element types and capacities, and after each compares size, samples,
+ * sum, mean, min, max and (where enabled) variance with a scan of a plain
+ * list of the samples held. It fails if any differ.
+ *
+ * Then it times the device's two uses, --reads reads each: the 5 s
+ * CO2/T/RH average that sensor.cpp read from three parallel ring arrays
+ * before TimeWindow, and the chart history min/max that ui_display.cpp
+ * rescanned (RingBuffer<30>), each as before and with TimeWindow. Samples
+ * arrive once a second and the window is read every 100 ms, as on the
+ * device. A 5 min average over 320 samples shows how the scan grows with
+ * the window and TimeWindow does not.
+ */
+
+#include "time_window.h"
+
+#include <chrono>
+#include <deque>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static std::mt19937 g_rng(1);
+
+static uint32_t rnd(uint32_t n) { return (uint32_t)(g_rng() % n); }
+
+struct Sample {
+  int64_t ts;
+  double v;
+};
+
+static bool close_to(double a, double b) {
+  return fabs(a - b) <= 1e-6 * (1.0 + fabs(a) + fabs(b));
+}
+
+// Compare w with the samples held in model; name the first difference
+template <typename T, size_t N, bool V>
+static bool check(const TimeWindow<T, N, V> &w, const std::deque<Sample> &model,
+                  const char *name, uint32_t op) {
+  const char *bad = nullptr;
+  double sum = 0.0;
+  double mn = 0.0;
+  double mx = 0.0;
+  for (size_t i = 0; i < model.size(); i++) {
+    double v = model[i].v;
+    sum += v;
+    mn = (i == 0 || v < mn) ? v : mn;
+    mx = (i == 0 || v > mx) ? v : mx;
+    if ((double)w.at_oldest(i) != v || w.time_oldest(i) != model[i].ts) {
+      bad = "sample";
+    }
+  }
+  if (w.size() != model.size() || w.empty() != model.empty()) {
+    bad = "size";
+  } else if (!close_to((double)w.sum(), sum)) {
+    bad = "sum";
+  } else if (!close_to(w.mean(), model.empty() ? 0.0 : sum / model.size())) {
+    bad = "mean";
+  } else if ((double)w.min() != mn || (double)w.max() != mx) {
+    bad = "min/max";
+  }
+  if constexpr (V) {
+    double var = 0.0;
+    if (model.size() >= 2) {
+      double mean = sum / model.size();
+      for (const Sample &s : model) {
+        var += (s.v - mean) * (s.v - mean);
+      }
+      var /= model.size();
+    }
+    // Welford's running m2 carries the rounding of every sample that passed
+    // through; compare against the spread of the values, not the variance
+    if (!bad && fabs(w.variance() - var) > 1e-6 * (1.0 + mx * mx + mn * mn)) {
+      bad = "variance";
+    }
+  }
+  if (bad) {
+    printf("FAIL %s: %s differs after op %u (%zu samples)\n", name, bad, op, model.size());
+    return false;
+  }
+  return true;
+}
+
+template <typename T, size_t N, bool V>
+static bool verify(const char *name, uint32_t ops, T lo, T hi) {
+  static TimeWindow<T, N, V> w;  // Zeroed, as in the device's state structs
+  std::deque<Sample> model;
+  int64_t now = 0;
+  for (uint32_t op = 0; op < ops; op++) {
+    uint32_t r = rnd(100);
+    if (r < 70) {
+      // Equal timestamps and runs of equal values both happen on the device
+      now += rnd(3) * 500;
+      T v = rnd(4) == 0 && !model.empty()
+                ? (T)model.back().v
+                : (T)(lo + (double)(hi - lo) * rnd(10001) / 10000.0);
+      w.push(now, v);
+      model.push_back({now, (double)v});
+      if (model.size() > N) {
+        model.pop_front();
+      }
+    } else if (r < 99) {
+      int64_t start = now - rnd(6000);
+      w.evict_before(start);
+      while (!model.empty() && model.front().ts < start) {
+        model.pop_front();
+      }
+    } else {
+      w.clear();
+      model.clear();
+    }
+    if (!check(w, model, name, op)) {
+      return false;
+    }
+  }
+  printf("%-28s %u ops ok\n", name, ops);
+  return true;
+}
+
+// The averaging sensor.cpp did before TimeWindow
+template <size_t N>
+struct Co2RingScan {
+  int ppm[N];
+  float temp[N];
+  float rh[N];
+  int64_t ts[N];
+  int head;
+  int size;
+
+  void push(int p, float t, float h, int64_t now) {
+    ppm[head] = p;
+    temp[head] = t;
+    rh[head] = h;
+    ts[head] = now;
+    head = (head + 1) % (int)N;
+    if (size < (int)N) size++;
+  }
+
+  bool avg(int64_t now, int64_t span, int *p, float *t, float *h) const {
+    int count = 0;
+    long sum_ppm = 0;
+    double sum_t = 0.0;
+    double sum_rh = 0.0;
+    for (int i = 0; i < size; ++i) {
+      int idx = (head - 1 - i + (int)N) % (int)N;
+      if (ts[idx] >= now - span) {
+        sum_ppm += ppm[idx];
+        sum_t += temp[idx];
+        sum_rh += rh[idx];
+        count++;
+      } else {
+        break;
+      }
+    }
+    if (count == 0) return false;
+    *p = (int)(sum_ppm / count);
+    *t = (float)(sum_t / count);
+    *h = (float)(sum_rh / count);
+    return true;
+  }
+};
+
+template <size_t N>
+struct Co2Windows {
+  TimeWindow<int, N> ppm;
+  TimeWindow<float, N> temp;
+  TimeWindow<float, N> rh;
+
+  void push(int p, float t, float h, int64_t now) {
+    ppm.push(now, p);
+    temp.push(now, t);
+    rh.push(now, h);
+  }
+
+  bool avg(int64_t now, int64_t span, int *p, float *t, float *h) {
+    ppm.evict_before(now - span);
+    temp.evict_before(now - span);
+    rh.evict_before(now - span);
+    if (ppm.empty()) return false;
+    *p = (int)ppm.mean();
+    *t = (float)temp.mean();
+    *h = (float)rh.mean();
+    return true;
+  }
+};
+
+// The chart history ui_display.cpp rescanned before TimeWindow
+template <size_t N>
+struct RingScan {
+  float values[N];
+  size_t count;
+  size_t head;
+
+  void push(float v) {
+    values[head] = v;
+    head = (head + 1) % N;
+    if (count < N) count += 1;
+  }
+
+  void min_max(float &mn, float &mx) const {
+    const size_t start = (head + N - count) % N;
+    mn = mx = values[start];
+    for (size_t i = 1; i < count; i++) {
+      float v = values[(start + i) % N];
+      if (v < mn) mn = v;
+      if (v > mx) mx = v;
+    }
+  }
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double ns_since(Clock::time_point t0, uint32_t n) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / n;
+}
+
+// Sample once a second, read every 100 ms; returns ns per read and the
+// checksum of what was read so the two sides can be compared
+template <typename W>
+static double time_avg(W *w, uint32_t reads, int64_t span, double *check) {
+  memset(static_cast<void *>(w), 0, sizeof(*w));
+  std::mt19937 rng(7);
+  double acc = 0.0;
+  Clock::time_point t0 = Clock::now();
+  for (uint32_t i = 0; i < reads; i++) {
+    int64_t now = (int64_t)i * 100;
+    if (i % 10 == 0) {
+      w->push(400 + (int)(rng() % 600), 20.0f + (rng() % 100) / 10.0f,
+              40.0f + (rng() % 300) / 10.0f, now);
+    }
+    int p = 0;
+    float t = 0.0f;
+    float h = 0.0f;
+    if (w->avg(now, span, &p, &t, &h)) {
+      acc += p + t + h;
+    }
+  }
+  double ns = ns_since(t0, reads);
+  *check = acc;
+  return ns;
+}
+
+template <typename F>
+static double time_chart(F read, uint32_t reads, double *check) {
+  std::mt19937 rng(7);
+  double acc = 0.0;
+  Clock::time_point t0 = Clock::now();
+  for (uint32_t i = 0; i < reads; i++) {
+    acc += read(i, 400.0f + (float)(rng() % 600));
+  }
+  double ns = ns_since(t0, reads);
+  *check = acc;
+  return ns;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--ops N] [--reads N]\n"
+          "  Checks TimeWindow against brute force over --ops random operations\n"
+          "  per window type, then times --reads reads of the 5 s average and\n"
+          "  chart min/max as before and with TimeWindow.\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  uint32_t ops = 200000;
+  uint32_t reads = 2000000;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (strcmp(argv[i], "--ops") == 0) {
+      ops = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (strcmp(argv[i], "--reads") == 0) {
+      reads = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (reads == 0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  bool ok = true;
+  ok = verify<int, 12, false>("int, 12 (CO2)", ops, 400, 5000) && ok;
+  ok = verify<float, 12, true>("float, 12, variance (T/RH)", ops, -20.0f, 60.0f) && ok;
+  ok = verify<float, 30, false>("float, 30 (chart)", ops, 0.0f, 1000.0f) && ok;
+  ok = verify<int32_t, 300, true>("int32, 300, variance", ops, 1, 500) && ok;
+  ok = verify<uint16_t, 255, false>("uint16, 255", ops, 0, 65535) && ok;
+  ok = verify<int16_t, 256, false>("int16, 256", ops, -32768, 32767) && ok;
+  ok = verify<double, 1, true>("double, 1", ops, -1.0, 1.0) && ok;
+  printf("\n");
+
+  static Co2RingScan<12> scan;
+  static Co2Windows<12> windows;
+  double scan_check = 0.0;
+  double window_check = 0.0;
+  double scan_ns = time_avg(&scan, reads, 5000, &scan_check);
+  double window_ns = time_avg(&windows, reads, 5000, &window_check);
+  printf("5 s CO2/T/RH average, 12 samples: scan %6.1f ns, TimeWindow %6.1f ns per read\n",
+         scan_ns, window_ns);
+  ok = close_to(scan_check, window_check) && ok;
+
+  static Co2RingScan<320> long_scan;
+  static Co2Windows<320> long_windows;
+  scan_ns = time_avg(&long_scan, reads, 300000, &scan_check);
+  window_ns = time_avg(&long_windows, reads, 300000, &window_check);
+  printf("5 min average, 320 samples:        scan %6.1f ns, TimeWindow %6.1f ns per read\n",
+         scan_ns, window_ns);
+  ok = close_to(scan_check, window_check) && ok;
+
+  static RingScan<30> ring;
+  static TimeWindow<float, 30> hist;
+  double ring_check = 0.0;
+  double hist_check = 0.0;
+  double ring_ns = time_chart(
+      [](uint32_t i, float v) {
+        if (i % 10 == 0) ring.push(v);
+        float mn = 0.0f;
+        float mx = 0.0f;
+        ring.min_max(mn, mx);
+        return (double)(mx - mn);
+      },
+      reads, &ring_check);
+  double hist_ns = time_chart(
+      [](uint32_t i, float v) {
+        if (i % 10 == 0) hist.push(i * 100, v);
+        return (double)(hist.max() - hist.min());
+      },
+      reads, &hist_check);
+  printf("Chart min/max, 30 samples:         scan %6.1f ns, TimeWindow %6.1f ns per read\n",
+         ring_ns, hist_ns);
+  ok = close_to(ring_check, hist_check) && ok;
+
+  printf("\nsizeof: TimeWindow<int, 12> %zu, <float, 30> %zu, <int32_t, 300, true> %zu bytes\n",
+         sizeof(TimeWindow<int, 12>), sizeof(TimeWindow<float, 30>),
+         sizeof(TimeWindow<int32_t, 300, true>));
+  if (!ok) {
+    printf("FAIL\n");
+  }
+  return ok ? 0 : 1;
+}